@@ -753,6 +753,577 @@ uint32_t br_rsa_i31_private_alg1(unsigned char *x,
 
 uint32_t br_rsa_i31_private_protected(unsigned char*x,
 		const br_rsa_private_key *sk);
+
+/*
+ * Variants of the protected engines that draw their randomness from a
+ * caller-provided PRNG instead of seeding a fresh HMAC_DRBG from the
+ * operating system on each call. The PRNG must already be seeded; the
+ * caller is responsible for reseeding it. This keeps the getrandom()
+ * system call out of the per-operation path (and allows use in
+ * processes where that call is not permitted).
+ */
+uint32_t br_rsa_i31_private_msg_blind_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+uint32_t br_rsa_i31_private_mod_rand_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+uint32_t br_rsa_i31_private_mod_prerand_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+uint32_t br_rsa_i31_private_FI_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+uint32_t br_rsa_i31_private_protected_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+
+/**
+ * \brief Protected RSA private key engine "i15".
+ *
+ * Same countermeasures as `br_rsa_i31_private_protected()`, with all
+ * arithmetic (including key masking) performed on 15-bit words. This
+ * is meant for small 32-bit cores where 32x32->64 multiplications are
+ * not constant-time (see `BR_LOMUL`).
+ *
+ * \param x    operand to exponentiate.
+ * \param sk   RSA private key.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i15_private_protected(unsigned char *x,
+	const br_rsa_private_key *sk);
+
+/**
+ * \brief Variant of `br_rsa_i15_private_protected()` with a
+ * caller-provided (already seeded) PRNG.
+ *
+ * \param rng  PRNG for all masks.
+ * \param x    operand to exponentiate.
+ * \param sk   RSA private key.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i15_private_protected_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+
+/**
+ * \brief Protected RSA private key engine "i62".
+ *
+ * Same countermeasures as `br_rsa_i31_private_protected()` (message and
+ * exponent blinding, pre-randomized key, per-window modulus
+ * randomization and fault check), but the modular exponentiations use
+ * 62-bit words with 64x64->128 multiplications. This function is
+ * defined only on architectures that offer such an opcode; use
+ * `br_rsa_i62_private_protected_get()` to dynamically obtain a pointer
+ * to that function.
+ *
+ * \param x    operand to exponentiate.
+ * \param sk   RSA private key.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i62_private_protected(unsigned char *x,
+	const br_rsa_private_key *sk);
+
+/**
+ * \brief Variant of `br_rsa_i62_private_protected()` with a
+ * caller-provided (already seeded) PRNG.
+ *
+ * \param rng  PRNG for all masks.
+ * \param x    operand to exponentiate.
+ * \param sk   RSA private key.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i62_private_protected_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+
+/**
+ * \brief Get the protected RSA "i62" implementation (private key
+ * operations), if available.
+ *
+ * \return  the implementation, or 0.
+ */
+br_rsa_private br_rsa_i62_private_protected_get(void);
+
+/**
+ * \brief Protected RSA private key engine "i52".
+ *
+ * Same countermeasures as `br_rsa_i31_private_protected()`, but the
+ * modular exponentiations use 52-bit limbs with the AVX-512 IFMA
+ * opcodes, eight limbs per opcode. This function MUST NOT be called
+ * on a CPU without AVX-512 IFMA support; use
+ * `br_rsa_i52_private_protected_get()` to dynamically obtain a pointer
+ * to that function, if available on the current CPU.
+ *
+ * \param x    operand to exponentiate.
+ * \param sk   RSA private key.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i52_private_protected(unsigned char *x,
+	const br_rsa_private_key *sk);
+
+/**
+ * \brief Variant of `br_rsa_i52_private_protected()` with a
+ * caller-provided (already seeded) PRNG.
+ *
+ * \param rng  PRNG for all masks.
+ * \param x    operand to exponentiate.
+ * \param sk   RSA private key.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i52_private_protected_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+
+/**
+ * \brief Get the protected RSA "i52" implementation (private key
+ * operations), if available (compiler and CPU support for AVX-512
+ * IFMA).
+ *
+ * \return  the implementation, or 0.
+ */
+br_rsa_private br_rsa_i52_private_protected_get(void);
+
+/**
+ * \brief Type for a multi-buffer RSA private key engine.
+ *
+ * The `count` operands `xs[i]` are processed with the same private
+ * key, in place; each has the length of the modulus. If `status` is
+ * not `NULL`, then `status[i]` receives 1 or 0 for each item, with
+ * the same meaning as the return value of a `br_rsa_private` engine.
+ * A failed item does not stop the other ones.
+ *
+ * Returned value is 1 if all items succeeded, 0 otherwise.
+ *
+ * \param xs       operands to exponentiate.
+ * \param count    number of operands.
+ * \param sk       RSA private key.
+ * \param status   per-item status (or `NULL`).
+ * \return  1 if all items succeeded, 0 otherwise.
+ */
+typedef uint32_t (*br_rsa_private_mb)(unsigned char *const *xs,
+	size_t count, const br_rsa_private_key *sk, uint32_t *status);
+
+/**
+ * \brief Multi-buffer RSA private key engine "i52".
+ *
+ * The operands are processed by groups of four; the eight modular
+ * exponentiations of a group (modulo p and modulo q for each operand)
+ * run in parallel, one per 64-bit lane of the AVX-512 registers, with
+ * 52-bit limbs and the AVX-512 IFMA opcodes. The CRT recombination is
+ * then done with the "i31" code. Like `br_rsa_i31_private()`, this
+ * engine has no blinding countermeasure. This function MUST NOT be
+ * called on a CPU without AVX-512 IFMA support; use
+ * `br_rsa_i52_private_mb_get()` to dynamically obtain a pointer to
+ * that function, if available on the current CPU.
+ *
+ * \see br_rsa_private_mb
+ *
+ * \param xs       operands to exponentiate.
+ * \param count    number of operands.
+ * \param sk       RSA private key.
+ * \param status   per-item status (or `NULL`).
+ * \return  1 if all items succeeded, 0 otherwise.
+ */
+uint32_t br_rsa_i52_private_mb(unsigned char *const *xs, size_t count,
+	const br_rsa_private_key *sk, uint32_t *status);
+
+/**
+ * \brief Get the multi-buffer RSA "i52" implementation (private key
+ * operations), if available (compiler and CPU support for AVX-512
+ * IFMA).
+ *
+ * \return  the implementation, or 0.
+ */
+br_rsa_private_mb br_rsa_i52_private_mb_get(void);
+
+/**
+ * \brief Maximum modulus size (in bits) for a protected key context.
+ */
+#define BR_RSA_PROTECTED_MAX_SIZE    4096
+
+/**
+ * \brief Bit length of the random masks applied to protected keys.
+ */
+#define BR_RSA_PROTECTED_MASK_SIZE   62
+
+/**
+ * \brief Default number of uses of a cached message blinding pair
+ * before it is regenerated (see `br_rsa_i31_protected_set_blind_period()`).
+ */
+#define BR_RSA_PROTECTED_BLIND_PERIOD   32
+
+/**
+ * \brief Word length of a factor in `br_rsa_i31_protected_key`.
+ *
+ * This covers a factor of a `BR_RSA_PROTECTED_MAX_SIZE`-bit modulus
+ * multiplied by a `BR_RSA_PROTECTED_MASK_SIZE`-bit mask.
+ */
+#define BR_RSA_I31_PROTECTED_FWLEN   (2 + ((((BR_RSA_PROTECTED_MAX_SIZE \
+	+ 64) >> 1) + BR_RSA_PROTECTED_MASK_SIZE + 30) / 31))
+
+/**
+ * \brief Private key in 31-bit word form ("i31").
+ *
+ * This structure contains the modulus, the two factors and the CRT
+ * coefficient of a RSA private key, already decoded into the internal
+ * "i31" representation, along with the Montgomery constants derived
+ * from them: -1/m mod 2^31 and R^2 mod m for the modulus and both
+ * factors. The CRT coefficient is reduced modulo p and kept in
+ * Montgomery representation. Engines that take this structure skip
+ * the decoding and Montgomery setup that they would otherwise perform
+ * on each call.
+ *
+ * The factors may be masked (multiplied by a random value), as is the
+ * case for the key held in a `br_rsa_i31_protected_context`.
+ */
+typedef struct {
+#ifndef BR_DOXYGEN_IGNORE
+	uint32_t n[2 + ((BR_RSA_PROTECTED_MAX_SIZE + 30) / 31)];
+	uint32_t n_r2[2 + ((BR_RSA_PROTECTED_MAX_SIZE + 30) / 31)];
+	uint32_t p[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t p_r2[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t q[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t q_r2[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t iq[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t n0i, p0i, q0i;
+#endif
+} br_rsa_i31_protected_key;
+
+/**
+ * \brief Convert a RSA private key to the "i31" word form.
+ *
+ * The source key must include the modulus. This is a one-time
+ * conversion; the source structure is not referenced afterwards.
+ *
+ * \param wk   destination key.
+ * \param sk   source RSA private key.
+ * \return  1 on success, 0 on error (unsupported size, even factor).
+ */
+uint32_t br_rsa_i31_protected_key_init(br_rsa_i31_protected_key *wk,
+	const br_rsa_private_key *sk);
+
+/**
+ * \brief Operation statistics of a protected RSA key context.
+ *
+ * The counters are plain words in the context, updated by the thread
+ * that uses the context, without any lock; they wrap around modulo
+ * 2^64.
+ */
+typedef struct {
+	/** \brief Number of private key operations. */
+	uint64_t operations;
+	/** \brief Number of operations whose fault check failed. */
+	uint64_t faults;
+	/** \brief Number of inputs rejected as out of range. */
+	uint64_t range_errors;
+	/** \brief Number of mask refreshes (automatic or explicit). */
+	uint64_t refreshes;
+} br_rsa_i31_protected_stats;
+
+/**
+ * \brief Type for a fault notification callback.
+ *
+ * The callback receives the opaque pointer registered with it and the
+ * current statistics of the context (fault included). It is invoked
+ * after the faulty operation has completed (with a zero output), and
+ * it may call `br_rsa_i31_protected_refresh()` on the context.
+ *
+ * \param cb_ctx   opaque pointer registered with the callback.
+ * \param stats    current context statistics.
+ */
+typedef void (*br_rsa_i31_protected_fault_callback)(void *cb_ctx,
+	const br_rsa_i31_protected_stats *stats);
+
+/**
+ * \brief Protected RSA key context ("i31").
+ *
+ * This structure holds a long-lived pre-randomized copy of a RSA
+ * private key: the factors, the reduced exponents and the CRT
+ * coefficient are kept masked with the random values `r1` and `r2`,
+ * along with the blinded phi(p) and phi(q). The masking (`init_key()`)
+ * is done once, when the context is initialised; between operations
+ * the masks are only refreshed, which is much cheaper than building a
+ * fresh masked key on every call.
+ *
+ * The context also embeds its own HMAC_DRBG instance, seeded once at
+ * initialisation time, and a cached message blinding pair
+ * (r^e, 1/r) mod n, which is updated by squaring after each use.
+ * The masked key is also kept in word form (`br_rsa_i31_protected_key`),
+ * converted once per mask refresh. Operations, detected faults,
+ * rejected inputs and mask refreshes are counted in the context (see
+ * `br_rsa_i31_protected_get_stats()`).
+ *
+ * A context is not thread-safe; use one context per thread.
+ */
+typedef struct {
+#ifndef BR_DOXYGEN_IGNORE
+	br_rsa_private_key sk;
+	br_hmac_drbg_context rng;
+	size_t fwlen;
+	uint32_t refresh_period;
+	uint32_t op_count;
+	uint32_t r1[(BR_RSA_PROTECTED_MASK_SIZE + 63) >> 5];
+	uint32_t r2[(BR_RSA_PROTECTED_MASK_SIZE + 63) >> 5];
+	uint32_t phi_p[(BR_RSA_PROTECTED_MAX_SIZE
+		+ BR_RSA_PROTECTED_MASK_SIZE + 63) >> 5];
+	uint32_t phi_q[(BR_RSA_PROTECTED_MAX_SIZE
+		+ BR_RSA_PROTECTED_MASK_SIZE + 63) >> 5];
+	unsigned char n[(BR_RSA_PROTECTED_MAX_SIZE + 15) >> 3];
+	unsigned char p[(BR_RSA_PROTECTED_MAX_SIZE
+		+ BR_RSA_PROTECTED_MASK_SIZE + 15) >> 3];
+	unsigned char q[(BR_RSA_PROTECTED_MAX_SIZE
+		+ BR_RSA_PROTECTED_MASK_SIZE + 15) >> 3];
+	unsigned char dp[(BR_RSA_PROTECTED_MAX_SIZE + 15) >> 3];
+	unsigned char dq[(BR_RSA_PROTECTED_MAX_SIZE + 15) >> 3];
+	unsigned char iq[(BR_RSA_PROTECTED_MAX_SIZE + 15) >> 3];
+	unsigned char e[(BR_RSA_PROTECTED_MAX_SIZE + 15) >> 3];
+	uint32_t blind_period;
+	uint32_t blind_count;
+	uint32_t blind_re[2 + ((BR_RSA_PROTECTED_MAX_SIZE + 30) / 31)];
+	uint32_t blind_ri[2 + ((BR_RSA_PROTECTED_MAX_SIZE + 30) / 31)];
+	br_rsa_i31_protected_key wk;
+	uint32_t wk_ok;
+	br_rsa_i31_protected_stats stats;
+	br_rsa_i31_protected_fault_callback fault_cb;
+	void *fault_cb_ctx;
+	uint64_t fault_cb_interval;
+	uint64_t fault_cb_last;
+	int fault_cb_fired;
+#endif
+} br_rsa_i31_protected_context;
+
+/**
+ * \brief Initialise a protected RSA key context.
+ *
+ * The source key is masked once (`init_key()`) into the context; the
+ * source key structure is not referenced afterwards. The embedded DRBG
+ * is seeded from the provided PRNG (`rng`), or from the operating
+ * system if `rng` is `NULL`.
+ *
+ * The `refresh_period` parameter sets how often the masks are
+ * refreshed (`update_key()`): a value of N means that the masks are
+ * refreshed before every N-th operation (1 refreshes between every
+ * two operations). A value of 0 disables automatic refresh; the masks
+ * then change only through explicit calls to
+ * `br_rsa_i31_protected_refresh()`.
+ *
+ * \param ctx              context to initialise.
+ * \param rng              seeded PRNG for the DRBG seed, or `NULL`.
+ * \param sk               source RSA private key (with modulus).
+ * \param refresh_period   number of operations between mask refreshes.
+ * \return  1 on success, 0 on error (unsupported key size).
+ */
+uint32_t br_rsa_i31_protected_init(br_rsa_i31_protected_context *ctx,
+	const br_prng_class **rng, const br_rsa_private_key *sk,
+	uint32_t refresh_period);
+
+/**
+ * \brief Initialise a protected RSA key context from a masked key.
+ *
+ * This is the same as `br_rsa_i31_protected_init()`, except that the
+ * source key is already in the masked format (as produced by
+ * `br_rsa_i31_keygen_protected()`), with its masks `r1` and `r2` and
+ * the blinded phi(p) and phi(q); it is copied into the context without
+ * being masked again.
+ *
+ * \param ctx              context to initialise.
+ * \param rng              seeded PRNG for the DRBG seed, or `NULL`.
+ * \param sk               source masked RSA private key.
+ * \param refresh_period   number of operations between mask refreshes.
+ * \return  1 on success, 0 on error (unsupported key size).
+ */
+uint32_t br_rsa_i31_protected_init_masked(br_rsa_i31_protected_context *ctx,
+	const br_prng_class **rng, const br_rsa_private_key *sk,
+	uint32_t refresh_period);
+
+/**
+ * \brief Refresh the masks of a protected RSA key context.
+ *
+ * The word form of the key is converted again from the new masked
+ * key. If that conversion fails, the failure is latched: all private
+ * key operations on the context return 0 until a later refresh
+ * succeeds.
+ *
+ * \param ctx   protected key context.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_protected_refresh(br_rsa_i31_protected_context *ctx);
+
+/**
+ * \brief Set the regeneration period of the cached blinding pair.
+ *
+ * Operations that use a protected key context blind the message with a
+ * pair (r^e, 1/r) mod n kept in the context. After each use, both values
+ * are squared, which yields a new valid pair without a public exponent
+ * exponentiation or a modular inversion; every `period` uses, the pair
+ * is regenerated from a fresh random r. A period of 0 regenerates the
+ * pair on every operation. The default is
+ * `BR_RSA_PROTECTED_BLIND_PERIOD`.
+ *
+ * \param ctx      protected key context.
+ * \param period   number of uses between regenerations.
+ */
+void br_rsa_i31_protected_set_blind_period(br_rsa_i31_protected_context *ctx,
+	uint32_t period);
+
+/**
+ * \brief Get the operation statistics of a protected RSA key context.
+ *
+ * The counters are reset when the context is initialised. Operations
+ * through `br_rsa_i31_private_protected_ctx()` (and the padding and
+ * batch functions built on it) count faults, and inputs outside of
+ * 1..n-1 as range errors (a zero input cannot pass the fault check,
+ * and is not counted as a fault). `br_rsa_i31_private_mod_prerand_ctx()`
+ * has no fault check, and counts inputs not lower than n as range
+ * errors.
+ *
+ * \param ctx     protected key context.
+ * \param stats   destination for the statistics.
+ */
+void br_rsa_i31_protected_get_stats(const br_rsa_i31_protected_context *ctx,
+	br_rsa_i31_protected_stats *stats);
+
+/**
+ * \brief Set the fault notification callback of a protected RSA key
+ * context.
+ *
+ * The callback is invoked when the fault check of an operation fails.
+ * It is rate-limited: after an invocation, further faults are counted
+ * but not reported until at least `min_interval` more operations have
+ * been performed (0 reports every fault). A `NULL` callback removes
+ * the notification.
+ *
+ * \param ctx            protected key context.
+ * \param cb             callback, or `NULL`.
+ * \param cb_ctx         opaque pointer passed to the callback.
+ * \param min_interval   minimum number of operations between two
+ *                       invocations.
+ */
+void br_rsa_i31_protected_set_fault_callback(
+	br_rsa_i31_protected_context *ctx,
+	br_rsa_i31_protected_fault_callback cb, void *cb_ctx,
+	uint64_t min_interval);
+
+/**
+ * \brief RSA private key engine "i31" with a pre-randomized key context.
+ *
+ * This is the same operation as `br_rsa_i31_private_mod_prerand()`,
+ * but the masked key is taken from the provided context instead of
+ * being rebuilt on each call.
+ *
+ * \param x     operand to exponentiate.
+ * \param ctx   protected key context.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_private_mod_prerand_ctx(unsigned char *x,
+	br_rsa_i31_protected_context *ctx);
+
+/**
+ * \brief Protected RSA private key engine "i31" with a key context.
+ *
+ * This is the same operation as `br_rsa_i31_private_protected()`
+ * (message and exponent blinding, per-window modulus randomization and
+ * fault check), but the masked key is taken from the provided context
+ * instead of being rebuilt on each call. Masks are refreshed according
+ * to the context refresh period.
+ *
+ * \param x     operand to exponentiate.
+ * \param ctx   protected key context.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_private_protected_ctx(unsigned char *x,
+	br_rsa_i31_protected_context *ctx);
+
+/**
+ * \brief Protected RSA private key engine "i31", batch of operands.
+ *
+ * Each of the `count` operands `xs[i]` is processed in place by a
+ * call to `br_rsa_i31_private_protected_ctx()`, in order. This is a
+ * convenience wrapper: the items are not interleaved, and the cost is
+ * the same as calling `br_rsa_i31_private_protected_ctx()` in a loop
+ * (the word form of the masked key is already kept in the context).
+ * Each item gets its own message blinding, fault check and refresh
+ * schedule step.
+ *
+ * If `status` is not `NULL`, then `status[i]` receives 1 or 0 for
+ * each item, with the same meaning as the return value of
+ * `br_rsa_i31_private_protected_ctx()`. A failed item does not stop
+ * the batch.
+ *
+ * \param xs       operands to exponentiate.
+ * \param count    number of operands.
+ * \param ctx      protected key context.
+ * \param status   per-item status (or `NULL`).
+ * \return  1 if all items succeeded, 0 otherwise.
+ */
+uint32_t br_rsa_i31_private_batch(unsigned char *const *xs, size_t count,
+	br_rsa_i31_protected_context *ctx, uint32_t *status);
+
+/**
+ * \brief Protected RSA signature generation engine "i31" (PKCS#1 v1.5
+ * signatures), with a key context.
+ *
+ * \see br_rsa_pkcs1_sign
+ *
+ * \param hash_oid   encoded hash algorithm OID (or `NULL`).
+ * \param hash       hash value.
+ * \param hash_len   hash value length (in bytes).
+ * \param ctx        protected key context.
+ * \param x          output buffer for the signature value.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_protected_pkcs1_sign(const unsigned char *hash_oid,
+	const unsigned char *hash, size_t hash_len,
+	br_rsa_i31_protected_context *ctx, unsigned char *x);
+
+/**
+ * \brief Protected RSA signature generation engine "i31" (PSS
+ * signatures), with a key context.
+ *
+ * \see br_rsa_pss_sign
+ *
+ * \param rng        PRNG for salt generation (`NULL` if `salt_len` is zero).
+ * \param hf_data    hash function used to hash the signed data.
+ * \param hf_mgf1    hash function to use with MGF1.
+ * \param hash       hashed message.
+ * \param salt_len   salt length (in bytes).
+ * \param ctx        protected key context.
+ * \param x          output buffer for the signature value.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_protected_pss_sign(const br_prng_class **rng,
+	const br_hash_class *hf_data, const br_hash_class *hf_mgf1,
+	const unsigned char *hash, size_t salt_len,
+	br_rsa_i31_protected_context *ctx, unsigned char *x);
+
+/**
+ * \brief Protected RSA decryption engine "i31" (OAEP), with a key
+ * context.
+ *
+ * \see br_rsa_oaep_decrypt
+ *
+ * \param dig         hash function to use with MGF1.
+ * \param label       label value (may be `NULL` if `label_len` is zero).
+ * \param label_len   label length, in bytes.
+ * \param ctx         protected key context.
+ * \param data        input/output buffer.
+ * \param len         on input, encrypted message length;
+ *                    on output, decrypted message length.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_protected_oaep_decrypt(const br_hash_class *dig,
+	const void *label, size_t label_len,
+	br_rsa_i31_protected_context *ctx, void *data, size_t *len);
+
+/**
+ * \brief Protected RSA decryption of an SSL pre-master secret, with a
+ * key context.
+ *
+ * This is `br_rsa_ssl_decrypt()` with the private key operation done
+ * by `br_rsa_i31_private_protected_ctx()`. On success, the 48-byte
+ * pre-master secret is moved to the start of `data`.
+ *
+ * \param ctx    protected key context.
+ * \param data   input/output buffer.
+ * \param len    length (in bytes) of the data to decrypt.
+ * \return  1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_protected_ssl_decrypt(br_rsa_i31_protected_context *ctx,
+	unsigned char *data, size_t len);
+
 /**
  * \brief RSA signature generation engine "i31" (PKCS#1 v1.5 signatures).
  *
@@ -1092,7 +1663,8 @@ br_rsa_public br_rsa_public_get_default(void);
  * \brief Get "default" RSA implementation (private-key operations).
  *
  * This returns the preferred implementation of RSA (private-key operations)
- * on the current system.
+ * on the current system, for the protection level configured at build
+ * time with `BR_RSA_PROTECTION_LEVEL` (see `br_rsa_private_get_protected()`).
  *
  * \return  the default implementation.
  */
@@ -1122,12 +1694,71 @@ br_rsa_pss_vrfy br_rsa_pss_vrfy_get_default(void);
  * \brief Get "default" RSA implementation (PKCS#1 v1.5 signature generation).
  *
  * This returns the preferred implementation of RSA (signature generation)
- * on the current system.
+ * on the current system, for the protection level configured at build
+ * time with `BR_RSA_PROTECTION_LEVEL` (see
+ * `br_rsa_pkcs1_sign_get_protected()`).
  *
  * \return  the default implementation.
  */
 br_rsa_pkcs1_sign br_rsa_pkcs1_sign_get_default(void);
 
+/**
+ * \brief RSA private key protection levels.
+ *
+ * Each level selects a private key engine; higher levels add
+ * side-channel and fault countermeasures, at a cost in throughput:
+ *
+ *   - `BR_RSA_PROTECT_NONE`: plain constant-time engine.
+ *   - `BR_RSA_PROTECT_BLIND`: message and exponent blinding.
+ *   - `BR_RSA_PROTECT_MOD_RAND`: blinding and randomized modulus.
+ *   - `BR_RSA_PROTECT_PRERAND`: blinding, randomized modulus and
+ *     pre-randomized (masked) key.
+ *   - `BR_RSA_PROTECT_FULL`: all of the above, plus fault detection.
+ */
+#define BR_RSA_PROTECT_NONE       0
+#define BR_RSA_PROTECT_BLIND      1
+#define BR_RSA_PROTECT_MOD_RAND   2
+#define BR_RSA_PROTECT_PRERAND    3
+#define BR_RSA_PROTECT_FULL       4
+
+/**
+ * \brief Get the RSA implementation (private-key operations) for a
+ * given protection level.
+ *
+ * The fastest engine offering that level on the current system is
+ * returned; for `BR_RSA_PROTECT_NONE` and `BR_RSA_PROTECT_FULL` this is
+ * the "i62" engine where 64x64->128 multiplications are available, the
+ * "i15" engine on `BR_LOMUL` targets, and "i31" otherwise. The
+ * `BR_RSA_PROTECT_BLIND`, `BR_RSA_PROTECT_MOD_RAND` and
+ * `BR_RSA_PROTECT_PRERAND` engines exist only in "i31" form, and are
+ * returned on all targets; on `BR_LOMUL` targets they may thus be
+ * slower than the `BR_RSA_PROTECT_FULL` engine.
+ *
+ * Above `BR_RSA_PROTECT_NONE`, the engines need the modulus and the
+ * public exponent. If the private key does not contain them (`n` or
+ * `e` is `NULL`, as with keys obtained from `br_skey_decoder`), they
+ * are recomputed from the factors (see `br_rsa_compute_modulus` and
+ * `br_rsa_compute_pubexp`); the operation fails if that is not
+ * possible.
+ *
+ * \param level   protection level (`BR_RSA_PROTECT_*`).
+ * \return  the implementation, or 0 for an unknown level.
+ */
+br_rsa_private br_rsa_private_get_protected(unsigned level);
+
+/**
+ * \brief Get the RSA implementation (PKCS#1 v1.5 signature generation)
+ * for a given protection level.
+ *
+ * The returned function applies the padding, then the engine returned
+ * by `br_rsa_private_get_protected()` for the same level. It can be
+ * used along with that engine in `br_ssl_server_set_single_rsa()`.
+ *
+ * \param level   protection level (`BR_RSA_PROTECT_*`).
+ * \return  the implementation, or 0 for an unknown level.
+ */
+br_rsa_pkcs1_sign br_rsa_pkcs1_sign_get_protected(unsigned level);
+
 /**
  * \brief Get "default" RSA implementation (PSS signature generation).
  *
@@ -1382,6 +2013,28 @@ uint32_t br_rsa_i62_oaep_decrypt(
  */
 #define BR_RSA_KBUF_PUB_SIZE(size)     (4 + (((size) + 7) >> 3))
 
+/**
+ * \brief Get buffer size to hold masked RSA private key elements.
+ *
+ * This macro returns the length (in bytes) of the buffer needed to
+ * receive the elements of a masked RSA private key, as generated by
+ * one of the `br_rsa_*_keygen_protected()` functions: the masks `r1`
+ * and `r2` and the blinded phi(p) and phi(q) (as 32-bit words), the
+ * modulus, the masked factors and reduced private exponents, the CRT
+ * coefficient and the public exponent. The buffer need not be aligned.
+ * If the provided size is a constant expression, then the whole macro
+ * evaluates to a constant expression.
+ *
+ * \param size   target key size (modulus size, in bits)
+ * \return  the length of the masked private key buffer, in bytes.
+ */
+#define BR_RSA_KBUF_PROTECTED_SIZE(size)   (3 + 4 \
+	+ 8 * ((BR_RSA_PROTECTED_MASK_SIZE + 63) >> 5) \
+	+ 8 * (3 + ((((size) + 1) >> 1) + 30) / 31) \
+	+ (((size) + 7) >> 3) \
+	+ 4 * (((((size) + 1) >> 1) + BR_RSA_PROTECTED_MASK_SIZE + 7) >> 3) \
+	+ (((((size) + 1) >> 1) + 7) >> 3))
+
 /**
  * \brief Type for RSA key pair generator implementation.
  *
@@ -1508,6 +2161,166 @@ br_rsa_keygen br_rsa_i62_keygen_get(void);
  */
 br_rsa_keygen br_rsa_keygen_get_default(void);
 
+/**
+ * \brief Type for a parallel RSA key pair generator implementation.
+ *
+ * This function behaves as `br_rsa_keygen`, but the searches for the
+ * two prime factors run concurrently on a pool of `num_threads`
+ * workers (the calling thread included). Each prime is searched by
+ * `(num_threads + 1) / 2` independent candidate streams, each with its
+ * own HMAC_DRBG seeded from `rng_ctx`; the stream which finds a prime
+ * after the fewest candidates wins, and the other streams for that
+ * prime stop as soon as they cannot do better.
+ *
+ * The output depends only on the PRNG state and on `num_threads`, not
+ * on thread scheduling: for a given seed and thread count, the same
+ * key pair is obtained, even when fewer threads could be created. It
+ * differs from the output of the non-parallel function for the same
+ * seed. A `num_threads` of 0 is treated as 1, and values above 32 as
+ * 32.
+ *
+ * Worker threads are used only if the library was compiled with
+ * `BR_RSA_THREADS` (see `config.h`); otherwise, all streams run on the
+ * calling thread, with the same result.
+ *
+ * \param rng_ctx       source PRNG context (already initialized)
+ * \param sk            RSA private key structure (destination)
+ * \param kbuf_priv     buffer for private key elements
+ * \param pk            RSA public key structure (destination), or `NULL`
+ * \param kbuf_pub      buffer for public key elements, or `NULL`
+ * \param size          target RSA modulus size (in bits)
+ * \param pubexp        public exponent to use, or zero
+ * \param num_threads   number of workers
+ * \return  1 on success, 0 on error (invalid parameters)
+ */
+typedef uint32_t (*br_rsa_keygen_parallel)(
+	const br_prng_class **rng_ctx,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, unsigned num_threads);
+
+/**
+ * \brief Parallel RSA key pair generation with the "i31" engine.
+ *
+ * \see br_rsa_keygen_parallel
+ *
+ * \param rng_ctx       source PRNG context (already initialized)
+ * \param sk            RSA private key structure (destination)
+ * \param kbuf_priv     buffer for private key elements
+ * \param pk            RSA public key structure (destination), or `NULL`
+ * \param kbuf_pub      buffer for public key elements, or `NULL`
+ * \param size          target RSA modulus size (in bits)
+ * \param pubexp        public exponent to use, or zero
+ * \param num_threads   number of workers
+ * \return  1 on success, 0 on error (invalid parameters)
+ */
+uint32_t br_rsa_i31_keygen_parallel(
+	const br_prng_class **rng_ctx,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, unsigned num_threads);
+
+/**
+ * \brief Parallel RSA key pair generation with the "i62" engine.
+ *
+ * This function is defined only on architecture that offer a 64x64->128
+ * opcode. Use `br_rsa_i62_keygen_parallel_get()` to dynamically obtain
+ * a pointer to that function.
+ *
+ * \see br_rsa_keygen_parallel
+ *
+ * \param rng_ctx       source PRNG context (already initialized)
+ * \param sk            RSA private key structure (destination)
+ * \param kbuf_priv     buffer for private key elements
+ * \param pk            RSA public key structure (destination), or `NULL`
+ * \param kbuf_pub      buffer for public key elements, or `NULL`
+ * \param size          target RSA modulus size (in bits)
+ * \param pubexp        public exponent to use, or zero
+ * \param num_threads   number of workers
+ * \return  1 on success, 0 on error (invalid parameters)
+ */
+uint32_t br_rsa_i62_keygen_parallel(
+	const br_prng_class **rng_ctx,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, unsigned num_threads);
+
+/**
+ * \brief Get the parallel RSA "i62" implementation (key pair
+ * generation), if available.
+ *
+ * \return  the implementation, or 0.
+ */
+br_rsa_keygen_parallel br_rsa_i62_keygen_parallel_get(void);
+
+/**
+ * \brief RSA key pair generation with the "i31" engine, into the
+ * masked format of the protected key context.
+ *
+ * This function has the same parameters as `br_rsa_keygen`, but the
+ * private key is produced directly in the masked format of a
+ * `br_rsa_i31_protected_context` (see `br_rsa_i31_protected_init()`),
+ * in the same pass as the prime search: the factors are multiplied by
+ * random odd masks `r1` and `r2`, the blinded phi(p) and phi(q) are
+ * kept, the reduced private exponents are offset by them, and the
+ * modulus is included in the private key. The unmasked factors never
+ * leave the function. The private key buffer `kbuf_priv` must have
+ * length at least `BR_RSA_KBUF_PROTECTED_SIZE(size)` bytes; the
+ * resulting key is meant to be loaded with
+ * `br_rsa_i31_protected_init_masked()`, and is not usable with the
+ * plain private key engines. The public key output is identical to
+ * that of `br_rsa_i31_keygen()`.
+ *
+ * \see br_rsa_keygen
+ *
+ * \param rng_ctx     source PRNG context (already initialized)
+ * \param sk          RSA private key structure (destination)
+ * \param kbuf_priv   buffer for masked private key elements
+ * \param pk          RSA public key structure (destination), or `NULL`
+ * \param kbuf_pub    buffer for public key elements, or `NULL`
+ * \param size        target RSA modulus size (in bits)
+ * \param pubexp      public exponent to use, or zero
+ * \return  1 on success, 0 on error (invalid parameters)
+ */
+uint32_t br_rsa_i31_keygen_protected(
+	const br_prng_class **rng_ctx,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp);
+
+/**
+ * \brief RSA key pair generation with the "i62" engine, into the
+ * masked format of the protected key context.
+ *
+ * This function is defined only on architecture that offer a 64x64->128
+ * opcode. Use `br_rsa_i62_keygen_protected_get()` to dynamically obtain
+ * a pointer to that function.
+ *
+ * \see br_rsa_i31_keygen_protected
+ *
+ * \param rng_ctx     source PRNG context (already initialized)
+ * \param sk          RSA private key structure (destination)
+ * \param kbuf_priv   buffer for masked private key elements
+ * \param pk          RSA public key structure (destination), or `NULL`
+ * \param kbuf_pub    buffer for public key elements, or `NULL`
+ * \param size        target RSA modulus size (in bits)
+ * \param pubexp      public exponent to use, or zero
+ * \return  1 on success, 0 on error (invalid parameters)
+ */
+uint32_t br_rsa_i62_keygen_protected(
+	const br_prng_class **rng_ctx,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp);
+
+/**
+ * \brief Get the "i62" implementation of masked RSA key pair
+ * generation, if available.
+ *
+ * \return  the implementation, or 0.
+ */
+br_rsa_keygen br_rsa_i62_keygen_protected_get(void);
+
 /**
  * \brief Type for a modulus computing function.
  *
@@ -82,6 +82,7 @@ OBJ = \
  $(OBJDIR)$Pi15_moddiv$O \
  $(OBJDIR)$Pi15_modpow$O \
  $(OBJDIR)$Pi15_modpow2$O \
+ $(OBJDIR)$Pi15_modpow_rand$O \
  $(OBJDIR)$Pi15_montmul$O \
  $(OBJDIR)$Pi15_mulacc$O \
  $(OBJDIR)$Pi15_muladd$O \
@@ -99,10 +100,12 @@ OBJ = \
  $(OBJDIR)$Pi31_fmont$O \
  $(OBJDIR)$Pi31_iszero$O \
  $(OBJDIR)$Pi31_moddiv$O \
+ $(OBJDIR)$Pi31_modinv$O \
  $(OBJDIR)$Pi31_modpow$O \
  $(OBJDIR)$Pi31_modpow2$O \
  $(OBJDIR)$Pmod_rand_pow$O \
  $(OBJDIR)$Pi31_montmul$O \
+ $(OBJDIR)$Pi31_montsqr$O \
  $(OBJDIR)$Pi31_mulacc$O \
  $(OBJDIR)$Pi31_muladd$O \
  $(OBJDIR)$Pi31_ninv31$O \
@@ -110,6 +113,7 @@ OBJ = \
  $(OBJDIR)$Pi31_rshift$O \
  $(OBJDIR)$Pi31_sub$O \
  $(OBJDIR)$Pi31_tmont$O \
+ $(OBJDIR)$Pi31_wtab$O \
  $(OBJDIR)$Pi32_add$O \
  $(OBJDIR)$Pi32_bitlen$O \
  $(OBJDIR)$Pi32_decmod$O \
@@ -127,6 +131,9 @@ OBJ = \
  $(OBJDIR)$Pi32_reduce$O \
  $(OBJDIR)$Pi32_sub$O \
  $(OBJDIR)$Pi32_tmont$O \
+ $(OBJDIR)$Pi52_modpow_ifma$O \
+ $(OBJDIR)$Pi52_modpow_mb$O \
+ $(OBJDIR)$Pi62_modinv$O \
  $(OBJDIR)$Pi62_modpow2$O \
  $(OBJDIR)$Phkdf$O \
  $(OBJDIR)$Pshake$O \
@@ -155,10 +162,13 @@ OBJ = \
  $(OBJDIR)$Prsa_i15_pkcs1_vrfy$O \
  $(OBJDIR)$Prsa_i15_priv$O \
  $(OBJDIR)$Prsa_i15_privexp$O \
+ $(OBJDIR)$Prsa_i15_protected$O \
  $(OBJDIR)$Prsa_i15_pss_sign$O \
  $(OBJDIR)$Prsa_i15_pss_vrfy$O \
  $(OBJDIR)$Prsa_i15_pub$O \
  $(OBJDIR)$Prsa_i15_pubexp$O \
+ $(OBJDIR)$Prsa_i15_randkey$O \
+ $(OBJDIR)$Prsa_i31_blind_pair$O \
  $(OBJDIR)$Prsa_i31_keygen$O \
  $(OBJDIR)$Prsa_i31_keygen_inner$O \
  $(OBJDIR)$Prsa_i31_modulus$O \
@@ -180,12 +190,15 @@ OBJ = \
  $(OBJDIR)$Prsa_i32_pss_sign$O \
  $(OBJDIR)$Prsa_i32_pss_vrfy$O \
  $(OBJDIR)$Prsa_i32_pub$O \
+ $(OBJDIR)$Prsa_i52_private_mb$O \
+ $(OBJDIR)$Prsa_i52_protected$O \
  $(OBJDIR)$Prsa_i62_keygen$O \
  $(OBJDIR)$Prsa_i62_oaep_decrypt$O \
  $(OBJDIR)$Prsa_i62_oaep_encrypt$O \
  $(OBJDIR)$Prsa_i62_pkcs1_sign$O \
  $(OBJDIR)$Prsa_i62_pkcs1_vrfy$O \
  $(OBJDIR)$Prsa_i62_priv$O \
+ $(OBJDIR)$Prsa_i62_protected$O \
  $(OBJDIR)$Prsa_i62_pss_sign$O \
  $(OBJDIR)$Prsa_i62_pss_vrfy$O \
  $(OBJDIR)$Prsa_i62_pub$O \
@@ -193,6 +206,8 @@ OBJ = \
  $(OBJDIR)$Prsa_oaep_unpad$O \
  $(OBJDIR)$Prsa_pkcs1_sig_pad$O \
  $(OBJDIR)$Prsa_pkcs1_sig_unpad$O \
+ $(OBJDIR)$Prsa_protected_pkcs1_sign$O \
+ $(OBJDIR)$Prsa_protected_priv$O \
  $(OBJDIR)$Prsa_pss_sig_pad$O \
  $(OBJDIR)$Prsa_pss_sig_unpad$O \
  $(OBJDIR)$Prsa_ssl_decrypt$O \
@@ -200,6 +215,12 @@ OBJ = \
  $(OBJDIR)$Pmessage_and_exp_blind$O \
  $(OBJDIR)$Pmodulus_randomization$O \
  $(OBJDIR)$Ppre_randomization$O \
+ $(OBJDIR)$Prsa_i31_protected_ctx$O \
+ $(OBJDIR)$Prsa_i31_protected_key$O \
+ $(OBJDIR)$Prsa_i31_protected_oaep_decrypt$O \
+ $(OBJDIR)$Prsa_i31_protected_pkcs1_sign$O \
+ $(OBJDIR)$Prsa_i31_protected_pss_sign$O \
+ $(OBJDIR)$Prsa_i31_protected_ssl_decrypt$O \
  $(OBJDIR)$Prsa_i31_randkey$O \
  $(OBJDIR)$Prsa_secured$O \
  $(OBJDIR)$Pprime_gen$O \
@@ -626,6 +647,9 @@ $(OBJDIR)$Pi15_modpow$O: src$Pint$Pi15_modpow.c $(HEADERSPRIV)
 $(OBJDIR)$Pi15_modpow2$O: src$Pint$Pi15_modpow2.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi15_modpow2$O src$Pint$Pi15_modpow2.c
 
+$(OBJDIR)$Pi15_modpow_rand$O: src$Pint$Pi15_modpow_rand.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi15_modpow_rand$O src$Pint$Pi15_modpow_rand.c
+
 $(OBJDIR)$Pi15_montmul$O: src$Pint$Pi15_montmul.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi15_montmul$O src$Pint$Pi15_montmul.c
 
@@ -677,6 +701,9 @@ $(OBJDIR)$Pi31_iszero$O: src$Pint$Pi31_iszero.c $(HEADERSPRIV)
 $(OBJDIR)$Pi31_moddiv$O: src$Pint$Pi31_moddiv.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_moddiv$O src$Pint$Pi31_moddiv.c
 
+$(OBJDIR)$Pi31_modinv$O: src$Pint$Pi31_modinv.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_modinv$O src$Pint$Pi31_modinv.c
+
 $(OBJDIR)$Pi31_modpow$O: src$Pint$Pi31_modpow.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_modpow$O src$Pint$Pi31_modpow.c
 
@@ -689,6 +716,9 @@ $(OBJDIR)$Pmod_rand_pow$O: src$Pint$Pmod_rand_pow.c $(HEADERSPRIV)
 $(OBJDIR)$Pi31_montmul$O: src$Pint$Pi31_montmul.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_montmul$O src$Pint$Pi31_montmul.c
 
+$(OBJDIR)$Pi31_montsqr$O: src$Pint$Pi31_montsqr.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_montsqr$O src$Pint$Pi31_montsqr.c
+
 $(OBJDIR)$Pi31_mulacc$O: src$Pint$Pi31_mulacc.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_mulacc$O src$Pint$Pi31_mulacc.c
 
@@ -710,6 +740,9 @@ $(OBJDIR)$Pi31_sub$O: src$Pint$Pi31_sub.c $(HEADERSPRIV)
 $(OBJDIR)$Pi31_tmont$O: src$Pint$Pi31_tmont.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_tmont$O src$Pint$Pi31_tmont.c
 
+$(OBJDIR)$Pi31_wtab$O: src$Pint$Pi31_wtab.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi31_wtab$O src$Pint$Pi31_wtab.c
+
 $(OBJDIR)$Pi32_add$O: src$Pint$Pi32_add.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi32_add$O src$Pint$Pi32_add.c
 
@@ -761,6 +794,15 @@ $(OBJDIR)$Pi32_sub$O: src$Pint$Pi32_sub.c $(HEADERSPRIV)
 $(OBJDIR)$Pi32_tmont$O: src$Pint$Pi32_tmont.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi32_tmont$O src$Pint$Pi32_tmont.c
 
+$(OBJDIR)$Pi52_modpow_ifma$O: src$Pint$Pi52_modpow_ifma.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi52_modpow_ifma$O src$Pint$Pi52_modpow_ifma.c
+
+$(OBJDIR)$Pi52_modpow_mb$O: src$Pint$Pi52_modpow_mb.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi52_modpow_mb$O src$Pint$Pi52_modpow_mb.c
+
+$(OBJDIR)$Pi62_modinv$O: src$Pint$Pi62_modinv.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi62_modinv$O src$Pint$Pi62_modinv.c
+
 $(OBJDIR)$Pi62_modpow2$O: src$Pint$Pi62_modpow2.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Pi62_modpow2$O src$Pint$Pi62_modpow2.c
 
@@ -845,6 +887,9 @@ $(OBJDIR)$Prsa_i15_priv$O: src$Prsa$Prsa_i15_priv.c $(HEADERSPRIV)
 $(OBJDIR)$Prsa_i15_privexp$O: src$Prsa$Prsa_i15_privexp.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i15_privexp$O src$Prsa$Prsa_i15_privexp.c
 
+$(OBJDIR)$Prsa_i15_protected$O: src$Prsa$Prsa_i15_protected.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i15_protected$O src$Prsa$Prsa_i15_protected.c
+
 $(OBJDIR)$Prsa_i15_pss_sign$O: src$Prsa$Prsa_i15_pss_sign.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i15_pss_sign$O src$Prsa$Prsa_i15_pss_sign.c
 
@@ -857,6 +902,12 @@ $(OBJDIR)$Prsa_i15_pub$O: src$Prsa$Prsa_i15_pub.c $(HEADERSPRIV)
 $(OBJDIR)$Prsa_i15_pubexp$O: src$Prsa$Prsa_i15_pubexp.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i15_pubexp$O src$Prsa$Prsa_i15_pubexp.c
 
+$(OBJDIR)$Prsa_i15_randkey$O: src$Prsa$Prsa_i15_randkey.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i15_randkey$O src$Prsa$Prsa_i15_randkey.c
+
+$(OBJDIR)$Prsa_i31_blind_pair$O: src$Prsa$Prsa_i31_blind_pair.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_blind_pair$O src$Prsa$Prsa_i31_blind_pair.c
+
 $(OBJDIR)$Prsa_i31_keygen$O: src$Prsa$Prsa_i31_keygen.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_keygen$O src$Prsa$Prsa_i31_keygen.c
 
@@ -920,6 +971,12 @@ $(OBJDIR)$Prsa_i32_pss_vrfy$O: src$Prsa$Prsa_i32_pss_vrfy.c $(HEADERSPRIV)
 $(OBJDIR)$Prsa_i32_pub$O: src$Prsa$Prsa_i32_pub.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i32_pub$O src$Prsa$Prsa_i32_pub.c
 
+$(OBJDIR)$Prsa_i52_private_mb$O: src$Prsa$Prsa_i52_private_mb.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i52_private_mb$O src$Prsa$Prsa_i52_private_mb.c
+
+$(OBJDIR)$Prsa_i52_protected$O: src$Prsa$Prsa_i52_protected.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i52_protected$O src$Prsa$Prsa_i52_protected.c
+
 $(OBJDIR)$Prsa_i62_keygen$O: src$Prsa$Prsa_i62_keygen.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i62_keygen$O src$Prsa$Prsa_i62_keygen.c
 
@@ -938,6 +995,9 @@ $(OBJDIR)$Prsa_i62_pkcs1_vrfy$O: src$Prsa$Prsa_i62_pkcs1_vrfy.c $(HEADERSPRIV)
 $(OBJDIR)$Prsa_i62_priv$O: src$Prsa$Prsa_i62_priv.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i62_priv$O src$Prsa$Prsa_i62_priv.c
 
+$(OBJDIR)$Prsa_i62_protected$O: src$Prsa$Prsa_i62_protected.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i62_protected$O src$Prsa$Prsa_i62_protected.c
+
 $(OBJDIR)$Prsa_i62_pss_sign$O: src$Prsa$Prsa_i62_pss_sign.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i62_pss_sign$O src$Prsa$Prsa_i62_pss_sign.c
 
@@ -959,6 +1019,12 @@ $(OBJDIR)$Prsa_pkcs1_sig_pad$O: src$Prsa$Prsa_pkcs1_sig_pad.c $(HEADERSPRIV)
 $(OBJDIR)$Prsa_pkcs1_sig_unpad$O: src$Prsa$Prsa_pkcs1_sig_unpad.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_pkcs1_sig_unpad$O src$Prsa$Prsa_pkcs1_sig_unpad.c
 
+$(OBJDIR)$Prsa_protected_pkcs1_sign$O: src$Prsa$Prsa_protected_pkcs1_sign.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_protected_pkcs1_sign$O src$Prsa$Prsa_protected_pkcs1_sign.c
+
+$(OBJDIR)$Prsa_protected_priv$O: src$Prsa$Prsa_protected_priv.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_protected_priv$O src$Prsa$Prsa_protected_priv.c
+
 $(OBJDIR)$Prsa_pss_sig_pad$O: src$Prsa$Prsa_pss_sig_pad.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_pss_sig_pad$O src$Prsa$Prsa_pss_sig_pad.c
 
@@ -980,6 +1046,24 @@ $(OBJDIR)$Pmodulus_randomization$O: src$Prsa$Pmodulus_randomization.c $(HEADERSP
 $(OBJDIR)$Ppre_randomization$O: src$Prsa$Ppre_randomization.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Ppre_randomization$O src$Prsa$Ppre_randomization.c
 
+$(OBJDIR)$Prsa_i31_protected_ctx$O: src$Prsa$Prsa_i31_protected_ctx.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_protected_ctx$O src$Prsa$Prsa_i31_protected_ctx.c
+
+$(OBJDIR)$Prsa_i31_protected_key$O: src$Prsa$Prsa_i31_protected_key.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_protected_key$O src$Prsa$Prsa_i31_protected_key.c
+
+$(OBJDIR)$Prsa_i31_protected_oaep_decrypt$O: src$Prsa$Prsa_i31_protected_oaep_decrypt.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_protected_oaep_decrypt$O src$Prsa$Prsa_i31_protected_oaep_decrypt.c
+
+$(OBJDIR)$Prsa_i31_protected_pkcs1_sign$O: src$Prsa$Prsa_i31_protected_pkcs1_sign.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_protected_pkcs1_sign$O src$Prsa$Prsa_i31_protected_pkcs1_sign.c
+
+$(OBJDIR)$Prsa_i31_protected_pss_sign$O: src$Prsa$Prsa_i31_protected_pss_sign.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_protected_pss_sign$O src$Prsa$Prsa_i31_protected_pss_sign.c
+
+$(OBJDIR)$Prsa_i31_protected_ssl_decrypt$O: src$Prsa$Prsa_i31_protected_ssl_decrypt.c $(HEADERSPRIV)
+	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_protected_ssl_decrypt$O src$Prsa$Prsa_i31_protected_ssl_decrypt.c
+
 $(OBJDIR)$Prsa_i31_randkey$O: src$Prsa$Prsa_i31_randkey.c $(HEADERSPRIV)
 	$(CC) $(CFLAGS) $(INCFLAGS) $(CCOUT)$(OBJDIR)$Prsa_i31_randkey$O src$Prsa$Prsa_i31_randkey.c
 
@@ -130,6 +130,7 @@ coresrc=" \
 	src/int/i15_moddiv.c \
 	src/int/i15_modpow.c \
 	src/int/i15_modpow2.c \
+	src/int/i15_modpow_rand.c \
 	src/int/i15_montmul.c \
 	src/int/i15_mulacc.c \
 	src/int/i15_muladd.c \
@@ -147,10 +148,12 @@ coresrc=" \
 	src/int/i31_fmont.c \
 	src/int/i31_iszero.c \
 	src/int/i31_moddiv.c \
+	src/int/i31_modinv.c \
 	src/int/i31_modpow.c \
 	src/int/i31_modpow2.c \
 	src/int/mod_rand_pow.c \
 	src/int/i31_montmul.c \
+	src/int/i31_montsqr.c \
 	src/int/i31_mulacc.c \
 	src/int/i31_muladd.c \
 	src/int/i31_ninv31.c \
@@ -158,6 +161,7 @@ coresrc=" \
 	src/int/i31_rshift.c \
 	src/int/i31_sub.c \
 	src/int/i31_tmont.c \
+	src/int/i31_wtab.c \
 	src/int/i32_add.c \
 	src/int/i32_bitlen.c \
 	src/int/i32_decmod.c \
@@ -175,6 +179,9 @@ coresrc=" \
 	src/int/i32_reduce.c \
 	src/int/i32_sub.c \
 	src/int/i32_tmont.c \
+	src/int/i52_modpow_ifma.c \
+	src/int/i52_modpow_mb.c \
+	src/int/i62_modinv.c \
 	src/int/i62_modpow2.c \
 	src/kdf/hkdf.c \
 	src/kdf/shake.c \
@@ -203,10 +210,13 @@ coresrc=" \
 	src/rsa/rsa_i15_pkcs1_vrfy.c \
 	src/rsa/rsa_i15_priv.c \
 	src/rsa/rsa_i15_privexp.c \
+	src/rsa/rsa_i15_protected.c \
 	src/rsa/rsa_i15_pss_sign.c \
 	src/rsa/rsa_i15_pss_vrfy.c \
 	src/rsa/rsa_i15_pub.c \
 	src/rsa/rsa_i15_pubexp.c \
+	src/rsa/rsa_i15_randkey.c \
+	src/rsa/rsa_i31_blind_pair.c \
 	src/rsa/rsa_i31_keygen.c \
 	src/rsa/rsa_i31_keygen_inner.c \
 	src/rsa/rsa_i31_modulus.c \
@@ -228,12 +238,15 @@ coresrc=" \
 	src/rsa/rsa_i32_pss_sign.c \
 	src/rsa/rsa_i32_pss_vrfy.c \
 	src/rsa/rsa_i32_pub.c \
+	src/rsa/rsa_i52_private_mb.c \
+	src/rsa/rsa_i52_protected.c \
 	src/rsa/rsa_i62_keygen.c \
 	src/rsa/rsa_i62_oaep_decrypt.c \
 	src/rsa/rsa_i62_oaep_encrypt.c \
 	src/rsa/rsa_i62_pkcs1_sign.c \
 	src/rsa/rsa_i62_pkcs1_vrfy.c \
 	src/rsa/rsa_i62_priv.c \
+	src/rsa/rsa_i62_protected.c \
 	src/rsa/rsa_i62_pss_sign.c \
 	src/rsa/rsa_i62_pss_vrfy.c \
 	src/rsa/rsa_i62_pub.c \
@@ -241,6 +254,8 @@ coresrc=" \
 	src/rsa/rsa_oaep_unpad.c \
 	src/rsa/rsa_pkcs1_sig_pad.c \
 	src/rsa/rsa_pkcs1_sig_unpad.c \
+	src/rsa/rsa_protected_pkcs1_sign.c \
+	src/rsa/rsa_protected_priv.c \
 	src/rsa/rsa_pss_sig_pad.c \
 	src/rsa/rsa_pss_sig_unpad.c \
 	src/rsa/rsa_ssl_decrypt.c \
@@ -248,6 +263,12 @@ coresrc=" \
 	src/rsa/message_and_exp_blind.c \
 	src/rsa/modulus_randomization.c \
 	src/rsa/pre_randomization.c \
+	src/rsa/rsa_i31_protected_ctx.c \
+	src/rsa/rsa_i31_protected_key.c \
+	src/rsa/rsa_i31_protected_oaep_decrypt.c \
+	src/rsa/rsa_i31_protected_pkcs1_sign.c \
+	src/rsa/rsa_i31_protected_pss_sign.c \
+	src/rsa/rsa_i31_protected_ssl_decrypt.c \
 	src/rsa/rsa_i31_randkey.c \
 	src/rsa/rsa_secured.c \
 	src/rsa/prime_gen.c \
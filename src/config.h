@@ -228,6 +228,39 @@
 #define BR_UMUL128   1
  */
 
+/*
+ * BR_RSA_PROTECTION_LEVEL selects the RSA private key engine returned
+ * by br_rsa_private_get_default() and br_rsa_pkcs1_sign_get_default(),
+ * hence used by br_ssl_server_init_full_rsa() and the command-line
+ * tools. Higher levels add countermeasures and cost throughput:
+ *   0   plain constant-time engines (default)
+ *   1   message and exponent blinding
+ *   2   randomized modulus in the exponentiation
+ *   3   pre-randomized (masked) key
+ *   4   all of the above, plus fault detection
+ *
+#define BR_RSA_PROTECTION_LEVEL   4
+ */
+
+/*
+ * When BR_RSA_THREADS is enabled, the combined protected RSA core
+ * computes the two CRT halves (modulo p and modulo q) concurrently, the
+ * q half on a POSIX thread created for each operation, with its own
+ * scratch area and DRBG. That core is used by
+ * br_rsa_i31_private_protected(), its i62 and i52 variants,
+ * br_rsa_i31_private_protected_ctx() and the batch functions; the other
+ * protected engines (message blinding, modulus randomization,
+ * pre-randomized key, FI and i15) still compute the halves one after
+ * the other. Any latency gain requires an idle core and must outweigh
+ * the thread creation; it has not been measured on a multi-core
+ * system. This flag also lets the parallel RSA key generation
+ * functions (br_rsa_keygen_parallel) run their workers on POSIX
+ * threads; without it, they run on the calling thread, with the same
+ * output. The library must then be linked with -pthread.
+ *
+#define BR_RSA_THREADS   1
+ */
+
 /*
  * When BR_LE_UNALIGNED is enabled, then the current architecture is
  * assumed to use little-endian encoding for integers, and to tolerate
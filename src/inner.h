@@ -84,7 +84,7 @@
 /*
  * Bit len of random number used as mask
  */
-#define BR_RSA_RAND_FACTOR 62
+#define BR_RSA_RAND_FACTOR   BR_RSA_PROTECTED_MASK_SIZE
 /*
  * Some macros to recognize the current architecture. Right now, we are
  * interested into automatically recognizing architecture with efficient
@@ -134,6 +134,21 @@
 #endif
 #endif
 
+/*
+ * RSA private key engine selection policy (see config.h).
+ */
+#ifndef BR_RSA_PROTECTION_LEVEL
+#define BR_RSA_PROTECTION_LEVEL   0
+#endif
+
+/*
+ * Threaded CRT halves in the protected RSA engines, and worker threads
+ * for the parallel RSA key generation (see config.h).
+ */
+#ifndef BR_RSA_THREADS
+#define BR_RSA_THREADS   0
+#endif
+
 /*
  * Architecture detection.
  */
@@ -308,6 +323,16 @@
 #endif
 #endif
 
+/*
+ * AVX-512 IFMA intrinsics are available on x86 (64-bit only) with
+ * GCC 5.0+ and Clang 3.8+.
+ */
+#ifndef BR_AVX512IFMA
+#if BR_amd64 && (BR_GCC_5_0 || BR_CLANG_3_8)
+#define BR_AVX512IFMA   1
+#endif
+#endif
+
 /*
  * Determine type of OS for random number generation. Macro names and
  * values are documented on:
@@ -1455,6 +1480,14 @@ uint32_t br_i31_ninv31(uint32_t x);
 void br_i31_montymul(uint32_t *d, const uint32_t *x, const uint32_t *y,
 	const uint32_t *m, uint32_t m0i);
 
+/*
+ * Compute a modular Montgomery squaring: d[] is filled with x*x/R
+ * modulo m[]. Same constraints and output as br_i31_montymul(x, x),
+ * but the symmetric cross products are computed only once.
+ */
+void br_i31_montysqr(uint32_t *d, const uint32_t *x,
+	const uint32_t *m, uint32_t m0i);
+
 /*
  * Convert a modular integer to Montgomery representation. The integer x[]
  * MUST be lower than m[], but with the same announced bit length.
@@ -1523,10 +1556,59 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 	const unsigned char *e, size_t elen,
 	const uint32_t *m, uint32_t m0i, uint32_t *tmp, size_t twlen);
 
+/*
+ * Window tables for the fixed-window exponentiations (up to
+ * BR_I31_MAX_WINDOW bits). Values use mwlen words each (header word
+ * included); a table for a k-bit window holds the 2^k-1 non-trivial
+ * powers of the base, stored word-interleaved: word v of every entry
+ * is adjacent in memory, so that a constant-time lookup reads the table
+ * once, sequentially. The table uses (2^k-1)*mwlen words.
+ *
+ * br_i31_window_len() returns the window size (1 to BR_I31_MAX_WINDOW)
+ * best suited to an exponent of 'ebits' bits, among those for which
+ * (2^k+1)*mwlen words fit in twlen (window size 1 needs no table).
+ *
+ * br_i31_wtab_build() fills the table from the base x (Montgomery
+ * representation, modulo m); t[] must have room for 2*mwlen words.
+ *
+ * br_i31_wtab_get() sets d[] to the entry for 'bits' (1 <= bits < 2^k),
+ * or to zero (with announced bit length 'bitlen') if bits is zero.
+ */
+#define BR_I31_MAX_WINDOW   7
+
+int br_i31_window_len(size_t ebits, size_t mwlen, size_t twlen);
+void br_i31_wtab_build(uint32_t *tab, int k, const uint32_t *x,
+	const uint32_t *m, uint32_t m0i, size_t mwlen, uint32_t *t);
+void br_i31_wtab_get(uint32_t *d, const uint32_t *tab, int k, uint32_t bits,
+	size_t mwlen, uint32_t bitlen);
+
+/*
+ * Compute two modular exponentiations of the same base with a single
+ * pass over the exponents: on input, x1[] contains the base (same
+ * constraints as for br_i31_modpow_opt_rand()); on output, x1[] contains
+ * x1^e1 mod m and x2[] contains x1^e2 mod m. The x2[] array need not be
+ * initialised, but it MUST be as large as x1[]. Both exponents are in
+ * big-endian unsigned notation; they need not have the same length.
+ *
+ * The window table, the per-window modulus re-randomization (mask
+ * generation, m*r product and its Montgomery inverse) and the loop are
+ * shared by both exponentiations. tmp[] has the same requirements as for
+ * br_i31_modpow_opt_rand(), and the same window size is selected.
+ *
+ * If r2 is not NULL, it MUST contain R^2 mod m, for R = 2^(31*len) where
+ * len is the word length of m, with the same announced bit length as m
+ * (e.g. as cached in br_rsa_i31_protected_key). The conversion of the
+ * base to Montgomery representation modulo the randomized modulus then
+ * costs one Montgomery multiplication instead of br_i31_to_monty().
+ *
+ * Returned value is 1 on success, 0 on error. An error is reported if
+ * the provided tmp[] array is too short.
+ */
 uint32_t
 br_i31_double_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x1, uint32_t *x2,
 	const unsigned char *e1, size_t elen1, const unsigned char *e2, size_t elen2,
-	const uint32_t *m, uint32_t m0i, uint32_t *tmp, size_t twlen);
+	const uint32_t *m, uint32_t m0i, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen);
 /*
  * Compute d+a*b, result in d. The initial announced bit length of d[]
  * MUST match that of a[]. The d[] array MUST be large enough to
@@ -1557,11 +1639,55 @@ void br_i31_mulacc(uint32_t *d, const uint32_t *a, const uint32_t *b);
 uint32_t br_i31_moddiv(uint32_t *x, const uint32_t *y,
 	const uint32_t *m, uint32_t m0i, uint32_t *t);
 
+/*
+ * Compute x/y mod m, result in x, with the constant-time "safegcd"
+ * algorithm (Bernstein-Yang divsteps). Rules on x, y and m are the same
+ * as for br_i31_moddiv(); setting x to 1 yields the inverse of y. The
+ * number of divsteps depends only on the announced bit length of m.
+ *
+ * br_i31_modinv() uses batches of 30 divsteps with 32-bit transition
+ * matrices. br_i62_modinv() uses batches of 62 divsteps with 64-bit
+ * transition matrices and 128-bit products; without 128-bit integer
+ * support, it calls br_i31_modinv(). For both functions, t[] must
+ * have room for five integers of the size of m, plus ten words (it
+ * need not be 64-bit aligned).
+ *
+ * x and y may overlap each other; t must be disjoint from all other
+ * arrays. Returned value is 1 on success (y is invertible modulo m),
+ * 0 otherwise.
+ */
+uint32_t br_i31_modinv(uint32_t *x, const uint32_t *y,
+	const uint32_t *m, uint32_t *t);
+uint32_t br_i62_modinv(uint32_t *x, const uint32_t *y,
+	const uint32_t *m, uint32_t *t);
+
 void init_key( const br_prng_class ** rng, const br_rsa_private_key *sk, br_rsa_private_key *new_sk, uint32_t *tmp, uint32_t fwlen);
 void update_key( const br_prng_class ** rng, br_rsa_private_key *new_sk, uint32_t *tmp, uint32_t fwlen );
 size_t blind_exponent( const br_prng_class ** rng, unsigned char * x, const unsigned char* d, const size_t size, uint32_t * m, uint32_t * t1);
 void make_rand(const br_prng_class **rng, uint32_t *x, uint32_t esize);
 
+/*
+ * Per-window masks used by the randomized modular exponentiations are
+ * not requested from the PRNG one at a time: each generate() call on
+ * HMAC_DRBG has a fixed cost (two extra HMAC computations to update the
+ * state) that dwarfs the cost of producing 8 bytes. Instead, masks are
+ * drawn in bulk into a pool of BR_RSA_RAND_POOL entries, each
+ * BR_RSA_RAND_WLEN words long. With 5-bit windows, a full pool covers an
+ * exponentiation modulo a 640-bit factor with a single generate() call.
+ */
+#define BR_RSA_RAND_WLEN   ((BR_RSA_RAND_FACTOR + 31) >> 5)
+#define BR_RSA_RAND_POOL   128
+
+/*
+ * Extract the next mask (BR_RSA_RAND_FACTOR bits, odd, with its bit
+ * length word) from the pool into x[], refilling the pool when it is
+ * exhausted (*ptr == *len; both must be 0 initially). 'rem' is the number
+ * of masks still needed for the current exponentiation, including this
+ * one; the pool is never filled beyond that.
+ */
+void make_rand_pooled(const br_prng_class **rng, uint32_t *x,
+	uint32_t *pool, size_t *ptr, size_t *len, size_t rem);
+
 /* ==================================================================== */
 
 /*
@@ -1619,6 +1745,44 @@ void br_i15_mulacc(uint16_t *d, const uint16_t *a, const uint16_t *b);
 uint32_t br_i15_moddiv(uint16_t *x, const uint16_t *y,
 	const uint16_t *m, uint16_t m0i, uint16_t *t);
 
+/*
+ * Randomized exponentiations with 15-bit words; same API and behaviour
+ * as br_i31_modpow_opt_rand() and br_i31_double_modpow_opt_rand().
+ */
+uint32_t br_i15_modpow_opt_rand(const br_prng_class **rng, uint16_t *x,
+	const unsigned char *e, size_t elen,
+	const uint16_t *m, uint16_t m0i, uint16_t *tmp, size_t twlen);
+uint32_t br_i15_double_modpow_opt_rand(const br_prng_class **rng,
+	uint16_t *x1, uint16_t *x2,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint16_t *m, uint16_t m0i, uint16_t *tmp, size_t twlen);
+
+/*
+ * Conversions between i31 and i15 integers (same value; the announced
+ * bit length of the destination is the actual bit length of the value).
+ * These use no multiplication. The destination must have room for the
+ * announced bit length of the source, and no more is written.
+ */
+void br_i15_from_i31(uint16_t *d, const uint32_t *s);
+void br_i31_from_i15(uint32_t *d, const uint16_t *s);
+
+/*
+ * i15 versions of make_rand(), blind_exponent(), init_key() and
+ * update_key(). The masked key has the same format as with the i31
+ * functions. For init_key_i15() and update_key_i15(), 'fwlen' is the
+ * factor length in 15-bit words (including some room for the masks),
+ * and tmp[] must have room for 17*fwlen words. For make_rand_i15(),
+ * esize is at most 2*BR_RSA_RAND_FACTOR.
+ */
+void make_rand_i15(const br_prng_class **rng, uint16_t *x, uint32_t esize);
+size_t blind_exponent_i15(const br_prng_class **rng, unsigned char *x,
+	const unsigned char *d, size_t size, const uint16_t *m, uint16_t *t1);
+void init_key_i15(const br_prng_class **rng, const br_rsa_private_key *sk,
+	br_rsa_private_key *new_sk, uint16_t *tmp, uint32_t fwlen);
+void update_key_i15(const br_prng_class **rng, br_rsa_private_key *new_sk,
+	uint16_t *tmp, uint32_t fwlen);
+
 /*
  * Variant of br_i31_modpow_opt() that internally uses 64x64->128
  * multiplications. It expects the same parameters as br_i31_modpow_opt(),
@@ -1646,6 +1810,148 @@ uint32_t br_i62_modpow_opt_as_i31(uint32_t *x,
 	const unsigned char *e, size_t elen,
 	const uint32_t *m, uint32_t m0i, uint32_t *tmp, size_t twlen);
 
+/*
+ * Randomized exponentiations with 62-bit words; same API as
+ * br_i31_modpow_opt_rand() and br_i31_double_modpow_opt_rand(), except
+ * that the temporaries are 64-bit words. If 64x64->128 multiplications
+ * are not available, these call the i31 functions.
+ */
+uint32_t br_i62_modpow_opt_rand(const br_prng_class **rng, uint32_t *x31,
+	const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint64_t *tmp, size_t twlen);
+uint32_t br_i62_double_modpow_opt_rand(const br_prng_class **rng,
+	uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint32_t m0i31, uint64_t *tmp, size_t twlen);
+
+/*
+ * Types for functions with the same API as br_i31_modpow_opt_rand() and
+ * br_i31_double_modpow_opt_rand() (some implementations may have stricter
+ * alignment requirements on the temporaries).
+ */
+typedef uint32_t (*br_i31_modpow_opt_rand_type)(const br_prng_class **rng,
+	uint32_t *x, const unsigned char *e, size_t elen,
+	const uint32_t *m, uint32_t m0i, uint32_t *tmp, size_t twlen);
+typedef uint32_t (*br_i31_double_modpow_opt_rand_type)(
+	const br_prng_class **rng, uint32_t *x1, uint32_t *x2,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m, uint32_t m0i, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen);
+
+/*
+ * Wrappers for br_i62_modpow_opt_rand() and
+ * br_i62_double_modpow_opt_rand() with the i31 types; 'tmp' MUST be
+ * 64-bit aligned. The r2 parameter is ignored (the i62 code performs
+ * its own conversion).
+ */
+uint32_t br_i62_modpow_opt_rand_as_i31(const br_prng_class **rng,
+	uint32_t *x, const unsigned char *e, size_t elen,
+	const uint32_t *m, uint32_t m0i, uint32_t *tmp, size_t twlen);
+uint32_t br_i62_double_modpow_opt_rand_as_i31(const br_prng_class **rng,
+	uint32_t *x1, uint32_t *x2,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m, uint32_t m0i, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen);
+
+/*
+ * Exponentiations with 52-bit limbs and the AVX-512 IFMA opcodes, with
+ * the i31 types (br_i31_modpow_opt_type, br_i31_modpow_opt_rand_type
+ * and br_i31_double_modpow_opt_rand_type); 'tmp' MUST be 64-bit
+ * aligned. When the modulus is too large or the temporaries too small,
+ * they use the i62 code. These functions must be called only if the
+ * CPU supports AVX-512 IFMA, as reported by the matching _get()
+ * function, which returns 0 otherwise.
+ */
+uint32_t br_i52_modpow_opt(uint32_t *x31, const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint32_t *tmp, size_t twlen);
+uint32_t br_i52_modpow_opt_rand(const br_prng_class **rng, uint32_t *x31,
+	const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint32_t *tmp, size_t twlen);
+uint32_t br_i52_double_modpow_opt_rand(const br_prng_class **rng,
+	uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint32_t m0i31, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen);
+br_i31_modpow_opt_type br_i52_modpow_opt_get(void);
+br_i31_modpow_opt_rand_type br_i52_modpow_opt_rand_get(void);
+br_i31_double_modpow_opt_rand_type br_i52_double_modpow_opt_rand_get(void);
+
+/*
+ * Multi-buffer exponentiation with 52-bit limbs and the AVX-512 IFMA
+ * opcodes: x[i] <- x[i]^e[i] mod m[i] for 0 <= i < count (at most 8),
+ * with one independent computation per 64-bit lane. Integers use the
+ * i31 representation; each modulus must be odd and each x[i] must be
+ * lower than m[i] and have the same announced bit length. All
+ * exponents are big-endian and have length elen bytes (shorter
+ * exponents must be padded with leading zeros). tmp[] (twlen 64-bit
+ * words) must have room for at least 48*num words, num being the
+ * size of the largest modulus in 52-bit limbs; more room allows a
+ * larger window. Returned value is 1 on success, 0 on error (count
+ * over 8, even or too large modulus, tmp[] too small). This function
+ * must be called only if br_i52_modpow_mb_get() returns it.
+ */
+typedef uint32_t (*br_i52_modpow_mb_type)(uint32_t *const *x,
+	const unsigned char *const *e, size_t elen,
+	const uint32_t *const *m, size_t count, uint64_t *tmp, size_t twlen);
+uint32_t br_i52_modpow_mb(uint32_t *const *x, const unsigned char *const *e,
+	size_t elen, const uint32_t *const *m, size_t count,
+	uint64_t *tmp, size_t twlen);
+br_i52_modpow_mb_type br_i52_modpow_mb_get(void);
+
+/*
+ * Events reported by the protected private key cores, for the context
+ * statistics (see br_rsa_i31_protected_record()).
+ */
+#define BR_RSA_PROTECTED_EV_FAULT   0x01
+#define BR_RSA_PROTECTED_EV_RANGE   0x02
+
+/*
+ * Account for one private key operation on a protected key context,
+ * with the events (BR_RSA_PROTECTED_EV_*) it reported; a fault invokes
+ * the context callback, subject to its rate limit.
+ */
+void br_rsa_i31_protected_record(br_rsa_i31_protected_context *ctx,
+	uint32_t events);
+
+/*
+ * Get the message blinding pair of a protected key context: re = r^e
+ * and ri = 1/r modulo n, in Montgomery representation (arrays of the
+ * size of n). The pair kept in the context is then squared, and
+ * regenerated from a fresh r every ctx->blind_period uses. n0i is
+ * -1/n mod 2^31. tmp[] (twlen words) must hold at least six integers
+ * of the size of n, plus ten words (for br_i62_modinv()). Returned
+ * value is 1 on success, 0 on error.
+ */
+uint32_t br_rsa_i31_blind_pair_take(br_rsa_i31_protected_context *ctx,
+	const uint32_t *n, uint32_t n0i, uint32_t *re, uint32_t *ri,
+	uint32_t *tmp, size_t twlen);
+
+/*
+ * Convert a (masked) private key to word form; this is
+ * br_rsa_i31_protected_key_init(), except that when full is 0, the
+ * field n_r2 (which no engine reads; it is kept for callers of the
+ * public structure) is not computed, which saves the two Montgomery
+ * conversions modulo n. The per-call engine uses that reduced
+ * conversion.
+ */
+uint32_t br_rsa_i31_protected_key_decode(br_rsa_i31_protected_key *wk,
+	const br_rsa_private_key *sk, int full);
+
+/*
+ * Core of the protected RSA private key engine (message blinding,
+ * exponent blinding, pre-randomized key, per-window modulus
+ * randomization and fault check), with the exponentiation provided as
+ * a parameter. The i31 and i62 engines call this with the matching
+ * double exponentiation function.
+ */
+uint32_t br_rsa_i31_private_protected_inner(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk,
+	br_i31_double_modpow_opt_rand_type dmp);
+
 /* ==================================================================== */
 
 static inline size_t
@@ -2041,6 +2347,15 @@ size_t br_rsa_oaep_pad(const br_prng_class **rnd, const br_hash_class *dig,
 uint32_t br_rsa_oaep_unpad(const br_hash_class *dig,
 	const void *label, size_t label_len, void *data, size_t *len);
 
+/*
+ * Check the PKCS#1 v1.5 type 2 padding of a decrypted SSL pre-master
+ * secret (48 bytes) and move it to the start of the buffer. The buffer
+ * length must already have been checked against the modulus length
+ * (and be at least 59 bytes). Returned value is 1 if the padding is
+ * correct, 0 otherwise; the check is constant-time.
+ */
+uint32_t br_rsa_ssl_decrypt_unpad(unsigned char *data, size_t len);
+
 /*
  * Compute MGF1 for a given seed, and XOR the output into the provided
  * buffer.
@@ -2057,6 +2372,26 @@ uint32_t br_rsa_i31_keygen_inner(const br_prng_class **rng,
 	br_rsa_public_key *pk, void *kbuf_pub,
 	unsigned size, uint32_t pubexp, br_i31_modpow_opt_type mp31);
 
+/*
+ * Inner function for parallel RSA key generation (see
+ * br_rsa_keygen_parallel); used by the "i31" and "i62" implementations.
+ */
+uint32_t br_rsa_i31_keygen_parallel_inner(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, br_i31_modpow_opt_type mp31,
+	unsigned num_threads);
+
+/*
+ * Inner function for RSA key generation into the masked format of the
+ * protected key context (see br_rsa_i31_keygen_protected); used by the
+ * "i31" and "i62" implementations.
+ */
+uint32_t br_rsa_i31_keygen_protected_inner(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_prot,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, br_i31_modpow_opt_type mp31);
+
 void my_mkprime(const br_prng_class **rng, uint32_t *x, uint32_t esize,
         uint32_t *t, size_t tlen, br_i31_modpow_opt_type mp31);
 /* ==================================================================== */
@@ -2605,6 +2940,76 @@ br_cpuid(uint32_t mask_eax, uint32_t mask_ebx,
 	return 0;
 }
 
+/*
+ * Test features from the "structured extended feature flags" CPUID leaf
+ * (leaf 7, sub-leaf 0): returned value is 1 if all bits in the masks
+ * are set.
+ */
+static inline int
+br_cpuid7(uint32_t mask_ebx, uint32_t mask_ecx, uint32_t mask_edx)
+{
+#if BR_GCC || BR_CLANG
+	unsigned eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0, 0) >= 7) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if ((ebx & mask_ebx) == mask_ebx
+			&& (ecx & mask_ecx) == mask_ecx
+			&& (edx & mask_edx) == mask_edx)
+		{
+			return 1;
+		}
+	}
+#elif BR_MSC
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] >= 7) {
+		__cpuidex(info, 7, 0);
+		if (((uint32_t)info[1] & mask_ebx) == mask_ebx
+			&& ((uint32_t)info[2] & mask_ecx) == mask_ecx
+			&& ((uint32_t)info[3] & mask_edx) == mask_edx)
+		{
+			return 1;
+		}
+	}
+#endif
+	return 0;
+}
+
+/*
+ * Test that the OS saves and restores the register state components
+ * whose bits are set in 'mask' (XCR0 register). This is needed for AVX
+ * and AVX-512 registers, on top of the CPUID feature flags.
+ */
+static inline int
+br_xcr0(uint32_t mask)
+{
+	uint32_t lo;
+
+	/*
+	 * Bit mask for features in ECX:
+	 *   27   OSXSAVE
+	 */
+	if (!br_cpuid(0, 0, 0x08000000, 0)) {
+		return 0;
+	}
+#if BR_GCC || BR_CLANG
+	{
+		uint32_t hi;
+
+		__asm__ __volatile__ ("xgetbv"
+			: "=a" (lo), "=d" (hi) : "c" (0));
+		(void)hi;
+	}
+#elif BR_MSC
+	lo = (uint32_t)_xgetbv(0);
+#else
+	lo = 0;
+#endif
+	return (lo & mask) == mask;
+}
+
 #endif
 
 #endif
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+/*
+ * Randomized modular exponentiation over 15-bit words. This mirrors
+ * br_i31_modpow_opt_rand() and br_i31_double_modpow_opt_rand(): the
+ * modulus m is replaced with m*r, with a fresh random odd r for each
+ * exponent window, all values being kept below the Montgomery factor
+ * (which is fixed) and congruent to the expected values modulo m. Only
+ * 15x15->32 multiplications are used, which are constant-time on small
+ * cores that lack a constant-time 32x32->64 multiplier.
+ */
+
+/*
+ * Bytes per mask, and mask size in 15-bit words.
+ */
+#define MASK_BLEN    ((BR_RSA_RAND_FACTOR + 7) >> 3)
+#define MASK_WLEN    ((BR_RSA_RAND_FACTOR + 14) / 15)
+
+/*
+ * Size (in 15-bit words) of the randomized modulus buffer.
+ */
+#define MLEN         (3 + ((BR_MAX_RSA_FACTOR + 3 * BR_RSA_RAND_FACTOR \
+                         + 14) / 15))
+
+/*
+ * Decode a random odd value of 'bits' bits from src[] (which is
+ * modified) into x[].
+ */
+static void
+decode_mask(uint16_t *x, unsigned char *src, size_t blen, unsigned bits)
+{
+	src[0] &= 0xFF >> ((blen << 3) - bits);
+	src[blen - 1] |= 0x01;
+	br_i15_decode(x, src, blen);
+}
+
+/*
+ * Get the next window mask, from a pool that is refilled with a single
+ * generate() call when exhausted (see make_rand_pooled()).
+ */
+static void
+next_mask(const br_prng_class **rng, uint16_t *x,
+	unsigned char *pool, size_t *ptr, size_t *len, size_t rem)
+{
+	unsigned char tmp[MASK_BLEN];
+
+	if (*ptr == *len) {
+		if (rem > BR_RSA_RAND_POOL) {
+			rem = BR_RSA_RAND_POOL;
+		}
+		*len = rem * MASK_BLEN;
+		*ptr = 0;
+		(*rng)->generate(rng, pool, *len);
+	}
+	memcpy(tmp, pool + *ptr, MASK_BLEN);
+	*ptr += MASK_BLEN;
+	decode_mask(x, tmp, MASK_BLEN, BR_RSA_RAND_FACTOR);
+}
+
+/*
+ * Set curr_m[] to m*r, with announced bit length 'bitlen', and return
+ * -(1/curr_m) mod 2^15.
+ */
+static uint16_t
+rand_modulus(uint16_t *curr_m, const uint16_t *m, const uint16_t *r,
+	uint16_t bitlen)
+{
+	br_i15_zero(curr_m, bitlen);
+	curr_m[0] = m[0];
+	br_i15_mulacc(curr_m, m, r);
+	curr_m[0] = bitlen;
+	return br_i15_ninv15(curr_m[1]);
+}
+
+/*
+ * Constant-time window lookup (see the i31 code).
+ */
+static void
+window_lookup(uint16_t *d, uint32_t bits, int k, size_t mwlen, uint16_t len)
+{
+	const uint16_t *base;
+	size_t u, v;
+
+	br_i15_zero(d, len);
+	base = d + mwlen;
+	for (u = 1; u < ((uint32_t)1 << k); u ++) {
+		uint32_t mask;
+
+		mask = -EQ(u, bits);
+		for (v = 1; v < mwlen; v ++) {
+			d[v] |= mask & base[v];
+		}
+		base += mwlen;
+	}
+}
+
+/*
+ * Common code: x1 <- x1^e1, and (if x2 is not NULL) x2 <- x1^e2.
+ */
+static uint32_t
+modpow_rand(const br_prng_class **rng, uint16_t *x1, uint16_t *x2,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint16_t *m, uint16_t *tmp, size_t twlen)
+{
+	size_t mlen, mwlen, elen, off1, off2, nwin, xwlen;
+	uint16_t *t1, *t2, *base;
+	uint16_t curr_m[MLEN], r[2 + 2 * MASK_WLEN], new_r[1 + MASK_WLEN];
+	unsigned char rbuf[2 * MASK_BLEN];
+	unsigned char pool[BR_RSA_RAND_POOL * MASK_BLEN];
+	size_t u, pool_ptr, pool_len;
+	uint32_t acc1, acc2;
+	uint16_t m0i, bitlen;
+	int acc_len, win_len;
+
+	if (x2 == NULL) {
+		elen2 = 0;
+	}
+
+	/*
+	 * Initial randomized modulus; its bit length is kept as the
+	 * announced length of all the per-window moduli.
+	 */
+	(*rng)->generate(rng, rbuf, sizeof rbuf);
+	decode_mask(r, rbuf, sizeof rbuf, 2 * BR_RSA_RAND_FACTOR);
+	br_i15_zero(curr_m, m[0]);
+	br_i15_mulacc(curr_m, m, r);
+	bitlen = (uint16_t)br_i15_bit_length(curr_m + 1,
+		(curr_m[0] + 15) >> 4);
+	curr_m[0] = bitlen;
+	m0i = br_i15_ninv15(curr_m[1]);
+
+	mwlen = (bitlen + 31) >> 4;
+	mlen = mwlen * sizeof curr_m[0];
+	mwlen += (mwlen & 1);
+	t1 = tmp;
+	t2 = tmp + mwlen;
+	if (twlen < (mwlen << 1)) {
+		return 0;
+	}
+	for (win_len = 5; win_len > 1; win_len --) {
+		if ((((uint32_t)1 << win_len) + 1) * mwlen <= twlen) {
+			break;
+		}
+	}
+
+	/*
+	 * Extend x1 to the randomized modulus size.
+	 */
+	xwlen = (x1[0] + 31) >> 4;
+	for (; xwlen < ((size_t)(bitlen + 31) >> 4); xwlen ++) {
+		x1[xwlen] = 0;
+	}
+	x1[0] = bitlen;
+
+	br_i15_to_monty(x1, curr_m);
+	if (win_len == 1) {
+		memcpy(t2, x1, mlen);
+	} else {
+		memcpy(t2 + mwlen, x1, mlen);
+		base = t2 + mwlen;
+		for (u = 2; u < ((unsigned)1 << win_len); u ++) {
+			br_i15_montymul(base + mwlen, base, x1, curr_m, m0i);
+			base += mwlen;
+		}
+	}
+
+	br_i15_zero(x1, bitlen);
+	x1[(bitlen + 15) >> 4] = 1;
+	br_i15_muladd_small(x1, 0, curr_m);
+	if (x2 != NULL) {
+		memcpy(x2, x1, mlen);
+	}
+
+	elen = elen1 > elen2 ? elen1 : elen2;
+	off1 = elen - elen1;
+	off2 = elen - elen2;
+	nwin = ((elen << 3) + win_len - 1) / win_len;
+	pool_ptr = 0;
+	pool_len = 0;
+
+	acc1 = 0;
+	acc2 = 0;
+	acc_len = 0;
+	u = 0;
+	while (acc_len > 0 || u < elen) {
+		int i, k;
+		uint32_t bits1, bits2;
+
+		k = win_len;
+		if (acc_len < win_len) {
+			if (u < elen) {
+				acc1 = (acc1 << 8)
+					| (u >= off1 ? e1[u - off1] : 0);
+				acc2 = (acc2 << 8)
+					| (u >= off2 ? e2[u - off2] : 0);
+				u ++;
+				acc_len += 8;
+			} else {
+				k = acc_len;
+			}
+		}
+		bits1 = (acc1 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		bits2 = (acc2 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		acc_len -= k;
+
+		next_mask(rng, new_r, pool, &pool_ptr, &pool_len, nwin --);
+		m0i = rand_modulus(curr_m, m, new_r, bitlen);
+
+		for (i = 0; i < k; i ++) {
+			br_i15_montymul(t1, x1, x1, curr_m, m0i);
+			memcpy(x1, t1, mlen);
+		}
+		if (win_len > 1) {
+			window_lookup(t2, bits1, k, mwlen, bitlen);
+		}
+		br_i15_montymul(t1, x1, t2, curr_m, m0i);
+		CCOPY(NEQ(bits1, 0), x1, t1, mlen);
+
+		if (x2 != NULL) {
+			for (i = 0; i < k; i ++) {
+				br_i15_montymul(t1, x2, x2, curr_m, m0i);
+				memcpy(x2, t1, mlen);
+			}
+			if (win_len > 1) {
+				window_lookup(t2, bits2, k, mwlen, bitlen);
+			}
+			br_i15_montymul(t1, x2, t2, curr_m, m0i);
+			CCOPY(NEQ(bits2, 0), x2, t1, mlen);
+		}
+	}
+
+	/*
+	 * Convert back from Montgomery representation (with the initial
+	 * randomized modulus) and reduce modulo m.
+	 */
+	m0i = rand_modulus(curr_m, m, r, bitlen);
+	memcpy(t1, x1, mlen);
+	br_i15_from_monty(t1, curr_m, m0i);
+	br_i15_reduce(x1, t1, m);
+	if (x2 != NULL) {
+		memcpy(t1, x2, mlen);
+		br_i15_from_monty(t1, curr_m, m0i);
+		br_i15_reduce(x2, t1, m);
+	}
+	return 1;
+}
+
+/* see inner.h */
+uint32_t
+br_i15_modpow_opt_rand(const br_prng_class **rng, uint16_t *x,
+	const unsigned char *e, size_t elen,
+	const uint16_t *m, uint16_t m0i, uint16_t *tmp, size_t twlen)
+{
+	(void)m0i;
+	return modpow_rand(rng, x, NULL, e, elen, NULL, 0, m, tmp, twlen);
+}
+
+/* see inner.h */
+uint32_t
+br_i15_double_modpow_opt_rand(const br_prng_class **rng,
+	uint16_t *x1, uint16_t *x2,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint16_t *m, uint16_t m0i, uint16_t *tmp, size_t twlen)
+{
+	(void)m0i;
+	return modpow_rand(rng, x1, x2, e1, elen1, e2, elen2, m, tmp, twlen);
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2018 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+/*
+ * Modular division with the "safegcd" algorithm of Bernstein and Yang
+ * (https://eprint.iacr.org/2019/266), by batches of 30 divsteps. This
+ * is the portable variant of br_i62_modinv(): transition matrices have
+ * 32-bit coefficients, and products are 64-bit.
+ *
+ * Values are signed integers over 'num' limbs of 30 bits (int32_t); all
+ * limbs are in 0..2^30-1, except the top one, which is signed.
+ */
+
+#define M30   ((uint32_t)0x3FFFFFFF)
+
+/*
+ * Arithmetic right shift of a signed 64-bit value (see ARSH() in
+ * inner.h).
+ */
+#if BR_NO_ARITH_SHIFT
+#define ARSH64(x, n)   ((int64_t)(((uint64_t)(x) >> (n)) \
+                       | ((-((uint64_t)(x) >> 63)) << (64 - (n)))))
+#else
+#define ARSH64(x, n)   ((x) >> (n))
+#endif
+
+/*
+ * Perform 30 divsteps on the low limbs f0 and g0; see divsteps_62() in
+ * i62_modinv.c.
+ */
+static int32_t
+divsteps_30(int32_t delta, uint32_t f0, uint32_t g0, int32_t *t)
+{
+	uint32_t u, v, q, r, f, g;
+	int i;
+
+	u = 1;
+	v = 0;
+	q = 0;
+	r = 1;
+	f = f0;
+	g = g0;
+	for (i = 0; i < 30; i ++) {
+		uint32_t c1, c2, x, y, z;
+
+		c1 = -(((uint32_t)-delta) >> 31);
+		c2 = -(g & 1);
+		x = (f ^ c1) - c1;
+		y = (u ^ c1) - c1;
+		z = (v ^ c1) - c1;
+		g += x & c2;
+		q += y & c2;
+		r += z & c2;
+		c1 &= c2;
+		delta = (int32_t)(((uint32_t)delta ^ c1) - c1) + 1;
+		f += g & c1;
+		u += q & c1;
+		v += r & c1;
+		g >>= 1;
+		u <<= 1;
+		v <<= 1;
+	}
+	t[0] = (int32_t)u;
+	t[1] = (int32_t)v;
+	t[2] = (int32_t)q;
+	t[3] = (int32_t)r;
+	return delta;
+}
+
+static void
+update_fg_30(int32_t *f, int32_t *g, size_t num, const int32_t *t)
+{
+	int64_t cf, cg;
+	size_t i;
+
+	cf = (int64_t)t[0] * f[0] + (int64_t)t[1] * g[0];
+	cg = (int64_t)t[2] * f[0] + (int64_t)t[3] * g[0];
+	cf = ARSH64(cf, 30);
+	cg = ARSH64(cg, 30);
+	for (i = 1; i < num; i ++) {
+		cf += (int64_t)t[0] * f[i] + (int64_t)t[1] * g[i];
+		cg += (int64_t)t[2] * f[i] + (int64_t)t[3] * g[i];
+		f[i - 1] = (int32_t)((uint32_t)cf & M30);
+		g[i - 1] = (int32_t)((uint32_t)cg & M30);
+		cf = ARSH64(cf, 30);
+		cg = ARSH64(cg, 30);
+	}
+	f[num - 1] = (int32_t)cf;
+	g[num - 1] = (int32_t)cg;
+}
+
+/*
+ * The modulus is not converted to 30-bit limbs in t[] (this keeps the
+ * temporary area within the same size as for br_i62_modinv()): its
+ * limbs are extracted on the fly from the i31 words, in ascending
+ * order.
+ */
+typedef struct {
+	const uint32_t *m;
+	size_t len, u;
+	uint64_t acc;
+	int acc_len;
+} limbs_30;
+
+static void
+limbs_30_init(limbs_30 *ls, const uint32_t *m)
+{
+	ls->m = m + 1;
+	ls->len = (m[0] + 31) >> 5;
+	ls->u = 0;
+	ls->acc = 0;
+	ls->acc_len = 0;
+}
+
+static int32_t
+limbs_30_next(limbs_30 *ls)
+{
+	int32_t w;
+
+	while (ls->acc_len < 30) {
+		uint64_t z;
+
+		z = ls->u < ls->len ? (uint64_t)ls->m[ls->u ++] : 0;
+		ls->acc |= z << ls->acc_len;
+		ls->acc_len += 31;
+	}
+	w = (int32_t)((uint32_t)ls->acc & M30);
+	ls->acc >>= 30;
+	ls->acc_len -= 30;
+	return w;
+}
+
+/*
+ * Apply the transition matrix to (d, e), modulo m; minv = 1/m mod 2^30.
+ * See update_de_62() in i62_modinv.c.
+ */
+static void
+update_de_30(int32_t *d, int32_t *e, size_t num, const int32_t *t,
+	const uint32_t *m, uint32_t minv)
+{
+	int32_t sd, se, md, me, mw;
+	int64_t cd, ce;
+	size_t i;
+	limbs_30 ls;
+
+	sd = -(int32_t)((uint32_t)d[num - 1] >> 31);
+	se = -(int32_t)((uint32_t)e[num - 1] >> 31);
+	md = (t[0] & sd) + (t[1] & se);
+	me = (t[2] & sd) + (t[3] & se);
+	cd = (int64_t)t[0] * d[0] + (int64_t)t[1] * e[0];
+	ce = (int64_t)t[2] * d[0] + (int64_t)t[3] * e[0];
+	md -= (int32_t)((minv * (uint32_t)cd + (uint32_t)md) & M30);
+	me -= (int32_t)((minv * (uint32_t)ce + (uint32_t)me) & M30);
+	limbs_30_init(&ls, m);
+	mw = limbs_30_next(&ls);
+	cd += (int64_t)mw * md;
+	ce += (int64_t)mw * me;
+	cd = ARSH64(cd, 30);
+	ce = ARSH64(ce, 30);
+	for (i = 1; i < num; i ++) {
+		mw = limbs_30_next(&ls);
+		cd += (int64_t)t[0] * d[i] + (int64_t)t[1] * e[i]
+			+ (int64_t)mw * md;
+		ce += (int64_t)t[2] * d[i] + (int64_t)t[3] * e[i]
+			+ (int64_t)mw * me;
+		d[i - 1] = (int32_t)((uint32_t)cd & M30);
+		e[i - 1] = (int32_t)((uint32_t)ce & M30);
+		cd = ARSH64(cd, 30);
+		ce = ARSH64(ce, 30);
+	}
+	d[num - 1] = (int32_t)cd;
+	e[num - 1] = (int32_t)ce;
+}
+
+/*
+ * Conditionally negate a (ctl = -1) or keep it unchanged (ctl = 0).
+ */
+static void
+cond_negate_30(int32_t *a, size_t num, int32_t ctl)
+{
+	int32_t cc;
+	size_t i;
+
+	cc = ctl & 1;
+	for (i = 0; i + 1 < num; i ++) {
+		cc += a[i] ^ (ctl & (int32_t)M30);
+		a[i] = (int32_t)((uint32_t)cc & M30);
+		cc = (int32_t)((uint32_t)cc >> 30);
+	}
+	a[num - 1] = (a[num - 1] ^ ctl) + cc;
+}
+
+/*
+ * Add m to a if a is negative.
+ */
+static void
+cond_add_30(int32_t *a, const uint32_t *m, size_t num)
+{
+	int32_t cc, sm;
+	size_t i;
+	limbs_30 ls;
+
+	sm = -(int32_t)((uint32_t)a[num - 1] >> 31);
+	cc = 0;
+	limbs_30_init(&ls, m);
+	for (i = 0; i + 1 < num; i ++) {
+		cc += a[i] + (limbs_30_next(&ls) & sm);
+		a[i] = (int32_t)((uint32_t)cc & M30);
+		cc = (int32_t)((uint32_t)cc >> 30);
+	}
+	a[num - 1] += (limbs_30_next(&ls) & sm) + cc;
+}
+
+/*
+ * Convert an i31 integer (with its header word) into num signed 30-bit
+ * limbs (nonnegative value).
+ */
+static void
+from_i31(int32_t *d, const uint32_t *x, size_t num)
+{
+	size_t len, u, v;
+	uint64_t acc;
+	int acc_len;
+
+	len = (x[0] + 31) >> 5;
+	acc = 0;
+	acc_len = 0;
+	v = 0;
+	for (u = 0; u < len; u ++) {
+		acc |= (uint64_t)x[u + 1] << acc_len;
+		acc_len += 31;
+		while (acc_len >= 30 && v < num) {
+			d[v ++] = (int32_t)((uint32_t)acc & M30);
+			acc >>= 30;
+			acc_len -= 30;
+		}
+	}
+	while (v < num) {
+		d[v ++] = (int32_t)((uint32_t)acc & M30);
+		acc >>= 30;
+	}
+}
+
+/*
+ * Convert num nonnegative 30-bit limbs into an i31 integer; the header
+ * word of x is used for the size, but not modified.
+ */
+static void
+to_i31(uint32_t *x, const int32_t *a, size_t num)
+{
+	size_t len, u, v;
+	uint64_t acc;
+	int acc_len;
+
+	len = (x[0] + 31) >> 5;
+	acc = 0;
+	acc_len = 0;
+	v = 0;
+	for (u = 0; u < len; u ++) {
+		while (acc_len < 31) {
+			uint64_t w;
+
+			w = v < num ? (uint64_t)(uint32_t)a[v ++] : 0;
+			acc |= w << acc_len;
+			acc_len += 30;
+		}
+		x[u + 1] = (uint32_t)acc & 0x7FFFFFFF;
+		acc >>= 31;
+		acc_len -= 31;
+	}
+}
+
+/* see inner.h */
+uint32_t
+br_i31_modinv(uint32_t *x, const uint32_t *y, const uint32_t *m, uint32_t *t)
+{
+	int32_t *f, *g, *d, *e;
+	int32_t delta, tr[4], sf;
+	uint32_t minv, z, mbits;
+	size_t num, n, i;
+
+	mbits = m[0] - (m[0] >> 5);
+	num = (mbits + 31) / 30;
+	f = (int32_t *)t;
+	g = f + num;
+	d = g + num;
+	e = d + num;
+	from_i31(f, m, num);
+	from_i31(g, y, num);
+	from_i31(e, x, num);
+	memset(d, 0, num * sizeof *d);
+
+	/*
+	 * minv = 1/m mod 2^30 (Newton iteration, from 5 correct bits).
+	 */
+	minv = (3 * (uint32_t)f[0]) ^ 2;
+	for (i = 0; i < 3; i ++) {
+		minv *= 2 - (uint32_t)f[0] * minv;
+	}
+	minv &= M30;
+
+	/*
+	 * Same invariants and number of divsteps as br_i62_modinv().
+	 */
+	if (mbits < 46) {
+		n = (49 * (size_t)mbits + 80) / 17;
+	} else {
+		n = (49 * (size_t)mbits + 57) / 17;
+	}
+	delta = 1;
+	for (i = 0; i < n; i += 30) {
+		delta = divsteps_30(delta, (uint32_t)f[0], (uint32_t)g[0], tr);
+		update_fg_30(f, g, num, tr);
+		update_de_30(d, e, num, tr, m, minv);
+	}
+
+	sf = -(int32_t)((uint32_t)f[num - 1] >> 31);
+	cond_negate_30(f, num, sf);
+	z = (uint32_t)f[0] ^ 1;
+	for (i = 1; i < num; i ++) {
+		z |= (uint32_t)f[i];
+	}
+	cond_add_30(d, m, num);
+	cond_negate_30(d, num, sf);
+	cond_add_30(d, m, num);
+	to_i31(x, d, num);
+	return EQ0(z);
+}
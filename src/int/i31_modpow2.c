@@ -31,8 +31,7 @@ br_i31_modpow_opt(uint32_t *x,
 	const uint32_t *m, uint32_t m0i, uint32_t *tmp, size_t twlen)
 {
 	size_t mlen, mwlen;
-	uint32_t *t1, *t2, *base;
-	size_t u, v;
+	uint32_t *t1, *t2;
 	uint32_t acc;
 	int acc_len, win_len;
 
@@ -46,19 +45,15 @@ br_i31_modpow_opt(uint32_t *x,
 	t2 = tmp + mwlen;
 
 	/*
-	 * Compute possible window size, with a maximum of 5 bits.
-	 * When the window has size 1 bit, we use a specific code
-	 * that requires only two temporaries. Otherwise, for a
-	 * window of k bits, we need 2^k+1 temporaries.
+	 * Compute the window size (see br_i31_window_len()). When the
+	 * window has size 1 bit, we use a specific code that requires
+	 * only two temporaries. Otherwise, for a window of k bits, we
+	 * need 2^k+1 temporaries.
 	 */
 	if (twlen < (mwlen << 1)) {
 		return 0;
 	}
-	for (win_len = 5; win_len > 1; win_len --) {
-		if ((((uint32_t)1 << win_len) + 1) * mwlen <= twlen) {
-			break;
-		}
-	}
+	win_len = br_i31_window_len(elen << 3, mwlen, twlen);
 
 	/*
 	 * Everything is done in Montgomery representation.
@@ -67,18 +62,13 @@ br_i31_modpow_opt(uint32_t *x,
 
 	/*
 	 * Compute window contents. If the window has size one bit only,
-	 * then t2 is set to x; otherwise, t2[0] is left untouched, and
-	 * t2[k] is set to x^k (for k >= 1).
+	 * then t2 is set to x; otherwise, the table after t2 receives
+	 * x^k (for k >= 1), word-interleaved.
 	 */
 	if (win_len == 1) {
 		memcpy(t2, x, mlen);
 	} else {
-		memcpy(t2 + mwlen, x, mlen);
-		base = t2 + mwlen;
-		for (u = 2; u < ((unsigned)1 << win_len); u ++) {
-			br_i31_montymul(base + mwlen, base, x, m, m0i);
-			base += mwlen;
-		}
+		br_i31_wtab_build(t2 + mwlen, win_len, x, m, m0i, mwlen, t1);
 	}
 
 	/*
@@ -120,7 +110,7 @@ br_i31_modpow_opt(uint32_t *x,
 		 * We could get exactly k bits. Compute k squarings.
 		 */
 		for (i = 0; i < k; i ++) {
-			br_i31_montymul(t1, x, x, m, m0i);
+			br_i31_montysqr(t1, x, m, m0i);
 			memcpy(x, t1, mlen);
 		}
 
@@ -131,17 +121,8 @@ br_i31_modpow_opt(uint32_t *x,
 		 * already set; otherwise, we do a constant-time lookup.
 		 */
 		if (win_len > 1) {
-			br_i31_zero(t2, m[0]);
-			base = t2 + mwlen;
-			for (u = 1; u < ((uint32_t)1 << k); u ++) {
-				uint32_t mask;
-
-				mask = -EQ(u, bits);
-				for (v = 1; v < mwlen; v ++) {
-					t2[v] |= mask & base[v];
-				}
-				base += mwlen;
-			}
+			br_i31_wtab_get(t2, t2 + mwlen, win_len, bits,
+				mwlen, m[0]);
 		}
 
 		/*
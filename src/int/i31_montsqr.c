@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "inner.h"
+
+/*
+ * Largest modulus (in words) handled with the dedicated code; this
+ * covers RSA moduli and their randomized multiples. Larger moduli use
+ * br_i31_montymul().
+ */
+#define SQR_MAXLEN   ((BR_MAX_RSA_SIZE + 256 + 30) / 31)
+
+/*
+ * Add a[i]*b[-i] for i = 0 to n-1 to the column accumulator (lo, hi):
+ * lo receives the low 31 bits of the added values, hi the high bits.
+ * Since a product is less than 2^62, four of them can be added
+ * together before being split.
+ */
+static inline void
+dot_rev(uint64_t *acc, const uint32_t *a, const uint32_t *b, size_t n)
+{
+	uint64_t lo, hi, z;
+
+	lo = acc[0];
+	hi = acc[1];
+	if ((n & 1) != 0) {
+		z = MUL31(a[0], b[0]);
+		lo += z & 0x7FFFFFFF;
+		hi += z >> 31;
+		a ++;
+		b --;
+	}
+	if ((n & 2) != 0) {
+		z = MUL31(a[0], b[0]) + MUL31(a[1], b[-1]);
+		lo += z & 0x7FFFFFFF;
+		hi += z >> 31;
+		a += 2;
+		b -= 2;
+	}
+	for (n >>= 2; n > 0; n --, a += 4, b -= 4) {
+		z = MUL31(a[0], b[0]) + MUL31(a[1], b[-1])
+			+ MUL31(a[2], b[-2]) + MUL31(a[3], b[-3]);
+		lo += z & 0x7FFFFFFF;
+		hi += z >> 31;
+	}
+	acc[0] = lo;
+	acc[1] = hi;
+}
+
+/* see inner.h */
+void
+br_i31_montysqr(uint32_t *d, const uint32_t *x,
+	const uint32_t *m, uint32_t m0i)
+{
+	/*
+	 * Product scanning: output column k receives all x[i]*x[j] and
+	 * f[i]*m[j] with i+j = k. Cross products x[i]*x[j] (i < j) are
+	 * computed once and doubled, so the square uses len*(len+1)/2
+	 * products instead of len^2. For k < len, the Montgomery factor
+	 * f[k] is chosen to clear the column; for k >= len, the column
+	 * is the output word d[k-len+1]. The result is x^2/R mod m, in
+	 * the same range as with br_i31_montymul().
+	 */
+	uint32_t f[SQR_MAXLEN];
+	uint64_t acc[2];
+	size_t len, k;
+
+	len = (m[0] + 31) >> 5;
+	if (len > SQR_MAXLEN) {
+		br_i31_montymul(d, x, x, m, m0i);
+		return;
+	}
+
+	x ++;
+	m ++;
+	acc[0] = 0;
+	acc[1] = 0;
+	for (k = 0; k < 2 * len - 1; k ++) {
+		uint64_t xa[2], z;
+		size_t i0;
+
+		i0 = k < len ? 0 : k - len + 1;
+
+		/*
+		 * Cross products x[i]*x[j], i < j, i+j = k; then the
+		 * square x[k/2]^2.
+		 */
+		xa[0] = 0;
+		xa[1] = 0;
+		dot_rev(xa, x + i0, x + k - i0, (k + 1) / 2 - i0);
+		acc[0] += xa[0] << 1;
+		acc[1] += xa[1] << 1;
+		if ((k & 1) == 0) {
+			z = MUL31(x[k >> 1], x[k >> 1]);
+			acc[0] += z & 0x7FFFFFFF;
+			acc[1] += z >> 31;
+		}
+
+		/*
+		 * Reduction products f[i]*m[j], i+j = k, i < min(k, len).
+		 */
+		dot_rev(acc, f + i0, m + k - i0, (k < len ? k : len) - i0);
+		if (k < len) {
+			uint32_t fk;
+
+			fk = MUL31_lo((uint32_t)acc[0], m0i);
+			f[k] = fk;
+			z = MUL31(fk, m[0]);
+			acc[0] += z & 0x7FFFFFFF;
+			acc[1] += z >> 31;
+		} else {
+			d[k - len + 1] = (uint32_t)acc[0] & 0x7FFFFFFF;
+		}
+		acc[0] = acc[1] + (acc[0] >> 31);
+		acc[1] = 0;
+	}
+
+	/*
+	 * The last carry holds the top word; its bit 31 is set if the
+	 * result is not lower than 2^(31*len), which triggers the final
+	 * subtraction.
+	 */
+	d[0] = m[-1];
+	d[len] = (uint32_t)acc[0] & 0x7FFFFFFF;
+	br_i31_sub(d, m - 1, NEQ((uint32_t)(acc[0] >> 31), 0)
+		| NOT(br_i31_sub(d, m - 1, 0)));
+}
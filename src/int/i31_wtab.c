@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "inner.h"
+
+/* see inner.h */
+int
+br_i31_window_len(size_t ebits, size_t mwlen, size_t twlen)
+{
+	uint32_t best_cost;
+	int k, best;
+
+	/*
+	 * Cost model, in word operations divided by mwlen: a Montgomery
+	 * multiplication counts for about 4*mwlen, and a table lookup
+	 * reads all 2^k-1 entries once. Each window needs one lookup and
+	 * one multiplication; the table costs 2^k-2 multiplications.
+	 * Squarings do not depend on the window size.
+	 */
+	best = 1;
+	best_cost = 0xFFFFFFFF;
+	for (k = 1; k <= BR_I31_MAX_WINDOW; k ++) {
+		uint32_t nwin, cost;
+
+		if (k > 1 && (((size_t)1 << k) + 1) * mwlen > twlen) {
+			break;
+		}
+		nwin = (uint32_t)((ebits + k - 1) / k);
+		cost = nwin * (4 * (uint32_t)mwlen + ((uint32_t)1 << k))
+			+ (((uint32_t)1 << k) - 2) * 4 * (uint32_t)mwlen;
+		if (k == 1) {
+			cost = nwin * 4 * (uint32_t)mwlen;
+		}
+		if (cost < best_cost) {
+			best = k;
+			best_cost = cost;
+		}
+	}
+	return best;
+}
+
+/* see inner.h */
+void
+br_i31_wtab_build(uint32_t *tab, int k, const uint32_t *x,
+	const uint32_t *m, uint32_t m0i, size_t mwlen, uint32_t *t)
+{
+	size_t stride, u, v;
+	uint32_t *cur, *nxt;
+
+	/*
+	 * Entry u (1 <= u < 2^k) is x^u; word v (1 <= v < mwlen) of that
+	 * entry goes to tab[(v - 1) * stride + (u - 1)], so that all
+	 * entries for a given word are adjacent.
+	 */
+	stride = ((size_t)1 << k) - 1;
+	cur = t;
+	nxt = t + mwlen;
+	memset(t, 0, 2 * mwlen * sizeof *t);
+	memcpy(cur, x, ((m[0] + 63) >> 5) * sizeof *x);
+	for (u = 1;; u ++) {
+		uint32_t *w;
+
+		for (v = 1; v < mwlen; v ++) {
+			tab[(v - 1) * stride + (u - 1)] = cur[v];
+		}
+		if (u == stride) {
+			break;
+		}
+		br_i31_montymul(nxt, cur, x, m, m0i);
+		w = cur;
+		cur = nxt;
+		nxt = w;
+	}
+}
+
+/* see inner.h */
+void
+br_i31_wtab_get(uint32_t *d, const uint32_t *tab, int k, uint32_t bits,
+	size_t mwlen, uint32_t bitlen)
+{
+	uint32_t mask[1 << BR_I31_MAX_WINDOW];
+	size_t stride, u, v;
+	const uint32_t *row;
+
+	/*
+	 * The selection masks only depend on the window value; every
+	 * table word is read once, in memory order.
+	 */
+	stride = ((size_t)1 << k) - 1;
+	for (u = 0; u < stride; u ++) {
+		mask[u] = -EQ((uint32_t)u + 1, bits);
+	}
+	br_i31_zero(d, bitlen);
+	row = tab;
+	for (v = 1; v < mwlen; v ++) {
+		uint32_t w;
+
+		w = 0;
+		for (u = 0; u < stride; u ++) {
+			w |= row[u] & mask[u];
+		}
+		d[v] = w;
+		row += stride;
+	}
+}
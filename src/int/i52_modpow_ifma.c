@@ -0,0 +1,700 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define BR_ENABLE_INTRINSICS   1
+#include "inner.h"
+
+/*
+ * This is the modular exponentiation code that leverages the AVX-512
+ * IFMA opcodes (vpmadd52luq / vpmadd52huq). Integers are represented
+ * over 52-bit limbs (in 64-bit words, without header word), and a
+ * Montgomery multiplication processes eight limbs per opcode.
+ *
+ * The exponentiation logic (windows, modulus randomization) follows
+ * the i62 code; only the limb size and the multiplication differ.
+ */
+
+#if BR_AVX512IFMA
+
+/*
+ * Test CPU support for AVX-512F and AVX-512 IFMA, and OS support for
+ * the AVX-512 register state.
+ */
+static int
+ifma_supported(void)
+{
+	/*
+	 * Bit mask for features in EBX (leaf 7):
+	 *   16   AVX-512F
+	 *   21   AVX-512 IFMA
+	 * Bit mask for XCR0:
+	 *   1-2  SSE and AVX state
+	 *   5-7  AVX-512 state (opmask, ZMM0-15 high, ZMM16-31)
+	 */
+	return br_cpuid7(0x00210000, 0, 0) && br_xcr0(0x000000E6);
+}
+
+#define MASK52   ((uint64_t)0x000FFFFFFFFFFFFF)
+
+/*
+ * Largest modulus size (in 52-bit limbs), and matching number of
+ * 512-bit vectors. This covers RSA moduli and their randomized
+ * multiples.
+ */
+#define I52_MAXNUM   ((BR_MAX_RSA_SIZE + 256 + 51) / 52)
+#define I52_MAXNV    ((I52_MAXNUM + 7) >> 3)
+
+/*
+ * Arrays of 52-bit limbs use a stride which is a multiple of 8, so that
+ * full vectors may be read; the extra limbs are zero.
+ */
+#define STRIDE(num)   (((num) + 7) & ~(size_t)7)
+
+/*
+ * Subtract b from a, and return the final carry. If 'ctl32' is 0, then
+ * a[] is kept unmodified, but the final carry is still computed and
+ * returned.
+ */
+static uint32_t
+i52_sub(uint64_t *a, const uint64_t *b, size_t num, uint32_t ctl32)
+{
+	uint64_t cc, mask;
+	size_t u;
+
+	cc = 0;
+	ctl32 = -ctl32;
+	mask = (uint64_t)ctl32 | ((uint64_t)ctl32 << 32);
+	for (u = 0; u < num; u ++) {
+		uint64_t aw, bw, dw;
+
+		aw = a[u];
+		bw = b[u];
+		dw = aw - bw - cc;
+		cc = dw >> 63;
+		dw &= MASK52;
+		a[u] = aw ^ (mask & (dw ^ aw));
+	}
+	return (uint32_t)cc;
+}
+
+BR_TARGETS_X86_UP
+
+/*
+ * Montgomery multiplication: d <- a*b/R mod m, with R = 2^(52*num).
+ * Operands must be lower than R; the output is lower than R (and
+ * lower than m if both operands are lower than m). The destination
+ * may be the same array as a or b. All arrays have STRIDE(num) limbs.
+ *
+ * Each step adds the low halves of a*b[i] and m*y (y being chosen so
+ * that the lowest limb becomes a multiple of 2^52), moves all limbs
+ * one lane down, then adds the high halves of the same products. Limbs
+ * are not normalized during the loop: each receives less than 2^54
+ * per step, so 64-bit lanes cannot overflow for I52_MAXNUM limbs.
+ */
+BR_TARGET("avx512f,avx512ifma")
+static void
+montymul52(uint64_t *d, const uint64_t *a, const uint64_t *b,
+	const uint64_t *m, size_t num, uint64_t m0i)
+{
+	__m512i acc[I52_MAXNV], av[I52_MAXNV], mv[I52_MAXNV];
+	uint64_t t[I52_MAXNV << 3];
+	size_t nv, u, k;
+	uint64_t cc, m0;
+
+	nv = (num + 7) >> 3;
+	for (k = 0; k < nv; k ++) {
+		acc[k] = _mm512_setzero_si512();
+		av[k] = _mm512_loadu_si512((const void *)(a + (k << 3)));
+		mv[k] = _mm512_loadu_si512((const void *)(m + (k << 3)));
+	}
+	m0 = m[0];
+	for (u = 0; u < num; u ++) {
+		__m512i bi, yi;
+		uint64_t a0, y;
+
+		bi = _mm512_set1_epi64((long long)b[u]);
+		for (k = 0; k < nv; k ++) {
+			acc[k] = _mm512_madd52lo_epu64(acc[k], av[k], bi);
+		}
+		a0 = (uint64_t)_mm_cvtsi128_si64(
+			_mm512_castsi512_si128(acc[0]));
+		y = (a0 * m0i) & MASK52;
+		yi = _mm512_set1_epi64((long long)y);
+		for (k = 0; k < nv; k ++) {
+			acc[k] = _mm512_madd52lo_epu64(acc[k], mv[k], yi);
+		}
+
+		/*
+		 * The low limb is now a multiple of 2^52; its high bits
+		 * are carried into the next limb, after the shift.
+		 */
+		cc = (a0 + ((m0 * y) & MASK52)) >> 52;
+		for (k = 0; k + 1 < nv; k ++) {
+			acc[k] = _mm512_alignr_epi64(acc[k + 1], acc[k], 1);
+		}
+		acc[nv - 1] = _mm512_alignr_epi64(
+			_mm512_setzero_si512(), acc[nv - 1], 1);
+		acc[0] = _mm512_add_epi64(acc[0],
+			_mm512_maskz_set1_epi64(1, (long long)cc));
+		for (k = 0; k < nv; k ++) {
+			acc[k] = _mm512_madd52hi_epu64(acc[k], av[k], bi);
+			acc[k] = _mm512_madd52hi_epu64(acc[k], mv[k], yi);
+		}
+	}
+
+	/*
+	 * Normalize limbs; the value is lower than R+m, so the final
+	 * carry is 0 or 1, and a single subtraction is enough.
+	 */
+	for (k = 0; k < nv; k ++) {
+		_mm512_storeu_si512((void *)(t + (k << 3)), acc[k]);
+	}
+	cc = 0;
+	for (u = 0; u < num; u ++) {
+		uint64_t z;
+
+		z = t[u] + cc;
+		d[u] = z & MASK52;
+		cc = z >> 52;
+	}
+	for (; u < (nv << 3); u ++) {
+		d[u] = 0;
+	}
+	i52_sub(d, m, num, (uint32_t)cc | NOT(i52_sub(d, m, num, 0)));
+}
+
+BR_TARGETS_X86_DOWN
+
+/*
+ * Convert an integer in 31-bit words (with its header word) into an
+ * array of STRIDE(num) 52-bit limbs. The integer must fit in num limbs.
+ */
+static void
+i31_to_i52(uint64_t *d, const uint32_t *s31, size_t num)
+{
+	size_t u, len31;
+
+	len31 = (s31[0] + 31) >> 5;
+	for (u = 0; u < STRIDE(num); u ++) {
+		size_t q, r;
+		uint64_t w;
+
+		q = (52 * u) / 31;
+		r = (52 * u) % 31;
+		w = 0;
+		if (q < len31) {
+			w = (uint64_t)s31[q + 1] >> r;
+		}
+		if (q + 1 < len31) {
+			w |= (uint64_t)s31[q + 2] << (31 - r);
+		}
+		if (q + 2 < len31) {
+			w |= (uint64_t)s31[q + 3] << (62 - r);
+		}
+		d[u] = w & MASK52;
+	}
+}
+
+/*
+ * Reverse of i31_to_i52(); the header word of d31 is used for the
+ * size, but not modified.
+ */
+static void
+i52_to_i31(uint32_t *d31, const uint64_t *s, size_t num)
+{
+	size_t u, len31;
+
+	len31 = (d31[0] + 31) >> 5;
+	for (u = 0; u < len31; u ++) {
+		size_t q, r;
+		uint64_t w;
+
+		q = (31 * u) / 52;
+		r = (31 * u) % 52;
+		w = 0;
+		if (q < num) {
+			w = s[q] >> r;
+		}
+		if (q + 1 < num) {
+			w |= s[q + 1] << (52 - r);
+		}
+		d31[u + 1] = (uint32_t)w & 0x7FFFFFFF;
+	}
+}
+
+/*
+ * Compute -(1/m) mod 2^52 from -(1/m) mod 2^31.
+ */
+static uint64_t
+ninv52(uint64_t m0, uint32_t m0i31)
+{
+	uint64_t m0i;
+
+	m0i = (uint64_t)m0i31;
+	return (m0i * ((uint64_t)2 + m0i * m0)) & MASK52;
+}
+
+/*
+ * Compute R^2 mod m (R = 2^(52*num)) into r2; m has bit length
+ * 'bitlen' (its top bit is set). This starts from 2^(bitlen-1) and
+ * doubles up to R*2^(13*num) mod m, then squares twice. t[] must have
+ * STRIDE(num) limbs.
+ */
+static void
+make_r2(uint64_t *r2, const uint64_t *m, size_t num, uint32_t bitlen,
+	uint64_t m0i, uint64_t *t)
+{
+	size_t u, v;
+
+	memset(r2, 0, STRIDE(num) * sizeof *r2);
+	r2[(bitlen - 1) / 52] = (uint64_t)1 << ((bitlen - 1) % 52);
+	for (u = bitlen - 1; u < 65 * num; u ++) {
+		uint64_t cc;
+
+		cc = 0;
+		for (v = 0; v < num; v ++) {
+			uint64_t z;
+
+			z = (r2[v] << 1) | cc;
+			cc = z >> 52;
+			r2[v] = z & MASK52;
+		}
+		i52_sub(r2, m, num, (uint32_t)cc | NOT(i52_sub(r2, m, num, 0)));
+	}
+	montymul52(t, r2, r2, m, num, m0i);
+	montymul52(r2, t, t, m, num, m0i);
+}
+
+/*
+ * Constant-time window lookup: d <- tab[bits-1] (entries have
+ * STRIDE(num) limbs each, for values 1 to 2^k-1); d is set to zero if
+ * bits is 0.
+ */
+static void
+window_lookup(uint64_t *d, const uint64_t *tab, int k, uint32_t bits,
+	size_t num)
+{
+	size_t stride, u, v;
+
+	stride = STRIDE(num);
+	memset(d, 0, stride * sizeof *d);
+	for (u = 1; u < ((size_t)1 << k); u ++) {
+		uint64_t mask;
+
+		mask = -(uint64_t)EQ((uint32_t)u, bits);
+		for (v = 0; v < num; v ++) {
+			d[v] |= mask & tab[v];
+		}
+		tab += stride;
+	}
+}
+
+/*
+ * Multiply x by the window value t2 (already looked up), keeping the
+ * product only if bits is not zero.
+ */
+static void
+window_mul(uint64_t *x, const uint64_t *t2, uint64_t *t1, uint32_t bits,
+	const uint64_t *m, size_t num, uint64_t m0i)
+{
+	uint64_t mask1, mask2;
+	size_t u;
+
+	montymul52(t1, x, t2, m, num, m0i);
+	mask1 = -(uint64_t)EQ(bits, 0);
+	mask2 = ~mask1;
+	for (u = 0; u < num; u ++) {
+		x[u] = (mask1 & x[u]) | (mask2 & t1[u]);
+	}
+}
+
+/* see inner.h */
+uint32_t
+br_i52_modpow_opt(uint32_t *x31, const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint32_t *tmp32, size_t twlen)
+{
+	size_t u, num, stride;
+	uint64_t *tmp, *x, *m, *r2, *t1, *t2;
+	uint64_t m0i;
+	uint32_t acc;
+	int win_len, acc_len;
+
+	/*
+	 * Temporaries are counted in 64-bit words from now on. We need
+	 * the modulus, the operand, R^2 and two temporaries, and at
+	 * least one window slot. Small moduli, and moduli beyond the
+	 * supported size, use the i62 code.
+	 */
+	tmp = (uint64_t *)tmp32;
+	twlen >>= 1;
+	num = (m31[0] - (m31[0] >> 5) + 51) / 52;
+	stride = STRIDE(num);
+	if (num < 4 || num > I52_MAXNUM || 6 * stride > twlen) {
+		return br_i62_modpow_opt(x31, e, elen, m31, m0i31,
+			tmp, twlen);
+	}
+	m = tmp;
+	x = m + stride;
+	r2 = x + stride;
+	t1 = r2 + stride;
+	t2 = t1 + stride;
+	tmp = t2 + stride;
+	twlen -= 5 * stride;
+	for (win_len = 5; win_len > 1; win_len --) {
+		if ((((uint32_t)1 << win_len) - 1) * stride <= twlen) {
+			break;
+		}
+	}
+
+	i31_to_i52(m, m31, num);
+	i31_to_i52(x, x31, num);
+	m0i = ninv52(m[0], m0i31);
+	make_r2(r2, m, num, m31[0] - (m31[0] >> 5), m0i, t1);
+
+	/*
+	 * Window contents: tmp[] receives x^1 to x^(2^k-1) (Montgomery
+	 * representation). For a 1-bit window, t2 is set to x.
+	 */
+	montymul52(x, x, r2, m, num, m0i);
+	memcpy(tmp, x, stride * sizeof *x);
+	for (u = 2; u < ((size_t)1 << win_len); u ++) {
+		montymul52(tmp + (u - 1) * stride, tmp + (u - 2) * stride,
+			x, m, num, m0i);
+	}
+	if (win_len == 1) {
+		memcpy(t2, x, stride * sizeof *x);
+	}
+
+	/*
+	 * Set x to 1, in Montgomery representation.
+	 */
+	memset(t1, 0, stride * sizeof *t1);
+	t1[0] = 1;
+	montymul52(x, t1, r2, m, num, m0i);
+
+	acc = 0;
+	acc_len = 0;
+	while (acc_len > 0 || elen > 0) {
+		int i, k;
+		uint32_t bits;
+
+		k = win_len;
+		if (acc_len < win_len) {
+			if (elen > 0) {
+				acc = (acc << 8) | *e ++;
+				elen --;
+				acc_len += 8;
+			} else {
+				k = acc_len;
+			}
+		}
+		bits = (acc >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		acc_len -= k;
+
+		for (i = 0; i < k; i ++) {
+			montymul52(x, x, x, m, num, m0i);
+		}
+		if (win_len > 1) {
+			window_lookup(t2, tmp, k, bits, num);
+		}
+		window_mul(x, t2, t1, bits, m, num, m0i);
+	}
+
+	/*
+	 * Convert back from Montgomery representation, then into 31-bit
+	 * words.
+	 */
+	memset(t1, 0, stride * sizeof *t1);
+	t1[0] = 1;
+	montymul52(x, x, t1, m, num, m0i);
+	i52_to_i31(x31, x, num);
+	return 1;
+}
+
+#define U2         (4 + ((BR_MAX_RSA_FACTOR + 30) / 31))
+#define TLEN_TMP   (4 * U2)
+
+/*
+ * Set curr_m[] (31-bit words, announced bit length 'bitlen') to m31*r,
+ * then m[] to the same value in 52-bit limbs; return -(1/m) mod 2^52.
+ */
+static uint64_t
+rand_modulus(uint64_t *m, uint32_t *curr_m, const uint32_t *m31,
+	const uint32_t *r, uint32_t bitlen, size_t num)
+{
+	br_i31_zero(curr_m, bitlen);
+	br_i31_mulacc(curr_m, m31, r);
+	curr_m[0] = bitlen;
+	i31_to_i52(m, curr_m, num);
+	return ninv52(m[0], br_i31_ninv31(curr_m[1]));
+}
+
+/*
+ * Randomized exponentiation core, shared by the single and double
+ * variants; this is the i62 modpow_rand() with 52-bit limbs. All
+ * values are kept below R = 2^(52*num) and congruent to the expected
+ * values modulo m31, while the modulus is m31*r with a fresh random r
+ * for each window. Returned value is 0 if the temporaries are too
+ * small, or the randomized modulus too large.
+ */
+static uint32_t
+modpow_rand(const br_prng_class **rng, uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint64_t *tmp, size_t twlen)
+{
+	size_t u, ei, mw31num, num, stride, elen, off1, off2, nwin;
+	uint64_t *m, *xa, *xb, *t1, *t2;
+	uint64_t m0i;
+	uint32_t acc1, acc2, bitlen, xlen;
+	int win_len, acc_len;
+	uint32_t curr_m[TLEN_TMP];
+	uint32_t r[((2 * BR_RSA_RAND_FACTOR) + 63) >> 5];
+	uint32_t new_r[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t pool[BR_RSA_RAND_POOL * BR_RSA_RAND_WLEN];
+	size_t pool_ptr, pool_len;
+
+	if (x31b == NULL) {
+		elen2 = 0;
+	}
+
+	/*
+	 * Initial randomized modulus. Its bit length is kept as the
+	 * announced length of all subsequent moduli, so that the
+	 * Montgomery factor stays the same.
+	 */
+	make_rand(rng, r, 2 * BR_RSA_RAND_FACTOR);
+	r[1] |= 1;
+	r[0] = br_i31_bit_length(r + 1, ((2 * BR_RSA_RAND_FACTOR) + 31) >> 5);
+	br_i31_zero(curr_m, m31[0]);
+	br_i31_mulacc(curr_m, m31, r);
+	bitlen = br_i31_bit_length(curr_m + 1, (curr_m[0] + 31) >> 5);
+	curr_m[0] = bitlen;
+	mw31num = (bitlen + 31) >> 5;
+	num = (bitlen - (bitlen >> 5) + 51) / 52;
+	stride = STRIDE(num);
+	if (num > I52_MAXNUM || 5 * stride > twlen) {
+		return 0;
+	}
+
+	xlen = (x31a[0] + 63) >> 5;
+	for (; xlen <= mw31num; xlen ++) {
+		x31a[xlen] = 0;
+	}
+	x31a[0] = bitlen;
+	m = tmp;
+	xa = m + stride;
+	xb = xa + stride;
+	t1 = xb + stride;
+	t2 = t1 + stride;
+	tmp = t2 + stride;
+	twlen -= 5 * stride;
+	for (win_len = 5; win_len > 1; win_len --) {
+		if ((((uint32_t)1 << win_len) - 1) * stride <= twlen) {
+			break;
+		}
+	}
+
+	/*
+	 * Operand in Montgomery representation (R^2 is computed in xb),
+	 * then window contents.
+	 */
+	i31_to_i52(m, curr_m, num);
+	i31_to_i52(xa, x31a, num);
+	m0i = ninv52(m[0], br_i31_ninv31(curr_m[1]));
+	make_r2(xb, m, num, bitlen - (bitlen >> 5), m0i, t1);
+	montymul52(xa, xa, xb, m, num, m0i);
+	memcpy(tmp, xa, stride * sizeof *xa);
+	for (u = 2; u < ((size_t)1 << win_len); u ++) {
+		montymul52(tmp + (u - 1) * stride, tmp + (u - 2) * stride,
+			xa, m, num, m0i);
+	}
+	if (win_len == 1) {
+		memcpy(t2, xa, stride * sizeof *xa);
+	}
+
+	/*
+	 * Accumulators start at 1 (Montgomery representation).
+	 */
+	memset(t1, 0, stride * sizeof *t1);
+	t1[0] = 1;
+	montymul52(xa, t1, xb, m, num, m0i);
+	memcpy(xb, xa, stride * sizeof *xa);
+
+	elen = elen1 > elen2 ? elen1 : elen2;
+	off1 = elen - elen1;
+	off2 = elen - elen2;
+	nwin = ((elen << 3) + win_len - 1) / win_len;
+	pool_ptr = 0;
+	pool_len = 0;
+
+	acc1 = 0;
+	acc2 = 0;
+	acc_len = 0;
+	ei = 0;
+	while (acc_len > 0 || ei < elen) {
+		int i, j, k;
+		uint32_t bits[2];
+		uint64_t *xx[2];
+
+		k = win_len;
+		if (acc_len < win_len) {
+			if (ei < elen) {
+				acc1 = (acc1 << 8)
+					| (ei >= off1 ? e1[ei - off1] : 0);
+				acc2 = (acc2 << 8)
+					| (ei >= off2 ? e2[ei - off2] : 0);
+				ei ++;
+				acc_len += 8;
+			} else {
+				k = acc_len;
+			}
+		}
+		bits[0] = (acc1 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		bits[1] = (acc2 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		acc_len -= k;
+		xx[0] = xa;
+		xx[1] = xb;
+
+		/*
+		 * Re-randomize the modulus for this window.
+		 */
+		make_rand_pooled(rng, new_r, pool, &pool_ptr, &pool_len,
+			nwin --);
+		m0i = rand_modulus(m, curr_m, m31, new_r, bitlen, num);
+
+		for (j = 0; j < (x31b == NULL ? 1 : 2); j ++) {
+			uint64_t *x;
+
+			x = xx[j];
+			for (i = 0; i < k; i ++) {
+				montymul52(x, x, x, m, num, m0i);
+			}
+			if (win_len > 1) {
+				window_lookup(t2, tmp, k, bits[j], num);
+			}
+			window_mul(x, t2, t1, bits[j], m, num, m0i);
+		}
+	}
+
+	/*
+	 * Convert back from Montgomery representation (with the initial
+	 * randomized modulus), then reduce modulo m31.
+	 */
+	m0i = rand_modulus(m, curr_m, m31, r, bitlen, num);
+	memset(t1, 0, stride * sizeof *t1);
+	t1[0] = 1;
+	montymul52(xa, xa, t1, m, num, m0i);
+	x31a[0] = bitlen;
+	i52_to_i31(x31a, xa, num);
+	if (x31b != NULL) {
+		montymul52(xb, xb, t1, m, num, m0i);
+		x31b[0] = bitlen;
+		i52_to_i31(x31b, xb, num);
+		br_i31_reduce(curr_m, x31b, m31);
+		memcpy(x31b, curr_m, ((m31[0] + 63) >> 5) * sizeof *curr_m);
+	}
+	br_i31_reduce(curr_m, x31a, m31);
+	memcpy(x31a, curr_m, ((m31[0] + 63) >> 5) * sizeof *curr_m);
+	return 1;
+}
+
+/* see inner.h */
+uint32_t
+br_i52_modpow_opt_rand(const br_prng_class **rng, uint32_t *x31,
+	const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint32_t *tmp, size_t twlen)
+{
+	if (modpow_rand(rng, x31, NULL, e, elen, NULL, 0, m31,
+		(uint64_t *)tmp, twlen >> 1))
+	{
+		return 1;
+	}
+	return br_i62_modpow_opt_rand_as_i31(rng, x31, e, elen,
+		m31, m0i31, tmp, twlen);
+}
+
+/* see inner.h */
+uint32_t
+br_i52_double_modpow_opt_rand(const br_prng_class **rng,
+	uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint32_t m0i31, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen)
+{
+	if (modpow_rand(rng, x31a, x31b, e1, elen1, e2, elen2, m31,
+		(uint64_t *)tmp, twlen >> 1))
+	{
+		return 1;
+	}
+	return br_i62_double_modpow_opt_rand_as_i31(rng, x31a, x31b,
+		e1, elen1, e2, elen2, m31, m0i31, r2, tmp, twlen);
+}
+
+/* see inner.h */
+br_i31_modpow_opt_type
+br_i52_modpow_opt_get(void)
+{
+	return ifma_supported() ? &br_i52_modpow_opt : 0;
+}
+
+/* see inner.h */
+br_i31_modpow_opt_rand_type
+br_i52_modpow_opt_rand_get(void)
+{
+	return ifma_supported() ? &br_i52_modpow_opt_rand : 0;
+}
+
+/* see inner.h */
+br_i31_double_modpow_opt_rand_type
+br_i52_double_modpow_opt_rand_get(void)
+{
+	return ifma_supported() ? &br_i52_double_modpow_opt_rand : 0;
+}
+
+#else
+
+/* see inner.h */
+br_i31_modpow_opt_type
+br_i52_modpow_opt_get(void)
+{
+	return 0;
+}
+
+/* see inner.h */
+br_i31_modpow_opt_rand_type
+br_i52_modpow_opt_rand_get(void)
+{
+	return 0;
+}
+
+/* see inner.h */
+br_i31_double_modpow_opt_rand_type
+br_i52_double_modpow_opt_rand_get(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define BR_ENABLE_INTRINSICS   1
+#include "inner.h"
+
+/*
+ * Multi-buffer modular exponentiation with AVX-512 IFMA: eight
+ * independent exponentiations, each with its own modulus and exponent,
+ * run in the eight 64-bit lanes of the AVX-512 registers.
+ *
+ * Integers are "transposed": limb v (52 bits) of lane j is word 8*v+j,
+ * so that one 512-bit vector holds the same limb of all eight values.
+ * All lanes use the same number of limbs (that of the largest modulus)
+ * and the same sequence of operations; only the data differs, so the
+ * whole computation runs as a single instruction stream.
+ */
+
+#if BR_AVX512IFMA
+
+/*
+ * Test CPU support for AVX-512F and AVX-512 IFMA, and OS support for
+ * the AVX-512 register state (see i52_modpow_ifma.c).
+ */
+static int
+ifma_supported(void)
+{
+	return br_cpuid7(0x00210000, 0, 0) && br_xcr0(0x000000E6);
+}
+
+#define MASK52   ((uint64_t)0x000FFFFFFFFFFFFF)
+
+/*
+ * Largest supported modulus size, in 52-bit limbs.
+ */
+#define MB_MAXNUM   ((BR_MAX_RSA_SIZE + 51) / 52)
+
+#define LD(p)      _mm512_loadu_si512((const void *)(p))
+#define ST(p, x)   _mm512_storeu_si512((void *)(p), (x))
+
+BR_TARGETS_X86_UP
+
+/*
+ * Final reduction of a value held in d[] (num normalized limbs per lane)
+ * plus an extra top bit per lane in 'hi': d <- d - m if the value is
+ * not lower than m. The value must be lower than 2*m. t[] receives
+ * num vectors (scratch).
+ */
+BR_TARGET("avx512f")
+static void
+cond_sub_mb(uint64_t *d, const uint64_t *m, __m512i hi,
+	size_t num, uint64_t *t)
+{
+	__m512i mask, cc;
+	__mmask8 keep;
+	size_t v;
+
+	mask = _mm512_set1_epi64(MASK52);
+	cc = _mm512_setzero_si512();
+	for (v = 0; v < num; v ++) {
+		__m512i w;
+
+		w = _mm512_sub_epi64(_mm512_sub_epi64(
+			LD(d + 8 * v), LD(m + 8 * v)), cc);
+		cc = _mm512_srli_epi64(w, 63);
+		ST(t + 8 * v, _mm512_and_si512(w, mask));
+	}
+
+	/*
+	 * The subtraction borrowed (value lower than m) if and only if
+	 * the final borrow is greater than the extra top bit.
+	 */
+	keep = _mm512_cmpgt_epu64_mask(cc, hi);
+	for (v = 0; v < num; v ++) {
+		ST(d + 8 * v, _mm512_mask_blend_epi64(keep,
+			LD(t + 8 * v), LD(d + 8 * v)));
+	}
+}
+
+/*
+ * Montgomery multiplication in all lanes: d <- a*b/R mod m, with
+ * R = 2^(52*num). Each lane has its own modulus and its own value
+ * m0i = -1/m mod 2^52. Operands must be lower than their modulus. d
+ * may alias a or b. m0i[] contains the eight lane values. t[] receives
+ * num vectors (scratch).
+ *
+ * Limbs of the accumulator are not normalized during the main loop;
+ * each round adds at most 4*2^52 + 2^12 to each of them, which cannot
+ * overflow 64 bits for num <= MB_MAXNUM.
+ */
+BR_TARGET("avx512f,avx512ifma")
+static void
+montymul_mb(uint64_t *d, const uint64_t *a, const uint64_t *b,
+	const uint64_t *m, const uint64_t *m0i, size_t num, uint64_t *t)
+{
+	__m512i zero, mask, cc, vm0i;
+	size_t u, v;
+
+	zero = _mm512_setzero_si512();
+	mask = _mm512_set1_epi64(MASK52);
+	vm0i = LD(m0i);
+	for (v = 0; v < num; v ++) {
+		ST(t + 8 * v, zero);
+	}
+	for (u = 0; u < num; u ++) {
+		__m512i bu, y, w;
+
+		bu = LD(b + 8 * u);
+		w = _mm512_madd52lo_epu64(LD(t), LD(a), bu);
+		y = _mm512_madd52lo_epu64(zero, w, vm0i);
+		w = _mm512_madd52lo_epu64(w, LD(m), y);
+		cc = _mm512_srli_epi64(w, 52);
+
+		/*
+		 * Add the high halves of the products for limb v-1 and
+		 * the low halves for limb v, and shift down by one limb.
+		 */
+		for (v = 1; v < num; v ++) {
+			w = _mm512_add_epi64(LD(t + 8 * v), cc);
+			w = _mm512_madd52lo_epu64(w, LD(a + 8 * v), bu);
+			w = _mm512_madd52lo_epu64(w, LD(m + 8 * v), y);
+			w = _mm512_madd52hi_epu64(w, LD(a + 8 * (v - 1)), bu);
+			w = _mm512_madd52hi_epu64(w, LD(m + 8 * (v - 1)), y);
+			ST(t + 8 * (v - 1), w);
+			cc = zero;
+		}
+		w = _mm512_madd52hi_epu64(cc, LD(a + 8 * (num - 1)), bu);
+		w = _mm512_madd52hi_epu64(w, LD(m + 8 * (num - 1)), y);
+		ST(t + 8 * (num - 1), w);
+	}
+
+	/*
+	 * Normalize into d; the result is lower than 2*m, hence it fits
+	 * on num limbs plus one extra bit.
+	 */
+	cc = zero;
+	for (v = 0; v < num; v ++) {
+		__m512i w;
+
+		w = _mm512_add_epi64(LD(t + 8 * v), cc);
+		cc = _mm512_srli_epi64(w, 52);
+		ST(d + 8 * v, _mm512_and_si512(w, mask));
+	}
+	cond_sub_mb(d, m, cc, num, t);
+}
+
+/*
+ * Compute R^2 mod m in all lanes. Every lane starts from 2^e0, with
+ * e0 lower than the bit length of all moduli, and is doubled up to
+ * R*2^(13*num); two Montgomery squarings then yield R^2. t[] receives
+ * num vectors (scratch).
+ */
+BR_TARGET("avx512f,avx512ifma")
+static void
+make_r2_mb(uint64_t *r2, const uint64_t *m, const uint64_t *m0i,
+	size_t num, uint32_t e0, uint64_t *t)
+{
+	__m512i mask, one;
+	size_t u, v;
+
+	mask = _mm512_set1_epi64(MASK52);
+	one = _mm512_set1_epi64(1);
+	for (v = 0; v < num; v ++) {
+		ST(r2 + 8 * v, _mm512_setzero_si512());
+	}
+	ST(r2 + 8 * (e0 / 52), _mm512_slli_epi64(one, e0 % 52));
+	for (u = e0; u < 65 * num; u ++) {
+		__m512i cc;
+
+		cc = _mm512_setzero_si512();
+		for (v = 0; v < num; v ++) {
+			__m512i w;
+
+			w = _mm512_or_si512(
+				_mm512_slli_epi64(LD(r2 + 8 * v), 1), cc);
+			cc = _mm512_srli_epi64(w, 52);
+			ST(r2 + 8 * v, _mm512_and_si512(w, mask));
+		}
+		cond_sub_mb(r2, m, cc, num, t);
+	}
+	montymul_mb(r2, r2, r2, m, m0i, num, t);
+	montymul_mb(r2, r2, r2, m, m0i, num, t);
+}
+
+/*
+ * Constant-time lookup in all lanes: lane j of d receives lane j of
+ * tab[idx[j]]. The table has 2^k entries of num vectors each.
+ */
+BR_TARGET("avx512f")
+static void
+window_lookup_mb(uint64_t *d, const uint64_t *tab, int k,
+	const uint64_t *idx, size_t num)
+{
+	__mmask8 sel[1 << BR_I31_MAX_WINDOW];
+	__m512i vi;
+	size_t n, u, v;
+
+	n = (size_t)1 << k;
+	vi = LD(idx);
+	for (u = 0; u < n; u ++) {
+		sel[u] = _mm512_cmpeq_epu64_mask(vi,
+			_mm512_set1_epi64((long long)u));
+	}
+	for (v = 0; v < num; v ++) {
+		__m512i w;
+
+		w = _mm512_setzero_si512();
+		for (u = 0; u < n; u ++) {
+			w = _mm512_mask_mov_epi64(w, sel[u],
+				LD(tab + 8 * (u * num + v)));
+		}
+		ST(d + 8 * v, w);
+	}
+}
+
+BR_TARGETS_X86_DOWN
+
+/*
+ * Convert an integer in 31-bit words (with its header word) into lane
+ * j of a transposed array of num 52-bit limbs.
+ */
+static void
+i31_to_mb(uint64_t *d, int j, const uint32_t *s31, size_t num)
+{
+	size_t u, len31;
+
+	len31 = (s31[0] + 31) >> 5;
+	for (u = 0; u < num; u ++) {
+		size_t q, r;
+		uint64_t w;
+
+		q = (52 * u) / 31;
+		r = (52 * u) % 31;
+		w = 0;
+		if (q < len31) {
+			w = (uint64_t)s31[q + 1] >> r;
+		}
+		if (q + 1 < len31) {
+			w |= (uint64_t)s31[q + 2] << (31 - r);
+		}
+		if (q + 2 < len31) {
+			w |= (uint64_t)s31[q + 3] << (62 - r);
+		}
+		d[8 * u + j] = w & MASK52;
+	}
+}
+
+/*
+ * Reverse of i31_to_mb(); the header word of d31 is used for the size,
+ * but not modified.
+ */
+static void
+mb_to_i31(uint32_t *d31, const uint64_t *s, int j, size_t num)
+{
+	size_t u, len31;
+
+	len31 = (d31[0] + 31) >> 5;
+	for (u = 0; u < len31; u ++) {
+		size_t q, r;
+		uint64_t w;
+
+		q = (31 * u) / 52;
+		r = (31 * u) % 52;
+		w = 0;
+		if (q < num) {
+			w = s[8 * q + j] >> r;
+		}
+		if (q + 1 < num) {
+			w |= s[8 * (q + 1) + j] << (52 - r);
+		}
+		d31[u + 1] = (uint32_t)w & 0x7FFFFFFF;
+	}
+}
+
+/*
+ * Get the k-bit chunk of a big-endian exponent that starts at bit
+ * 'off' (counted from the least significant bit); bits beyond the
+ * exponent length read as zero.
+ */
+static uint32_t
+get_bits(const unsigned char *e, size_t elen, size_t off, int k)
+{
+	uint32_t w;
+	int i;
+
+	w = 0;
+	for (i = k - 1; i >= 0; i --) {
+		size_t b;
+
+		b = off + (size_t)i;
+		w <<= 1;
+		if ((b >> 3) < elen) {
+			w |= (e[elen - 1 - (b >> 3)] >> (b & 7)) & 1;
+		}
+	}
+	return w;
+}
+
+/* see inner.h */
+uint32_t
+br_i52_modpow_mb(uint32_t *const *x31, const unsigned char *const *e,
+	size_t elen, const uint32_t *const *m31, size_t count,
+	uint64_t *tmp, size_t twlen)
+{
+	const uint32_t *lm[8];
+	const unsigned char *le[8];
+	uint32_t e0;
+	uint64_t m0i[8], idx[8];
+	size_t num, mwlen, ebits, nw, u;
+	uint64_t *m, *t, *r, *w, *tab;
+	int j, k;
+
+	if (count == 0) {
+		return 1;
+	}
+	if (count > 8) {
+		return 0;
+	}
+
+	/*
+	 * Unused lanes replay the first one.
+	 */
+	num = 0;
+	e0 = 0xFFFFFFFF;
+	for (j = 0; j < 8; j ++) {
+		uint32_t bitlen;
+		size_t n;
+
+		lm[j] = m31[(size_t)j < count ? j : 0];
+		le[j] = e[(size_t)j < count ? j : 0];
+		if ((lm[j][1] & 1) == 0) {
+			return 0;
+		}
+		bitlen = lm[j][0] - (lm[j][0] >> 5);
+		n = (bitlen + 51) / 52;
+		if (n > num) {
+			num = n;
+		}
+		if (bitlen - 1 < e0) {
+			e0 = bitlen - 1;
+		}
+	}
+	if (num > MB_MAXNUM) {
+		return 0;
+	}
+
+	/*
+	 * Temporaries (in vectors of eight 64-bit words): modulus,
+	 * scratch for the multiplications, current result, window entry,
+	 * and the table of 2^k entries.
+	 */
+	mwlen = 8 * num;
+	ebits = elen << 3;
+	if (twlen < 6 * mwlen) {
+		return 0;
+	}
+	k = br_i31_window_len(ebits, mwlen, twlen - 3 * mwlen);
+	m = tmp;
+	t = m + mwlen;
+	r = t + mwlen;
+	w = r + mwlen;
+	tab = w + mwlen;
+
+	for (j = 0; j < 8; j ++) {
+		i31_to_mb(m, j, lm[j], num);
+		m0i[j] = (uint64_t)br_i31_ninv31(lm[j][1]);
+		m0i[j] = (m0i[j] * ((uint64_t)2 + m0i[j] * m[j])) & MASK52;
+	}
+
+	/*
+	 * Window table: tab[0] = 1 and tab[1] = x (Montgomery
+	 * representation), tab[i] = x^i.
+	 */
+	make_r2_mb(w, m, m0i, num, e0, t);
+	memset(tab, 0, 2 * mwlen * sizeof *tab);
+	for (j = 0; j < 8; j ++) {
+		tab[j] = 1;
+		i31_to_mb(tab + mwlen, j, x31[(size_t)j < count ? j : 0], num);
+	}
+	montymul_mb(tab, tab, w, m, m0i, num, t);
+	montymul_mb(tab + mwlen, tab + mwlen, w, m, m0i, num, t);
+	for (u = 2; u < ((size_t)1 << k); u ++) {
+		montymul_mb(tab + u * mwlen, tab + (u - 1) * mwlen,
+			tab + mwlen, m, m0i, num, t);
+	}
+
+	/*
+	 * Windows are aligned on the low end of the exponent; the top
+	 * window may be shorter.
+	 */
+	nw = (ebits + (size_t)k - 1) / (size_t)k;
+	for (j = 0; j < 8; j ++) {
+		idx[j] = get_bits(le[j], elen, (nw - 1) * (size_t)k, k);
+	}
+	window_lookup_mb(r, tab, k, idx, num);
+	for (u = nw - 1; u > 0; u --) {
+		int i;
+
+		for (i = 0; i < k; i ++) {
+			montymul_mb(r, r, r, m, m0i, num, t);
+		}
+		for (j = 0; j < 8; j ++) {
+			idx[j] = get_bits(le[j], elen, (u - 1) * (size_t)k, k);
+		}
+		window_lookup_mb(w, tab, k, idx, num);
+		montymul_mb(r, r, w, m, m0i, num, t);
+	}
+
+	/*
+	 * Convert back from Montgomery representation.
+	 */
+	memset(w, 0, mwlen * sizeof *w);
+	for (j = 0; j < 8; j ++) {
+		w[j] = 1;
+	}
+	montymul_mb(r, r, w, m, m0i, num, t);
+	for (j = 0; j < (int)count; j ++) {
+		mb_to_i31(x31[j], r, j, num);
+	}
+	return 1;
+}
+
+/* see inner.h */
+br_i52_modpow_mb_type
+br_i52_modpow_mb_get(void)
+{
+	return ifma_supported() ? &br_i52_modpow_mb : 0;
+}
+
+#else
+
+/* see inner.h */
+br_i52_modpow_mb_type
+br_i52_modpow_mb_get(void)
+{
+	return 0;
+}
+
+#endif
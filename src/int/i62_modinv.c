@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2018 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+/*
+ * Modular division with the "safegcd" algorithm of Bernstein and Yang
+ * (https://eprint.iacr.org/2019/266), by batches of 62 divsteps. Each
+ * batch computes a 2x2 transition matrix with 64-bit coefficients from
+ * the low limbs of f and g alone, then applies it to the full values
+ * (f, g) and to the Bezout coefficients (d, e) with 128-bit products.
+ *
+ * Values are signed integers over 'num' limbs of 62 bits (int64_t); all
+ * limbs are in 0..2^62-1, except the top one, which is signed.
+ */
+
+#if BR_INT128
+
+#define M62   ((uint64_t)0x3FFFFFFFFFFFFFFF)
+
+/*
+ * Perform 62 divsteps on the low limbs f0 and g0, starting from the
+ * provided delta value; the new delta is returned. The transition
+ * matrix, scaled by 2^62, is written in t[] as (u, v, q, r):
+ *
+ *   2^62*f' = u*f + v*g
+ *   2^62*g' = q*f + r*g
+ *
+ * with |u|+|v| <= 2^62 and |q|+|r| <= 2^62.
+ */
+static int64_t
+divsteps_62(int64_t delta, uint64_t f0, uint64_t g0, int64_t *t)
+{
+	uint64_t u, v, q, r, f, g;
+	int i;
+
+	u = 1;
+	v = 0;
+	q = 0;
+	r = 1;
+	f = f0;
+	g = g0;
+	for (i = 0; i < 62; i ++) {
+		uint64_t c1, c2, x, y, z;
+
+		/*
+		 * divstep(delta, f, g):
+		 *   if delta > 0 and g odd:  (1-delta, g, (g-f)/2)
+		 *   else:                    (1+delta, f, (g+(g&1)*f)/2)
+		 * The division of g by 2 is applied to the matrix as a
+		 * multiplication of the other row by 2.
+		 */
+		c1 = -(((uint64_t)-delta) >> 63);
+		c2 = -(g & 1);
+		x = (f ^ c1) - c1;
+		y = (u ^ c1) - c1;
+		z = (v ^ c1) - c1;
+		g += x & c2;
+		q += y & c2;
+		r += z & c2;
+		c1 &= c2;
+		delta = (int64_t)(((uint64_t)delta ^ c1) - c1) + 1;
+		f += g & c1;
+		u += q & c1;
+		v += r & c1;
+		g >>= 1;
+		u <<= 1;
+		v <<= 1;
+	}
+	t[0] = (int64_t)u;
+	t[1] = (int64_t)v;
+	t[2] = (int64_t)q;
+	t[3] = (int64_t)r;
+	return delta;
+}
+
+/*
+ * Apply the transition matrix to (f, g): the low 62 bits of both
+ * products are zero and are dropped.
+ */
+static void
+update_fg_62(int64_t *f, int64_t *g, size_t num, const int64_t *t)
+{
+	__int128 cf, cg;
+	size_t i;
+
+	cf = (__int128)t[0] * f[0] + (__int128)t[1] * g[0];
+	cg = (__int128)t[2] * f[0] + (__int128)t[3] * g[0];
+	cf >>= 62;
+	cg >>= 62;
+	for (i = 1; i < num; i ++) {
+		cf += (__int128)t[0] * f[i] + (__int128)t[1] * g[i];
+		cg += (__int128)t[2] * f[i] + (__int128)t[3] * g[i];
+		f[i - 1] = (int64_t)((uint64_t)cf & M62);
+		g[i - 1] = (int64_t)((uint64_t)cg & M62);
+		cf >>= 62;
+		cg >>= 62;
+	}
+	f[num - 1] = (int64_t)cf;
+	g[num - 1] = (int64_t)cg;
+}
+
+/*
+ * Apply the transition matrix to (d, e), modulo m: a multiple of m is
+ * added to each product so that the low 62 bits are zero, and these
+ * bits are dropped. minv = 1/m mod 2^62. If d and e are in the -2*m..m-1
+ * range, then so are the new values.
+ */
+static void
+update_de_62(int64_t *d, int64_t *e, size_t num, const int64_t *t,
+	const int64_t *m, uint64_t minv)
+{
+	int64_t sd, se, md, me;
+	__int128 cd, ce;
+	size_t i;
+
+	/*
+	 * Start with t*[d,e] (plus corrections that keep the result in
+	 * range if d or e is negative), then add m*[md,me] with md and
+	 * me such that the low 62 bits cancel out.
+	 */
+	sd = -(int64_t)((uint64_t)d[num - 1] >> 63);
+	se = -(int64_t)((uint64_t)e[num - 1] >> 63);
+	md = (t[0] & sd) + (t[1] & se);
+	me = (t[2] & sd) + (t[3] & se);
+	cd = (__int128)t[0] * d[0] + (__int128)t[1] * e[0];
+	ce = (__int128)t[2] * d[0] + (__int128)t[3] * e[0];
+	md -= (int64_t)((minv * (uint64_t)cd + (uint64_t)md) & M62);
+	me -= (int64_t)((minv * (uint64_t)ce + (uint64_t)me) & M62);
+	cd += (__int128)m[0] * md;
+	ce += (__int128)m[0] * me;
+	cd >>= 62;
+	ce >>= 62;
+	for (i = 1; i < num; i ++) {
+		cd += (__int128)t[0] * d[i] + (__int128)t[1] * e[i]
+			+ (__int128)m[i] * md;
+		ce += (__int128)t[2] * d[i] + (__int128)t[3] * e[i]
+			+ (__int128)m[i] * me;
+		d[i - 1] = (int64_t)((uint64_t)cd & M62);
+		e[i - 1] = (int64_t)((uint64_t)ce & M62);
+		cd >>= 62;
+		ce >>= 62;
+	}
+	d[num - 1] = (int64_t)cd;
+	e[num - 1] = (int64_t)ce;
+}
+
+/*
+ * Conditionally negate a (ctl = -1) or keep it unchanged (ctl = 0).
+ */
+static void
+cond_negate_62(int64_t *a, size_t num, int64_t ctl)
+{
+	int64_t cc;
+	size_t i;
+
+	cc = ctl & 1;
+	for (i = 0; i + 1 < num; i ++) {
+		cc += a[i] ^ (ctl & (int64_t)M62);
+		a[i] = (int64_t)((uint64_t)cc & M62);
+		cc >>= 62;
+	}
+	a[num - 1] = (a[num - 1] ^ ctl) + cc;
+}
+
+/*
+ * Add m to a if a is negative.
+ */
+static void
+cond_add_62(int64_t *a, const int64_t *m, size_t num)
+{
+	int64_t cc, sm;
+	size_t i;
+
+	sm = -(int64_t)((uint64_t)a[num - 1] >> 63);
+	cc = 0;
+	for (i = 0; i + 1 < num; i ++) {
+		cc += a[i] + (m[i] & sm);
+		a[i] = (int64_t)((uint64_t)cc & M62);
+		cc >>= 62;
+	}
+	a[num - 1] += (m[num - 1] & sm) + cc;
+}
+
+/*
+ * Convert an i31 integer (with its header word) into num signed 62-bit
+ * limbs (nonnegative value).
+ */
+static void
+from_i31(int64_t *d, const uint32_t *x, size_t num)
+{
+	size_t len, u, v;
+	uint64_t acc;
+	int acc_len;
+
+	len = (x[0] + 31) >> 5;
+	acc = 0;
+	acc_len = 0;
+	v = 0;
+	for (u = 0; u < len; u ++) {
+		uint64_t w;
+
+		w = x[u + 1];
+		acc |= w << acc_len;
+		acc_len += 31;
+		if (acc_len >= 62) {
+			d[v ++] = (int64_t)(acc & M62);
+			acc_len -= 62;
+			acc = w >> (31 - acc_len);
+		}
+	}
+	while (v < num) {
+		d[v ++] = (int64_t)acc;
+		acc = 0;
+	}
+}
+
+/*
+ * Convert num nonnegative 62-bit limbs into an i31 integer; the header
+ * word of x is used for the size, but not modified.
+ */
+static void
+to_i31(uint32_t *x, const int64_t *a, size_t num)
+{
+	size_t len, u, v;
+	uint64_t acc;
+	int acc_len;
+
+	len = (x[0] + 31) >> 5;
+	acc = 0;
+	acc_len = 0;
+	v = 0;
+	for (u = 0; u < len; u ++) {
+		if (acc_len < 31) {
+			uint64_t w;
+
+			w = v < num ? (uint64_t)a[v ++] : 0;
+			x[u + 1] = (uint32_t)(acc | (w << acc_len)) & 0x7FFFFFFF;
+			acc = w >> (31 - acc_len);
+			acc_len += 31;
+		} else {
+			x[u + 1] = (uint32_t)acc & 0x7FFFFFFF;
+			acc >>= 31;
+			acc_len -= 31;
+		}
+	}
+}
+
+/* see inner.h */
+uint32_t
+br_i62_modinv(uint32_t *x, const uint32_t *y, const uint32_t *m, uint32_t *t)
+{
+	int64_t *f, *g, *d, *e, *mm;
+	int64_t delta, tr[4], sf;
+	uint64_t minv, z;
+	uint32_t mbits;
+	size_t num, n, i;
+
+	mbits = m[0] - (m[0] >> 5);
+	num = (mbits + 63) / 62;
+	if (((uintptr_t)t & 4) != 0) {
+		t ++;
+	}
+	f = (int64_t *)t;
+	g = f + num;
+	d = g + num;
+	e = d + num;
+	mm = e + num;
+	from_i31(mm, m, num);
+	from_i31(g, y, num);
+	from_i31(e, x, num);
+	memcpy(f, mm, num * sizeof *f);
+	memset(d, 0, num * sizeof *d);
+
+	/*
+	 * minv = 1/m mod 2^62 (Newton iteration, from 5 correct bits).
+	 */
+	minv = (3 * (uint64_t)mm[0]) ^ 2;
+	for (i = 0; i < 4; i ++) {
+		minv *= 2 - (uint64_t)mm[0] * minv;
+	}
+	minv &= M62;
+
+	/*
+	 * Invariants (modulo m): d*y = f*x and e*y = g*x. The divsteps
+	 * bring g to zero and f to +/-GCD(m, y); the number of divsteps
+	 * is the bound from the safegcd paper (Theorem 11.2), with
+	 * delta starting at 1.
+	 */
+	if (mbits < 46) {
+		n = (49 * (size_t)mbits + 80) / 17;
+	} else {
+		n = (49 * (size_t)mbits + 57) / 17;
+	}
+	delta = 1;
+	for (i = 0; i < n; i += 62) {
+		delta = divsteps_62(delta, (uint64_t)f[0], (uint64_t)g[0], tr);
+		update_fg_62(f, g, num, tr);
+		update_de_62(d, e, num, tr, mm, minv);
+	}
+
+	/*
+	 * Division succeeded if f = 1 or -1; the result is then d*f,
+	 * brought back from -2*m..m-1 into 0..m-1.
+	 */
+	sf = -(int64_t)((uint64_t)f[num - 1] >> 63);
+	cond_negate_62(f, num, sf);
+	z = (uint64_t)f[0] ^ 1;
+	for (i = 1; i < num; i ++) {
+		z |= (uint64_t)f[i];
+	}
+	cond_add_62(d, mm, num);
+	cond_negate_62(d, num, sf);
+	cond_add_62(d, mm, num);
+	to_i31(x, d, num);
+	return EQ0((uint32_t)(z | (z >> 32)));
+}
+
+#else
+
+/* see inner.h */
+uint32_t
+br_i62_modinv(uint32_t *x, const uint32_t *y, const uint32_t *m, uint32_t *t)
+{
+	return br_i31_modinv(x, y, m, t);
+}
+
+#endif
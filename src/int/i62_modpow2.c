@@ -199,6 +199,124 @@ montymul(uint64_t *d, const uint64_t *x, const uint64_t *y,
 	i62_sub(d, m, num, (uint32_t)dh | NOT(i62_sub(d, m, num, 0)));
 }
 
+#if BR_INT128
+
+/*
+ * Largest modulus (in 62-bit words) handled by montysqr(); larger
+ * moduli use montymul().
+ */
+#define SQR_MAXNUM   ((BR_MAX_RSA_SIZE + 256 + 61) / 62)
+
+/*
+ * Add a[i]*b[-i] for i = 0 to n-1 to the column accumulator (lo, hi),
+ * whose value is lo + hi*2^62. Products are less than 2^124, hence
+ * four of them can be added to lo (kept below 2^62 between groups)
+ * without overflow. The a, b and n arguments are modified.
+ */
+#define DOT_REV62(lo, hi, a, b, n)   do { \
+		unsigned __int128 dotz; \
+		if (((n) & 1) != 0) { \
+			dotz = (unsigned __int128)(a)[0] * (b)[0]; \
+			(lo) += dotz; \
+			(hi) += (lo) >> 62; \
+			(lo) &= MASK62; \
+			(a) ++; \
+			(b) --; \
+		} \
+		if (((n) & 2) != 0) { \
+			dotz = (unsigned __int128)(a)[0] * (b)[0] \
+				+ (unsigned __int128)(a)[1] * (b)[-1]; \
+			(lo) += dotz; \
+			(hi) += (lo) >> 62; \
+			(lo) &= MASK62; \
+			(a) += 2; \
+			(b) -= 2; \
+		} \
+		for ((n) >>= 2; (n) > 0; (n) --, (a) += 4, (b) -= 4) { \
+			dotz = (unsigned __int128)(a)[0] * (b)[0] \
+				+ (unsigned __int128)(a)[1] * (b)[-1] \
+				+ (unsigned __int128)(a)[2] * (b)[-2] \
+				+ (unsigned __int128)(a)[3] * (b)[-3]; \
+			(lo) += dotz; \
+			(hi) += (lo) >> 62; \
+			(lo) &= MASK62; \
+		} \
+	} while (0)
+
+/*
+ * Montgomery squaring, over arrays of 62-bit values: same as
+ * montymul(d, x, x, m, num, m0i), but with product scanning, so that
+ * cross products x[i]*x[j] (i < j) are computed only once. The
+ * destination array (d) must be distinct from x and m.
+ */
+static void
+montysqr(uint64_t *d, const uint64_t *x,
+	const uint64_t *m, size_t num, uint64_t m0i)
+{
+	uint64_t f[SQR_MAXNUM];
+	unsigned __int128 lo, hi, z;
+	size_t k;
+
+	if (num > SQR_MAXNUM) {
+		montymul(d, x, x, m, num, m0i);
+		return;
+	}
+
+	lo = 0;
+	hi = 0;
+	for (k = 0; k < 2 * num - 1; k ++) {
+		const uint64_t *a, *b;
+		unsigned __int128 xlo, xhi;
+		size_t i0, n;
+
+		i0 = k < num ? 0 : k - num + 1;
+
+		/*
+		 * Cross products (doubled), then the square x[k/2]^2.
+		 */
+		xlo = 0;
+		xhi = 0;
+		a = x + i0;
+		b = x + k - i0;
+		n = (k + 1) / 2 - i0;
+		DOT_REV62(xlo, xhi, a, b, n);
+		lo += xlo << 1;
+		hi += xhi << 1;
+		if ((k & 1) == 0) {
+			z = (unsigned __int128)x[k >> 1] * x[k >> 1];
+			lo += z & MASK62;
+			hi += z >> 62;
+		}
+
+		/*
+		 * Reduction products f[i]*m[j]; for k < num, f[k] is
+		 * set to clear the column.
+		 */
+		a = f + i0;
+		b = m + k - i0;
+		n = (k < num ? k : num) - i0;
+		DOT_REV62(lo, hi, a, b, n);
+		if (k < num) {
+			f[k] = MUL62_lo((uint64_t)lo, m0i);
+			z = (unsigned __int128)f[k] * m[0];
+			lo += z & MASK62;
+			hi += z >> 62;
+		} else {
+			d[k - num] = (uint64_t)lo & MASK62;
+		}
+		lo = hi + (lo >> 62);
+		hi = 0;
+	}
+	d[num - 1] = (uint64_t)lo & MASK62;
+	i62_sub(d, m, num, (uint32_t)(lo >> 62) | NOT(i62_sub(d, m, num, 0)));
+}
+
+#else
+
+#define montysqr(d, x, m, num, m0i)   montymul(d, x, x, m, num, m0i)
+
+#endif
+
 /*
  * Conversion back from Montgomery representation.
  */
@@ -400,7 +518,7 @@ br_i62_modpow_opt(uint32_t *x31, const unsigned char *e, size_t elen,
 		 * We could get exactly k bits. Compute k squarings.
 		 */
 		for (i = 0; i < k; i ++) {
-			montymul(t1, x, x, m, mw62num, m0i);
+			montysqr(t1, x, m, mw62num, m0i);
 			memcpy(x, t1, mw62num * sizeof *x);
 		}
 
@@ -459,6 +577,287 @@ br_i62_modpow_opt(uint32_t *x31, const unsigned char *e, size_t elen,
 	return 1;
 }
 
+#define U2         (4 + ((BR_MAX_RSA_FACTOR + 30) / 31))
+#define TLEN_TMP   (4 * U2)
+
+/*
+ * Convert an integer in 31-bit words (with its header word) into an
+ * array of 62-bit words (without header), over mw31num 31-bit words.
+ */
+static void
+i31_to_i62(uint64_t *d, const uint32_t *s31, size_t mw31num)
+{
+	size_t u;
+
+	for (u = 0; u < mw31num; u += 2) {
+		size_t v;
+
+		v = u >> 1;
+		if ((u + 1) == mw31num) {
+			d[v] = (uint64_t)s31[u + 1];
+		} else {
+			d[v] = (uint64_t)s31[u + 1]
+				+ ((uint64_t)s31[u + 2] << 31);
+		}
+	}
+}
+
+/*
+ * Reverse of i31_to_i62(); the header word of d31 is not modified.
+ */
+static void
+i62_to_i31(uint32_t *d31, const uint64_t *s, size_t mw31num)
+{
+	size_t u;
+
+	for (u = 0; u < mw31num; u += 2) {
+		uint64_t zw;
+
+		zw = s[u >> 1];
+		d31[u + 1] = (uint32_t)zw & 0x7FFFFFFF;
+		if ((u + 1) < mw31num) {
+			d31[u + 2] = (uint32_t)(zw >> 31);
+		}
+	}
+}
+
+/*
+ * Set curr_m[] (31-bit words, announced bit length 'bitlen') to m31*r,
+ * then m[] to the same value in 62-bit words; return -(1/m) mod 2^62.
+ */
+static uint64_t
+rand_modulus(uint64_t *m, uint32_t *curr_m, const uint32_t *m31,
+	const uint32_t *r, uint32_t bitlen, size_t mw31num)
+{
+	uint64_t m0i;
+
+	br_i31_zero(curr_m, bitlen);
+	br_i31_mulacc(curr_m, m31, r);
+	curr_m[0] = bitlen;
+	i31_to_i62(m, curr_m, mw31num);
+	m0i = (uint64_t)br_i31_ninv31(curr_m[1]);
+	return MUL62_lo(m0i, (uint64_t)2 + MUL62_lo(m0i, m[0]));
+}
+
+/*
+ * Randomized exponentiation core, shared by the single and double
+ * variants. If x31b is NULL, then only x31a^e1 is computed (e2 and elen2
+ * are ignored). Otherwise, x31b receives x31a^e2. This follows
+ * br_i31_double_modpow_opt_rand(), with Montgomery multiplications over
+ * 62-bit words: the modulus is m31*r with a fresh random r for each
+ * window, all values being kept below 2^(62*num) and congruent to the
+ * expected values modulo m31.
+ */
+static uint32_t
+modpow_rand(const br_prng_class **rng, uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint64_t *tmp, size_t twlen)
+{
+	size_t u, ei, mw31num, mw62num, elen, off1, off2, nwin;
+	uint64_t *m, *xa, *xb, *t1, *t2;
+	uint64_t m0i;
+	uint32_t acc1, acc2, bitlen, xlen;
+	int win_len, acc_len;
+	uint32_t curr_m[TLEN_TMP];
+	uint32_t r[((2 * BR_RSA_RAND_FACTOR) + 63) >> 5];
+	uint32_t new_r[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t pool[BR_RSA_RAND_POOL * BR_RSA_RAND_WLEN];
+	size_t pool_ptr, pool_len;
+
+	if (x31b == NULL) {
+		elen2 = 0;
+	}
+
+	/*
+	 * Initial randomized modulus. Its bit length is kept as the
+	 * announced length of all subsequent moduli, so that the
+	 * Montgomery factor stays the same.
+	 */
+	make_rand(rng, r, 2 * BR_RSA_RAND_FACTOR);
+	r[1] |= 1;
+	r[0] = br_i31_bit_length(r + 1, ((2 * BR_RSA_RAND_FACTOR) + 31) >> 5);
+	br_i31_zero(curr_m, m31[0]);
+	br_i31_mulacc(curr_m, m31, r);
+	bitlen = br_i31_bit_length(curr_m + 1, (curr_m[0] + 31) >> 5);
+	curr_m[0] = bitlen;
+	mw31num = (bitlen + 31) >> 5;
+	mw62num = (mw31num + 1) >> 1;
+
+	/*
+	 * Operand and accumulators, extended to the randomized modulus
+	 * size, then in Montgomery representation (with 2^(62*mw62num)
+	 * as Montgomery factor).
+	 */
+	xlen = (x31a[0] + 63) >> 5;
+	for (; xlen <= mw31num; xlen ++) {
+		x31a[xlen] = 0;
+	}
+	x31a[0] = bitlen;
+	if ((5 * mw62num) > twlen) {
+		return 0;
+	}
+	m = tmp;
+	xa = tmp + mw62num;
+	xb = tmp + 2 * mw62num;
+	t1 = tmp + 3 * mw62num;
+	t2 = tmp + 4 * mw62num;
+	twlen -= 4 * mw62num;
+	for (win_len = 5; win_len > 1; win_len --) {
+		if (((uint32_t)1 << win_len) * mw62num <= twlen) {
+			break;
+		}
+	}
+
+	for (u = 0; u < mw62num; u ++) {
+		br_i31_muladd_small(x31a, 0, curr_m);
+		br_i31_muladd_small(x31a, 0, curr_m);
+	}
+	i31_to_i62(m, curr_m, mw31num);
+	i31_to_i62(xa, x31a, mw31num);
+	m0i = (uint64_t)br_i31_ninv31(curr_m[1]);
+	m0i = MUL62_lo(m0i, (uint64_t)2 + MUL62_lo(m0i, m[0]));
+
+	if (win_len == 1) {
+		memcpy(t2, xa, mw62num * sizeof *xa);
+	} else {
+		uint64_t *base;
+
+		memcpy(t2 + mw62num, xa, mw62num * sizeof *xa);
+		base = t2 + mw62num;
+		for (u = 2; u < ((unsigned)1 << win_len); u ++) {
+			montymul(base + mw62num, base, xa, m, mw62num, m0i);
+			base += mw62num;
+		}
+	}
+
+	br_i31_zero(x31a, bitlen);
+	x31a[mw31num] = 1;
+	br_i31_muladd_small(x31a, 0, curr_m);
+	if (mw31num & 1) {
+		br_i31_muladd_small(x31a, 0, curr_m);
+	}
+	i31_to_i62(xa, x31a, mw31num);
+	memcpy(xb, xa, mw62num * sizeof *xa);
+
+	elen = elen1 > elen2 ? elen1 : elen2;
+	off1 = elen - elen1;
+	off2 = elen - elen2;
+	nwin = ((elen << 3) + win_len - 1) / win_len;
+	pool_ptr = 0;
+	pool_len = 0;
+
+	acc1 = 0;
+	acc2 = 0;
+	acc_len = 0;
+	ei = 0;
+	while (acc_len > 0 || ei < elen) {
+		int i, j, k;
+		uint32_t bits[2];
+		uint64_t *xx[2];
+
+		k = win_len;
+		if (acc_len < win_len) {
+			if (ei < elen) {
+				acc1 = (acc1 << 8)
+					| (ei >= off1 ? e1[ei - off1] : 0);
+				acc2 = (acc2 << 8)
+					| (ei >= off2 ? e2[ei - off2] : 0);
+				ei ++;
+				acc_len += 8;
+			} else {
+				k = acc_len;
+			}
+		}
+		bits[0] = (acc1 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		bits[1] = (acc2 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		acc_len -= k;
+		xx[0] = xa;
+		xx[1] = xb;
+
+		/*
+		 * Re-randomize the modulus for this window.
+		 */
+		make_rand_pooled(rng, new_r, pool, &pool_ptr, &pool_len,
+			nwin --);
+		m0i = rand_modulus(m, curr_m, m31, new_r, bitlen, mw31num);
+
+		for (j = 0; j < (x31b == NULL ? 1 : 2); j ++) {
+			uint64_t *x, mask1, mask2;
+
+			x = xx[j];
+			for (i = 0; i < k; i ++) {
+				montysqr(t1, x, m, mw62num, m0i);
+				memcpy(x, t1, mw62num * sizeof *x);
+			}
+			if (win_len > 1) {
+				uint64_t *base;
+
+				memset(t2, 0, mw62num * sizeof *t2);
+				base = t2 + mw62num;
+				for (u = 1; u < ((uint32_t)1 << k); u ++) {
+					uint64_t mask;
+					size_t v;
+
+					mask = -(uint64_t)EQ(u, bits[j]);
+					for (v = 0; v < mw62num; v ++) {
+						t2[v] |= mask & base[v];
+					}
+					base += mw62num;
+				}
+			}
+			montymul(t1, x, t2, m, mw62num, m0i);
+			mask1 = -(uint64_t)EQ(bits[j], 0);
+			mask2 = ~mask1;
+			for (u = 0; u < mw62num; u ++) {
+				x[u] = (mask1 & x[u]) | (mask2 & t1[u]);
+			}
+		}
+	}
+
+	/*
+	 * Convert back from Montgomery representation (with the initial
+	 * randomized modulus), then reduce modulo m31.
+	 */
+	m0i = rand_modulus(m, curr_m, m31, r, bitlen, mw31num);
+	frommonty(xa, m, mw62num, m0i);
+	x31a[0] = bitlen;
+	i62_to_i31(x31a, xa, mw31num);
+	if (x31b != NULL) {
+		frommonty(xb, m, mw62num, m0i);
+		x31b[0] = bitlen;
+		i62_to_i31(x31b, xb, mw31num);
+		br_i31_reduce(curr_m, x31b, m31);
+		memcpy(x31b, curr_m, ((m31[0] + 63) >> 5) * sizeof *curr_m);
+	}
+	br_i31_reduce(curr_m, x31a, m31);
+	memcpy(x31a, curr_m, ((m31[0] + 63) >> 5) * sizeof *curr_m);
+	return 1;
+}
+
+/* see inner.h */
+uint32_t
+br_i62_modpow_opt_rand(const br_prng_class **rng, uint32_t *x31,
+	const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint64_t *tmp, size_t twlen)
+{
+	(void)m0i31;
+	return modpow_rand(rng, x31, NULL, e, elen, NULL, 0, m31, tmp, twlen);
+}
+
+/* see inner.h */
+uint32_t
+br_i62_double_modpow_opt_rand(const br_prng_class **rng,
+	uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint32_t m0i31, uint64_t *tmp, size_t twlen)
+{
+	(void)m0i31;
+	return modpow_rand(rng, x31a, x31b, e1, elen1, e2, elen2,
+		m31, tmp, twlen);
+}
+
 #else
 
 /* see inner.h */
@@ -476,6 +875,29 @@ br_i62_modpow_opt(uint32_t *x31, const unsigned char *e, size_t elen,
 		(uint32_t *)tmp, twlen << 1);
 }
 
+/* see inner.h */
+uint32_t
+br_i62_modpow_opt_rand(const br_prng_class **rng, uint32_t *x31,
+	const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint64_t *tmp, size_t twlen)
+{
+	return br_i31_modpow_opt_rand(rng, x31, e, elen, m31, m0i31,
+		(uint32_t *)tmp, twlen << 1);
+}
+
+/* see inner.h */
+uint32_t
+br_i62_double_modpow_opt_rand(const br_prng_class **rng,
+	uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint32_t m0i31, uint64_t *tmp, size_t twlen)
+{
+	return br_i31_double_modpow_opt_rand(rng, x31a, x31b,
+		e1, elen1, e2, elen2, m31, m0i31, NULL,
+		(uint32_t *)tmp, twlen << 1);
+}
+
 #endif
 
 /* see inner.h */
@@ -491,3 +913,27 @@ br_i62_modpow_opt_as_i31(uint32_t *x31, const unsigned char *e, size_t elen,
 	return br_i62_modpow_opt(x31, e, elen, m31, m0i31,
 		(uint64_t *)tmp, twlen >> 1);
 }
+
+/* see inner.h */
+uint32_t
+br_i62_modpow_opt_rand_as_i31(const br_prng_class **rng, uint32_t *x31,
+	const unsigned char *e, size_t elen,
+	const uint32_t *m31, uint32_t m0i31, uint32_t *tmp, size_t twlen)
+{
+	return br_i62_modpow_opt_rand(rng, x31, e, elen, m31, m0i31,
+		(uint64_t *)tmp, twlen >> 1);
+}
+
+/* see inner.h */
+uint32_t
+br_i62_double_modpow_opt_rand_as_i31(const br_prng_class **rng,
+	uint32_t *x31a, uint32_t *x31b,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m31, uint32_t m0i31, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen)
+{
+	(void)r2;
+	return br_i62_double_modpow_opt_rand(rng, x31a, x31b,
+		e1, elen1, e2, elen2, m31, m0i31, (uint64_t *)tmp, twlen >> 1);
+}
@@ -28,6 +28,41 @@
 #define U2      (4 + ((BR_MAX_RSA_FACTOR + 30) / 31))
 #define TLEN_TMP  4*U2
 
+/* see inner.h */
+void
+make_rand_pooled(const br_prng_class **rng, uint32_t *x,
+	uint32_t *pool, size_t *ptr, size_t *len, size_t rem)
+{
+	size_t u;
+	unsigned m;
+
+	if (*ptr == *len) {
+		if (rem > BR_RSA_RAND_POOL) {
+			rem = BR_RSA_RAND_POOL;
+		}
+		*len = rem * BR_RSA_RAND_WLEN;
+		*ptr = 0;
+		(*rng)->generate(rng, pool, *len * sizeof *pool);
+	}
+	memcpy(x + 1, pool + *ptr, BR_RSA_RAND_WLEN * sizeof *pool);
+	*ptr += BR_RSA_RAND_WLEN;
+
+	/*
+	 * Same masking as make_rand().
+	 */
+	for (u = 1; u < BR_RSA_RAND_WLEN; u ++) {
+		x[u] &= 0x7FFFFFFF;
+	}
+	m = BR_RSA_RAND_FACTOR & 31;
+	if (m == 0) {
+		x[BR_RSA_RAND_WLEN] &= 0x7FFFFFFF;
+	} else {
+		x[BR_RSA_RAND_WLEN] &= 0x7FFFFFFF >> (31 - m);
+	}
+	x[1] |= 1;
+	x[0] = br_i31_bit_length(x + 1, BR_RSA_RAND_WLEN);
+}
+
 /* see inner.h */
 uint32_t
 br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
@@ -35,13 +70,15 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 	const uint32_t *m, uint32_t m0i, uint32_t *tmp, size_t twlen)
 {	
 	size_t mlen, mwlen;
-	uint32_t *t1, *t2, *base;
-	size_t u, v;
+	uint32_t *t1, *t2;
+	size_t nwin;
 	uint32_t acc;
 	int acc_len, win_len, prev_bitlen;
 	uint32_t BUFF[TLEN_TMP];
 	uint32_t r[(((2 * BR_RSA_RAND_FACTOR)) + 63) >> 5];
 	uint32_t new_r[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t pool[BR_RSA_RAND_POOL * BR_RSA_RAND_WLEN];
+	size_t pool_ptr, pool_len;
 
 	make_rand(rng, r, (2 * BR_RSA_RAND_FACTOR));
 	r[1] |= 1;
@@ -61,8 +98,8 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 	mwlen = (curr_m[0] + 63 + 128) >> 5;
 	mlen = mwlen * sizeof curr_m[0];
 	mwlen += (mwlen & 1);
-	t1 = tmp + mwlen;
-	t2 = tmp + 2 * mwlen;
+	t1 = tmp;
+	t2 = tmp + mwlen;
     
     /*
      * We increased the moudulus size, now we zero words in x up to the modulus size
@@ -75,20 +112,24 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 
 	
 	/*
-	 * Compute possible window size, with a maximum of 5 bits.
-	 * When the window has size 1 bit, we use a specific code
-	 * that requires only two temporaries. Otherwise, for a
-	 * window of k bits, we need 2^k+1 temporaries.
+	 * Compute the window size (see br_i31_window_len()). When the
+	 * window has size 1 bit, we use a specific code that requires
+	 * only two temporaries. Otherwise, for a window of k bits, we
+	 * need 2^k+1 temporaries.
 	 */
 	if (twlen < (mwlen << 1)) {
 		return 0;
 	}
-	for (win_len = 5; win_len > 1; win_len --) {
-		if ((((uint32_t)1 << win_len) + 1) * mwlen <= twlen) {
-			break;
-		}
-	}
+	win_len = br_i31_window_len(elen << 3, mwlen, twlen);
 	
+	/*
+	 * Each loop iteration below consumes win_len exponent bits
+	 * (fewer for the last one), and needs one fresh mask.
+	 */
+	nwin = ((elen << 3) + win_len - 1) / win_len;
+	pool_ptr = 0;
+	pool_len = 0;
+
 	/*
 	 * Everything is done in Montgomery representation.
 	 */
@@ -96,20 +137,14 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 	
 	/*
 	 * Compute window contents. If the window has size one bit only,
-	 * then t2 is set to x; otherwise, t2[0] is left untouched, and
-	 * t2[k] is set to x^k (for k >= 1).
+	 * then t2 is set to x; otherwise, the table after t2 receives
+	 * x^k (for k >= 1), word-interleaved.
 	 */
 	if (win_len == 1) {
 		memcpy(t2, x, mlen);
 	} else {
-		memcpy(t2 + mwlen, x, mlen);
-		base = t2 + mwlen;
-		for (u = 2; u < ((unsigned)1 << win_len); u ++) {
-
-			
-			br_i31_montymul(base + mwlen, base, x, curr_m, m0i);
-			base += mwlen;
-		}
+		br_i31_wtab_build(t2 + mwlen, win_len, x, curr_m, m0i,
+			mwlen, t1);
 	}
 
 	/*
@@ -150,9 +185,7 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 		bits = (acc >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
 		acc_len -= k;
 
-		make_rand(rng, new_r, BR_RSA_RAND_FACTOR);
-		new_r[1] |= 1;
-		new_r[0] = br_i31_bit_length(new_r + 1, (BR_RSA_RAND_FACTOR + 31) >> 5);
+		make_rand_pooled(rng, new_r, pool, &pool_ptr, &pool_len, nwin --);
 
 		prev_bitlen = curr_m[0];
 		br_i31_zero(curr_m, prev_bitlen);
@@ -168,7 +201,7 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 		 */
 
 		for (i = 0; i < k; i ++) {
-			br_i31_montymul(t1, x, x, curr_m, m0i);
+			br_i31_montysqr(t1, x, curr_m, m0i);
 			memcpy(x, t1, mlen);
 		}
 
@@ -179,17 +212,8 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 		 * already set; otherwise, we do a constant-time lookup.
 		 */
 		if (win_len > 1) {
-			br_i31_zero(t2, curr_m[0]);
-			base = t2 + mwlen;
-			for (u = 1; u < ((uint32_t)1 << k); u ++) {
-				uint32_t mask;
-
-				mask = -EQ(u, bits);
-				for (v = 1; v < mwlen; v ++) {
-					t2[v] |= mask & base[v];
-				}
-				base += mwlen;
-			}
+			br_i31_wtab_get(t2, t2 + mwlen, win_len, bits,
+				mwlen, curr_m[0]);
 		}
 
 		/*
@@ -211,9 +235,193 @@ br_i31_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x,
 	m0i = br_i31_ninv31(curr_m[1]);
 	curr_m[0] = prev_bitlen;
 
+	memcpy(t1, x, mlen);
 	br_i31_from_monty(t1, curr_m, m0i);
 	br_i31_reduce(x, t1, m);
 	
 	return 1;
 }
 
+
+/* see inner.h */
+uint32_t
+br_i31_double_modpow_opt_rand(const br_prng_class ** rng, uint32_t *x1, uint32_t *x2,
+	const unsigned char *e1, size_t elen1, const unsigned char *e2, size_t elen2,
+	const uint32_t *m, uint32_t m0i, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen)
+{
+	size_t mlen, mwlen, elen, off1, off2;
+	uint32_t *t1, *t2, *curr_m;
+	size_t u, nwin;
+	uint32_t acc1, acc2, xlen;
+	int acc_len, win_len, prev_bitlen;
+	uint32_t BUFF[TLEN_TMP];
+	uint32_t r[(((2 * BR_RSA_RAND_FACTOR)) + 63) >> 5];
+	uint32_t new_r[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t pool[BR_RSA_RAND_POOL * BR_RSA_RAND_WLEN];
+	size_t pool_ptr, pool_len;
+
+	/*
+	 * Initial randomized modulus, as in br_i31_modpow_opt_rand().
+	 */
+	make_rand(rng, r, (2 * BR_RSA_RAND_FACTOR));
+	r[1] |= 1;
+	r[0] = br_i31_bit_length(r + 1, (((2 * BR_RSA_RAND_FACTOR)) + 31) >> 5);
+
+	curr_m = BUFF;
+	br_i31_zero(curr_m, m[0]);
+	br_i31_mulacc(curr_m, m, r);
+	curr_m[0] = br_i31_bit_length(curr_m + 1 , (curr_m[0] + 31) >> 5);
+	m0i = br_i31_ninv31(curr_m[1]);
+	prev_bitlen = curr_m[0];
+
+	mwlen = (curr_m[0] + 63 + 128) >> 5;
+	mlen = mwlen * sizeof curr_m[0];
+	mwlen += (mwlen & 1);
+	t1 = tmp;
+	t2 = tmp + mwlen;
+
+	xlen = (x1[0] + 63) >> 5;
+	for (; xlen < (curr_m[0] + 63) >> 5; xlen ++) {
+		x1[xlen] = 0;
+	}
+	x1[0] = curr_m[0];
+
+	if (twlen < (mwlen << 1)) {
+		return 0;
+	}
+
+	/*
+	 * Exponents are right-aligned: the shorter one is virtually
+	 * padded with leading zero bytes. One mask is drawn per window
+	 * and used for both exponentiations.
+	 */
+	elen = elen1 > elen2 ? elen1 : elen2;
+	off1 = elen - elen1;
+	off2 = elen - elen2;
+	win_len = br_i31_window_len(elen << 3, mwlen, twlen);
+	nwin = ((elen << 3) + win_len - 1) / win_len;
+	pool_ptr = 0;
+	pool_len = 0;
+
+	/*
+	 * Convert the base to Montgomery representation. With R^2 mod m
+	 * provided, it is turned into R'^2 mod m for the Montgomery
+	 * factor R' of the randomized modulus with a few word shifts
+	 * (one pair per extra word). Since m divides curr_m, that value
+	 * also stands for R'^2 modulo curr_m, and a single Montgomery
+	 * multiplication replaces br_i31_to_monty().
+	 */
+	if (r2 != NULL) {
+		size_t mw, cw;
+
+		mw = (m[0] + 31) >> 5;
+		cw = (curr_m[0] + 31) >> 5;
+		memcpy(t2, r2, (mw + 1) * sizeof *r2);
+		for (u = mw; u < cw; u ++) {
+			br_i31_muladd_small(t2, 0, m);
+			br_i31_muladd_small(t2, 0, m);
+		}
+		for (u = mw + 1; u <= cw; u ++) {
+			t2[u] = 0;
+		}
+		t2[0] = curr_m[0];
+		br_i31_montymul(t1, x1, t2, curr_m, m0i);
+		memcpy(x1, t1, mlen);
+	} else {
+		br_i31_to_monty(x1, curr_m);
+	}
+
+	/*
+	 * Build the window table once, from the common base.
+	 */
+	if (win_len == 1) {
+		memcpy(t2, x1, mlen);
+	} else {
+		br_i31_wtab_build(t2 + mwlen, win_len, x1, curr_m, m0i,
+			mwlen, t1);
+	}
+
+	/*
+	 * Set both accumulators to 1 (Montgomery representation).
+	 */
+	br_i31_zero(x1, curr_m[0]);
+	x1[(curr_m[0] + 31) >> 5] = 1;
+	br_i31_muladd_small(x1, 0, curr_m);
+	memcpy(x2, x1, mlen);
+
+	acc1 = 0;
+	acc2 = 0;
+	acc_len = 0;
+	u = 0;
+	while (acc_len > 0 || u < elen) {
+		int i, k;
+		uint32_t bits1, bits2;
+
+		k = win_len;
+		if (acc_len < win_len) {
+			if (u < elen) {
+				acc1 = (acc1 << 8)
+					| (u >= off1 ? e1[u - off1] : 0);
+				acc2 = (acc2 << 8)
+					| (u >= off2 ? e2[u - off2] : 0);
+				u ++;
+				acc_len += 8;
+			} else {
+				k = acc_len;
+			}
+		}
+		bits1 = (acc1 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		bits2 = (acc2 >> (acc_len - k)) & (((uint32_t)1 << k) - 1);
+		acc_len -= k;
+
+		/*
+		 * Re-randomize the modulus for this window.
+		 */
+		make_rand_pooled(rng, new_r, pool, &pool_ptr, &pool_len, nwin --);
+		prev_bitlen = curr_m[0];
+		br_i31_zero(curr_m, prev_bitlen);
+		br_i31_mulacc(curr_m, m, new_r);
+		curr_m[0] = br_i31_bit_length(curr_m + 1 , (curr_m[0] + 31) >> 5);
+		m0i = br_i31_ninv31(curr_m[1]);
+		curr_m[0] = prev_bitlen;
+
+		for (i = 0; i < k; i ++) {
+			br_i31_montysqr(t1, x1, curr_m, m0i);
+			memcpy(x1, t1, mlen);
+			br_i31_montysqr(t1, x2, curr_m, m0i);
+			memcpy(x2, t1, mlen);
+		}
+
+		if (win_len > 1) {
+			br_i31_wtab_get(t2, t2 + mwlen, win_len, bits1,
+				mwlen, curr_m[0]);
+		}
+		br_i31_montymul(t1, x1, t2, curr_m, m0i);
+		CCOPY(NEQ(bits1, 0), x1, t1, mlen);
+
+		if (win_len > 1) {
+			br_i31_wtab_get(t2, t2 + mwlen, win_len, bits2,
+				mwlen, curr_m[0]);
+		}
+		br_i31_montymul(t1, x2, t2, curr_m, m0i);
+		CCOPY(NEQ(bits2, 0), x2, t1, mlen);
+	}
+
+	/*
+	 * Convert both values back from Montgomery representation.
+	 */
+	br_i31_zero(curr_m, prev_bitlen);
+	br_i31_mulacc(curr_m, m, r);
+	m0i = br_i31_ninv31(curr_m[1]);
+	curr_m[0] = prev_bitlen;
+
+	memcpy(t1, x1, mlen);
+	br_i31_from_monty(t1, curr_m, m0i);
+	br_i31_reduce(x1, t1, m);
+	memcpy(t1, x2, mlen);
+	br_i31_from_monty(t1, curr_m, m0i);
+	br_i31_reduce(x2, t1, m);
+
+	return 1;
+}
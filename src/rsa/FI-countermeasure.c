@@ -28,9 +28,65 @@
 #define U      (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))
 #define TLEN   (24 * U)
 
+/*
+ * Check that s^e = c mod m, for the public exponent e (big-endian,
+ * over elen bytes). The exponent is public, hence a plain left-to-right
+ * square-and-multiply over its bits is used, without modulus
+ * randomization (for e = 65537, this is 16 squarings and one
+ * multiplication). Both s and c are converted in place to Montgomery
+ * representation, and the comparison is done there: s^e*R against c*R.
+ * s and c MUST be integers modulo m (same announced bit length); t1
+ * and t2 are temporaries as large as m. Returned value is 1 on match,
+ * 0 otherwise.
+ */
+static uint32_t
+check_pubexp(uint32_t *s, uint32_t *c,
+	const unsigned char *e, size_t elen,
+	const uint32_t *m, uint32_t m0i, uint32_t *t1, uint32_t *t2)
+{
+	size_t len, u;
+	uint32_t *a, *b, *w, cc;
+	int k;
+
+	while (elen > 0 && *e == 0) {
+		e ++;
+		elen --;
+	}
+	if (elen == 0) {
+		return 0;
+	}
+	len = (m[0] + 31) >> 5;
+	br_i31_to_monty(s, m);
+	br_i31_to_monty(c, m);
+	a = t1;
+	b = t2;
+	memcpy(a, s, (1 + len) * sizeof *s);
+	for (k = 7; ((e[0] >> k) & 1) == 0; k --);
+	for (u = 0; u < elen; u ++) {
+		for (k = (u == 0) ? k - 1 : 7; k >= 0; k --) {
+			br_i31_montysqr(b, a, m, m0i);
+			w = a;
+			a = b;
+			b = w;
+			if (((e[u] >> k) & 1) != 0) {
+				br_i31_montymul(b, a, s, m, m0i);
+				w = a;
+				a = b;
+				b = w;
+			}
+		}
+	}
+	cc = 0;
+	for (u = 1; u <= len; u ++) {
+		cc |= a[u] ^ c[u];
+	}
+	return EQ(cc, 0);
+}
+
 /* see bearssl_rsa.h */
 uint32_t
-br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
+br_rsa_i31_private_FI_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
 {
 	const unsigned char *p, *q;
         size_t plen, qlen;
@@ -115,28 +171,19 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
         rsa_sk.phi_q = phi_q;
         rsa_sk.e = e_buf;
     
-        unsigned char buffer[16];
-        ssize_t result;
-
-        // Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
-        //        and enough random data is available.
-        result = getrandom(buffer, sizeof(buffer), 0);
-
-        br_hmac_drbg_context rng;
-        br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result); //"seed for RSA SAFE", 17);
         
 
        
     
         uint32_t r1[(BR_RSA_RAND_FACTOR + 63) >> 5];
 
-        make_rand(&rng.vtable, r1, BR_RSA_RAND_FACTOR);
+        make_rand(rng, r1, BR_RSA_RAND_FACTOR);
         r1[1] |= 1;
         r1[0] = br_i31_bit_length(r1 + 1, (BR_RSA_RAND_FACTOR + 31) >> 5);
         
-        br_i31_init_key(&rng.vtable, sk, &rsa_sk, tmp, fwlen);
+        br_i31_init_key(rng, sk, &rsa_sk, tmp, fwlen);
 
-        br_i31_update_key(&rng.vtable, &rsa_sk, tmp, fwlen);
+        br_i31_update_key(rng, &rsa_sk, tmp, fwlen);
         /*
          * Decode q.
          */
@@ -229,7 +276,7 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
 
         
         unsigned char* dq = (unsigned char *) (tmp + 6 *fwlen); 
-        size_t dqlen = blind_exponent(&rng.vtable, dq, rsa_sk.dq, rsa_sk.dqlen, rsa_sk.phi_q, tmp + 7 * fwlen);
+        size_t dqlen = blind_exponent(rng, dq, rsa_sk.dq, rsa_sk.dqlen, rsa_sk.phi_q, tmp + 7 * fwlen);
 
 
         uint32_t * s2_prime = tmp + 2 * fwlen;
@@ -245,7 +292,7 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
         q0i = br_i31_ninv31(mq[1]);
 
 
-        r &= br_i31_modpow_opt_rand(&rng.vtable, s2, dq, dqlen, mq, q0i,
+        r &= br_i31_modpow_opt_rand(rng, s2, dq, dqlen, mq, q0i,
                 tmp + 7 * fwlen, TLEN - 7 * fwlen);
         
          /*
@@ -254,7 +301,7 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
 
         uint32_t r20i = br_i31_ninv31(rsa_sk.r2[1]);
 
-        r &= br_i31_modpow_opt_rand(&rng.vtable, s2_prime, dq, dqlen, rsa_sk.r2, r20i,
+        r &= br_i31_modpow_opt_rand(rng, s2_prime, dq, dqlen, rsa_sk.r2, r20i,
                 tmp + 7 * fwlen, TLEN - 7 * fwlen);
 
        
@@ -263,7 +310,7 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
          */
         
         unsigned char* dp = (unsigned char *) (tmp + 6 *fwlen); 
-        size_t dplen = blind_exponent(&rng.vtable, dp, rsa_sk.dp, rsa_sk.dplen, rsa_sk.phi_p, tmp + 7 * fwlen);
+        size_t dplen = blind_exponent(rng, dp, rsa_sk.dp, rsa_sk.dplen, rsa_sk.phi_p, tmp + 7 * fwlen);
 
         uint32_t * s1_prime = tmp + 3 * fwlen;
        
@@ -275,7 +322,7 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
         p0i = br_i31_ninv31(mp[1]);
         
        
-        r &= br_i31_modpow_opt_rand(&rng.vtable, s1, dp, dplen, mp, p0i,
+        r &= br_i31_modpow_opt_rand(rng, s1, dp, dplen, mp, p0i,
                 tmp + 7 * fwlen, TLEN - 7 * fwlen);
         
          /*
@@ -284,7 +331,7 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
 
         uint32_t r10i = br_i31_ninv31(rsa_sk.r1[1]);
 
-        r &= br_i31_modpow_opt_rand(&rng.vtable, s1_prime, dp, dplen, rsa_sk.r1, r10i,
+        r &= br_i31_modpow_opt_rand(rng, s1_prime, dp, dplen, rsa_sk.r1, r10i,
                 tmp + 7 * fwlen, TLEN - 7 * fwlen);
 
 
@@ -368,25 +415,20 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
         t2[0] = n[0];
         t1[0] = n[0];
         
-        r &= br_i31_moddiv(t1, t2, n, br_i31_ninv31(n[1]), tmp + 8 * fwlen);
+        r &= br_i62_modinv(t1, t2, n, tmp + 8 * fwlen);
         
         /*
-         * Check wheter s^e = x mod n
+         * Check whether s^e = x mod n (with the public exponent, on the
+         * plain modulus; see check_pubexp()).
          */
 
-        br_i31_zero(t2, n[0]);
-        memcpy(t2 + 1, t1 + 1, (t1[0] + 7 >> 3));
-        t2[0] = t1[0];
-        
-        br_i31_modpow_opt_rand(&rng.vtable, t2, rsa_sk.e, rsa_sk.elen, n, br_i31_ninv31(n[1]),
-                tmp + 8 * fwlen, TLEN - 8 * fwlen);      
-
-        unsigned char * c_verif = (unsigned char *) n;
-        br_i31_encode(c_verif, xlen, t2);
-        uint32_t mask = 0xFFFFFFFF;
-        for( int i = 0; i < xlen; ++i){
-               mask &= -EQ(c_verif[i],x[i]);
-        }
+        t2 = tmp + 6 * fwlen;
+        memcpy(t2, t1, (1 + ((n[0] + 31) >> 5)) * sizeof *t1);
+        c = tmp + 12 * fwlen;
+        br_i31_zero(c, n[0]);
+        br_i31_decode_reduce(c, x, xlen, n);
+        uint32_t mask = -check_pubexp(t2, c, rsa_sk.e, rsa_sk.elen,
+                n, br_i31_ninv31(n[1]), tmp + 8 * fwlen, tmp + 10 * fwlen);
         for( int i = 0; i < xlen; ++i){
                 t1[i] &= mask;
         }
@@ -405,3 +447,21 @@ br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
          */
         return p0i & q0i & r;
 }
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_FI(unsigned char *x, const br_rsa_private_key *sk)
+{
+        unsigned char buffer[16];
+        ssize_t result;
+        br_hmac_drbg_context rng;
+
+        // Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
+        //        and enough random data is available.
+        result = getrandom(buffer, sizeof(buffer), 0);
+        if (result <= 0) {
+                return 0;
+        }
+        br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result);
+        return br_rsa_i31_private_FI_rng(&rng.vtable, x, sk);
+}
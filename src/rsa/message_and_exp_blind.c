@@ -31,7 +31,8 @@
 
 /* see bearssl_rsa.h */
 uint32_t
-br_rsa_i31_private_msg_blind(unsigned char *x, const br_rsa_private_key *sk)
+br_rsa_i31_private_msg_blind_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
 {
 	const unsigned char *p, *q;
 	size_t plen, qlen;
@@ -44,19 +45,10 @@ br_rsa_i31_private_msg_blind(unsigned char *x, const br_rsa_private_key *sk)
 	uint32_t r;
 
 	mq = tmp;
-	unsigned char buffer[16];
-    ssize_t result;
-
-   	// Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
-    //        and enough random data is available.
-    result = getrandom(buffer, sizeof(buffer), 0);
-    
-	br_hmac_drbg_context rng;
-	br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result);
 	
 
 	uint32_t r1[(BR_RSA_RAND_FACTOR + 63) >> 5];
-	make_rand(&rng.vtable, r1, BR_RSA_RAND_FACTOR);
+	make_rand(rng, r1, BR_RSA_RAND_FACTOR);
 	r1[0] = br_i31_bit_length(r1 + 1, (BR_RSA_RAND_FACTOR + 31) >> 5);
 	
 	/*
@@ -203,7 +195,7 @@ br_rsa_i31_private_msg_blind(unsigned char *x, const br_rsa_private_key *sk)
 
 	unsigned char* dq = (unsigned char *) (tmp + 6 *fwlen); 
 	mq[1] ^= 1;
-	size_t dqlen = blind_exponent(&rng.vtable,dq, sk->dq, sk->dqlen, mq, tmp + 7 * fwlen);
+	size_t dqlen = blind_exponent(rng,dq, sk->dq, sk->dqlen, mq, tmp + 7 * fwlen);
 	mq[1] ^= 1;
 	r &= br_i31_modpow_opt(s2, dq, dqlen, mq, q0i,
 		tmp + 7 * fwlen, TLEN - 7 * fwlen);
@@ -213,7 +205,7 @@ br_rsa_i31_private_msg_blind(unsigned char *x, const br_rsa_private_key *sk)
 	p0i = br_i31_ninv31(mp[1]);
 	unsigned char* dp = (unsigned char *) (tmp + 6 *fwlen); 
 	mp[1] ^= 1;
-	size_t dplen = blind_exponent(&rng.vtable,dp, sk->dp, sk->dplen, mp, tmp + 7 * fwlen);
+	size_t dplen = blind_exponent(rng,dp, sk->dp, sk->dplen, mp, tmp + 7 * fwlen);
 	mp[1] ^= 1;
 	r &= br_i31_modpow_opt(s1, dp, dplen, mp, p0i,
 		tmp + 7 * fwlen, TLEN - 7 * fwlen);
@@ -259,7 +251,7 @@ br_rsa_i31_private_msg_blind(unsigned char *x, const br_rsa_private_key *sk)
 	t3[0] = n[0];
 	t1[0] = n[0];
 	
-	r &= br_i31_moddiv(t3, t1, n, br_i31_ninv31(n[1]), tmp + 6 * fwlen);
+	r &= br_i62_modinv(t3, t1, n, tmp + 6 * fwlen);
 	
 	/*
 	 * Encode the result. Since we already checked the value of xlen,
@@ -273,3 +265,21 @@ br_rsa_i31_private_msg_blind(unsigned char *x, const br_rsa_private_key *sk)
 	 */
 	return p0i & q0i & r;
 }
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_msg_blind(unsigned char *x, const br_rsa_private_key *sk)
+{
+	unsigned char buffer[16];
+	ssize_t result;
+	br_hmac_drbg_context rng;
+
+	// Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
+	//        and enough random data is available.
+	result = getrandom(buffer, sizeof(buffer), 0);
+	if (result <= 0) {
+		return 0;
+	}
+	br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result);
+	return br_rsa_i31_private_msg_blind_rng(&rng.vtable, x, sk);
+}
@@ -27,115 +27,39 @@
 #define U      (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))
 #define TLEN   (24 * U)
 
-
-
-/* see bearssl_rsa.h */
-uint32_t
-br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
+/*
+ * Run the CRT private key operation with an already pre-randomized key
+ * (as produced by init_key() and update_key()). The message is blinded
+ * with a fresh random mask, and exponents are blinded with the masked
+ * phi(p) and phi(q) values. The tmp[] buffer must have room for TLEN
+ * words; fwlen is the factor length (in words) used to lay out the
+ * temporaries. If events is not NULL, it receives
+ * BR_RSA_PROTECTED_EV_RANGE if the input is not lower than the
+ * modulus, 0 otherwise.
+ */
+static uint32_t
+mod_prerand_core(const br_prng_class **rng, unsigned char *x,
+        const br_rsa_private_key *rsa_sk, size_t fwlen,
+        br_rsa_i31_protected_context *bctx, uint32_t *tmp, uint32_t *events)
 {
-        const unsigned char *p, *q;
-        size_t plen, qlen;
-        size_t fwlen;
-        uint32_t p0i, q0i;
+        uint32_t p0i, q0i, n0i;
         size_t xlen, u;
-        uint32_t tmp[1 + TLEN];
-        long z;
         uint32_t *mp, *mq, *s1, *s2, *t1, *t2, *t3;
         uint32_t r;
+        uint32_t r_inv[2 + ((BR_MAX_RSA_SIZE + 30) / 31)];
 
-        
-
-        /*
-         * Compute the actual lengths of p and q, in bytes.
-         * These lengths are not considered secret (we cannot really hide
-         * them anyway in constant-time code).
-         */
-        p = sk->p;
-        plen = sk->plen;
-
-        while (plen > 0 && *p == 0) {
-                p ++;
-                plen --;
-        }
-        q = sk->q;
-        qlen = sk->qlen;
-        while (qlen > 0 && *q == 0) {
-                q ++;
-                qlen --;
-        }
-        /*
-         * Compute the maximum factor length, in words.
-         */
-        z = (long)(plen > qlen ? plen : qlen) << 3;
-        fwlen =  1 + 18;
-        while (z > 0) {
-                z -= 31;
-                fwlen ++;
-        }
-
-        /*
-         * Round up the word length to an even number.
-         */
-        fwlen += (fwlen & 1);
-
-        /*
-         * We need to fit at least 6 values in the stack buffer.
-         */
-        if (6 * fwlen > TLEN) {
-                return 0;
-        }
+        xlen = (rsa_sk->n_bitlen + 7) >> 3;
 
         /*
-         * Compute modulus length (in bytes).
+         * With a key context, the message blinding pair comes from
+         * the context; otherwise a fresh random r is used.
          */
-        xlen = (sk->n_bitlen + 7) >> 3;
-    
-  
-        br_rsa_private_key rsa_sk;
-        mq = tmp;
-        uint32_t r2[(BR_RSA_RAND_FACTOR + 63) >> 5];
-        uint32_t r3[(BR_RSA_RAND_FACTOR + 63) >> 5];
-        uint32_t phi_p[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR +  63) >> 5];
-        uint32_t phi_q[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
-        unsigned char n_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-        unsigned char p_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
-        unsigned char q_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
-        unsigned char dp_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-        unsigned char dq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-        unsigned char iq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-        unsigned char e_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-        rsa_sk.r1 = r2;
-        rsa_sk.r2 = r3;
-        rsa_sk.n = n_buf;
-        rsa_sk.p = p_buf;
-        rsa_sk.q = q_buf;
-        rsa_sk.dp = dp_buf;
-        rsa_sk.dq = dq_buf;
-        rsa_sk.iq = iq_buf;
-        rsa_sk.phi_p = phi_p;
-        rsa_sk.phi_q = phi_q;
-        rsa_sk.e = e_buf;
-    
-        unsigned char buffer[16];
-        ssize_t result;
-
-        // Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
-        //        and enough random data is available.
-        result = getrandom(buffer, sizeof(buffer), 0);
-
-        br_hmac_drbg_context rng;
-        br_hmac_drbg_init(&rng, &br_sha256_vtable,buffer, result); // "seed for RSA SAFE", 17);
-        
-
-
-
-        init_key(&rng.vtable, sk, &rsa_sk, tmp, fwlen);
-
-        update_key(&rng.vtable, &rsa_sk, tmp, fwlen);
-    
         uint32_t r1[(BR_RSA_RAND_FACTOR + 63) >> 5];
-        make_rand(&rng.vtable, r1, BR_RSA_RAND_FACTOR);
-        r1[0] = br_i31_bit_length(r1 + 1, (BR_RSA_RAND_FACTOR + 31) >> 5);
+        if (bctx == NULL) {
+                make_rand(rng, r1, BR_RSA_RAND_FACTOR);
+                r1[0] = br_i31_bit_length(r1 + 1,
+                        (BR_RSA_RAND_FACTOR + 31) >> 5);
+        }
         
 
         /*
@@ -157,8 +81,7 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
          */
         
         t2 = mq + 2 * fwlen;
-        br_i31_zero(t2, mq[0]);
-        br_i31_decode(t2, rsa_sk.n, (rsa_sk.n_bitlen + 7) >> 3);
+        br_i31_decode(t2, rsa_sk->n, (rsa_sk->n_bitlen + 7) >> 3);
         /*
          * We encode the modulus into bytes, to perform the comparison
          * with bytes. We know that the product length, in bytes, is
@@ -180,13 +103,16 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
                 wx = x[u];
                 r = ((wx - (wn + r)) >> 8) & 1;
         }
+        if (events != NULL) {
+                *events = (r ^ 1) * BR_RSA_PROTECTED_EV_RANGE;
+        }
         
         /*
          * Compute (r^e * C) (mod n)
          */     
         
         uint32_t *n = t2;
-        br_i31_decode(n, rsa_sk.n, (rsa_sk.n_bitlen + 7) >> 3);
+        br_i31_decode(n, rsa_sk->n, (rsa_sk->n_bitlen + 7) >> 3);
         uint32_t *c = t3;
         uint32_t *c_prime = mq + 6 * fwlen;
         uint32_t * r_to_e = mq; 
@@ -194,11 +120,19 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
         br_i31_zero(c, n[0]);
         br_i31_decode_reduce(c, x, xlen, n);
         
-        br_i31_zero(r_to_e, n[0]);
-        memcpy(r_to_e + 1, r1 + 1,  ((*r1 + 7) >> 3));
-        r_to_e[0] = n[0];
-
-        r &= br_i31_modpow_opt(r_to_e, rsa_sk.e, rsa_sk.elen, n,  br_i31_ninv31(n[1]), mq + 8 * fwlen, TLEN - 8 * fwlen);
+        n0i = br_i31_ninv31(n[1]);
+        if (bctx != NULL) {
+                r &= br_rsa_i31_blind_pair_take(bctx, n, n0i,
+                        r_to_e, r_inv, mq + 8 * fwlen, TLEN - 8 * fwlen);
+                br_i31_from_monty(r_to_e, n, n0i);
+        } else {
+                br_i31_zero(r_to_e, n[0]);
+                memcpy(r_to_e + 1, r1 + 1,  ((*r1 + 7) >> 3));
+                r_to_e[0] = n[0];
+
+                r &= br_i31_modpow_opt(r_to_e, rsa_sk->e, rsa_sk->elen,
+                        n, n0i, mq + 8 * fwlen, TLEN - 8 * fwlen);
+        }
 
         br_i31_zero(c_prime, n[0]);
         c[0] = c_prime[0];
@@ -208,8 +142,8 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
         mp = tmp + 5 * fwlen;
 
 
-        br_i31_decode(mq,  rsa_sk.q,  rsa_sk.qlen);
-        br_i31_decode(mp,  rsa_sk.p,  rsa_sk.plen);
+        br_i31_decode(mq,  rsa_sk->q,  rsa_sk->qlen);
+        br_i31_decode(mp,  rsa_sk->p,  rsa_sk->plen);
     
         s2 = tmp;
         s1 = tmp + fwlen;
@@ -230,7 +164,7 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
 
         
         unsigned char* dq = (unsigned char *) (tmp + 6 *fwlen); 
-        size_t dqlen = blind_exponent(&rng.vtable, dq, rsa_sk.dq, rsa_sk.dqlen, rsa_sk.phi_q, tmp + 7 * fwlen);
+        size_t dqlen = blind_exponent(rng, dq, rsa_sk->dq, rsa_sk->dqlen, rsa_sk->phi_q, tmp + 7 * fwlen);
 
                 
         /*
@@ -239,7 +173,7 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
         q0i = br_i31_ninv31(mq[1]);
 
         
-        r &= br_i31_modpow_opt_rand(&rng.vtable, s2, dq, dqlen, mq, q0i,
+        r &= br_i31_modpow_opt_rand(rng, s2, dq, dqlen, mq, q0i,
                 tmp + 7 * fwlen, TLEN - 7 * fwlen);
         
         /*
@@ -247,12 +181,12 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
          */
         
         unsigned char* dp = (unsigned char *) (tmp + 6 *fwlen); 
-        size_t dplen = blind_exponent(&rng.vtable, dp, rsa_sk.dp, rsa_sk.dplen, rsa_sk.phi_p, tmp + 7 * fwlen);
+        size_t dplen = blind_exponent(rng, dp, rsa_sk->dp, rsa_sk->dplen, rsa_sk->phi_p, tmp + 7 * fwlen);
 
         
         p0i = br_i31_ninv31(mp[1]);
         
-        r &= br_i31_modpow_opt_rand(&rng.vtable, s1, dp, dplen, mp, p0i,
+        r &= br_i31_modpow_opt_rand(rng, s1, dp, dplen, mp, p0i,
                 tmp + 8 * fwlen, TLEN - 8 * fwlen);
         
         /*
@@ -275,7 +209,7 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
         br_i31_reduce(t2, s2, mp); 
         br_i31_add(s1, mp, br_i31_sub(s1, t2, 1));
         br_i31_to_monty(s1, mp);
-        br_i31_decode_reduce(t1,  rsa_sk.iq,  rsa_sk.iqlen, mp);
+        br_i31_decode_reduce(t1,  rsa_sk->iq,  rsa_sk->iqlen, mp);
         br_i31_montymul(t2, s1, t1, mp, p0i);
         
         /*
@@ -299,12 +233,16 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
         
 
         t2 = tmp + 6 * fwlen;
-        br_i31_zero(t2, n[0]);
-        memcpy(t2 + 1, r1 + 1, (*r1 + 7) >> 3);
-        t2[0] = n[0];
         t1[0] = n[0];
-        
-        r &= br_i31_moddiv(t1, t2, n, br_i31_ninv31(n[1]), tmp + 8 * fwlen);
+        if (bctx != NULL) {
+                br_i31_montymul(t2, t1, r_inv, n, n0i);
+                t1 = t2;
+        } else {
+                br_i31_zero(t2, n[0]);
+                memcpy(t2 + 1, r1 + 1, (*r1 + 7) >> 3);
+                t2[0] = n[0];
+                r &= br_i62_modinv(t1, t2, n, tmp + 8 * fwlen);
+        }
         
         /*
          * Encode the result. Since we already checked the value of xlen,
@@ -321,3 +259,137 @@ br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
          */
         return p0i & q0i & r;
 }
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_mod_prerand_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
+{
+        const unsigned char *p, *q;
+        size_t plen, qlen;
+        size_t fwlen;
+        uint32_t tmp[1 + TLEN];
+        long z;
+
+        
+
+        /*
+         * Compute the actual lengths of p and q, in bytes.
+         * These lengths are not considered secret (we cannot really hide
+         * them anyway in constant-time code).
+         */
+        p = sk->p;
+        plen = sk->plen;
+
+        while (plen > 0 && *p == 0) {
+                p ++;
+                plen --;
+        }
+        q = sk->q;
+        qlen = sk->qlen;
+        while (qlen > 0 && *q == 0) {
+                q ++;
+                qlen --;
+        }
+        /*
+         * Compute the maximum factor length, in words.
+         */
+        z = (long)(plen > qlen ? plen : qlen) << 3;
+        fwlen =  1 + 18;
+        while (z > 0) {
+                z -= 31;
+                fwlen ++;
+        }
+
+        /*
+         * Round up the word length to an even number.
+         */
+        fwlen += (fwlen & 1);
+
+        /*
+         * We need to fit at least 6 values in the stack buffer.
+         */
+        if (6 * fwlen > TLEN) {
+                return 0;
+        }
+
+        br_rsa_private_key rsa_sk;
+        uint32_t r2[(BR_RSA_RAND_FACTOR + 63) >> 5];
+        uint32_t r3[(BR_RSA_RAND_FACTOR + 63) >> 5];
+        uint32_t phi_p[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR +  63) >> 5];
+        uint32_t phi_q[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
+        unsigned char n_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+        unsigned char p_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+        unsigned char q_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+        unsigned char dp_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+        unsigned char dq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+        unsigned char iq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+        unsigned char e_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+        rsa_sk.r1 = r2;
+        rsa_sk.r2 = r3;
+        rsa_sk.n = n_buf;
+        rsa_sk.p = p_buf;
+        rsa_sk.q = q_buf;
+        rsa_sk.dp = dp_buf;
+        rsa_sk.dq = dq_buf;
+        rsa_sk.iq = iq_buf;
+        rsa_sk.phi_p = phi_p;
+        rsa_sk.phi_q = phi_q;
+        rsa_sk.e = e_buf;
+    
+        
+
+
+
+        init_key(rng, sk, &rsa_sk, tmp, fwlen);
+
+        update_key(rng, &rsa_sk, tmp, fwlen);
+
+        return mod_prerand_core(rng, x, &rsa_sk, fwlen, NULL, tmp, NULL);
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_mod_prerand(unsigned char *x, const br_rsa_private_key *sk)
+{
+        unsigned char buffer[16];
+        ssize_t result;
+        br_hmac_drbg_context rng;
+
+        // Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
+        //        and enough random data is available.
+        result = getrandom(buffer, sizeof(buffer), 0);
+        if (result <= 0) {
+                return 0;
+        }
+        br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result);
+        return br_rsa_i31_private_mod_prerand_rng(&rng.vtable, x, sk);
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_mod_prerand_ctx(unsigned char *x,
+        br_rsa_i31_protected_context *ctx)
+{
+        uint32_t tmp[1 + TLEN];
+        uint32_t r, ev;
+
+        /*
+         * The masked key is re-randomized every refresh_period
+         * operations; init_key() already ran when the context was
+         * loaded, so the first operation uses the initial masks.
+         */
+        if (ctx->refresh_period != 0) {
+                if (ctx->op_count >= ctx->refresh_period) {
+                        br_rsa_i31_protected_refresh(ctx);
+                }
+                ctx->op_count ++;
+        }
+        if (!ctx->wk_ok) {
+                return 0;
+        }
+        r = mod_prerand_core(&ctx->rng.vtable, x, &ctx->sk,
+                ctx->fwlen, ctx, tmp, &ev);
+        br_rsa_i31_protected_record(ctx, ev);
+        return r;
+}
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/random.h>
+
+#include "inner.h"
+
+/*
+ * i15 version of the protected engine of rsa_secured.c, for small
+ * cores where 32x32->64 multiplications are not constant-time (see
+ * BR_LOMUL). Same countermeasures: key pre-randomization (masked factors,
+ * exponents and CRT coefficient, refreshed on each call), message
+ * blinding with r^e, exponent blinding, per-window modulus
+ * randomization, and a fault check: with co_d = phi - (d mod phi), the
+ * values x^d*x^co_d mod p' and mod q' are recombined and must yield 1.
+ */
+
+#define U      (2 + ((BR_MAX_RSA_FACTOR + 14) / 15))
+#define TLEN   (40 * U)
+
+/*
+ * Room (in 15-bit words) added to the factor length for the masks: the
+ * factors are multiplied by r1 (or r2), then by the per-exponentiation
+ * mask of 2*BR_RSA_RAND_FACTOR bits.
+ */
+#define MASK_ROOM   (2 + (3 * BR_RSA_RAND_FACTOR + 14) / 15)
+
+/*
+ * Compute co_d = phi - (d mod phi), encoded in dst[] (returned value is
+ * its length in bytes). The t[] buffer must have room for two integers
+ * of 'fwlen' words.
+ */
+static size_t
+co_exponent(unsigned char *dst, const unsigned char *d, size_t dlen,
+	const uint16_t *phi, uint16_t *t, size_t fwlen)
+{
+	uint16_t *t1, *t2;
+	size_t len;
+
+	t1 = t;
+	t2 = t + fwlen;
+	br_i15_decode_reduce(t1, d, dlen, phi);
+	memcpy(t2, phi, (((phi[0] + 15) >> 4) + 1) * sizeof *phi);
+	br_i15_sub(t2, t1, 1);
+	t2[0] = (uint16_t)br_i15_bit_length(t2 + 1, (t2[0] + 15) >> 4);
+	len = (((t2[0] & 15) + (size_t)(t2[0] >> 4) * 15) + 7) >> 3;
+	br_i15_encode(dst, len, t2);
+	return len;
+}
+
+/*
+ * CRT recombination: given s1 (mod p) and s2 (mod q), compute
+ * s2 + q*((s1 - s2)*iq mod p) into s2 (which must have room for the
+ * product); s1 is destroyed. t1 and t2 are temporaries with the size
+ * of p.
+ */
+static void
+crt(uint16_t *s1, uint16_t *s2, const uint16_t *mp, const uint16_t *mq,
+	uint16_t p0i, const unsigned char *iq, size_t iqlen,
+	uint16_t *t1, uint16_t *t2)
+{
+	br_i15_reduce(t2, s2, mp);
+	br_i15_add(s1, mp, br_i15_sub(s1, t2, 1));
+	br_i15_to_monty(s1, mp);
+	br_i15_decode_reduce(t1, iq, iqlen, mp);
+	br_i15_montymul(t2, s1, t1, mp, p0i);
+	br_i15_mulacc(s2, mq, t2);
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i15_private_protected_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
+{
+	const unsigned char *p, *q;
+	size_t plen, qlen;
+	size_t fwlen;
+	uint16_t p0i, q0i;
+	size_t xlen, u, dlen, co_dlen;
+	uint16_t tmp[1 + TLEN];
+	long z;
+	uint16_t *mp, *mq, *s1, *s2, *co_s1, *co_s2, *t1, *t2, *t3, *n;
+	uint16_t phi_p[2 + U + MASK_ROOM], phi_q[2 + U + MASK_ROOM];
+	uint16_t rm[2 + ((BR_RSA_RAND_FACTOR + 14) / 15)];
+	unsigned char *dx, *co_dx;
+	uint32_t r, acc;
+
+	br_rsa_private_key rsa_sk;
+	uint32_t r1_buf[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t r2_buf[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t phi_p_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t phi_q_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
+	unsigned char n_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char p_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+	unsigned char q_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+	unsigned char dp_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char dq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char iq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char e_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+
+	/*
+	 * Compute the actual lengths of p and q, in bytes.
+	 * These lengths are not considered secret (we cannot really hide
+	 * them anyway in constant-time code).
+	 */
+	p = sk->p;
+	plen = sk->plen;
+	while (plen > 0 && *p == 0) {
+		p ++;
+		plen --;
+	}
+	q = sk->q;
+	qlen = sk->qlen;
+	while (qlen > 0 && *q == 0) {
+		q ++;
+		qlen --;
+	}
+
+	/*
+	 * Compute the maximum factor length, in words, with room for the
+	 * masks, rounded up to an even number.
+	 */
+	z = (long)(plen > qlen ? plen : qlen) << 3;
+	fwlen = 1 + MASK_ROOM;
+	while (z > 0) {
+		z -= 15;
+		fwlen ++;
+	}
+	fwlen += (fwlen & 1);
+
+	/*
+	 * We need 17 values for the key masking, and a few more for
+	 * the exponentiations.
+	 */
+	if (17 * fwlen > TLEN || sk->n_bitlen > BR_MAX_RSA_SIZE) {
+		return 0;
+	}
+
+	/*
+	 * Compute modulus length (in bytes).
+	 */
+	xlen = (sk->n_bitlen + 7) >> 3;
+
+	/*
+	 * Mask the key (a fresh masked copy for each call).
+	 */
+	rsa_sk.r1 = r1_buf;
+	rsa_sk.r2 = r2_buf;
+	rsa_sk.n = n_buf;
+	rsa_sk.p = p_buf;
+	rsa_sk.q = q_buf;
+	rsa_sk.dp = dp_buf;
+	rsa_sk.dq = dq_buf;
+	rsa_sk.iq = iq_buf;
+	rsa_sk.phi_p = phi_p_buf;
+	rsa_sk.phi_q = phi_q_buf;
+	rsa_sk.e = e_buf;
+	init_key_i15(rng, sk, &rsa_sk, tmp, fwlen);
+	update_key_i15(rng, &rsa_sk, tmp, fwlen);
+	br_i15_from_i31(phi_p, rsa_sk.phi_p);
+	br_i15_from_i31(phi_q, rsa_sk.phi_q);
+
+	/*
+	 * Check that the source value is lower than the modulus; as in
+	 * the unprotected engine, we compare the encoded bytes and keep
+	 * the carry in r.
+	 */
+	n = tmp + 2 * fwlen;
+	br_i15_decode(n, rsa_sk.n, xlen);
+	t3 = tmp + 4 * fwlen;
+	br_i15_encode(t3, xlen, n);
+	u = xlen;
+	r = 0;
+	while (u > 0) {
+		uint32_t wn, wx;
+
+		u --;
+		wn = ((unsigned char *)t3)[u];
+		wx = x[u];
+		r = ((wx - (wn + r)) >> 8) & 1;
+	}
+
+	/*
+	 * Message blinding: C' = C * rm^e (product not reduced).
+	 */
+	make_rand_i15(rng, rm, BR_RSA_RAND_FACTOR);
+	t1 = tmp;
+	t2 = tmp + 4 * fwlen;
+	t3 = tmp + 6 * fwlen;
+	br_i15_decode_reduce(t2, x, xlen, n);
+	br_i15_zero(t1, n[0]);
+	memcpy(t1 + 1, rm + 1, ((rm[0] + 15) >> 4) * sizeof *rm);
+	r &= br_i15_modpow_opt(t1, rsa_sk.e, rsa_sk.elen, n,
+		br_i15_ninv15(n[1]), tmp + 10 * fwlen, TLEN - 10 * fwlen);
+	br_i15_zero(t3, n[0]);
+	br_i15_mulacc(t3, t2, t1);
+
+	/*
+	 * Reduce C' modulo the masked factors.
+	 */
+	mq = tmp + 4 * fwlen;
+	mp = tmp + 5 * fwlen;
+	br_i15_decode(mq, rsa_sk.q, rsa_sk.qlen);
+	br_i15_decode(mp, rsa_sk.p, rsa_sk.plen);
+	s2 = tmp;
+	s1 = tmp + fwlen;
+	co_s2 = tmp + 2 * fwlen;
+	co_s1 = tmp + 3 * fwlen;
+	br_i15_reduce(s1, t3, mp);
+	br_i15_reduce(s2, t3, mq);
+	dx = (unsigned char *)(tmp + 6 * fwlen);
+	co_dx = (unsigned char *)(tmp + 7 * fwlen);
+
+	/*
+	 * s2 = C'^dq' and co_s2 = C'^co_dq' mod q', with a freshly
+	 * blinded dq' and co_dq' computed before blinding.
+	 */
+	q0i = br_i15_ninv15(mq[1]);
+	co_dlen = co_exponent(co_dx, rsa_sk.dq, rsa_sk.dqlen, phi_q,
+		tmp + 8 * fwlen, fwlen);
+	dlen = blind_exponent_i15(rng, dx, rsa_sk.dq, rsa_sk.dqlen, phi_q,
+		tmp + 8 * fwlen);
+	br_i15_zero(co_s2, mq[0]);
+	r &= br_i15_double_modpow_opt_rand(rng, s2, co_s2,
+		dx, dlen, co_dx, co_dlen, mq, q0i,
+		tmp + 8 * fwlen, TLEN - 8 * fwlen);
+	t1 = tmp + 6 * fwlen;
+	br_i15_zero(t1, mq[0]);
+	br_i15_mulacc(t1, s2, co_s2);
+	br_i15_reduce(co_s2, t1, mq);
+
+	/*
+	 * Same modulo p'.
+	 */
+	p0i = br_i15_ninv15(mp[1]);
+	co_dlen = co_exponent(co_dx, rsa_sk.dp, rsa_sk.dplen, phi_p,
+		tmp + 8 * fwlen, fwlen);
+	dlen = blind_exponent_i15(rng, dx, rsa_sk.dp, rsa_sk.dplen, phi_p,
+		tmp + 8 * fwlen);
+	br_i15_zero(co_s1, mp[0]);
+	r &= br_i15_double_modpow_opt_rand(rng, s1, co_s1,
+		dx, dlen, co_dx, co_dlen, mp, p0i,
+		tmp + 8 * fwlen, TLEN - 8 * fwlen);
+	t1 = tmp + 6 * fwlen;
+	br_i15_zero(t1, mp[0]);
+	br_i15_mulacc(t1, s1, co_s1);
+	br_i15_reduce(co_s1, t1, mp);
+
+	/*
+	 * Fault check: recombine co_s1 and co_s2 (in co_s2, which extends
+	 * over the co_s1 slot), reduce modulo n; the result must be 1.
+	 */
+	crt(co_s1, co_s2, mp, mq, p0i, rsa_sk.iq, rsa_sk.iqlen,
+		tmp + 6 * fwlen, tmp + 7 * fwlen);
+	n = tmp + 8 * fwlen;
+	t1 = tmp + 6 * fwlen;
+	br_i15_decode(n, rsa_sk.n, xlen);
+	br_i15_reduce(t1, co_s2, n);
+	acc = t1[1] ^ 1;
+	for (u = 2; u <= ((size_t)(n[0] + 15) >> 4); u ++) {
+		acc |= t1[u];
+	}
+	r &= EQ(acc, 0);
+
+	/*
+	 * Actual result: recombine s1 and s2 (into s2, which extends over
+	 * the s1 slot), reduce modulo n, and remove the message mask.
+	 */
+	crt(s1, s2, mp, mq, p0i, rsa_sk.iq, rsa_sk.iqlen,
+		tmp + 6 * fwlen, tmp + 7 * fwlen);
+	t1 = tmp + 4 * fwlen;
+	t2 = tmp + 6 * fwlen;
+	br_i15_reduce(t1, s2, n);
+	br_i15_zero(t2, n[0]);
+	memcpy(t2 + 1, rm + 1, ((rm[0] + 15) >> 4) * sizeof *rm);
+	r &= br_i15_moddiv(t1, t2, n, br_i15_ninv15(n[1]), tmp + 10 * fwlen);
+
+	/*
+	 * On a failed fault check, the (possibly faulty) result is
+	 * replaced with zero, so that it never reaches the caller.
+	 */
+	acc = -EQ(acc, 0);
+	for (u = 1; u <= ((size_t)(n[0] + 15) >> 4); u ++) {
+		t1[u] &= (uint16_t)acc;
+	}
+
+	br_i15_encode(x, xlen, t1);
+
+	/*
+	 * The only error conditions remaining at that point are invalid
+	 * values for p and q (even integers).
+	 */
+	return p0i & q0i & r;
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i15_private_protected(unsigned char *x, const br_rsa_private_key *sk)
+{
+	unsigned char buffer[16];
+	ssize_t result;
+	br_hmac_drbg_context rng;
+
+	// Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
+	//        and enough random data is available.
+	result = getrandom(buffer, sizeof(buffer), 0);
+	if (result <= 0) {
+		return 0;
+	}
+	br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result);
+	return br_rsa_i15_private_protected_rng(&rng.vtable, x, sk);
+}
@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+/*
+ * i15 versions of the key masking helpers of rsa_i31_randkey.c. The
+ * masked key keeps the same format (byte strings for p, q, dp, dq and
+ * iq; i31 integers for r1, r2, phi_p and phi_q), so that a key masked
+ * by either implementation can be used by both; all arithmetic is done
+ * with 15-bit words.
+ */
+
+#define MASK_WLEN    ((BR_RSA_RAND_FACTOR + 14) / 15)
+
+/*
+ * Actual bit length of an i15 integer (x[0] is the encoded length).
+ */
+static uint32_t
+rbitlen(const uint16_t *x)
+{
+	return (x[0] & 15) + (uint32_t)(x[0] >> 4) * 15;
+}
+
+/*
+ * Set x[0] to the encoded length of the value, and return its length
+ * in bytes.
+ */
+static size_t
+trim(uint16_t *x)
+{
+	x[0] = (uint16_t)br_i15_bit_length(x + 1, (x[0] + 15) >> 4);
+	return (rbitlen(x) + 7) >> 3;
+}
+
+/*
+ * The conversions repack the value words directly; going through a
+ * byte encoding would make the decoder write one extra (zero) word
+ * whenever the byte length holds more bits than the value needs, which
+ * the destination arrays (sized for the actual bit length) do not
+ * allow.
+ */
+
+/* see inner.h */
+void
+br_i15_from_i31(uint16_t *d, const uint32_t *s)
+{
+	uint64_t acc;
+	size_t u, v, slen, dlen;
+	int acc_len;
+
+	slen = (s[0] + 31) >> 5;
+	dlen = ((s[0] & 31) + (s[0] >> 5) * 31 + 14) / 15;
+	acc = 0;
+	acc_len = 0;
+	v = 1;
+	for (u = 1; u <= slen; u ++) {
+		acc |= (uint64_t)s[u] << acc_len;
+		acc_len += 31;
+		while (acc_len >= 15) {
+			if (v <= dlen) {
+				d[v ++] = (uint16_t)(acc & 0x7FFF);
+			}
+			acc >>= 15;
+			acc_len -= 15;
+		}
+	}
+	if (acc_len > 0 && v <= dlen) {
+		d[v ++] = (uint16_t)acc;
+	}
+	d[0] = (uint16_t)br_i15_bit_length(d + 1, v - 1);
+}
+
+/* see inner.h */
+void
+br_i31_from_i15(uint32_t *d, const uint16_t *s)
+{
+	uint64_t acc;
+	size_t u, v, slen, dlen;
+	int acc_len;
+
+	slen = (s[0] + 15) >> 4;
+	dlen = (rbitlen(s) + 30) / 31;
+	acc = 0;
+	acc_len = 0;
+	v = 1;
+	for (u = 1; u <= slen; u ++) {
+		acc |= (uint64_t)s[u] << acc_len;
+		acc_len += 15;
+		if (acc_len >= 31) {
+			if (v <= dlen) {
+				d[v ++] = (uint32_t)acc & 0x7FFFFFFF;
+			}
+			acc >>= 31;
+			acc_len -= 31;
+		}
+	}
+	if (acc_len > 0 && v <= dlen) {
+		d[v ++] = (uint32_t)acc;
+	}
+	d[0] = br_i31_bit_length(d + 1, v - 1);
+}
+
+/* see inner.h */
+void
+make_rand_i15(const br_prng_class **rng, uint16_t *x, uint32_t esize)
+{
+	unsigned char buf[(2 * BR_RSA_RAND_FACTOR + 7) >> 3];
+	size_t len;
+
+	len = (esize + 7) >> 3;
+	(*rng)->generate(rng, buf, len);
+	buf[0] &= 0xFF >> ((len << 3) - esize);
+	br_i15_decode(x, buf, len);
+}
+
+/*
+ * Random odd mask of BR_RSA_RAND_FACTOR bits.
+ */
+static void
+make_mask(const br_prng_class **rng, uint16_t *x)
+{
+	make_rand_i15(rng, x, BR_RSA_RAND_FACTOR);
+	x[1] |= 1;
+	x[0] = (uint16_t)br_i15_bit_length(x + 1, MASK_WLEN);
+}
+
+/*
+ * d <- a*b mod m. The tb[] buffer must be large enough for the full
+ * product. d[] may alias a[] or b[].
+ */
+static void
+mulmod(uint16_t *d, const uint16_t *a, const uint16_t *b,
+	const uint16_t *m, uint16_t *tb)
+{
+	memset(tb, 0, (((a[0] + 15) >> 4) + ((b[0] + 15) >> 4) + 2)
+		* sizeof *tb);
+	tb[0] = a[0];
+	br_i15_mulacc(tb, a, b);
+	br_i15_reduce(d, tb, m);
+}
+
+/*
+ * d <- 1/s mod m (s must be lower than m). The t[] buffer must have room
+ * for three integers of the size of m.
+ */
+static void
+inverse(uint16_t *d, const uint16_t *s, const uint16_t *m, uint16_t *t)
+{
+	uint16_t *y;
+	size_t mwlen;
+
+	mwlen = ((m[0] + 15) >> 4) + 1;
+	y = t;
+	br_i15_zero(y, m[0]);
+	memcpy(y + 1, s + 1, ((s[0] + 15) >> 4) * sizeof *s);
+	br_i15_zero(d, m[0]);
+	d[1] = 1;
+	br_i15_moddiv(d, y, m, br_i15_ninv15(m[1]), t + mwlen);
+}
+
+/*
+ * d <- a + b (d has the announced length of b, which must be at least
+ * that of a).
+ */
+static void
+add_ext(uint16_t *d, const uint16_t *a, const uint16_t *b)
+{
+	uint16_t one[2];
+
+	memcpy(d + 1, a + 1, ((a[0] + 15) >> 4) * sizeof *a);
+	memset(d + 1 + ((a[0] + 15) >> 4), 0,
+		(((b[0] + 15) >> 4) - ((a[0] + 15) >> 4) + 1) * sizeof *d);
+	d[0] = b[0];
+	one[0] = 1;
+	one[1] = 1;
+	br_i15_mulacc(d, b, one);
+}
+
+/* see inner.h */
+size_t
+blind_exponent_i15(const br_prng_class **rng, unsigned char *x,
+	const unsigned char *d, size_t size, const uint16_t *m, uint16_t *t1)
+{
+	uint16_t r[2 + MASK_WLEN];
+	size_t xlen;
+
+	/*
+	 * t1 = d + r*m, for a random r.
+	 */
+	make_rand_i15(rng, r, BR_RSA_RAND_FACTOR);
+	br_i15_zero(t1, m[0]);
+	br_i15_decode(t1, d, size);
+	t1[0] = m[0];
+	br_i15_mulacc(t1, m, r);
+	xlen = trim(t1);
+	br_i15_encode(x, xlen, t1);
+	return xlen;
+}
+
+/*
+ * Mask a factor: phi = (f-1)*r and f' = f*r, with f given as bytes.
+ * f' is written back as bytes, phi as an i31 integer.
+ */
+static void
+mask_factor(unsigned char *dst, size_t *dlen, uint32_t *phi31,
+	const unsigned char *f, size_t flen, const uint16_t *r, uint16_t *tmp,
+	uint32_t fwlen)
+{
+	uint16_t *t1;
+
+	t1 = tmp + 2 * fwlen;
+	br_i15_decode(tmp, f, flen);
+	tmp[1] ^= 1;
+	br_i15_zero(t1, tmp[0]);
+	br_i15_mulacc(t1, tmp, r);
+	trim(t1);
+	br_i31_from_i15(phi31, t1);
+	tmp[1] ^= 1;
+	br_i15_zero(t1, tmp[0]);
+	br_i15_mulacc(t1, tmp, r);
+	*dlen = trim(t1);
+	br_i15_encode(dst, *dlen, t1);
+}
+
+/*
+ * Masked private exponent: d' = d + phi, written back as bytes.
+ */
+static void
+mask_exponent(unsigned char *dst, size_t *dlen, const unsigned char *d,
+	size_t len, const uint32_t *phi31, uint16_t *tmp, uint32_t fwlen)
+{
+	uint16_t *phi, *t1;
+
+	phi = tmp;
+	t1 = tmp + 2 * fwlen;
+	br_i15_from_i31(phi, phi31);
+	br_i15_decode(t1 + 2 * fwlen, d, len);
+	add_ext(t1, t1 + 2 * fwlen, phi);
+	*dlen = trim(t1);
+	br_i15_encode(dst, *dlen, t1);
+}
+
+/* see inner.h */
+void
+init_key_i15(const br_prng_class **rng, const br_rsa_private_key *sk,
+	br_rsa_private_key *new_sk, uint16_t *tmp, uint32_t fwlen)
+{
+	uint16_t r1[2 + MASK_WLEN], r2[2 + MASK_WLEN];
+	uint16_t *n, *p, *t1, *t2, *t3;
+
+	memcpy(new_sk->n, sk->n, (sk->n_bitlen + 7) >> 3);
+	new_sk->n_bitlen = sk->n_bitlen;
+
+	/*
+	 * Random masks r1 and r2; p' = p*r1, q' = q*r2,
+	 * phi_p = (p-1)*r1, phi_q = (q-1)*r2.
+	 */
+	make_mask(rng, r1);
+	make_mask(rng, r2);
+	br_i31_from_i15(new_sk->r1, r1);
+	br_i31_from_i15(new_sk->r2, r2);
+	mask_factor(new_sk->p, &new_sk->plen, new_sk->phi_p,
+		sk->p, sk->plen, r1, tmp, fwlen);
+	mask_factor(new_sk->q, &new_sk->qlen, new_sk->phi_q,
+		sk->q, sk->qlen, r2, tmp, fwlen);
+
+	/*
+	 * iq' = iq * (1/r2 mod n) mod p'.
+	 */
+	n = tmp;
+	t1 = tmp + 2 * fwlen;
+	t2 = tmp + 4 * fwlen;
+	t3 = tmp + 6 * fwlen;
+	br_i15_decode(n, new_sk->n, (new_sk->n_bitlen + 7) >> 3);
+	inverse(t2, r2, n, t3);
+	p = n;
+	br_i15_decode(p, new_sk->p, new_sk->plen);
+	br_i15_reduce(t1, t2, p);
+	br_i15_decode_reduce(t2, sk->iq, sk->iqlen, p);
+	mulmod(t2, t2, t1, p, t3);
+	new_sk->iqlen = trim(t2);
+	br_i15_encode(new_sk->iq, new_sk->iqlen, t2);
+
+	/*
+	 * dp' = dp + phi_p, dq' = dq + phi_q.
+	 */
+	mask_exponent(new_sk->dp, &new_sk->dplen, sk->dp, sk->dplen,
+		new_sk->phi_p, tmp, fwlen);
+	mask_exponent(new_sk->dq, &new_sk->dqlen, sk->dq, sk->dqlen,
+		new_sk->phi_q, tmp, fwlen);
+
+	memcpy(new_sk->e, sk->e, sk->elen);
+	new_sk->elen = sk->elen;
+}
+
+/*
+ * Replace the mask of one factor: with u = r_old^-1 * r_new mod n,
+ * f' <- f'*u mod n, phi <- phi*u mod n, d' <- d' + (phi_new - phi_old).
+ * The values are exact (not just modular), since f*r_new and
+ * (f-1)*r_new are lower than n.
+ */
+static void
+remask_factor(unsigned char *f, size_t *flen, uint32_t *phi31,
+	unsigned char *d, size_t *dlen, const uint16_t *u, const uint16_t *n,
+	uint16_t *tmp, uint32_t fwlen)
+{
+	uint16_t *t1, *t2, *t3, *tb;
+
+	t1 = tmp;
+	t2 = tmp + 2 * fwlen;
+	t3 = tmp + 4 * fwlen;
+	tb = tmp + 6 * fwlen;
+
+	br_i15_zero(t1, n[0]);
+	br_i15_decode(t1, f, *flen);
+	t1[0] = n[0];
+	mulmod(t1, t1, u, n, tb);
+	*flen = trim(t1);
+	br_i15_encode(f, *flen, t1);
+
+	/*
+	 * t2 = old phi, t3 = new phi (both with the length of n).
+	 */
+	br_i15_zero(t2, n[0]);
+	br_i15_from_i31(tb, phi31);
+	memcpy(t2 + 1, tb + 1, ((tb[0] + 15) >> 4) * sizeof *tb);
+	mulmod(t3, t2, u, n, tb);
+	memcpy(t1, t3, (((n[0] + 15) >> 4) + 1) * sizeof *t3);
+	trim(t1);
+	br_i31_from_i15(phi31, t1);
+
+	/*
+	 * d' + new phi - old phi (never negative, since d' >= old phi).
+	 */
+	br_i15_zero(t1, n[0]);
+	br_i15_decode(t1, d, *dlen);
+	t1[0] = n[0];
+	br_i15_add(t1, t3, 1);
+	br_i15_sub(t1, t2, 1);
+	*dlen = trim(t1);
+	br_i15_encode(d, *dlen, t1);
+}
+
+/* see inner.h */
+void
+update_key_i15(const br_prng_class **rng, br_rsa_private_key *new_sk,
+	uint16_t *tmp, uint32_t fwlen)
+{
+	uint16_t r1[2 + MASK_WLEN], r2[2 + MASK_WLEN], r2_old[2 + MASK_WLEN];
+	uint16_t *n, *inv, *u, *p, *t1, *work;
+
+	n = tmp;
+	inv = tmp + 2 * fwlen;
+	u = tmp + 4 * fwlen;
+	work = tmp + 6 * fwlen;
+	br_i15_decode(n, new_sk->n, (new_sk->n_bitlen + 7) >> 3);
+
+	/*
+	 * New masks.
+	 */
+	br_i15_from_i31(r1, new_sk->r1);
+	br_i15_from_i31(r2_old, new_sk->r2);
+	make_mask(rng, r2);
+
+	/*
+	 * p: u = r1_old^-1 * r1_new mod n.
+	 */
+	inverse(inv, r1, n, work);
+	make_mask(rng, r1);
+	br_i15_zero(u, n[0]);
+	memcpy(u + 1, r1 + 1, ((r1[0] + 15) >> 4) * sizeof *r1);
+	mulmod(u, u, inv, n, work);
+	remask_factor(new_sk->p, &new_sk->plen, new_sk->phi_p,
+		new_sk->dp, &new_sk->dplen, u, n, work, fwlen);
+
+	/*
+	 * q: u = r2_old^-1 * r2_new mod n.
+	 */
+	inverse(inv, r2_old, n, work);
+	br_i15_zero(u, n[0]);
+	memcpy(u + 1, r2 + 1, ((r2[0] + 15) >> 4) * sizeof *r2);
+	mulmod(u, u, inv, n, work);
+	remask_factor(new_sk->q, &new_sk->qlen, new_sk->phi_q,
+		new_sk->dq, &new_sk->dqlen, u, n, work, fwlen);
+
+	br_i31_from_i15(new_sk->r1, r1);
+	br_i31_from_i15(new_sk->r2, r2);
+
+	/*
+	 * iq' = iq' * r2_old * (1/r2_new) mod p'.
+	 */
+	inverse(inv, r2, n, work);
+	p = n;
+	t1 = u;
+	br_i15_decode(p, new_sk->p, new_sk->plen);
+	br_i15_reduce(t1, inv, p);
+	br_i15_zero(inv, p[0]);
+	memcpy(inv + 1, r2_old + 1, ((r2_old[0] + 15) >> 4) * sizeof *r2_old);
+	mulmod(t1, t1, inv, p, work);
+	br_i15_decode_reduce(inv, new_sk->iq, new_sk->iqlen, p);
+	mulmod(t1, t1, inv, p, work);
+	new_sk->iqlen = trim(t1);
+	br_i15_encode(new_sk->iq, new_sk->iqlen, t1);
+}
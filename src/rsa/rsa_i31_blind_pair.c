@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2016 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+/* see inner.h */
+uint32_t
+br_rsa_i31_blind_pair_take(br_rsa_i31_protected_context *ctx,
+	const uint32_t *n, uint32_t n0i, uint32_t *re, uint32_t *ri,
+	uint32_t *tmp, size_t twlen)
+{
+	size_t nlen;
+	uint32_t r;
+
+	nlen = (n[0] + 63) >> 5;
+	r = 1;
+
+	/*
+	 * Regenerate the pair from a fresh random r when it has been
+	 * squared blind_period times (or was never set): re = r^e and
+	 * ri = 1/r, both kept in Montgomery representation.
+	 */
+	if (ctx->blind_count >= ctx->blind_period) {
+		uint32_t rnd[(BR_RSA_RAND_FACTOR + 63) >> 5];
+
+		make_rand(&ctx->rng.vtable, rnd, BR_RSA_RAND_FACTOR);
+		rnd[0] = br_i31_bit_length(rnd + 1,
+			(BR_RSA_RAND_FACTOR + 31) >> 5);
+		br_i31_zero(ctx->blind_re, n[0]);
+		memcpy(ctx->blind_re + 1, rnd + 1,
+			((rnd[0] + 31) >> 5) * sizeof(uint32_t));
+		memcpy(ctx->blind_ri, ctx->blind_re,
+			nlen * sizeof(uint32_t));
+		r &= br_i31_modpow_opt(ctx->blind_re, ctx->sk.e, ctx->sk.elen,
+			n, n0i, tmp, twlen);
+		br_i31_zero(tmp, n[0]);
+		tmp[1] = 1;
+		r &= br_i62_modinv(tmp, ctx->blind_ri, n, tmp + nlen);
+		memcpy(ctx->blind_ri, tmp, nlen * sizeof(uint32_t));
+		br_i31_to_monty(ctx->blind_re, n);
+		br_i31_to_monty(ctx->blind_ri, n);
+		ctx->blind_count = 0;
+	}
+
+	/*
+	 * Hand out the current pair, then square both values for the
+	 * next operation: (r^e)^2 = (r^2)^e and (1/r)^2 = 1/r^2.
+	 */
+	memcpy(re, ctx->blind_re, nlen * sizeof(uint32_t));
+	memcpy(ri, ctx->blind_ri, nlen * sizeof(uint32_t));
+	br_i31_montysqr(tmp, ctx->blind_re, n, n0i);
+	memcpy(ctx->blind_re, tmp, nlen * sizeof(uint32_t));
+	br_i31_montysqr(tmp, ctx->blind_ri, n, n0i);
+	memcpy(ctx->blind_ri, tmp, nlen * sizeof(uint32_t));
+	ctx->blind_count ++;
+	return r;
+}
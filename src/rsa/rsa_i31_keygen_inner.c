@@ -24,6 +24,10 @@
 
 #include "inner.h"
 
+#if BR_RSA_THREADS
+#include <pthread.h>
+#endif
+
 /*
  * Make a random integer of the provided size. The size is encoded.
  * The header word is untouched.
@@ -48,38 +52,226 @@ mkrand(const br_prng_class **rng, uint32_t *x, uint32_t esize)
 }
 
 /*
- * This is the big-endian unsigned representation of the product of
- * all small primes from 13 to 1481.
+ * Odd primes from 3 to 17881, used to sieve prime candidates (see
+ * mkprime()).
  */
-static const unsigned char SMALL_PRIMES[] = {
-	0x2E, 0xAB, 0x92, 0xD1, 0x8B, 0x12, 0x47, 0x31, 0x54, 0x0A,
-	0x99, 0x5D, 0x25, 0x5E, 0xE2, 0x14, 0x96, 0x29, 0x1E, 0xB7,
-	0x78, 0x70, 0xCC, 0x1F, 0xA5, 0xAB, 0x8D, 0x72, 0x11, 0x37,
-	0xFB, 0xD8, 0x1E, 0x3F, 0x5B, 0x34, 0x30, 0x17, 0x8B, 0xE5,
-	0x26, 0x28, 0x23, 0xA1, 0x8A, 0xA4, 0x29, 0xEA, 0xFD, 0x9E,
-	0x39, 0x60, 0x8A, 0xF3, 0xB5, 0xA6, 0xEB, 0x3F, 0x02, 0xB6,
-	0x16, 0xC3, 0x96, 0x9D, 0x38, 0xB0, 0x7D, 0x82, 0x87, 0x0C,
-	0xF7, 0xBE, 0x24, 0xE5, 0x5F, 0x41, 0x04, 0x79, 0x76, 0x40,
-	0xE7, 0x00, 0x22, 0x7E, 0xB5, 0x85, 0x7F, 0x8D, 0x01, 0x50,
-	0xE9, 0xD3, 0x29, 0x42, 0x08, 0xB3, 0x51, 0x40, 0x7B, 0xD7,
-	0x8D, 0xCC, 0x10, 0x01, 0x64, 0x59, 0x28, 0xB6, 0x53, 0xF3,
-	0x50, 0x4E, 0xB1, 0xF2, 0x58, 0xCD, 0x6E, 0xF5, 0x56, 0x3E,
-	0x66, 0x2F, 0xD7, 0x07, 0x7F, 0x52, 0x4C, 0x13, 0x24, 0xDC,
-	0x8E, 0x8D, 0xCC, 0xED, 0x77, 0xC4, 0x21, 0xD2, 0xFD, 0x08,
-	0xEA, 0xD7, 0xC0, 0x5C, 0x13, 0x82, 0x81, 0x31, 0x2F, 0x2B,
-	0x08, 0xE4, 0x80, 0x04, 0x7A, 0x0C, 0x8A, 0x3C, 0xDC, 0x22,
-	0xE4, 0x5A, 0x7A, 0xB0, 0x12, 0x5E, 0x4A, 0x76, 0x94, 0x77,
-	0xC2, 0x0E, 0x92, 0xBA, 0x8A, 0xA0, 0x1F, 0x14, 0x51, 0x1E,
-	0x66, 0x6C, 0x38, 0x03, 0x6C, 0xC7, 0x4A, 0x4B, 0x70, 0x80,
-	0xAF, 0xCA, 0x84, 0x51, 0xD8, 0xD2, 0x26, 0x49, 0xF5, 0xA8,
-	0x5E, 0x35, 0x4B, 0xAC, 0xCE, 0x29, 0x92, 0x33, 0xB7, 0xA2,
-	0x69, 0x7D, 0x0C, 0xE0, 0x9C, 0xDB, 0x04, 0xD6, 0xB4, 0xBC,
-	0x39, 0xD7, 0x7F, 0x9E, 0x9D, 0x78, 0x38, 0x7F, 0x51, 0x54,
-	0x50, 0x8B, 0x9E, 0x9C, 0x03, 0x6C, 0xF5, 0x9D, 0x2C, 0x74,
-	0x57, 0xF0, 0x27, 0x2A, 0xC3, 0x47, 0xCA, 0xB9, 0xD7, 0x5C,
-	0xFF, 0xC2, 0xAC, 0x65, 0x4E, 0xBD
+static const uint16_t SIEVE_PRIMES[] = {
+	3, 5, 7, 11, 13, 17, 19, 23, 29, 31,
+	37, 41, 43, 47, 53, 59, 61, 67, 71, 73,
+	79, 83, 89, 97, 101, 103, 107, 109, 113, 127,
+	131, 137, 139, 149, 151, 157, 163, 167, 173, 179,
+	181, 191, 193, 197, 199, 211, 223, 227, 229, 233,
+	239, 241, 251, 257, 263, 269, 271, 277, 281, 283,
+	293, 307, 311, 313, 317, 331, 337, 347, 349, 353,
+	359, 367, 373, 379, 383, 389, 397, 401, 409, 419,
+	421, 431, 433, 439, 443, 449, 457, 461, 463, 467,
+	479, 487, 491, 499, 503, 509, 521, 523, 541, 547,
+	557, 563, 569, 571, 577, 587, 593, 599, 601, 607,
+	613, 617, 619, 631, 641, 643, 647, 653, 659, 661,
+	673, 677, 683, 691, 701, 709, 719, 727, 733, 739,
+	743, 751, 757, 761, 769, 773, 787, 797, 809, 811,
+	821, 823, 827, 829, 839, 853, 857, 859, 863, 877,
+	881, 883, 887, 907, 911, 919, 929, 937, 941, 947,
+	953, 967, 971, 977, 983, 991, 997, 1009, 1013, 1019,
+	1021, 1031, 1033, 1039, 1049, 1051, 1061, 1063, 1069, 1087,
+	1091, 1093, 1097, 1103, 1109, 1117, 1123, 1129, 1151, 1153,
+	1163, 1171, 1181, 1187, 1193, 1201, 1213, 1217, 1223, 1229,
+	1231, 1237, 1249, 1259, 1277, 1279, 1283, 1289, 1291, 1297,
+	1301, 1303, 1307, 1319, 1321, 1327, 1361, 1367, 1373, 1381,
+	1399, 1409, 1423, 1427, 1429, 1433, 1439, 1447, 1451, 1453,
+	1459, 1471, 1481, 1483, 1487, 1489, 1493, 1499, 1511, 1523,
+	1531, 1543, 1549, 1553, 1559, 1567, 1571, 1579, 1583, 1597,
+	1601, 1607, 1609, 1613, 1619, 1621, 1627, 1637, 1657, 1663,
+	1667, 1669, 1693, 1697, 1699, 1709, 1721, 1723, 1733, 1741,
+	1747, 1753, 1759, 1777, 1783, 1787, 1789, 1801, 1811, 1823,
+	1831, 1847, 1861, 1867, 1871, 1873, 1877, 1879, 1889, 1901,
+	1907, 1913, 1931, 1933, 1949, 1951, 1973, 1979, 1987, 1993,
+	1997, 1999, 2003, 2011, 2017, 2027, 2029, 2039, 2053, 2063,
+	2069, 2081, 2083, 2087, 2089, 2099, 2111, 2113, 2129, 2131,
+	2137, 2141, 2143, 2153, 2161, 2179, 2203, 2207, 2213, 2221,
+	2237, 2239, 2243, 2251, 2267, 2269, 2273, 2281, 2287, 2293,
+	2297, 2309, 2311, 2333, 2339, 2341, 2347, 2351, 2357, 2371,
+	2377, 2381, 2383, 2389, 2393, 2399, 2411, 2417, 2423, 2437,
+	2441, 2447, 2459, 2467, 2473, 2477, 2503, 2521, 2531, 2539,
+	2543, 2549, 2551, 2557, 2579, 2591, 2593, 2609, 2617, 2621,
+	2633, 2647, 2657, 2659, 2663, 2671, 2677, 2683, 2687, 2689,
+	2693, 2699, 2707, 2711, 2713, 2719, 2729, 2731, 2741, 2749,
+	2753, 2767, 2777, 2789, 2791, 2797, 2801, 2803, 2819, 2833,
+	2837, 2843, 2851, 2857, 2861, 2879, 2887, 2897, 2903, 2909,
+	2917, 2927, 2939, 2953, 2957, 2963, 2969, 2971, 2999, 3001,
+	3011, 3019, 3023, 3037, 3041, 3049, 3061, 3067, 3079, 3083,
+	3089, 3109, 3119, 3121, 3137, 3163, 3167, 3169, 3181, 3187,
+	3191, 3203, 3209, 3217, 3221, 3229, 3251, 3253, 3257, 3259,
+	3271, 3299, 3301, 3307, 3313, 3319, 3323, 3329, 3331, 3343,
+	3347, 3359, 3361, 3371, 3373, 3389, 3391, 3407, 3413, 3433,
+	3449, 3457, 3461, 3463, 3467, 3469, 3491, 3499, 3511, 3517,
+	3527, 3529, 3533, 3539, 3541, 3547, 3557, 3559, 3571, 3581,
+	3583, 3593, 3607, 3613, 3617, 3623, 3631, 3637, 3643, 3659,
+	3671, 3673, 3677, 3691, 3697, 3701, 3709, 3719, 3727, 3733,
+	3739, 3761, 3767, 3769, 3779, 3793, 3797, 3803, 3821, 3823,
+	3833, 3847, 3851, 3853, 3863, 3877, 3881, 3889, 3907, 3911,
+	3917, 3919, 3923, 3929, 3931, 3943, 3947, 3967, 3989, 4001,
+	4003, 4007, 4013, 4019, 4021, 4027, 4049, 4051, 4057, 4073,
+	4079, 4091, 4093, 4099, 4111, 4127, 4129, 4133, 4139, 4153,
+	4157, 4159, 4177, 4201, 4211, 4217, 4219, 4229, 4231, 4241,
+	4243, 4253, 4259, 4261, 4271, 4273, 4283, 4289, 4297, 4327,
+	4337, 4339, 4349, 4357, 4363, 4373, 4391, 4397, 4409, 4421,
+	4423, 4441, 4447, 4451, 4457, 4463, 4481, 4483, 4493, 4507,
+	4513, 4517, 4519, 4523, 4547, 4549, 4561, 4567, 4583, 4591,
+	4597, 4603, 4621, 4637, 4639, 4643, 4649, 4651, 4657, 4663,
+	4673, 4679, 4691, 4703, 4721, 4723, 4729, 4733, 4751, 4759,
+	4783, 4787, 4789, 4793, 4799, 4801, 4813, 4817, 4831, 4861,
+	4871, 4877, 4889, 4903, 4909, 4919, 4931, 4933, 4937, 4943,
+	4951, 4957, 4967, 4969, 4973, 4987, 4993, 4999, 5003, 5009,
+	5011, 5021, 5023, 5039, 5051, 5059, 5077, 5081, 5087, 5099,
+	5101, 5107, 5113, 5119, 5147, 5153, 5167, 5171, 5179, 5189,
+	5197, 5209, 5227, 5231, 5233, 5237, 5261, 5273, 5279, 5281,
+	5297, 5303, 5309, 5323, 5333, 5347, 5351, 5381, 5387, 5393,
+	5399, 5407, 5413, 5417, 5419, 5431, 5437, 5441, 5443, 5449,
+	5471, 5477, 5479, 5483, 5501, 5503, 5507, 5519, 5521, 5527,
+	5531, 5557, 5563, 5569, 5573, 5581, 5591, 5623, 5639, 5641,
+	5647, 5651, 5653, 5657, 5659, 5669, 5683, 5689, 5693, 5701,
+	5711, 5717, 5737, 5741, 5743, 5749, 5779, 5783, 5791, 5801,
+	5807, 5813, 5821, 5827, 5839, 5843, 5849, 5851, 5857, 5861,
+	5867, 5869, 5879, 5881, 5897, 5903, 5923, 5927, 5939, 5953,
+	5981, 5987, 6007, 6011, 6029, 6037, 6043, 6047, 6053, 6067,
+	6073, 6079, 6089, 6091, 6101, 6113, 6121, 6131, 6133, 6143,
+	6151, 6163, 6173, 6197, 6199, 6203, 6211, 6217, 6221, 6229,
+	6247, 6257, 6263, 6269, 6271, 6277, 6287, 6299, 6301, 6311,
+	6317, 6323, 6329, 6337, 6343, 6353, 6359, 6361, 6367, 6373,
+	6379, 6389, 6397, 6421, 6427, 6449, 6451, 6469, 6473, 6481,
+	6491, 6521, 6529, 6547, 6551, 6553, 6563, 6569, 6571, 6577,
+	6581, 6599, 6607, 6619, 6637, 6653, 6659, 6661, 6673, 6679,
+	6689, 6691, 6701, 6703, 6709, 6719, 6733, 6737, 6761, 6763,
+	6779, 6781, 6791, 6793, 6803, 6823, 6827, 6829, 6833, 6841,
+	6857, 6863, 6869, 6871, 6883, 6899, 6907, 6911, 6917, 6947,
+	6949, 6959, 6961, 6967, 6971, 6977, 6983, 6991, 6997, 7001,
+	7013, 7019, 7027, 7039, 7043, 7057, 7069, 7079, 7103, 7109,
+	7121, 7127, 7129, 7151, 7159, 7177, 7187, 7193, 7207, 7211,
+	7213, 7219, 7229, 7237, 7243, 7247, 7253, 7283, 7297, 7307,
+	7309, 7321, 7331, 7333, 7349, 7351, 7369, 7393, 7411, 7417,
+	7433, 7451, 7457, 7459, 7477, 7481, 7487, 7489, 7499, 7507,
+	7517, 7523, 7529, 7537, 7541, 7547, 7549, 7559, 7561, 7573,
+	7577, 7583, 7589, 7591, 7603, 7607, 7621, 7639, 7643, 7649,
+	7669, 7673, 7681, 7687, 7691, 7699, 7703, 7717, 7723, 7727,
+	7741, 7753, 7757, 7759, 7789, 7793, 7817, 7823, 7829, 7841,
+	7853, 7867, 7873, 7877, 7879, 7883, 7901, 7907, 7919, 7927,
+	7933, 7937, 7949, 7951, 7963, 7993, 8009, 8011, 8017, 8039,
+	8053, 8059, 8069, 8081, 8087, 8089, 8093, 8101, 8111, 8117,
+	8123, 8147, 8161, 8167, 8171, 8179, 8191, 8209, 8219, 8221,
+	8231, 8233, 8237, 8243, 8263, 8269, 8273, 8287, 8291, 8293,
+	8297, 8311, 8317, 8329, 8353, 8363, 8369, 8377, 8387, 8389,
+	8419, 8423, 8429, 8431, 8443, 8447, 8461, 8467, 8501, 8513,
+	8521, 8527, 8537, 8539, 8543, 8563, 8573, 8581, 8597, 8599,
+	8609, 8623, 8627, 8629, 8641, 8647, 8663, 8669, 8677, 8681,
+	8689, 8693, 8699, 8707, 8713, 8719, 8731, 8737, 8741, 8747,
+	8753, 8761, 8779, 8783, 8803, 8807, 8819, 8821, 8831, 8837,
+	8839, 8849, 8861, 8863, 8867, 8887, 8893, 8923, 8929, 8933,
+	8941, 8951, 8963, 8969, 8971, 8999, 9001, 9007, 9011, 9013,
+	9029, 9041, 9043, 9049, 9059, 9067, 9091, 9103, 9109, 9127,
+	9133, 9137, 9151, 9157, 9161, 9173, 9181, 9187, 9199, 9203,
+	9209, 9221, 9227, 9239, 9241, 9257, 9277, 9281, 9283, 9293,
+	9311, 9319, 9323, 9337, 9341, 9343, 9349, 9371, 9377, 9391,
+	9397, 9403, 9413, 9419, 9421, 9431, 9433, 9437, 9439, 9461,
+	9463, 9467, 9473, 9479, 9491, 9497, 9511, 9521, 9533, 9539,
+	9547, 9551, 9587, 9601, 9613, 9619, 9623, 9629, 9631, 9643,
+	9649, 9661, 9677, 9679, 9689, 9697, 9719, 9721, 9733, 9739,
+	9743, 9749, 9767, 9769, 9781, 9787, 9791, 9803, 9811, 9817,
+	9829, 9833, 9839, 9851, 9857, 9859, 9871, 9883, 9887, 9901,
+	9907, 9923, 9929, 9931, 9941, 9949, 9967, 9973, 10007, 10009,
+	10037, 10039, 10061, 10067, 10069, 10079, 10091, 10093, 10099, 10103,
+	10111, 10133, 10139, 10141, 10151, 10159, 10163, 10169, 10177, 10181,
+	10193, 10211, 10223, 10243, 10247, 10253, 10259, 10267, 10271, 10273,
+	10289, 10301, 10303, 10313, 10321, 10331, 10333, 10337, 10343, 10357,
+	10369, 10391, 10399, 10427, 10429, 10433, 10453, 10457, 10459, 10463,
+	10477, 10487, 10499, 10501, 10513, 10529, 10531, 10559, 10567, 10589,
+	10597, 10601, 10607, 10613, 10627, 10631, 10639, 10651, 10657, 10663,
+	10667, 10687, 10691, 10709, 10711, 10723, 10729, 10733, 10739, 10753,
+	10771, 10781, 10789, 10799, 10831, 10837, 10847, 10853, 10859, 10861,
+	10867, 10883, 10889, 10891, 10903, 10909, 10937, 10939, 10949, 10957,
+	10973, 10979, 10987, 10993, 11003, 11027, 11047, 11057, 11059, 11069,
+	11071, 11083, 11087, 11093, 11113, 11117, 11119, 11131, 11149, 11159,
+	11161, 11171, 11173, 11177, 11197, 11213, 11239, 11243, 11251, 11257,
+	11261, 11273, 11279, 11287, 11299, 11311, 11317, 11321, 11329, 11351,
+	11353, 11369, 11383, 11393, 11399, 11411, 11423, 11437, 11443, 11447,
+	11467, 11471, 11483, 11489, 11491, 11497, 11503, 11519, 11527, 11549,
+	11551, 11579, 11587, 11593, 11597, 11617, 11621, 11633, 11657, 11677,
+	11681, 11689, 11699, 11701, 11717, 11719, 11731, 11743, 11777, 11779,
+	11783, 11789, 11801, 11807, 11813, 11821, 11827, 11831, 11833, 11839,
+	11863, 11867, 11887, 11897, 11903, 11909, 11923, 11927, 11933, 11939,
+	11941, 11953, 11959, 11969, 11971, 11981, 11987, 12007, 12011, 12037,
+	12041, 12043, 12049, 12071, 12073, 12097, 12101, 12107, 12109, 12113,
+	12119, 12143, 12149, 12157, 12161, 12163, 12197, 12203, 12211, 12227,
+	12239, 12241, 12251, 12253, 12263, 12269, 12277, 12281, 12289, 12301,
+	12323, 12329, 12343, 12347, 12373, 12377, 12379, 12391, 12401, 12409,
+	12413, 12421, 12433, 12437, 12451, 12457, 12473, 12479, 12487, 12491,
+	12497, 12503, 12511, 12517, 12527, 12539, 12541, 12547, 12553, 12569,
+	12577, 12583, 12589, 12601, 12611, 12613, 12619, 12637, 12641, 12647,
+	12653, 12659, 12671, 12689, 12697, 12703, 12713, 12721, 12739, 12743,
+	12757, 12763, 12781, 12791, 12799, 12809, 12821, 12823, 12829, 12841,
+	12853, 12889, 12893, 12899, 12907, 12911, 12917, 12919, 12923, 12941,
+	12953, 12959, 12967, 12973, 12979, 12983, 13001, 13003, 13007, 13009,
+	13033, 13037, 13043, 13049, 13063, 13093, 13099, 13103, 13109, 13121,
+	13127, 13147, 13151, 13159, 13163, 13171, 13177, 13183, 13187, 13217,
+	13219, 13229, 13241, 13249, 13259, 13267, 13291, 13297, 13309, 13313,
+	13327, 13331, 13337, 13339, 13367, 13381, 13397, 13399, 13411, 13417,
+	13421, 13441, 13451, 13457, 13463, 13469, 13477, 13487, 13499, 13513,
+	13523, 13537, 13553, 13567, 13577, 13591, 13597, 13613, 13619, 13627,
+	13633, 13649, 13669, 13679, 13681, 13687, 13691, 13693, 13697, 13709,
+	13711, 13721, 13723, 13729, 13751, 13757, 13759, 13763, 13781, 13789,
+	13799, 13807, 13829, 13831, 13841, 13859, 13873, 13877, 13879, 13883,
+	13901, 13903, 13907, 13913, 13921, 13931, 13933, 13963, 13967, 13997,
+	13999, 14009, 14011, 14029, 14033, 14051, 14057, 14071, 14081, 14083,
+	14087, 14107, 14143, 14149, 14153, 14159, 14173, 14177, 14197, 14207,
+	14221, 14243, 14249, 14251, 14281, 14293, 14303, 14321, 14323, 14327,
+	14341, 14347, 14369, 14387, 14389, 14401, 14407, 14411, 14419, 14423,
+	14431, 14437, 14447, 14449, 14461, 14479, 14489, 14503, 14519, 14533,
+	14537, 14543, 14549, 14551, 14557, 14561, 14563, 14591, 14593, 14621,
+	14627, 14629, 14633, 14639, 14653, 14657, 14669, 14683, 14699, 14713,
+	14717, 14723, 14731, 14737, 14741, 14747, 14753, 14759, 14767, 14771,
+	14779, 14783, 14797, 14813, 14821, 14827, 14831, 14843, 14851, 14867,
+	14869, 14879, 14887, 14891, 14897, 14923, 14929, 14939, 14947, 14951,
+	14957, 14969, 14983, 15013, 15017, 15031, 15053, 15061, 15073, 15077,
+	15083, 15091, 15101, 15107, 15121, 15131, 15137, 15139, 15149, 15161,
+	15173, 15187, 15193, 15199, 15217, 15227, 15233, 15241, 15259, 15263,
+	15269, 15271, 15277, 15287, 15289, 15299, 15307, 15313, 15319, 15329,
+	15331, 15349, 15359, 15361, 15373, 15377, 15383, 15391, 15401, 15413,
+	15427, 15439, 15443, 15451, 15461, 15467, 15473, 15493, 15497, 15511,
+	15527, 15541, 15551, 15559, 15569, 15581, 15583, 15601, 15607, 15619,
+	15629, 15641, 15643, 15647, 15649, 15661, 15667, 15671, 15679, 15683,
+	15727, 15731, 15733, 15737, 15739, 15749, 15761, 15767, 15773, 15787,
+	15791, 15797, 15803, 15809, 15817, 15823, 15859, 15877, 15881, 15887,
+	15889, 15901, 15907, 15913, 15919, 15923, 15937, 15959, 15971, 15973,
+	15991, 16001, 16007, 16033, 16057, 16061, 16063, 16067, 16069, 16073,
+	16087, 16091, 16097, 16103, 16111, 16127, 16139, 16141, 16183, 16187,
+	16189, 16193, 16217, 16223, 16229, 16231, 16249, 16253, 16267, 16273,
+	16301, 16319, 16333, 16339, 16349, 16361, 16363, 16369, 16381, 16411,
+	16417, 16421, 16427, 16433, 16447, 16451, 16453, 16477, 16481, 16487,
+	16493, 16519, 16529, 16547, 16553, 16561, 16567, 16573, 16603, 16607,
+	16619, 16631, 16633, 16649, 16651, 16657, 16661, 16673, 16691, 16693,
+	16699, 16703, 16729, 16741, 16747, 16759, 16763, 16787, 16811, 16823,
+	16829, 16831, 16843, 16871, 16879, 16883, 16889, 16901, 16903, 16921,
+	16927, 16931, 16937, 16943, 16963, 16979, 16981, 16987, 16993, 17011,
+	17021, 17027, 17029, 17033, 17041, 17047, 17053, 17077, 17093, 17099,
+	17107, 17117, 17123, 17137, 17159, 17167, 17183, 17189, 17191, 17203,
+	17207, 17209, 17231, 17239, 17257, 17291, 17293, 17299, 17317, 17321,
+	17327, 17333, 17341, 17351, 17359, 17377, 17383, 17387, 17389, 17393,
+	17401, 17417, 17419, 17431, 17443, 17449, 17467, 17471, 17477, 17483,
+	17489, 17491, 17497, 17509, 17519, 17539, 17551, 17569, 17573, 17579,
+	17581, 17597, 17599, 17609, 17623, 17627, 17657, 17659, 17669, 17681,
+	17683, 17707, 17713, 17729, 17737, 17747, 17749, 17761, 17783, 17789,
+	17791, 17807, 17827, 17837, 17839, 17851, 17863, 17881
 };
 
+#define SIEVE_LEN   (sizeof SIEVE_PRIMES / sizeof SIEVE_PRIMES[0])
+
+/*
+ * Number of 32-bit words taken by the sieve residues (see mkprime()),
+ * rounded up to an even count so that the rest of the temporaries
+ * remains 64-bit aligned.
+ */
+#define SIEVE_WORDS   ((((SIEVE_LEN + 1) >> 1) + 1) & ~(size_t)1)
+
 /*
  * We need temporary values for at least 7 integers of the same size
  * as a factor (including header word); more space helps with performance
@@ -88,6 +280,13 @@ static const unsigned char SMALL_PRIMES[] = {
  * exceeds 512 (which is a count in 32-bit words) when BR_MAX_RSA_SIZE
  * is greater than 4464 (default value is 4096, so the 2-kB limit is
  * maintained unless BR_MAX_RSA_SIZE was modified).
+ *
+ * The prime search also keeps the sieve residues (SIEVE_WORDS words,
+ * i.e. 4 kilobytes) in the temporaries of its caller, and the masked
+ * key generation keeps two more factor-sized integers (the reduced
+ * exponents), so the key generation functions use buffers of about
+ * 6 kilobytes (6.5 for the masked variant) with the default
+ * BR_MAX_RSA_SIZE.
  */
 #define MAX(x, y)   ((x) > (y) ? (x) : (y))
 #define ROUND2(x)   ((((x) + 1) >> 1) << 1)
@@ -95,25 +294,63 @@ static const unsigned char SMALL_PRIMES[] = {
 #define TEMPS   MAX(512, ROUND2(7 * ((((BR_MAX_RSA_SIZE + 1) >> 1) + 61) / 31)))
 
 /*
- * Perform trial division on a candidate prime. This computes
- * y = SMALL_PRIMES mod x, then tries to compute y/y mod x. The
- * br_i31_moddiv() function will report an error if y is not invertible
- * modulo x. Returned value is 1 on success (none of the small primes
- * divides x), 0 on error (a non-trivial GCD is obtained).
- *
- * This function assumes that x is odd.
+ * Reduce a modulo p, for an odd prime p < 2^16 and a < 2^32. The
+ * quotient estimate uses m = floor(2^32 / p) and is off by at most 1,
+ * hence a single conditional subtraction. This is constant-time (the
+ * division that computes m involves only the public p).
  */
-static uint32_t
-trial_divisions(const uint32_t *x, uint32_t *t)
+static inline uint32_t
+mod_small(uint32_t a, uint32_t p, uint32_t m)
 {
-	uint32_t *y;
-	uint32_t x0i;
+	uint32_t r;
 
-	y = t;
-	t += 1 + ((x[0] + 31) >> 5);
-	x0i = br_i31_ninv31(x[1]);
-	br_i31_decode_reduce(y, SMALL_PRIMES, sizeof SMALL_PRIMES, x);
-	return br_i31_moddiv(y, y, x, x0i, t);
+	r = a - p * (uint32_t)(((uint64_t)a * m) >> 32);
+	return r - (p & -GE(r, p));
+}
+
+/*
+ * Compute the residues of x modulo all the sieve primes. The words
+ * of x are processed from the top, 15 and 16 bits at a time, so that
+ * intermediate values fit on 32 bits.
+ */
+static void
+sieve_init(uint16_t *res, const uint32_t *x)
+{
+	size_t u, len;
+
+	len = (x[0] + 31) >> 5;
+	for (u = 0; u < SIEVE_LEN; u ++) {
+		uint32_t p, m, r;
+		size_t v;
+
+		p = SIEVE_PRIMES[u];
+		m = 0xFFFFFFFF / p;
+		r = 0;
+		for (v = len; v > 0; v --) {
+			uint32_t w;
+
+			w = x[v];
+			r = mod_small((r << 15) | (w >> 16), p, m);
+			r = mod_small((r << 16) | (w & 0xFFFF), p, m);
+		}
+		res[u] = (uint16_t)r;
+	}
+}
+
+/*
+ * Add v (v < 2^31) to x. The carry out of the top word is dropped.
+ */
+static void
+add_small(uint32_t *x, uint32_t v)
+{
+	size_t u, len;
+
+	len = (x[0] + 31) >> 5;
+	for (u = 1; u <= len; u ++) {
+		v += x[u];
+		x[u] = v & 0x7FFFFFFF;
+		v >>= 31;
+	}
 }
 
 /*
@@ -227,22 +464,163 @@ miller_rabin(const br_prng_class **rng, const uint32_t *x, int n,
 	return 1;
 }
 
+/*
+ * Word length of a prime factor (including the header word).
+ */
+#define FLEN   (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))
+
+/*
+ * Shared state of the streams that search for the same prime in
+ * br_rsa_i31_keygen_parallel_inner(). Each stream counts the candidates
+ * that reach Miller-Rabin; the winner is the stream whose first success
+ * has the lowest count, ties going to the lowest stream index. A stream
+ * stops as soon as it can no longer win. The winner does not depend on
+ * thread scheduling, only on the stream seeds.
+ */
+typedef struct {
+#if BR_RSA_THREADS
+	pthread_mutex_t *lock;
+#endif
+	uint32_t best_count;
+	unsigned best_stream;
+	uint32_t x[FLEN];
+	uint32_t d[FLEN];
+} prime_race;
+
+static void
+race_lock(prime_race *race)
+{
+#if BR_RSA_THREADS
+	pthread_mutex_lock(race->lock);
+#else
+	(void)race;
+#endif
+}
+
+static void
+race_unlock(prime_race *race)
+{
+#if BR_RSA_THREADS
+	pthread_mutex_unlock(race->lock);
+#else
+	(void)race;
+#endif
+}
+
+/*
+ * Returned value is 1 if stream 'stream', at its candidate 'count',
+ * can no longer win the race.
+ */
+static int
+race_lost(prime_race *race, unsigned stream, uint32_t count)
+{
+	int lost;
+
+	race_lock(race);
+	lost = count > race->best_count
+		|| (count == race->best_count && stream > race->best_stream);
+	race_unlock(race);
+	return lost;
+}
+
+/*
+ * Report a success of stream 'stream' at its candidate 'count': the
+ * prime x and d = 1/e mod x-1 are kept if they beat the current best.
+ */
+static void
+race_submit(prime_race *race, unsigned stream, uint32_t count,
+	const uint32_t *x, const uint32_t *d)
+{
+	race_lock(race);
+	if (count < race->best_count
+		|| (count == race->best_count && stream < race->best_stream))
+	{
+		size_t len;
+
+		len = 1 + ((x[0] + 31) >> 5);
+		race->best_count = count;
+		race->best_stream = stream;
+		memcpy(race->x, x, len * sizeof *x);
+		memcpy(race->d, d, len * sizeof *d);
+	}
+	race_unlock(race);
+}
+
 /*
  * Create a random prime of the provided size. 'size' is the _encoded_
  * bit length. The two top bits and the two bottom bits are set to 1.
+ *
+ * This is an incremental search: a random start x is drawn, and the
+ * candidates x, x+4, x+8... are tried in order. The residues of the
+ * current candidate modulo the sieve primes are kept in a table (res[],
+ * SIEVE_LEN entries, provided by the caller) and updated with a small
+ * addition for each step; Miller-Rabin is run
+ * only on candidates that have no small factor. The distance from
+ * the start is the only thing that the search leaks: the sieve test
+ * itself is constant-time, and the start is discarded when the walk
+ * becomes too long, or would change the two top bits.
+ *
+ * If race is not NULL, then *count is incremented for each candidate
+ * that reaches Miller-Rabin, and the search is abandoned (returned
+ * value: 0) when the stream can no longer win the race. Otherwise, the
+ * returned value is 1.
  */
-static void
+static uint32_t
 mkprime(const br_prng_class **rng, uint32_t *x, uint32_t esize,
-	uint32_t pubexp, uint32_t *t, size_t tlen, br_i31_modpow_opt_type mp31)
+	uint32_t pubexp, uint16_t *res, uint32_t *t, size_t tlen,
+	br_i31_modpow_opt_type mp31,
+	prime_race *race, unsigned stream, uint32_t *count)
 {
-	size_t len;
+	uint16_t eidx[9];
+	size_t len, u, num_eidx;
+	int rounds;
 
 	x[0] = esize;
 	len = (esize + 31) >> 5;
+
+	/*
+	 * If pubexp has a factor p among the sieve primes, then we
+	 * must reject candidates equal to 1 modulo p, since we need e
+	 * to be invertible modulo the prime minus 1. An odd 32-bit
+	 * integer has at most nine distinct odd prime factors.
+	 */
+	num_eidx = 0;
+	for (u = 0; u < SIEVE_LEN; u ++) {
+		if (pubexp % SIEVE_PRIMES[u] == 0) {
+			eidx[num_eidx ++] = (uint16_t)u;
+		}
+	}
+
+	/*
+	 * Miller-Rabin algorithm. Since we selected a random
+	 * integer, not a maliciously crafted integer, we can use
+	 * relatively few rounds to lower the risk of a false
+	 * positive (i.e. declaring prime a non-prime) under
+	 * 2^(-80). It is not useful to lower the probability much
+	 * below that, since that would be substantially below
+	 * the probability of the hardware misbehaving. Sufficient
+	 * numbers of rounds are extracted from the Handbook of
+	 * Applied Cryptography, note 4.49 (page 149).
+	 *
+	 * Since we work on the encoded size (esize), we need to
+	 * compare with encoded thresholds.
+	 */
+	if (esize < 309) {
+		rounds = 12;
+	} else if (esize < 464) {
+		rounds = 9;
+	} else if (esize < 670) {
+		rounds = 6;
+	} else if (esize < 877) {
+		rounds = 4;
+	} else if (esize < 1341) {
+		rounds = 3;
+	} else {
+		rounds = 2;
+	}
+
 	for (;;) {
-		size_t u;
-		uint32_t m3, m5, m7, m11;
-		int rounds, s7, s11;
+		uint32_t k, ks;
 
 		/*
 		 * Generate random bits. We force the two top bits and the
@@ -258,132 +636,76 @@ mkprime(const br_prng_class **rng, uint32_t *x, uint32_t esize,
 			x[len] |= 0x00000003 << ((esize & 31) - 2);
 		}
 		x[1] |= 0x00000003;
+		sieve_init(res, x);
 
 		/*
-		 * Trial division with low primes (3, 5, 7 and 11). We
-		 * use the following properties:
-		 *
-		 *   2^2 = 1 mod 3
-		 *   2^4 = 1 mod 5
-		 *   2^3 = 1 mod 7
-		 *   2^10 = 1 mod 11
+		 * Walk the candidates x+4*k. The value in x is brought up
+		 * to date (from x+4*ks) only for the survivors of the sieve.
+		 * Steps of 4 keep the candidates equal to 3 modulo 4, as
+		 * required by miller_rabin().
 		 */
-		m3 = 0;
-		m5 = 0;
-		m7 = 0;
-		m11 = 0;
-		s7 = 0;
-		s11 = 0;
-		for (u = 0; u < len; u ++) {
-			uint32_t w, w3, w5, w7, w11;
-
-			w = x[1 + u];
-			w3 = (w & 0xFFFF) + (w >> 16);     /* max: 98302 */
-			w5 = (w & 0xFFFF) + (w >> 16);     /* max: 98302 */
-			w7 = (w & 0x7FFF) + (w >> 15);     /* max: 98302 */
-			w11 = (w & 0xFFFFF) + (w >> 20);   /* max: 1050622 */
-
-			m3 += w3 << (u & 1);
-			m3 = (m3 & 0xFF) + (m3 >> 8);      /* max: 1025 */
-
-			m5 += w5 << ((4 - u) & 3);
-			m5 = (m5 & 0xFFF) + (m5 >> 12);    /* max: 4479 */
-
-			m7 += w7 << s7;
-			m7 = (m7 & 0x1FF) + (m7 >> 9);     /* max: 1280 */
-			if (++ s7 == 3) {
-				s7 = 0;
-			}
-
-			m11 += w11 << s11;
-			if (++ s11 == 10) {
-				s11 = 0;
-			}
-			m11 = (m11 & 0x3FF) + (m11 >> 10); /* max: 526847 */
-		}
-
-		m3 = (m3 & 0x3F) + (m3 >> 6);      /* max: 78 */
-		m3 = (m3 & 0x0F) + (m3 >> 4);      /* max: 18 */
-		m3 = ((m3 * 43) >> 5) & 3;
-
-		m5 = (m5 & 0xFF) + (m5 >> 8);      /* max: 271 */
-		m5 = (m5 & 0x0F) + (m5 >> 4);      /* max: 31 */
-		m5 -= 20 & -GT(m5, 19);
-		m5 -= 10 & -GT(m5, 9);
-		m5 -= 5 & -GT(m5, 4);
+		ks = 0;
+		for (k = 0; k < 0x10000; k ++) {
+			uint32_t z;
 
-		m7 = (m7 & 0x3F) + (m7 >> 6);      /* max: 82 */
-		m7 = (m7 & 0x07) + (m7 >> 3);      /* max: 16 */
-		m7 = ((m7 * 147) >> 7) & 7;
+			if (k != 0) {
+				/*
+				 * 4 = 1 mod 3; for the other primes, a
+				 * single conditional subtraction suffices.
+				 */
+				res[0] = (uint16_t)(res[0] + 1
+					- (3 & -EQ(res[0], 2)));
+				for (u = 1; u < SIEVE_LEN; u ++) {
+					uint32_t p, r;
 
-		/*
-		 * 2^5 = 32 = -1 mod 11.
-		 */
-		m11 = (m11 & 0x3FF) + (m11 >> 10);      /* max: 1536 */
-		m11 = (m11 & 0x3FF) + (m11 >> 10);      /* max: 1023 */
-		m11 = (m11 & 0x1F) + 33 - (m11 >> 5);   /* max: 64 */
-		m11 -= 44 & -GT(m11, 43);
-		m11 -= 22 & -GT(m11, 21);
-		m11 -= 11 & -GT(m11, 10);
-
-		/*
-		 * If any of these modulo is 0, then the candidate is
-		 * not prime. Also, if pubexp is 3, 5, 7 or 11, and the
-		 * corresponding modulus is 1, then the candidate must
-		 * be rejected, because we need e to be invertible
-		 * modulo p-1. We can use simple comparisons here
-		 * because they won't leak information on a candidate
-		 * that we keep, only on one that we reject (and is thus
-		 * not secret).
-		 */
-		if (m3 == 0 || m5 == 0 || m7 == 0 || m11 == 0) {
-			continue;
-		}
-		if ((pubexp == 3 && m3 == 1)
-			|| (pubexp == 5 && m5 == 1)
-			|| (pubexp == 7 && m7 == 1)
-			|| (pubexp == 11 && m11 == 1))
-		{
-			continue;
-		}
+					p = SIEVE_PRIMES[u];
+					r = (uint32_t)res[u] + 4;
+					res[u] = (uint16_t)(r - (p & -GE(r, p)));
+				}
+			}
 
-		/*
-		 * More trial divisions.
-		 */
-		if (!trial_divisions(x, t)) {
-			continue;
-		}
+			/*
+			 * The test covers all primes without an early exit,
+			 * so that its timing does not depend on which prime
+			 * divides a rejected candidate.
+			 */
+			z = 0;
+			for (u = 0; u < SIEVE_LEN; u ++) {
+				z |= EQ(res[u], 0);
+			}
+			for (u = 0; u < num_eidx; u ++) {
+				z |= EQ(res[eidx[u]], 1);
+			}
+			if (z) {
+				continue;
+			}
 
-		/*
-		 * Miller-Rabin algorithm. Since we selected a random
-		 * integer, not a maliciously crafted integer, we can use
-		 * relatively few rounds to lower the risk of a false
-		 * positive (i.e. declaring prime a non-prime) under
-		 * 2^(-80). It is not useful to lower the probability much
-		 * below that, since that would be substantially below
-		 * the probability of the hardware misbehaving. Sufficient
-		 * numbers of rounds are extracted from the Handbook of
-		 * Applied Cryptography, note 4.49 (page 149).
-		 *
-		 * Since we work on the encoded size (esize), we need to
-		 * compare with encoded thresholds.
-		 */
-		if (esize < 309) {
-			rounds = 12;
-		} else if (esize < 464) {
-			rounds = 9;
-		} else if (esize < 670) {
-			rounds = 6;
-		} else if (esize < 877) {
-			rounds = 4;
-		} else if (esize < 1341) {
-			rounds = 3;
-		} else {
-			rounds = 2;
-		}
+			/*
+			 * Bring x up to date. If a carry reached the two
+			 * top bits, then the walk went out of range and we
+			 * need a new start.
+			 */
+			add_small(x, (k - ks) << 2);
+			ks = k;
+			if ((esize & 31) == 0) {
+				z = (x[len] >> 29) & 3;
+			} else if ((esize & 31) == 1) {
+				z = (x[len] << 1) | (x[len - 1] >> 30);
+			} else {
+				z = x[len] >> ((esize & 31) - 2);
+			}
+			if (z != 3) {
+				break;
+			}
 
-		if (miller_rabin(rng, x, rounds, t, tlen, mp31)) {
-			return;
+			if (race != NULL
+				&& race_lost(race, stream, ++ *count))
+			{
+				return 0;
+			}
+			if (miller_rabin(rng, x, rounds, t, tlen, mp31)) {
+				return 1;
+			}
 		}
 	}
 }
@@ -453,51 +775,79 @@ bufswap(void *b1, void *b2, size_t len)
 	}
 }
 
-/* see inner.h */
-uint32_t
-br_rsa_i31_keygen_inner(const br_prng_class **rng,
-	br_rsa_private_key *sk, void *kbuf_priv,
-	br_rsa_public_key *pk, void *kbuf_pub,
-	unsigned size, uint32_t pubexp, br_i31_modpow_opt_type mp31)
+/*
+ * Search for a prime x of encoded size esize, such that pubexp is
+ * invertible modulo x-1. On success, x contains the prime and t[]
+ * starts with d = 1/pubexp mod x-1 (same announced length as x). If
+ * race is not NULL, then the search runs as stream 'stream' of that
+ * race (see mkprime()), and a success is reported to the race. The
+ * first SIEVE_WORDS words of t[] receive the sieve residues during the
+ * search.
+ * Returned value is 1 on success, 0 if the race was lost.
+ */
+static uint32_t
+search_prime(const br_prng_class **rng, uint32_t *x, uint32_t esize,
+	uint32_t pubexp, uint32_t *t, size_t tlen, br_i31_modpow_opt_type mp31,
+	prime_race *race, unsigned stream)
 {
-	uint32_t esize_p, esize_q;
-	size_t plen, qlen, tlen;
-	uint32_t *p, *q, *t;
-	union {
-		uint32_t t32[TEMPS];
-		uint64_t t64[TEMPS >> 1];  /* for 64-bit alignment */
-	} tmp;
-	uint32_t r;
+	size_t len;
+	uint32_t count;
+
+	/*
+	 * When looking for primes p and q, we temporarily divide
+	 * candidates by 2, in order to compute the inverse of the
+	 * public exponent.
+	 */
+	len = (esize + 31) >> 5;
+	count = 0;
+	for (;;) {
+		if (!mkprime(rng, x, esize, pubexp, (uint16_t *)t,
+			t + SIEVE_WORDS, tlen - SIEVE_WORDS, mp31,
+			race, stream, &count))
+		{
+			return 0;
+		}
+		br_i31_rshift(x, 1);
+		if (invert_pubexp(t, x, pubexp, t + 1 + len)) {
+			br_i31_add(x, x, 1);
+			x[1] |= 1;
+			if (race != NULL) {
+				race_submit(race, stream, count, x, t);
+			}
+			return 1;
+		}
+	}
+}
+
+/*
+ * Check the key generation parameters and set the public key elements.
+ * The encoded sizes of p and q are written in *esize_p and *esize_q,
+ * and *pubexp is set to its actual value. Returned value is 1 on
+ * success, 0 on invalid parameters.
+ */
+static uint32_t
+keygen_setup(br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t *pubexp, uint32_t *esize_p, uint32_t *esize_q)
+{
+	uint32_t ep, eq;
 
 	if (size < BR_MIN_RSA_SIZE || size > BR_MAX_RSA_SIZE) {
 		return 0;
 	}
-	if (pubexp == 0) {
-		pubexp = 3;
-	} else if (pubexp == 1 || (pubexp & 1) == 0) {
+	if (*pubexp == 0) {
+		*pubexp = 3;
+	} else if (*pubexp == 1 || (*pubexp & 1) == 0) {
 		return 0;
 	}
 
-	esize_p = (size + 1) >> 1;
-	esize_q = size - esize_p;
-	sk->n_bitlen = size;
-	sk->p = kbuf_priv;
-	sk->plen = (esize_p + 7) >> 3;
-	sk->q = sk->p + sk->plen;
-	sk->qlen = (esize_q + 7) >> 3;
-	sk->dp = sk->q + sk->qlen;
-	sk->dplen = sk->plen;
-	sk->dq = sk->dp + sk->dplen;
-	sk->dqlen = sk->qlen;
-	sk->iq = sk->dq + sk->dqlen;
-	sk->iqlen = sk->plen;
-
+	ep = (size + 1) >> 1;
+	eq = size - ep;
 	if (pk != NULL) {
 		pk->n = kbuf_pub;
 		pk->nlen = (size + 7) >> 3;
 		pk->e = pk->n + pk->nlen;
 		pk->elen = 4;
-		br_enc32be(pk->e, pubexp);
+		br_enc32be(pk->e, *pubexp);
 		while (*pk->e == 0) {
 			pk->e ++;
 			pk->elen --;
@@ -511,44 +861,50 @@ br_rsa_i31_keygen_inner(const br_prng_class **rng,
 	 * integers x from 0 to 34966; the intermediate product fits on
 	 * 30 bits, thus we can use MUL31().
 	 */
-	esize_p += MUL31(esize_p, 16913) >> 19;
-	esize_q += MUL31(esize_q, 16913) >> 19;
-	plen = (esize_p + 31) >> 5;
-	qlen = (esize_q + 31) >> 5;
-	p = tmp.t32;
-	q = p + 1 + plen;
-	t = q + 1 + qlen;
-	tlen = ((sizeof tmp.t32) / sizeof(uint32_t)) - (2 + plen + qlen);
+	*esize_p = ep + (MUL31(ep, 16913) >> 19);
+	*esize_q = eq + (MUL31(eq, 16913) >> 19);
+	return 1;
+}
 
-	/*
-	 * When looking for primes p and q, we temporarily divide
-	 * candidates by 2, in order to compute the inverse of the
-	 * public exponent.
-	 */
+/*
+ * Set the lengths and pointers of the private key elements, for the
+ * layout of BR_RSA_KBUF_PRIV_SIZE().
+ */
+static void
+set_priv_layout(br_rsa_private_key *sk, void *kbuf_priv, unsigned size)
+{
+	uint32_t ep, eq;
 
-	for (;;) {
-		mkprime(rng, p, esize_p, pubexp, t, tlen, mp31);
-		br_i31_rshift(p, 1);
-		if (invert_pubexp(t, p, pubexp, t + 1 + plen)) {
-			br_i31_add(p, p, 1);
-			p[1] |= 1;
-			br_i31_encode(sk->p, sk->plen, p);
-			br_i31_encode(sk->dp, sk->dplen, t);
-			break;
-		}
-	}
+	ep = (size + 1) >> 1;
+	eq = size - ep;
+	sk->n_bitlen = size;
+	sk->p = kbuf_priv;
+	sk->plen = (ep + 7) >> 3;
+	sk->q = sk->p + sk->plen;
+	sk->qlen = (eq + 7) >> 3;
+	sk->dp = sk->q + sk->qlen;
+	sk->dplen = sk->plen;
+	sk->dq = sk->dp + sk->dplen;
+	sk->dqlen = sk->qlen;
+	sk->iq = sk->dq + sk->dqlen;
+	sk->iqlen = sk->plen;
+}
 
-	for (;;) {
-		mkprime(rng, q, esize_q, pubexp, t, tlen, mp31);
-		br_i31_rshift(q, 1);
-		if (invert_pubexp(t, q, pubexp, t + 1 + qlen)) {
-			br_i31_add(q, q, 1);
-			q[1] |= 1;
-			br_i31_encode(sk->q, sk->qlen, q);
-			br_i31_encode(sk->dq, sk->dqlen, t);
-			break;
-		}
-	}
+/*
+ * Finish the key pair from the primes p and q (already encoded in sk,
+ * along with dp and dq): order the primes, compute iq and the modulus.
+ * The q array must have room for as many words as p. Returned value
+ * is 1 on success, 0 on error (see below).
+ */
+static uint32_t
+keygen_finish(br_rsa_private_key *sk, br_rsa_public_key *pk,
+	uint32_t *p, uint32_t *q, uint32_t *t)
+{
+	size_t plen, qlen;
+	uint32_t r;
+
+	plen = (p[0] + 31) >> 5;
+	qlen = (q[0] + 31) >> 5;
 
 	/*
 	 * If p and q have the same size, then it is possible that q > p
@@ -565,7 +921,7 @@ br_rsa_i31_keygen_inner(const br_prng_class **rng,
 	 * because the only information we leak here is that we insist on
 	 * returning p and q such that p > q, which is not a secret.
 	 */
-	if (esize_p == esize_q && br_i31_sub(p, q, 0) == 1) {
+	if (p[0] == q[0] && br_i31_sub(p, q, 0) == 1) {
 		bufswap(p, q, (1 + plen) * sizeof *p);
 		bufswap(sk->p, sk->q, sk->plen);
 		bufswap(sk->dp, sk->dq, sk->dplen);
@@ -588,7 +944,6 @@ br_rsa_i31_keygen_inner(const br_prng_class **rng,
 	if (plen > qlen) {
 		q[plen] = 0;
 		t ++;
-		tlen --;
 	}
 	br_i31_zero(t, p[0]);
 	t[1] = 1;
@@ -607,3 +962,373 @@ br_rsa_i31_keygen_inner(const br_prng_class **rng,
 	}
 	return r;
 }
+
+/* see inner.h */
+uint32_t
+br_rsa_i31_keygen_inner(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, br_i31_modpow_opt_type mp31)
+{
+	uint32_t esize_p, esize_q;
+	size_t plen, qlen, tlen;
+	uint32_t *p, *q, *t;
+	union {
+		uint32_t t32[TEMPS + SIEVE_WORDS];
+		uint64_t t64[(TEMPS + SIEVE_WORDS) >> 1];
+	} tmp;
+
+	if (!keygen_setup(pk, kbuf_pub, size, &pubexp, &esize_p, &esize_q)) {
+		return 0;
+	}
+	set_priv_layout(sk, kbuf_priv, size);
+	plen = (esize_p + 31) >> 5;
+	qlen = (esize_q + 31) >> 5;
+	p = tmp.t32;
+	q = p + 1 + plen;
+	t = q + 1 + qlen;
+	tlen = ((sizeof tmp.t32) / sizeof(uint32_t)) - (2 + plen + qlen);
+
+	search_prime(rng, p, esize_p, pubexp, t, tlen, mp31, NULL, 0);
+	br_i31_encode(sk->p, sk->plen, p);
+	br_i31_encode(sk->dp, sk->dplen, t);
+	search_prime(rng, q, esize_q, pubexp, t, tlen, mp31, NULL, 0);
+	br_i31_encode(sk->q, sk->qlen, q);
+	br_i31_encode(sk->dq, sk->dqlen, t);
+	return keygen_finish(sk, pk, p, q, t);
+}
+
+/*
+ * Maximum number of threads (and of streams per prime) for
+ * br_rsa_i31_keygen_parallel_inner().
+ */
+#define MAX_THREADS   32
+
+/*
+ * One search stream: it looks for the prime of its race with its own
+ * DRBG, seeded from the caller's PRNG.
+ */
+typedef struct {
+	br_hmac_drbg_context rng;
+	prime_race *race;
+	unsigned stream;
+	uint32_t esize;
+} keygen_stream;
+
+/*
+ * Worker pool: the streams are handed out in order, under the lock.
+ */
+typedef struct {
+#if BR_RSA_THREADS
+	pthread_mutex_t lock;
+#endif
+	keygen_stream *streams;
+	size_t num_streams, next;
+	uint32_t pubexp;
+	br_i31_modpow_opt_type mp31;
+} keygen_pool;
+
+static void
+run_stream(keygen_pool *pool, keygen_stream *ks)
+{
+	union {
+		uint32_t t32[TEMPS + SIEVE_WORDS];
+		uint64_t t64[(TEMPS + SIEVE_WORDS) >> 1];
+	} tmp;
+	uint32_t *x, *t;
+	size_t tlen;
+
+	x = tmp.t32;
+	t = x + FLEN;
+	tlen = ((sizeof tmp.t32) / sizeof(uint32_t)) - FLEN;
+	search_prime(&ks->rng.vtable, x, ks->esize, pool->pubexp,
+		t, tlen, pool->mp31, ks->race, ks->stream);
+}
+
+static void *
+keygen_worker(void *arg)
+{
+	keygen_pool *pool;
+
+	pool = arg;
+	for (;;) {
+		size_t u;
+
+#if BR_RSA_THREADS
+		pthread_mutex_lock(&pool->lock);
+#endif
+		u = pool->next;
+		if (u < pool->num_streams) {
+			pool->next = u + 1;
+		}
+#if BR_RSA_THREADS
+		pthread_mutex_unlock(&pool->lock);
+#endif
+		if (u >= pool->num_streams) {
+			return NULL;
+		}
+		run_stream(pool, &pool->streams[u]);
+	}
+}
+
+/* see inner.h */
+uint32_t
+br_rsa_i31_keygen_parallel_inner(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, br_i31_modpow_opt_type mp31,
+	unsigned num_threads)
+{
+	uint32_t esize_p, esize_q;
+	size_t plen, qlen, u;
+	uint32_t *p, *q, *t;
+	union {
+		uint32_t t32[TEMPS];
+		uint64_t t64[TEMPS >> 1];  /* for 64-bit alignment */
+	} tmp;
+	prime_race races[2];
+	keygen_stream streams[2 * ((MAX_THREADS + 1) >> 1)];
+	keygen_pool pool;
+	unsigned num_per_prime;
+#if BR_RSA_THREADS
+	pthread_t th[MAX_THREADS - 1];
+	unsigned num_th;
+#endif
+
+	if (!keygen_setup(pk, kbuf_pub, size, &pubexp, &esize_p, &esize_q)) {
+		return 0;
+	}
+	set_priv_layout(sk, kbuf_priv, size);
+	if (num_threads == 0) {
+		num_threads = 1;
+	} else if (num_threads > MAX_THREADS) {
+		num_threads = MAX_THREADS;
+	}
+
+	/*
+	 * Streams for p and q alternate (p0, q0, p1, q1...), so that
+	 * both primes are searched concurrently. Each stream gets its
+	 * own DRBG; the seeds are drawn in stream order, which makes the
+	 * result depend only on the caller's PRNG and the thread count.
+	 */
+	num_per_prime = (num_threads + 1) >> 1;
+	for (u = 0; u < 2; u ++) {
+		races[u].best_count = 0xFFFFFFFF;
+		races[u].best_stream = 0;
+#if BR_RSA_THREADS
+		races[u].lock = &pool.lock;
+#endif
+	}
+	for (u = 0; u < 2 * num_per_prime; u ++) {
+		unsigned char seed[32];
+
+		(*rng)->generate(rng, seed, sizeof seed);
+		br_hmac_drbg_init(&streams[u].rng,
+			&br_sha256_vtable, seed, sizeof seed);
+		streams[u].race = &races[u & 1];
+		streams[u].stream = (unsigned)(u >> 1);
+		streams[u].esize = (u & 1) == 0 ? esize_p : esize_q;
+	}
+	pool.streams = streams;
+	pool.num_streams = 2 * num_per_prime;
+	pool.next = 0;
+	pool.pubexp = pubexp;
+	pool.mp31 = mp31;
+
+	/*
+	 * The calling thread is one of the workers. If a thread cannot
+	 * be created, the remaining workers take its share; the result
+	 * is the same.
+	 */
+#if BR_RSA_THREADS
+	pthread_mutex_init(&pool.lock, NULL);
+	for (num_th = 0; num_th < num_threads - 1; num_th ++) {
+		if (pthread_create(&th[num_th], NULL,
+			&keygen_worker, &pool) != 0)
+		{
+			break;
+		}
+	}
+	keygen_worker(&pool);
+	while (num_th -- > 0) {
+		pthread_join(th[num_th], NULL);
+	}
+	pthread_mutex_destroy(&pool.lock);
+#else
+	keygen_worker(&pool);
+#endif
+
+	/*
+	 * Each race has a winner: a stream only gives up when another
+	 * one has already reported a better success.
+	 */
+	plen = (esize_p + 31) >> 5;
+	qlen = (esize_q + 31) >> 5;
+	p = tmp.t32;
+	q = p + 1 + plen;
+	t = q + 1 + qlen;
+	memcpy(p, races[0].x, (1 + plen) * sizeof *p);
+	memcpy(q, races[1].x, (1 + qlen) * sizeof *q);
+	br_i31_encode(sk->p, sk->plen, p);
+	br_i31_encode(sk->dp, sk->dplen, races[0].d);
+	br_i31_encode(sk->q, sk->qlen, q);
+	br_i31_encode(sk->dq, sk->dqlen, races[1].d);
+	return keygen_finish(sk, pk, p, q, t);
+}
+
+/*
+ * Mask a prime factor x (with d = 1/e mod x-1) with the random value
+ * r, in the format of init_key(): phi receives (x-1)*r, and the masked
+ * factor x*r and exponent d + (x-1)*r are encoded (with their exact
+ * lengths) into xm and dm. x is unchanged. The temporary t[] must have
+ * room for an integer of the size of phi.
+ */
+static void
+mask_factor(uint32_t *phi, unsigned char *xm, size_t *xmlen,
+	unsigned char *dm, size_t *dmlen,
+	uint32_t *x, const uint32_t *d, const uint32_t *r, uint32_t *t)
+{
+	x[1] ^= 1;
+	br_i31_zero(phi, x[0]);
+	br_i31_mulacc(phi, x, r);
+	x[1] ^= 1;
+
+	br_i31_zero(t, x[0]);
+	br_i31_mulacc(t, x, r);
+	t[0] = br_i31_bit_length(t + 1, (t[0] + 31) >> 5);
+	*xmlen = (t[0] - (t[0] >> 5) + 7) >> 3;
+	br_i31_encode(xm, *xmlen, t);
+
+	/*
+	 * d < x-1 and r+1 <= 2^k, with k the bit length of r, hence
+	 * d + (x-1)*r < (x-1)*(r+1) fits in the announced length of phi.
+	 */
+	br_i31_zero(t, phi[0]);
+	memcpy(t + 1, d + 1, ((d[0] + 31) >> 5) * sizeof *d);
+	br_i31_add(t, phi, 1);
+	t[0] = br_i31_bit_length(t + 1, (t[0] + 31) >> 5);
+	*dmlen = (t[0] - (t[0] >> 5) + 7) >> 3;
+	br_i31_encode(dm, *dmlen, t);
+}
+
+/* see inner.h */
+uint32_t
+br_rsa_i31_keygen_protected_inner(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_prot,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, br_i31_modpow_opt_type mp31)
+{
+	uint32_t esize_p, esize_q, ep, r;
+	size_t plen, qlen, tlen, rlen, philen, xlen;
+	uint32_t *p, *q, *dp, *dq, *t, *w;
+	unsigned char *buf;
+	union {
+		uint32_t t32[TEMPS + SIEVE_WORDS + 2 * FLEN];
+		uint64_t t64[(TEMPS + SIEVE_WORDS + 2 * FLEN) >> 1];
+	} tmp;
+
+	if (!keygen_setup(pk, kbuf_pub, size, &pubexp, &esize_p, &esize_q)) {
+		return 0;
+	}
+
+	/*
+	 * Layout of the output buffer (see BR_RSA_KBUF_PROTECTED_SIZE()):
+	 * the masks and the masked phi values, as 32-bit words, then the
+	 * modulus, the masked p, q, dp and dq, iq and the public exponent.
+	 */
+	ep = (size + 1) >> 1;
+	rlen = (BR_RSA_PROTECTED_MASK_SIZE + 63) >> 5;
+	philen = 3 + (ep + 30) / 31;
+	xlen = (ep + BR_RSA_PROTECTED_MASK_SIZE + 7) >> 3;
+	buf = kbuf_prot;
+	buf += (size_t)(-(uintptr_t)buf & 3);
+	w = (uint32_t *)(void *)buf;
+	sk->r1 = w;
+	sk->r2 = w + rlen;
+	sk->phi_p = w + 2 * rlen;
+	sk->phi_q = w + 2 * rlen + philen;
+	buf = (unsigned char *)(w + 2 * rlen + 2 * philen);
+	sk->n_bitlen = size;
+	sk->n = buf;
+	sk->p = sk->n + ((size + 7) >> 3);
+	sk->q = sk->p + xlen;
+	sk->dp = sk->q + xlen;
+	sk->dq = sk->dp + xlen;
+	sk->iq = sk->dq + xlen;
+	sk->e = sk->iq + ((ep + 7) >> 3);
+
+	/*
+	 * The primes and the reduced exponents are kept in word form, in
+	 * our stack buffer only.
+	 */
+	plen = (esize_p + 31) >> 5;
+	qlen = (esize_q + 31) >> 5;
+	p = tmp.t32;
+	q = p + FLEN;
+	dp = q + FLEN;
+	dq = dp + FLEN;
+	t = dq + FLEN;
+	tlen = ((sizeof tmp.t32) / sizeof(uint32_t)) - 4 * FLEN;
+	search_prime(rng, p, esize_p, pubexp, t, tlen, mp31, NULL, 0);
+	memcpy(dp, t, (1 + plen) * sizeof *t);
+	search_prime(rng, q, esize_q, pubexp, t, tlen, mp31, NULL, 0);
+	memcpy(dq, t, (1 + qlen) * sizeof *t);
+
+	/*
+	 * Same ordering as br_rsa_i31_keygen_inner() (p > q).
+	 */
+	if (esize_p == esize_q && br_i31_sub(p, q, 0) == 1) {
+		bufswap(p, q, (1 + plen) * sizeof *p);
+		bufswap(dp, dq, (1 + plen) * sizeof *dp);
+	}
+
+	/*
+	 * Masks r1 and r2 (odd), then the masked factors, phi values
+	 * and exponents.
+	 */
+	make_rand(rng, sk->r1, BR_RSA_RAND_FACTOR);
+	sk->r1[1] |= 1;
+	sk->r1[0] = br_i31_bit_length(sk->r1 + 1,
+		(BR_RSA_RAND_FACTOR + 31) >> 5);
+	make_rand(rng, sk->r2, BR_RSA_RAND_FACTOR);
+	sk->r2[1] |= 1;
+	sk->r2[0] = br_i31_bit_length(sk->r2 + 1,
+		(BR_RSA_RAND_FACTOR + 31) >> 5);
+	mask_factor(sk->phi_p, sk->p, &sk->plen, sk->dp, &sk->dplen,
+		p, dp, sk->r1, t);
+	mask_factor(sk->phi_q, sk->q, &sk->qlen, sk->dq, &sk->dqlen,
+		q, dq, sk->r2, t);
+
+	/*
+	 * init_key() sets iq to iq/r2 mod p*r1; only its value modulo p
+	 * matters, so we directly compute 1/(q*r2) mod p, with a single
+	 * inversion. The exponents are no longer needed; their slots
+	 * receive the operands.
+	 */
+	br_i31_zero(t, q[0]);
+	br_i31_mulacc(t, q, sk->r2);
+	br_i31_reduce(dp, t, p);
+	br_i31_zero(dq, p[0]);
+	dq[1] = 1;
+	r = br_i62_modinv(dq, dp, p, t);
+	dq[0] = br_i31_bit_length(dq + 1, plen);
+	sk->iqlen = (dq[0] - (dq[0] >> 5) + 7) >> 3;
+	br_i31_encode(sk->iq, sk->iqlen, dq);
+
+	/*
+	 * Modulus (kept in the key, and copied to the public key).
+	 */
+	br_i31_zero(t, p[0]);
+	br_i31_mulacc(t, p, q);
+	br_i31_encode(sk->n, (size + 7) >> 3, t);
+	if (pk != NULL) {
+		memcpy(pk->n, sk->n, pk->nlen);
+	}
+	sk->elen = 4;
+	br_enc32be(sk->e, pubexp);
+	while (*sk->e == 0) {
+		sk->e ++;
+		sk->elen --;
+	}
+	return r;
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2016 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <sys/random.h>
+#include "bearssl.h"
+#include "inner.h"
+#define U      (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))
+#define TLEN   (24 * U)
+
+/*
+ * Common context setup: derive the factor length (in words) from the
+ * unmasked factor length (flen, in bytes) exactly as the per-call
+ * engine does, so that the same temporary layout is used; point the
+ * key structure to the context arrays and seed the embedded DRBG.
+ * Returned value is 1 on success, 0 on error.
+ */
+static uint32_t
+protected_setup(br_rsa_i31_protected_context *ctx,
+	const br_prng_class **rng, uint32_t n_bitlen, size_t flen,
+	uint32_t refresh_period)
+{
+	size_t fwlen;
+	long z;
+	unsigned char buffer[32];
+	size_t blen;
+
+	if (n_bitlen > BR_RSA_PROTECTED_MAX_SIZE) {
+		return 0;
+	}
+	z = (long)flen << 3;
+	fwlen = 1 + 18;
+	while (z > 0) {
+		z -= 31;
+		fwlen ++;
+	}
+	fwlen += (fwlen & 1);
+	if (6 * fwlen > TLEN) {
+		return 0;
+	}
+
+	ctx->sk.r1 = ctx->r1;
+	ctx->sk.r2 = ctx->r2;
+	ctx->sk.n = ctx->n;
+	ctx->sk.p = ctx->p;
+	ctx->sk.q = ctx->q;
+	ctx->sk.dp = ctx->dp;
+	ctx->sk.dq = ctx->dq;
+	ctx->sk.iq = ctx->iq;
+	ctx->sk.phi_p = ctx->phi_p;
+	ctx->sk.phi_q = ctx->phi_q;
+	ctx->sk.e = ctx->e;
+	ctx->fwlen = fwlen;
+	ctx->wk_ok = 0;
+	ctx->refresh_period = refresh_period;
+	ctx->op_count = 0;
+	ctx->blind_period = BR_RSA_PROTECTED_BLIND_PERIOD;
+	ctx->blind_count = BR_RSA_PROTECTED_BLIND_PERIOD;
+	memset(&ctx->stats, 0, sizeof ctx->stats);
+	ctx->fault_cb = 0;
+	ctx->fault_cb_ctx = NULL;
+	ctx->fault_cb_interval = 0;
+	ctx->fault_cb_last = 0;
+	ctx->fault_cb_fired = 0;
+
+	/*
+	 * The embedded DRBG is seeded either from the caller's PRNG
+	 * (e.g. a per-thread DRBG that the caller reseeds on its own
+	 * schedule), or from the operating system.
+	 */
+	if (rng != NULL) {
+		blen = sizeof buffer;
+		(*rng)->generate(rng, buffer, blen);
+	} else {
+		ssize_t result;
+
+		// Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
+		//        and enough random data is available.
+		result = getrandom(buffer, 16, 0);
+		if (result <= 0) {
+			return 0;
+		}
+		blen = (size_t)result;
+	}
+	br_hmac_drbg_init(&ctx->rng, &br_sha256_vtable, buffer, blen);
+	return 1;
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_protected_init(br_rsa_i31_protected_context *ctx,
+	const br_prng_class **rng, const br_rsa_private_key *sk,
+	uint32_t refresh_period)
+{
+	const unsigned char *p, *q;
+	size_t plen, qlen;
+	uint32_t tmp[1 + TLEN];
+
+	/*
+	 * Compute the actual lengths of p and q, in bytes.
+	 */
+	p = sk->p;
+	plen = sk->plen;
+	while (plen > 0 && *p == 0) {
+		p ++;
+		plen --;
+	}
+	q = sk->q;
+	qlen = sk->qlen;
+	while (qlen > 0 && *q == 0) {
+		q ++;
+		qlen --;
+	}
+	if (!protected_setup(ctx, rng, sk->n_bitlen,
+		plen > qlen ? plen : qlen, refresh_period))
+	{
+		return 0;
+	}
+
+	init_key(&ctx->rng.vtable, sk, &ctx->sk, tmp, ctx->fwlen);
+	ctx->wk_ok = br_rsa_i31_protected_key_init(&ctx->wk, &ctx->sk);
+	return ctx->wk_ok;
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_protected_init_masked(br_rsa_i31_protected_context *ctx,
+	const br_prng_class **rng, const br_rsa_private_key *sk,
+	uint32_t refresh_period)
+{
+	size_t nlen, rlen;
+
+	/*
+	 * The masked key already has the format that init_key()
+	 * produces; it is copied as is. The factor length is that of
+	 * the unmasked factors, which are never larger than half the
+	 * modulus (rounded up).
+	 */
+	if (!protected_setup(ctx, rng, sk->n_bitlen,
+		(((sk->n_bitlen + 1) >> 1) + 7) >> 3, refresh_period))
+	{
+		return 0;
+	}
+	nlen = (sk->n_bitlen + 7) >> 3;
+	rlen = (BR_RSA_PROTECTED_MASK_SIZE + 63) >> 5;
+	if (sk->plen > sizeof ctx->p || sk->qlen > sizeof ctx->q
+		|| sk->dplen > sizeof ctx->dp || sk->dqlen > sizeof ctx->dq
+		|| sk->iqlen > sizeof ctx->iq || sk->elen > sizeof ctx->e
+		|| ((sk->r1[0] + 31) >> 5) >= rlen
+		|| ((sk->r2[0] + 31) >> 5) >= rlen
+		|| ((sk->phi_p[0] + 31) >> 5) >= (sizeof ctx->phi_p) >> 2
+		|| ((sk->phi_q[0] + 31) >> 5) >= (sizeof ctx->phi_q) >> 2)
+	{
+		return 0;
+	}
+	ctx->sk.n_bitlen = sk->n_bitlen;
+	memcpy(ctx->n, sk->n, nlen);
+	memcpy(ctx->r1, sk->r1, (1 + ((sk->r1[0] + 31) >> 5)) * sizeof *sk->r1);
+	memcpy(ctx->r2, sk->r2, (1 + ((sk->r2[0] + 31) >> 5)) * sizeof *sk->r2);
+	memcpy(ctx->phi_p, sk->phi_p,
+		(1 + ((sk->phi_p[0] + 31) >> 5)) * sizeof *sk->phi_p);
+	memcpy(ctx->phi_q, sk->phi_q,
+		(1 + ((sk->phi_q[0] + 31) >> 5)) * sizeof *sk->phi_q);
+	memcpy(ctx->p, sk->p, sk->plen);
+	ctx->sk.plen = sk->plen;
+	memcpy(ctx->q, sk->q, sk->qlen);
+	ctx->sk.qlen = sk->qlen;
+	memcpy(ctx->dp, sk->dp, sk->dplen);
+	ctx->sk.dplen = sk->dplen;
+	memcpy(ctx->dq, sk->dq, sk->dqlen);
+	ctx->sk.dqlen = sk->dqlen;
+	memcpy(ctx->iq, sk->iq, sk->iqlen);
+	ctx->sk.iqlen = sk->iqlen;
+	memcpy(ctx->e, sk->e, sk->elen);
+	ctx->sk.elen = sk->elen;
+	ctx->wk_ok = br_rsa_i31_protected_key_init(&ctx->wk, &ctx->sk);
+	return ctx->wk_ok;
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_protected_refresh(br_rsa_i31_protected_context *ctx)
+{
+	uint32_t tmp[1 + TLEN];
+
+	update_key(&ctx->rng.vtable, &ctx->sk, tmp, ctx->fwlen);
+	ctx->wk_ok = br_rsa_i31_protected_key_init(&ctx->wk, &ctx->sk);
+	ctx->op_count = 0;
+	ctx->stats.refreshes ++;
+	return ctx->wk_ok;
+}
+
+/* see bearssl_rsa.h */
+void
+br_rsa_i31_protected_set_blind_period(br_rsa_i31_protected_context *ctx,
+	uint32_t period)
+{
+	/*
+	 * The current pair is dropped, so that the new period applies
+	 * from the next operation on.
+	 */
+	ctx->blind_period = period;
+	ctx->blind_count = period;
+}
+
+/* see bearssl_rsa.h */
+void
+br_rsa_i31_protected_get_stats(const br_rsa_i31_protected_context *ctx,
+	br_rsa_i31_protected_stats *stats)
+{
+	*stats = ctx->stats;
+}
+
+/* see bearssl_rsa.h */
+void
+br_rsa_i31_protected_set_fault_callback(br_rsa_i31_protected_context *ctx,
+	br_rsa_i31_protected_fault_callback cb, void *cb_ctx,
+	uint64_t min_interval)
+{
+	ctx->fault_cb = cb;
+	ctx->fault_cb_ctx = cb_ctx;
+	ctx->fault_cb_interval = min_interval;
+	ctx->fault_cb_fired = 0;
+}
+
+/* see inner.h */
+void
+br_rsa_i31_protected_record(br_rsa_i31_protected_context *ctx,
+	uint32_t events)
+{
+	ctx->stats.operations ++;
+	if (events == 0) {
+		return;
+	}
+	if ((events & BR_RSA_PROTECTED_EV_RANGE) != 0) {
+		ctx->stats.range_errors ++;
+	}
+	if ((events & BR_RSA_PROTECTED_EV_FAULT) != 0) {
+		ctx->stats.faults ++;
+
+		/*
+		 * Rate limit: faults within min_interval operations of
+		 * the last report are only counted.
+		 */
+		if (ctx->fault_cb != 0 && (!ctx->fault_cb_fired
+			|| ctx->stats.operations - ctx->fault_cb_last
+			>= ctx->fault_cb_interval))
+		{
+			ctx->fault_cb_fired = 1;
+			ctx->fault_cb_last = ctx->stats.operations;
+			ctx->fault_cb(ctx->fault_cb_ctx, &ctx->stats);
+		}
+	}
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2016 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "inner.h"
+
+#define FWLEN   (2 + ((BR_MAX_RSA_FACTOR + BR_RSA_RAND_FACTOR + 30) / 31))
+
+/*
+ * Set x to R^2 mod m (R = 2^(31*len)), for an odd modulus m.
+ */
+static void
+make_r2(uint32_t *x, const uint32_t *m)
+{
+	br_i31_zero(x, m[0]);
+	x[1] = 1;
+	br_i31_to_monty(x, m);
+	br_i31_to_monty(x, m);
+}
+
+/* see inner.h */
+uint32_t
+br_rsa_i31_protected_key_decode(br_rsa_i31_protected_key *wk,
+	const br_rsa_private_key *sk, int full)
+{
+	/*
+	 * Components are decoded with their full byte length (leading
+	 * zeros included), hence the bounds on the encoded lengths.
+	 */
+	if (sk->n_bitlen > BR_MAX_RSA_SIZE
+		|| sk->plen > (((FWLEN - 1) * 31) >> 3)
+		|| sk->qlen > (((FWLEN - 1) * 31) >> 3))
+	{
+		return 0;
+	}
+	br_i31_decode(wk->n, sk->n, (sk->n_bitlen + 7) >> 3);
+	br_i31_decode(wk->p, sk->p, sk->plen);
+	br_i31_decode(wk->q, sk->q, sk->qlen);
+	wk->n0i = br_i31_ninv31(wk->n[1]);
+	wk->p0i = br_i31_ninv31(wk->p[1]);
+	wk->q0i = br_i31_ninv31(wk->q[1]);
+	make_r2(wk->p_r2, wk->p);
+	make_r2(wk->q_r2, wk->q);
+
+	/*
+	 * Since we use br_i31_decode_reduce() for iq (purportedly, the
+	 * inverse of q modulo p), we also tolerate improperly large
+	 * values for this parameter. Multiplying by R^2 yields its
+	 * Montgomery representation.
+	 */
+	br_i31_zero(wk->iq, wk->p[0]);
+	br_i31_decode_reduce(wk->iq, sk->iq, sk->iqlen, wk->p);
+	br_i31_montymul(wk->n_r2, wk->iq, wk->p_r2, wk->p, wk->p0i);
+	memcpy(wk->iq, wk->n_r2, ((wk->p[0] + 63) >> 5) * sizeof(uint32_t));
+	if (full) {
+		make_r2(wk->n_r2, wk->n);
+	}
+
+	/*
+	 * An even factor or modulus is not a valid key.
+	 */
+	return wk->n0i & wk->p0i & wk->q0i & 1;
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_protected_key_init(br_rsa_i31_protected_key *wk,
+	const br_rsa_private_key *sk)
+{
+	return br_rsa_i31_protected_key_decode(wk, sk, 1);
+}
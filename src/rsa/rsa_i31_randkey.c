@@ -79,7 +79,7 @@ static void inverse(uint32_t * dest, uint32_t * src, uint32_t * mod, uint32_t *
         br_i31_zero(dest, mod[0]);
         src[0] = mod[0];
         dest[1] = 1;
-        br_i31_moddiv(dest, src, mod, br_i31_ninv31(mod[1]), tmp);
+        br_i62_modinv(dest, src, mod, tmp);
         dest[0] = br_i31_bit_length(dest + 1, (dest[0] + 31) >> 5);
 }
 
@@ -376,7 +376,7 @@ void br_i31_init_key( const br_prng_class ** rng, const br_rsa_private_key *sk,
         
         br_i31_zero(t2, tmp[0]);
         t2[1] = 1;
-        br_i31_moddiv(t2, t1, tmp, br_i31_ninv31(tmp[1]), t2 + 2*fwlen);
+        br_i62_modinv(t2, t1, tmp, t2 + 2*fwlen);
         t2[0] = br_i31_bit_length(t2 + 1, (t2[0] + 31) >> 5);
         br_i31_encode(new_sk->iq, (t2[0] + 7) >> 3, t2);
         new_sk->iqlen = (t2[0] + 7) >> 3;
@@ -514,7 +514,7 @@ void br_i31_update_key( const br_prng_class ** rng, br_rsa_private_key *new_sk,
     
         br_i31_zero(t3, mod[0]);
         t3[1] = 1;
-        br_i31_moddiv(t3, t1, mod, br_i31_ninv31(mod[1]), t4);
+        br_i62_modinv(t3, t1, mod, t4);
         t3[0] = br_i31_bit_length(t3 + 1, (t3[0] + 31) >> 5);
         br_i31_encode(new_sk->iq, (t3[0] + 7) >> 3, t3);
         new_sk->iqlen = (t3[0] + 7) >> 3;
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2016 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+#if BR_AVX512IFMA
+
+#define U      (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))
+#define NUM    ((BR_MAX_RSA_FACTOR + 51) / 52)
+
+/*
+ * Temporaries for the multi-buffer exponentiation, in 64-bit words:
+ * room for a 4-bit window (2^4 table entries and four other values,
+ * eight lanes each).
+ */
+#define TW     (8 * 20 * NUM)
+
+/*
+ * Number of operands per group (each uses two lanes).
+ */
+#define GROUP  4
+
+/*
+ * Copy an exponent into a buffer of elen bytes, with leading zeros.
+ */
+static void
+pad_exp(unsigned char *d, size_t elen, const unsigned char *e, size_t len)
+{
+	memset(d, 0, elen - len);
+	memcpy(d + elen - len, e, len);
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i52_private_mb(unsigned char *const *xs, size_t count,
+	const br_rsa_private_key *sk, uint32_t *status)
+{
+	const unsigned char *p, *q;
+	size_t plen, qlen, elen;
+	size_t fwlen, xlen, n, u;
+	uint32_t p0i;
+	long z;
+	uint32_t mp[U], mq[U], t1[U], t2[2 * U];
+	uint32_t s1[GROUP][U], s2[GROUP][2 * U];
+	unsigned char nb[BR_MAX_RSA_SIZE >> 3];
+	unsigned char ep[BR_MAX_RSA_FACTOR >> 3], eq[BR_MAX_RSA_FACTOR >> 3];
+	uint64_t tmp[TW];
+	uint32_t ret;
+
+	/*
+	 * Actual lengths of p and q, in bytes (not secret).
+	 */
+	p = sk->p;
+	plen = sk->plen;
+	while (plen > 0 && *p == 0) {
+		p ++;
+		plen --;
+	}
+	q = sk->q;
+	qlen = sk->qlen;
+	while (qlen > 0 && *q == 0) {
+		q ++;
+		qlen --;
+	}
+
+	/*
+	 * Maximum factor length, in words.
+	 */
+	z = (long)(plen > qlen ? plen : qlen) << 3;
+	fwlen = 1;
+	while (z > 0) {
+		z -= 31;
+		fwlen ++;
+	}
+	elen = sk->dplen > sk->dqlen ? sk->dplen : sk->dqlen;
+	xlen = (sk->n_bitlen + 7) >> 3;
+	if (fwlen > U || elen > sizeof ep || xlen > sizeof nb) {
+		goto fail;
+	}
+
+	/*
+	 * Decode the factors, and encode the modulus into bytes for
+	 * the range check on the operands.
+	 */
+	br_i31_decode(mp, p, plen);
+	br_i31_decode(mq, q, qlen);
+	br_i31_zero(t2, mq[0]);
+	br_i31_mulacc(t2, mq, mp);
+	br_i31_encode(nb, xlen, t2);
+	p0i = br_i31_ninv31(mp[1]);
+	pad_exp(ep, elen, sk->dp, sk->dplen);
+	pad_exp(eq, elen, sk->dq, sk->dqlen);
+
+	ret = 1;
+	for (n = 0; n < count; n += GROUP) {
+		uint32_t *xv[2 * GROUP];
+		const unsigned char *ev[2 * GROUP];
+		const uint32_t *mv[2 * GROUP];
+		uint32_t r[GROUP], rg;
+		size_t gn, i;
+
+		gn = count - n;
+		if (gn > GROUP) {
+			gn = GROUP;
+		}
+		for (i = 0; i < gn; i ++) {
+			unsigned char *x;
+			uint32_t cc, wn, wx;
+
+			/*
+			 * The carry when subtracting the modulus from the
+			 * operand must be 1 (operand lower than n).
+			 */
+			x = xs[n + i];
+			u = xlen;
+			cc = 0;
+			while (u > 0) {
+				u --;
+				wn = nb[u];
+				wx = x[u];
+				cc = ((wx - (wn + cc)) >> 8) & 1;
+			}
+			r[i] = cc;
+
+			br_i31_decode_reduce(s1[i], x, xlen, mp);
+			br_i31_decode_reduce(s2[i], x, xlen, mq);
+			xv[2 * i] = s1[i];
+			ev[2 * i] = ep;
+			mv[2 * i] = mp;
+			xv[2 * i + 1] = s2[i];
+			ev[2 * i + 1] = eq;
+			mv[2 * i + 1] = mq;
+		}
+		rg = br_i52_modpow_mb(xv, ev, elen, mv, 2 * gn, tmp, TW);
+
+		/*
+		 * CRT recombination, as in br_rsa_i31_private():
+		 *   h = (s1 - s2)*(1/q) mod p
+		 *   s = s2 + q*h
+		 */
+		for (i = 0; i < gn; i ++) {
+			uint32_t *a, *b;
+			uint32_t ok;
+
+			a = s1[i];
+			b = s2[i];
+			br_i31_reduce(t2, b, mp);
+			br_i31_add(a, mp, br_i31_sub(a, t2, 1));
+			br_i31_to_monty(a, mp);
+			br_i31_decode_reduce(t1, sk->iq, sk->iqlen, mp);
+			br_i31_montymul(t2, a, t1, mp, p0i);
+			br_i31_mulacc(b, mq, t2);
+
+			br_i31_encode(xs[n + i], xlen, b);
+			ok = r[i] & rg;
+			if (status != NULL) {
+				status[n + i] = ok;
+			}
+			ret &= ok;
+		}
+	}
+	return ret;
+
+fail:
+	if (status != NULL) {
+		for (n = 0; n < count; n ++) {
+			status[n] = 0;
+		}
+	}
+	return count == 0;
+}
+
+/* see bearssl_rsa.h */
+br_rsa_private_mb
+br_rsa_i52_private_mb_get(void)
+{
+	return br_i52_modpow_mb_get() != 0 ? &br_rsa_i52_private_mb : 0;
+}
+
+#else
+
+/* see bearssl_rsa.h */
+br_rsa_private_mb
+br_rsa_i52_private_mb_get(void)
+{
+	return 0;
+}
+
+#endif
@@ -45,6 +45,44 @@ br_rsa_i62_keygen_get(void)
 	return &br_rsa_i62_keygen;
 }
 
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i62_keygen_parallel(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp, unsigned num_threads)
+{
+	return br_rsa_i31_keygen_parallel_inner(rng,
+		sk, kbuf_priv, pk, kbuf_pub, size, pubexp,
+		&br_i62_modpow_opt_as_i31, num_threads);
+}
+
+/* see bearssl_rsa.h */
+br_rsa_keygen_parallel
+br_rsa_i62_keygen_parallel_get(void)
+{
+	return &br_rsa_i62_keygen_parallel;
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i62_keygen_protected(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_prot,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp)
+{
+	return br_rsa_i31_keygen_protected_inner(rng,
+		sk, kbuf_prot, pk, kbuf_pub, size, pubexp,
+		&br_i62_modpow_opt_as_i31);
+}
+
+/* see bearssl_rsa.h */
+br_rsa_keygen
+br_rsa_i62_keygen_protected_get(void)
+{
+	return &br_rsa_i62_keygen_protected;
+}
+
 #else
 
 /* see bearssl_rsa.h */
@@ -54,4 +92,18 @@ br_rsa_i62_keygen_get(void)
 	return 0;
 }
 
+/* see bearssl_rsa.h */
+br_rsa_keygen_parallel
+br_rsa_i62_keygen_parallel_get(void)
+{
+	return 0;
+}
+
+/* see bearssl_rsa.h */
+br_rsa_keygen
+br_rsa_i62_keygen_protected_get(void)
+{
+	return 0;
+}
+
 #endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/random.h>
+
+#include "inner.h"
+
+#if BR_INT128 || BR_UMUL128
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i62_private_protected_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
+{
+	return br_rsa_i31_private_protected_inner(rng, x, sk,
+		&br_i62_double_modpow_opt_rand_as_i31);
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i62_private_protected(unsigned char *x, const br_rsa_private_key *sk)
+{
+	unsigned char buffer[16];
+	ssize_t result;
+	br_hmac_drbg_context rng;
+
+	// Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
+	//        and enough random data is available.
+	result = getrandom(buffer, sizeof(buffer), 0);
+	if (result <= 0) {
+		return 0;
+	}
+	br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result);
+	return br_rsa_i62_private_protected_rng(&rng.vtable, x, sk);
+}
+
+/* see bearssl_rsa.h */
+br_rsa_private
+br_rsa_i62_private_protected_get(void)
+{
+	return &br_rsa_i62_private_protected;
+}
+
+#else
+
+/* see bearssl_rsa.h */
+br_rsa_private
+br_rsa_i62_private_protected_get(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+/*
+ * PKCS#1 v1.5 signature engines for each protection level above
+ * BR_RSA_PROTECT_NONE: padding, then the private key engine returned
+ * by br_rsa_private_get_protected() for that level.
+ */
+
+static uint32_t
+pkcs1_sign(br_rsa_private core, const unsigned char *hash_oid,
+	const unsigned char *hash, size_t hash_len,
+	const br_rsa_private_key *sk, unsigned char *x)
+{
+	if (!br_rsa_pkcs1_sig_pad(hash_oid, hash, hash_len, sk->n_bitlen, x)) {
+		return 0;
+	}
+	return core(x, sk);
+}
+
+static uint32_t
+pkcs1_sign_blind(const unsigned char *hash_oid,
+	const unsigned char *hash, size_t hash_len,
+	const br_rsa_private_key *sk, unsigned char *x)
+{
+	return pkcs1_sign(br_rsa_private_get_protected(BR_RSA_PROTECT_BLIND),
+		hash_oid, hash, hash_len, sk, x);
+}
+
+static uint32_t
+pkcs1_sign_mod_rand(const unsigned char *hash_oid,
+	const unsigned char *hash, size_t hash_len,
+	const br_rsa_private_key *sk, unsigned char *x)
+{
+	return pkcs1_sign(
+		br_rsa_private_get_protected(BR_RSA_PROTECT_MOD_RAND),
+		hash_oid, hash, hash_len, sk, x);
+}
+
+static uint32_t
+pkcs1_sign_prerand(const unsigned char *hash_oid,
+	const unsigned char *hash, size_t hash_len,
+	const br_rsa_private_key *sk, unsigned char *x)
+{
+	return pkcs1_sign(
+		br_rsa_private_get_protected(BR_RSA_PROTECT_PRERAND),
+		hash_oid, hash, hash_len, sk, x);
+}
+
+static uint32_t
+pkcs1_sign_full(const unsigned char *hash_oid,
+	const unsigned char *hash, size_t hash_len,
+	const br_rsa_private_key *sk, unsigned char *x)
+{
+	return pkcs1_sign(br_rsa_private_get_protected(BR_RSA_PROTECT_FULL),
+		hash_oid, hash, hash_len, sk, x);
+}
+
+/* see bearssl_rsa.h */
+br_rsa_pkcs1_sign
+br_rsa_pkcs1_sign_get_protected(unsigned level)
+{
+	switch (level) {
+	case BR_RSA_PROTECT_NONE:
+#if BR_INT128 || BR_UMUL128
+		return &br_rsa_i62_pkcs1_sign;
+#elif BR_LOMUL
+		return &br_rsa_i15_pkcs1_sign;
+#else
+		return &br_rsa_i31_pkcs1_sign;
+#endif
+	case BR_RSA_PROTECT_BLIND:
+		return &pkcs1_sign_blind;
+	case BR_RSA_PROTECT_MOD_RAND:
+		return &pkcs1_sign_mod_rand;
+	case BR_RSA_PROTECT_PRERAND:
+		return &pkcs1_sign_prerand;
+	case BR_RSA_PROTECT_FULL:
+		return &pkcs1_sign_full;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2017 Thomas Pornin <pornin@bolet.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining 
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "inner.h"
+
+/*
+ * The engines above BR_RSA_PROTECT_NONE use the modulus and the public
+ * exponent (for blinding and for the fault check), but a private key
+ * need not contain them (e.g. when obtained from br_skey_decoder). The
+ * missing elements are then recomputed from the factors, into a local
+ * copy of the key structure.
+ */
+static uint32_t
+with_public(br_rsa_private core, unsigned char *x,
+	const br_rsa_private_key *sk)
+{
+	br_rsa_private_key sk2;
+	unsigned char n[(BR_MAX_RSA_SIZE + 7) >> 3];
+	unsigned char e[4];
+	uint32_t pubexp;
+	size_t nlen;
+
+	if (sk->n != NULL && sk->e != NULL) {
+		return core(x, sk);
+	}
+	sk2 = *sk;
+	if (sk->n == NULL) {
+		nlen = br_rsa_i31_compute_modulus(NULL, sk);
+		if (nlen == 0 || nlen > sizeof n) {
+			return 0;
+		}
+		br_rsa_i31_compute_modulus(n, sk);
+		sk2.n = n;
+	}
+	if (sk->e == NULL) {
+		pubexp = br_rsa_i31_compute_pubexp(sk);
+		if (pubexp == 0) {
+			return 0;
+		}
+		br_enc32be(e, pubexp);
+		sk2.e = e;
+		sk2.elen = sizeof e;
+		while (*sk2.e == 0) {
+			sk2.e ++;
+			sk2.elen --;
+		}
+	}
+	return core(x, &sk2);
+}
+
+/*
+ * Message blinding, modulus randomization and key pre-randomization
+ * are implemented only on top of the "i31" code, hence the fixed
+ * engines for these three levels.
+ */
+static uint32_t
+private_blind(unsigned char *x, const br_rsa_private_key *sk)
+{
+	return with_public(&br_rsa_i31_private_msg_blind, x, sk);
+}
+
+static uint32_t
+private_mod_rand(unsigned char *x, const br_rsa_private_key *sk)
+{
+	return with_public(&br_rsa_i31_private_mod_rand, x, sk);
+}
+
+static uint32_t
+private_prerand(unsigned char *x, const br_rsa_private_key *sk)
+{
+	return with_public(&br_rsa_i31_private_mod_prerand, x, sk);
+}
+
+static uint32_t
+private_full(unsigned char *x, const br_rsa_private_key *sk)
+{
+#if BR_INT128 || BR_UMUL128
+	return with_public(&br_rsa_i62_private_protected, x, sk);
+#elif BR_LOMUL
+	return with_public(&br_rsa_i15_private_protected, x, sk);
+#else
+	return with_public(&br_rsa_i31_private_protected, x, sk);
+#endif
+}
+
+/* see bearssl_rsa.h */
+br_rsa_private
+br_rsa_private_get_protected(unsigned level)
+{
+	switch (level) {
+	case BR_RSA_PROTECT_NONE:
+#if BR_INT128 || BR_UMUL128
+		return &br_rsa_i62_private;
+#elif BR_LOMUL
+		return &br_rsa_i15_private;
+#else
+		return &br_rsa_i31_private;
+#endif
+	case BR_RSA_PROTECT_BLIND:
+		return &private_blind;
+	case BR_RSA_PROTECT_MOD_RAND:
+		return &private_mod_rand;
+	case BR_RSA_PROTECT_PRERAND:
+		return &private_prerand;
+	case BR_RSA_PROTECT_FULL:
+		return &private_full;
+	default:
+		return 0;
+	}
+}
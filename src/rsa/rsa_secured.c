@@ -28,135 +28,199 @@
 #define U      (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))
 #define TLEN   (36 * U)
 
-/* see bearssl_rsa.h */
-uint32_t
-br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
+#if BR_RSA_THREADS
+#include <pthread.h>
+#endif
+
+/*
+ * One CRT half of the protected operation. On input, s[] holds the
+ * blinded message reduced modulo m[] (masked factor). On output, s[]
+ * is s^d' mod m, where d' is the reduced exponent d blinded with phi,
+ * and co_s[] is s^d' * s^co_d mod m, with co_d = phi - (d mod phi); for
+ * a correct computation that product is 1 modulo the real factor.
+ * m0i is -1/m mod 2^31, and r2 is R^2 mod m. The work area w[] must
+ * have room for TLEN - 6 * fwlen words and be 64-bit aligned.
+ */
+static uint32_t
+crt_half(const br_prng_class **rng, uint32_t *s, uint32_t *co_s,
+	const uint32_t *m, uint32_t m0i, const uint32_t *r2,
+	const unsigned char *d, size_t dlen, const uint32_t *phi,
+	size_t fwlen, br_i31_double_modpow_opt_rand_type dmp, uint32_t *w)
 {
-	const unsigned char *p, *q;
-	size_t plen, qlen;
-	size_t fwlen;
-	uint32_t p0i, q0i;
-	size_t xlen, u;
-	uint32_t tmp[1 + TLEN];
-	long z;
-	uint32_t *mp, *mq, *s1, *s2, *t1, *t2, *t3;
+	unsigned char *dx, *co_dx;
+	size_t dxlen, co_dxlen;
+	uint32_t *t;
 	uint32_t r;
-	
-    /*
-	 * Compute the actual lengths of p and q, in bytes.
-	 * These lengths are not considered secret (we cannot really hide
-	 * them anyway in constant-time code).
-	 */
-	p = sk->p;
-	plen = sk->plen;
-
-	while (plen > 0 && *p == 0) {
-		p ++;
-		plen --;
-	}
-	q = sk->q;
-	qlen = sk->qlen;
-	while (qlen > 0 && *q == 0) {
-		q ++;
-		qlen --;
-	}
 
 	/*
-	 * Compute the maximum factor length, in words.
+	 * Blinded exponent in w (slot 0), complementary exponent in
+	 * slot 1, computed in slot 2.
 	 */
-	z = (long)(plen > qlen ? plen : qlen) << 3;
-	fwlen =  1 + 10;
-	while (z > 0) {
-		z -= 31;
-		fwlen ++;
-	}
+	dx = (unsigned char *)w;
+	dxlen = blind_exponent(rng, dx, d, dlen, (uint32_t *)phi, w + fwlen);
+	co_dx = (unsigned char *)(w + fwlen);
+	t = w + 2 * fwlen;
+	br_i31_zero(t, phi[0]);
+	memcpy(t + 1, phi + 1, (phi[0] + 7) >> 3);
+	br_i31_zero(w + fwlen, m[0]);
+	br_i31_decode_reduce(w + fwlen, d, dlen, phi);
+	br_i31_sub(t, w + fwlen, 1);
+	br_i31_zero(w + fwlen, m[0]);
+	co_dxlen = (t[0] + 7) >> 3;
+	br_i31_encode(co_dx, co_dxlen, t);
+
+	br_i31_zero(co_s, m[0]);
+	s[0] = m[0];
 
 	/*
-	 * Round up the word length to an even number.
+	 * s = x^dx and co_s = x^co_dx, in a single pass that shares the
+	 * window table and modulus re-randomization.
 	 */
-	fwlen += (fwlen & 1);
+	r = dmp(rng, s, co_s, dx, dxlen, co_dx, co_dxlen, m, m0i, r2,
+		w + 2 * fwlen, TLEN - 8 * fwlen);
 
-	/*
-	 * We need to fit at least 6 values in the stack buffer.
-	 */
-	if (6 * fwlen > TLEN) {
-		return 0;
-	}
-
-	/*
-	 * Compute modulus length (in bytes).
-	 */
-	xlen = (sk->n_bitlen + 7) >> 3;
-
-
-
-	br_rsa_private_key rsa_sk;
-	mq = tmp;
-	uint32_t r2[(BR_RSA_RAND_FACTOR + 63) >> 5];
-	uint32_t r3[(BR_RSA_RAND_FACTOR + 63) >> 5];
-	uint32_t phi_p[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR +  63) >> 5];
-	uint32_t phi_q[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
-	unsigned char n_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-	unsigned char p_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
-	unsigned char q_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
-	unsigned char dp_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-	unsigned char dq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-	unsigned char iq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-	unsigned char e_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
-	rsa_sk.r1 = r2;
-	rsa_sk.r2 = r3;
-	rsa_sk.n = n_buf;
-	rsa_sk.p = p_buf;
-	rsa_sk.q = q_buf;
-	rsa_sk.dp = dp_buf;
-	rsa_sk.dq = dq_buf;
-	rsa_sk.iq = iq_buf;
-	rsa_sk.phi_p = phi_p;
-	rsa_sk.phi_q = phi_q;
-	rsa_sk.e = e_buf;
+	br_i31_zero(w, m[0]);
+	br_i31_mulacc(w, s, co_s);
+	br_i31_reduce(co_s, w, m);
+	return r;
+}
 
+#if BR_RSA_THREADS
+
+typedef struct {
+	br_hmac_drbg_context rng;
+	uint32_t *s, *co_s;
+	const uint32_t *m;
+	uint32_t m0i;
+	const uint32_t *r2;
+	const unsigned char *d;
+	size_t dlen;
+	const uint32_t *phi;
+	size_t fwlen;
+	br_i31_double_modpow_opt_rand_type dmp;
+	uint32_t *w;
+	uint32_t r;
+} crt_job;
 
+static void *
+crt_worker(void *arg)
+{
+	crt_job *job;
 
-	unsigned char buffer[16];
-    ssize_t result;
+	job = arg;
+	job->r = crt_half(&job->rng.vtable, job->s, job->co_s,
+		job->m, job->m0i, job->r2, job->d, job->dlen, job->phi,
+		job->fwlen, job->dmp, job->w);
+	return NULL;
+}
 
-    // Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
-    //        and enough random data is available.
-    result = getrandom(buffer, sizeof(buffer), 0);
+#endif
 
-    br_hmac_drbg_context rng;
-    br_hmac_drbg_init(&rng, &br_sha256_vtable,buffer, result); // "seed for RSA SAFE", 17);
-	init_key(&rng.vtable, sk, &rsa_sk, tmp, fwlen);
+/*
+ * Run both CRT halves. With BR_RSA_THREADS, the q half runs on a worker
+ * thread with its own work area and its own DRBG (seeded from rng),
+ * while the p half runs on the calling thread; if the thread cannot be
+ * started, the q half runs on the calling thread afterwards. w[] is the
+ * work area for the calling thread (see crt_half()).
+ */
+static uint32_t
+crt_halves(const br_prng_class **rng, const br_rsa_private_key *sk,
+	const br_rsa_i31_protected_key *pk,
+	size_t fwlen, br_i31_double_modpow_opt_rand_type dmp,
+	uint32_t *s1, uint32_t *co_s1, uint32_t *s2, uint32_t *co_s2,
+	uint32_t *w)
+{
+#if BR_RSA_THREADS
+	uint64_t w2[(2 + TLEN) >> 1];
+	unsigned char seed[32];
+	crt_job job;
+	pthread_t th;
+	uint32_t r;
 
-	update_key(&rng.vtable, &rsa_sk, tmp, fwlen);
+	(*rng)->generate(rng, seed, sizeof seed);
+	br_hmac_drbg_init(&job.rng, &br_sha256_vtable, seed, sizeof seed);
+	job.s = s2;
+	job.co_s = co_s2;
+	job.m = pk->q;
+	job.m0i = pk->q0i;
+	job.r2 = pk->q_r2;
+	job.d = sk->dq;
+	job.dlen = sk->dqlen;
+	job.phi = sk->phi_q;
+	job.fwlen = fwlen;
+	job.dmp = dmp;
+	job.w = (uint32_t *)w2;
+	if (pthread_create(&th, NULL, &crt_worker, &job) != 0) {
+		crt_worker(&job);
+		r = job.r;
+		r &= crt_half(rng, s1, co_s1, pk->p, pk->p0i, pk->p_r2,
+			sk->dp, sk->dplen, sk->phi_p, fwlen, dmp, w);
+	} else {
+		r = crt_half(rng, s1, co_s1, pk->p, pk->p0i, pk->p_r2,
+			sk->dp, sk->dplen, sk->phi_p, fwlen, dmp, w);
+		pthread_join(th, NULL);
+		r &= job.r;
+	}
+	return r;
+#else
+	uint32_t r;
 
+	r = crt_half(rng, s2, co_s2, pk->q, pk->q0i, pk->q_r2,
+		sk->dq, sk->dqlen, sk->phi_q, fwlen, dmp, w);
+	r &= crt_half(rng, s1, co_s1, pk->p, pk->p0i, pk->p_r2,
+		sk->dp, sk->dplen, sk->phi_p, fwlen, dmp, w);
+	return r;
+#endif
+}
 
-	uint32_t r1[(BR_RSA_RAND_FACTOR + 63) >> 5];
-	make_rand(&rng.vtable, r1, BR_RSA_RAND_FACTOR);
-	r1[0] = br_i31_bit_length(r1 + 1, (BR_RSA_RAND_FACTOR + 31) >> 5);
-	
+/*
+ * Protected private key operation on an already masked key (as
+ * produced by init_key() and update_key()), with its word form in pk
+ * (see br_rsa_i31_protected_key_init()). The temporaries are
+ * split into slots of 'fwlen' words; tmp[] must have room for TLEN
+ * words and be 64-bit aligned.
+ *
+ * If events is not NULL, it receives the checks that failed, as
+ * BR_RSA_PROTECTED_EV_* flags (for the context statistics).
+ */
+static uint32_t
+protected_core(const br_prng_class **rng, unsigned char *x,
+	const br_rsa_private_key *sk, const br_rsa_i31_protected_key *pk, size_t fwlen,
+	br_i31_double_modpow_opt_rand_type dmp,
+	br_rsa_i31_protected_context *bctx, uint32_t *tmp, uint32_t *events)
+{
+	uint32_t p0i, q0i, n0i;
+	size_t xlen, u;
+	const uint32_t *mp, *mq, *n;
+	uint32_t *s1, *s2, *co_s1, *co_s2, *t1, *t2, *t3;
+	uint32_t r, range, fault, acc;
+	uint32_t r_inv[2 + ((BR_MAX_RSA_SIZE + 30) / 31)];
 
 	/*
-	 * Decode q.
+	 * Compute modulus length (in bytes).
 	 */
-
-	mq = tmp;
+	xlen = (sk->n_bitlen + 7) >> 3;
 
 	/*
-	 * Decode p.
+	 * With a key context, the message blinding pair comes from the
+	 * context (see br_rsa_i31_blind_pair_take()); otherwise a fresh
+	 * random r is used.
 	 */
+	uint32_t r1[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	if (bctx == NULL) {
+		make_rand(rng, r1, BR_RSA_RAND_FACTOR);
+		r1[0] = br_i31_bit_length(r1 + 1,
+			(BR_RSA_RAND_FACTOR + 31) >> 5);
+	}
 	
-	t1 = mq + fwlen;
-	
-	/*
-	 * Compute the modulus (product of the two factors), to compare
-	 * it with the source value. We use br_i31_mulacc(), since it's
-	 * already used later on.
-	 */
+
 	
-	t2 = mq + 2 * fwlen;
-	br_i31_zero(t2, mq[0]);
-	br_i31_decode(t2, rsa_sk.n, (rsa_sk.n_bitlen + 7) >> 3);
+	t1 = tmp + fwlen;
+	n = pk->n;
+	n0i = pk->n0i;
+	p0i = pk->p0i;
+	q0i = pk->q0i;
+
 	/*
 	 * We encode the modulus into bytes, to perform the comparison
 	 * with bytes. We know that the product length, in bytes, is
@@ -166,8 +230,8 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 	 * a value in the correct range. We keep it in r, which is our
 	 * accumulator for the error code.
 	 */
-	t3 = mq + 4 * fwlen;
-	br_i31_encode(t3, xlen, t2);
+	t3 = tmp + 4 * fwlen;
+	br_i31_encode(t3, xlen, n);
 	u = xlen;
 	r = 0;
 	while (u > 0) {
@@ -178,36 +242,45 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 		wx = x[u];
 		r = ((wx - (wn + r)) >> 8) & 1;
 	}
+	range = r;
 	
 	/*
 	 * Compute (r^e * C) (mod n)
 	 */	
 
-	uint32_t *n = t2;
-	br_i31_decode(n, rsa_sk.n, (rsa_sk.n_bitlen + 7) >> 3);
 	uint32_t *c = t3;
-	uint32_t *c_prime = mq + 6 * fwlen;
-	uint32_t * r_to_e = mq;	
+	uint32_t *c_prime = tmp + 6 * fwlen;
+	uint32_t * r_to_e = tmp;	
 	
 	br_i31_zero(c, n[0]);
 	br_i31_decode_reduce(c, x, xlen, n);
-	
-	br_i31_zero(r_to_e, n[0]);
-	memcpy(r_to_e + 1, r1 + 1,  ((*r1 + 7) >> 3));
-	r_to_e[0] = n[0];
 
-	r &= br_i31_modpow_opt(r_to_e, rsa_sk.e, rsa_sk.elen, n,  br_i31_ninv31(n[1]), mq + 8 * fwlen, TLEN - 8 * fwlen);
+	/*
+	 * A zero input cannot pass the fault check below; it is reported
+	 * as a range error (the input must be in 1..n-1).
+	 */
+	range &= br_i31_iszero(c) ^ 1;
+	r &= range;
+	
+	if (bctx != NULL) {
+		r &= br_rsa_i31_blind_pair_take(bctx, n, n0i, r_to_e, r_inv,
+			tmp + 8 * fwlen, TLEN - 8 * fwlen);
+		br_i31_from_monty(r_to_e, n, n0i);
+	} else {
+		br_i31_zero(r_to_e, n[0]);
+		memcpy(r_to_e + 1, r1 + 1,  ((*r1 + 7) >> 3));
+		r_to_e[0] = n[0];
+
+		r &= br_i31_modpow_opt(r_to_e, sk->e, sk->elen, n, n0i,
+			tmp + 8 * fwlen, TLEN - 8 * fwlen);
+	}
 
 	br_i31_zero(c_prime, n[0]);
 	c[0] = c_prime[0];
 	br_i31_mulacc(c_prime, c, r_to_e);
 	
-	mq = tmp + 4 * fwlen;
-	mp = tmp + 5 * fwlen;
-
-
-	br_i31_decode(mq,  rsa_sk.q,  rsa_sk.qlen);
-	br_i31_decode(mp,  rsa_sk.p,  rsa_sk.plen);
+	mq = pk->q;
+	mp = pk->p;
 
 	s2 = tmp;
 	s1 = tmp + fwlen;
@@ -224,93 +297,16 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 	br_i31_reduce(s2, c_prime, mq);
 		
 
-	unsigned char* dq = (unsigned char *) (tmp + 6 *fwlen); 
-	size_t dqlen = blind_exponent(&rng.vtable, dq, rsa_sk.dq, rsa_sk.dqlen, rsa_sk.phi_q, tmp + 7 * fwlen);
-    
-    uint32_t *co_s2 = tmp + 2 * fwlen;
-    br_i31_zero(co_s2, s2[0]);   
-	memcpy(co_s2 + 1, s2 + 1, (s2[0] + 7) >> 3);
-
-
-	unsigned char* co_dq = (unsigned char *) (tmp + 7 * fwlen);
-	br_i31_zero(tmp + 8 *fwlen, rsa_sk.phi_q[0]);
-	memcpy((tmp + 8 *fwlen) + 1, rsa_sk.phi_q + 1, (rsa_sk.phi_q[0] + 7) >> 3);
-
-
-    br_i31_decode_reduce(tmp + 7 * fwlen, rsa_sk.dq, rsa_sk.dqlen, rsa_sk.phi_q);
-	br_i31_sub((tmp + 8 *fwlen),tmp + 7 *fwlen , 1);
-	size_t co_dqlen = (*((tmp + 8 *fwlen)) + 7) >> 3;
-	br_i31_encode(co_dq, co_dqlen, tmp + 8 *fwlen);
-
-
 	/*
-	 * Compute s2 = x^dq mod q.
+	 * s2 = x^dq (mod q) and s1 = x^dp (mod p), each along with the
+	 * complementary exponentiation; co_s2 and co_s1 receive the
+	 * products used by the fault check.
 	 */
-	q0i = br_i31_ninv31(mq[1]);
-	s2[0] = mq[0];
-    co_s2[0] = mq[0];
-
-
-	r &= br_i31_modpow_opt_rand(&rng.vtable, s2, dq, dqlen, mq, q0i,
-		tmp + 8 * fwlen, TLEN - 8 * fwlen);
-
-
-
-	r &= br_i31_modpow_opt_rand(&rng.vtable, co_s2, co_dq, co_dqlen, mq, q0i,
-		tmp + 8 * fwlen, TLEN - 8 * fwlen);
-	
-
-	br_i31_zero(tmp + 6 *fwlen, mq[0]);
-	br_i31_mulacc(tmp + 6 *fwlen, s2, co_s2);
-	br_i31_reduce(co_s2, tmp + 6 *fwlen, mq);
-
-
-
-	/*
-	 * Compute s1 = x^dp mod p.
-	 */
-	
-	unsigned char* dp = (unsigned char *) (tmp + 6 *fwlen); 
-	size_t dplen = blind_exponent(&rng.vtable, dp, rsa_sk.dp, rsa_sk.dplen, rsa_sk.phi_p, tmp + 7 * fwlen);	
-   
-    uint32_t *co_s1 = tmp + 3 * fwlen;
-    br_i31_zero(co_s1, s1[0]);   
-	memcpy(co_s1 + 1, s1 + 1, (s1[0] + 7) >> 3);
-
-
-	unsigned char* co_dp = (unsigned char *) (tmp + 7 * fwlen);
-	br_i31_zero(tmp + 8 *fwlen, rsa_sk.phi_p[0]);
-	memcpy((tmp + 8 *fwlen) + 1, rsa_sk.phi_p + 1, (rsa_sk.phi_p[0] + 7) >> 3);
+	co_s2 = tmp + 2 * fwlen;
+	co_s1 = tmp + 3 * fwlen;
+	r &= crt_halves(rng, sk, pk, fwlen, dmp,
+		s1, co_s1, s2, co_s2, tmp + 6 * fwlen);
 
-    br_i31_zero(tmp + 7 * fwlen, mp[0]);
-	br_i31_decode_reduce(tmp + 7 * fwlen, rsa_sk.dp, rsa_sk.dplen, rsa_sk.phi_p);
-
-	br_i31_sub((tmp + 8 *fwlen),tmp + 7 *fwlen , 1);
-    br_i31_zero(tmp + 7 * fwlen, mp[0]);
-	size_t co_dplen = (*((tmp + 8 *fwlen)) + 7) >> 3;
-    br_i31_bit_length(tmp+8*fwlen, (*(tmp + 8 * fwlen) + 31) >> 5);
-	co_dplen = (*((tmp + 8 *fwlen)) + 7) >> 3;
-	br_i31_encode(co_dp, co_dplen, tmp + 8 * fwlen);
-
-
-	p0i = br_i31_ninv31(mp[1]);
-	s1[0] = mp[0];
-	co_s1[0] = mp[0];
-
-
-	r &= br_i31_modpow_opt_rand(&rng.vtable, s1, dp, dplen, mp, p0i,
-		tmp + 9 * fwlen, TLEN - 9 * fwlen);
-    
-
-
-	r &= br_i31_modpow_opt_rand(&rng.vtable, co_s1, co_dp, co_dplen, mp, p0i,
-		tmp + 8 * fwlen, TLEN - 8 * fwlen);
-
-
-
-	br_i31_zero(tmp + 6 *fwlen, mp[0]);
-	br_i31_mulacc(tmp + 6 *fwlen, s1, co_s1);
-	br_i31_reduce(co_s1, tmp + 6 *fwlen, mp);
 
 
 	
@@ -318,19 +314,21 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 	t2 = tmp + 7 * fwlen;
 	br_i31_reduce(t2, co_s2, mp); 
 	br_i31_add(co_s1, mp, br_i31_sub(co_s1, t2, 1));
-	br_i31_to_monty(co_s1, mp);
-	br_i31_decode_reduce(t1,  rsa_sk.iq,  rsa_sk.iqlen, mp);
-	br_i31_montymul(t2, co_s1, t1, mp, p0i);
+	br_i31_montymul(t2, co_s1, pk->iq, mp, p0i);
 	
 	t3 = co_s2;
-    n = tmp + 8 * fwlen;
 	br_i31_mulacc(t3, mq, t2);
-	br_i31_decode(n, rsa_sk.n, (rsa_sk.n_bitlen + 7) >> 3);
     br_i31_reduce(t1, t3, n);
 
-    if(t1[1] != 1){
-    	r = 0;
-    }
+	/*
+	 * The recombined value must be exactly 1 (all words checked).
+	 */
+	acc = t1[1] ^ 1;
+	for (u = 2; u <= ((size_t)(n[0] + 31) >> 5); u ++) {
+		acc |= t1[u];
+	}
+	fault = NEQ(acc, 0) & range;
+	r &= EQ(acc, 0);
     /*
 	 * Compute:
 	 *   h = (s1 - s2)*(1/q) mod p
@@ -340,9 +338,8 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 	 * but we want to support that occurrence, so we need to use the
 	 * reduction function.
 	 *
-	 * Since we use br_i31_decode_reduce() for iq (purportedly, the
-	 * inverse of q modulo p), we also tolerate improperly large
-	 * values for this parameter.
+	 * pk->iq is in Montgomery representation, so the Montgomery
+	 * product with s1 yields s1*iq directly.
 	 */
 
 	
@@ -350,9 +347,7 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 	t2 = tmp + 7 * fwlen;
 	br_i31_reduce(t2, s2, mp); 
 	br_i31_add(s1, mp, br_i31_sub(s1, t2, 1));
-	br_i31_to_monty(s1, mp);
-	br_i31_decode_reduce(t1,  rsa_sk.iq,  rsa_sk.iqlen, mp);
-	br_i31_montymul(t2, s1, t1, mp, p0i);
+	br_i31_montymul(t2, s1, pk->iq, mp, p0i);
 	
 	/*
 	 * h is now in t2. We compute the final result:
@@ -370,27 +365,44 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 	t3 = s2;
 	br_i31_mulacc(t3, mq, t2);
 	t1 = tmp + 4 * fwlen;
-    n = tmp  + 2 * fwlen;
-	br_i31_decode(n, rsa_sk.n, (rsa_sk.n_bitlen + 7) >> 3);
 	br_i31_zero(t1, n[0]);
 	br_i31_reduce(t1, t3, n); 
 	
 
     t2 = tmp + 6 * fwlen;
-	br_i31_zero(t2, n[0]);
-	memcpy(t2 + 1, r1 + 1, (*r1 + 7) >> 3);
 	t1[0] = n[0];
-	
-	r &= br_i31_moddiv(t1, t2, n, br_i31_ninv31(n[1]), tmp + 8 * fwlen);
+	if (bctx != NULL) {
+		/*
+		 * r_inv is 1/r in Montgomery representation, so a single
+		 * Montgomery multiplication removes the blinding factor.
+		 */
+		br_i31_montymul(t2, t1, r_inv, n, n0i);
+		t1 = t2;
+	} else {
+		br_i31_zero(t2, n[0]);
+		memcpy(t2 + 1, r1 + 1, (*r1 + 7) >> 3);
+		r &= br_i62_modinv(t1, t2, n, tmp + 8 * fwlen);
+	}
     	
+	/*
+	 * On a failed fault check, the (possibly faulty) result is
+	 * replaced with zero, so that it never reaches the caller.
+	 */
+	acc = -EQ(acc, 0);
+	for (u = 1; u <= ((size_t)(n[0] + 31) >> 5); u ++) {
+		t1[u] &= acc;
+	}
+
 	/*
 	 * Encode the result. Since we already checked the value of xlen,
 	 * we can just use it right away.
 	 */
-	
-
 	br_i31_encode(x, xlen, t1);
 
+	if (events != NULL) {
+		*events = (fault * BR_RSA_PROTECTED_EV_FAULT)
+			| ((range ^ 1) * BR_RSA_PROTECTED_EV_RANGE);
+	}
 
 	/*
 	 * The only error conditions remaining at that point are invalid
@@ -398,3 +410,226 @@ br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
 	 */
 	return p0i & q0i & r;
 }
+
+/* see inner.h */
+uint32_t
+br_rsa_i31_private_protected_inner(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk,
+	br_i31_double_modpow_opt_rand_type dmp)
+{
+	const unsigned char *p, *q;
+	size_t plen, qlen;
+	size_t fwlen;
+	uint64_t tmp64[(2 + TLEN) >> 1];
+	uint32_t *tmp;
+	long z;
+
+	/*
+	 * The temporaries are 64-bit aligned, since the exponentiation
+	 * function may use them as 64-bit words. fwlen is even, so all
+	 * slots below start on a 64-bit boundary.
+	 */
+	tmp = (uint32_t *)tmp64;
+	
+    /*
+	 * Compute the actual lengths of p and q, in bytes.
+	 * These lengths are not considered secret (we cannot really hide
+	 * them anyway in constant-time code).
+	 */
+	p = sk->p;
+	plen = sk->plen;
+
+	while (plen > 0 && *p == 0) {
+		p ++;
+		plen --;
+	}
+	q = sk->q;
+	qlen = sk->qlen;
+	while (qlen > 0 && *q == 0) {
+		q ++;
+		qlen --;
+	}
+
+	/*
+	 * Compute the maximum factor length, in words.
+	 */
+	z = (long)(plen > qlen ? plen : qlen) << 3;
+	fwlen =  1 + 10;
+	while (z > 0) {
+		z -= 31;
+		fwlen ++;
+	}
+
+	/*
+	 * Round up the word length to an even number.
+	 */
+	fwlen += (fwlen & 1);
+
+	/*
+	 * We need to fit at least 6 values in the stack buffer.
+	 */
+	if (6 * fwlen > TLEN) {
+		return 0;
+	}
+
+	br_rsa_private_key rsa_sk;
+	uint32_t r2[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t r3[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t phi_p[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR +  63) >> 5];
+	uint32_t phi_q[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
+	unsigned char n_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char p_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+	unsigned char q_buf[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+	unsigned char dp_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char dq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char iq_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char e_buf[(BR_MAX_RSA_SIZE + 15) >> 3];
+	rsa_sk.r1 = r2;
+	rsa_sk.r2 = r3;
+	rsa_sk.n = n_buf;
+	rsa_sk.p = p_buf;
+	rsa_sk.q = q_buf;
+	rsa_sk.dp = dp_buf;
+	rsa_sk.dq = dq_buf;
+	rsa_sk.iq = iq_buf;
+	rsa_sk.phi_p = phi_p;
+	rsa_sk.phi_q = phi_q;
+	rsa_sk.e = e_buf;
+
+
+
+	br_rsa_i31_protected_key pk;
+
+	init_key(rng, sk, &rsa_sk, tmp, fwlen);
+
+	update_key(rng, &rsa_sk, tmp, fwlen);
+
+	if (!br_rsa_i31_protected_key_decode(&pk, &rsa_sk, 0)) {
+		return 0;
+	}
+	return protected_core(rng, x, &rsa_sk, &pk, fwlen, dmp,
+		NULL, tmp, NULL);
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_protected_rng(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
+{
+	return br_rsa_i31_private_protected_inner(rng, x, sk,
+		&br_i31_double_modpow_opt_rand);
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_protected(unsigned char *x, const br_rsa_private_key *sk)
+{
+	unsigned char buffer[16];
+	ssize_t result;
+	br_hmac_drbg_context rng;
+
+	// Flags: 0 means a "blocking" call until the kernel CSPRNG is fully initialized
+	//        and enough random data is available.
+	result = getrandom(buffer, sizeof(buffer), 0);
+	if (result <= 0) {
+		return 0;
+	}
+	br_hmac_drbg_init(&rng, &br_sha256_vtable, buffer, result);
+	return br_rsa_i31_private_protected_rng(&rng.vtable, x, sk);
+}
+
+/*
+ * Slot length for the masked key held in a context. It is computed
+ * from the masked factors; they are larger than the source factors,
+ * so this is at least the length used by the per-call engine. Returned
+ * value is 0 if the key is too large for the temporaries, or if the
+ * last conversion to word form failed (see br_rsa_i31_protected_refresh()).
+ */
+static size_t
+ctx_fwlen(const br_rsa_i31_protected_context *ctx)
+{
+	const unsigned char *p, *q;
+	size_t plen, qlen;
+	size_t fwlen;
+	long z;
+
+	if (!ctx->wk_ok) {
+		return 0;
+	}
+	p = ctx->sk.p;
+	plen = ctx->sk.plen;
+	while (plen > 0 && *p == 0) {
+		p ++;
+		plen --;
+	}
+	q = ctx->sk.q;
+	qlen = ctx->sk.qlen;
+	while (qlen > 0 && *q == 0) {
+		q ++;
+		qlen --;
+	}
+	z = (long)(plen > qlen ? plen : qlen) << 3;
+	fwlen = 1 + 10;
+	while (z > 0) {
+		z -= 31;
+		fwlen ++;
+	}
+	fwlen += (fwlen & 1);
+	if (6 * fwlen > TLEN) {
+		return 0;
+	}
+	return fwlen;
+}
+
+/*
+ * Same refresh schedule as br_rsa_i31_private_mod_prerand_ctx().
+ */
+static void
+ctx_schedule(br_rsa_i31_protected_context *ctx)
+{
+	if (ctx->refresh_period != 0) {
+		if (ctx->op_count >= ctx->refresh_period) {
+			br_rsa_i31_protected_refresh(ctx);
+		}
+		ctx->op_count ++;
+	}
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_protected_ctx(unsigned char *x,
+	br_rsa_i31_protected_context *ctx)
+{
+	size_t fwlen;
+	uint64_t tmp64[(2 + TLEN) >> 1];
+	uint32_t r, ev;
+
+	ctx_schedule(ctx);
+	fwlen = ctx_fwlen(ctx);
+	if (fwlen == 0) {
+		return 0;
+	}
+	r = protected_core(&ctx->rng.vtable, x, &ctx->sk, &ctx->wk, fwlen,
+		&br_i31_double_modpow_opt_rand, ctx, (uint32_t *)tmp64, &ev);
+	br_rsa_i31_protected_record(ctx, ev);
+	return r;
+}
+
+/* see bearssl_rsa.h */
+uint32_t
+br_rsa_i31_private_batch(unsigned char *const *xs, size_t count,
+	br_rsa_i31_protected_context *ctx, uint32_t *status)
+{
+	size_t u;
+	uint32_t all, st;
+
+	all = 1;
+	for (u = 0; u < count; u ++) {
+		st = br_rsa_i31_private_protected_ctx(xs[u], ctx);
+		if (status != NULL) {
+			status[u] = st;
+		}
+		all &= st;
+	}
+	return all;
+}
@@ -30,7 +30,6 @@ br_rsa_ssl_decrypt(br_rsa_private core, const br_rsa_private_key *sk,
 	unsigned char *data, size_t len)
 {
 	uint32_t x;
-	size_t u;
 
 	/*
 	 * A first check on length. Since this test works only on the
@@ -40,8 +39,18 @@ br_rsa_ssl_decrypt(br_rsa_private core, const br_rsa_private_key *sk,
 		return 0;
 	}
 	x = core(data, sk);
+	x &= br_rsa_ssl_decrypt_unpad(data, len);
+	return x;
+}
+
+/* see inner.h */
+uint32_t
+br_rsa_ssl_decrypt_unpad(unsigned char *data, size_t len)
+{
+	uint32_t x;
+	size_t u;
 
-	x &= EQ(data[0], 0x00);
+	x = EQ(data[0], 0x00);
 	x &= EQ(data[1], 0x02);
 	for (u = 2; u < (len - 49); u ++) {
 		x &= NEQ(data[u], 0);
@@ -5313,13 +5313,14 @@ static const br_rsa_public_key RSA_PK = {
 };
 
 static const br_rsa_private_key RSA_SK = {
-	1024,
+	(void *)RSA_N, 1024,
 	(void *)RSA_P, sizeof RSA_P,
 	(void *)RSA_Q, sizeof RSA_Q,
 	(void *)RSA_DP, sizeof RSA_DP,
 	(void *)RSA_DQ, sizeof RSA_DQ,
 	(void *)RSA_IQ, sizeof RSA_IQ,
-	(void *)RSA_E, sizeof RSA_E
+	(void *)RSA_E, sizeof RSA_E,
+	NULL, NULL, NULL, NULL
 };
 
 /*
@@ -5459,13 +5460,14 @@ static const br_rsa_public_key RSA2048_PK = {
 };
 
 static const br_rsa_private_key RSA2048_SK = {
-	2048,
+	(void *)RSA2048_N, 2048,
 	(void *)RSA2048_P, sizeof RSA2048_P,
 	(void *)RSA2048_Q, sizeof RSA2048_Q,
 	(void *)RSA2048_DP, sizeof RSA2048_DP,
 	(void *)RSA2048_DQ, sizeof RSA2048_DQ,
 	(void *)RSA2048_IQ, sizeof RSA2048_IQ,
-	(void *)RSA2048_E, sizeof RSA2048_E
+	(void *)RSA2048_E, sizeof RSA2048_E,
+	NULL, NULL, NULL, NULL
 };
 
 /*
@@ -5717,14 +5719,14 @@ static const br_rsa_public_key RSA4096_PK = {
 };
 
 static const br_rsa_private_key RSA4096_SK = {
-	4096,
+	(void *)RSA4096_N, 4096,
 	(void *)RSA4096_P, sizeof RSA4096_P,
 	(void *)RSA4096_Q, sizeof RSA4096_Q,
 	(void *)RSA4096_DP, sizeof RSA4096_DP,
 	(void *)RSA4096_DQ, sizeof RSA4096_DQ,
 	(void *)RSA4096_IQ, sizeof RSA4096_IQ,
-	(void *)RSA4096_E, sizeof RSA4096_E
-
+	(void *)RSA4096_E, sizeof RSA4096_E,
+	NULL, NULL, NULL, NULL
 };
 
 static void
@@ -6960,6 +6962,62 @@ test_RSA_i15(void)
 		&br_rsa_i15_pkcs1_sign, &br_rsa_i15_pkcs1_vrfy);
 }
 
+static uint32_t
+rsa_i31_keygen_parallel3(const br_prng_class **rng,
+	br_rsa_private_key *sk, void *kbuf_priv,
+	br_rsa_public_key *pk, void *kbuf_pub,
+	unsigned size, uint32_t pubexp)
+{
+	return br_rsa_i31_keygen_parallel(rng,
+		sk, kbuf_priv, pk, kbuf_pub, size, pubexp, 3);
+}
+
+/*
+ * The parallel key generation must yield the same key pair for the
+ * same seed and thread count.
+ */
+static void
+test_RSA_keygen_parallel(const char *name, br_rsa_keygen_parallel kg)
+{
+	unsigned nt;
+
+	printf("Test %s: ", name);
+	fflush(stdout);
+
+	for (nt = 0; nt <= 4; nt ++) {
+		br_hmac_drbg_context rng;
+		br_rsa_private_key sk1, sk2;
+		br_rsa_public_key pk1, pk2;
+		unsigned char kp1[BR_RSA_KBUF_PRIV_SIZE(1024)];
+		unsigned char kp2[BR_RSA_KBUF_PRIV_SIZE(1024)];
+		unsigned char kq1[BR_RSA_KBUF_PUB_SIZE(1024)];
+		unsigned char kq2[BR_RSA_KBUF_PUB_SIZE(1024)];
+
+		br_hmac_drbg_init(&rng, &br_sha256_vtable, "parallel", 8);
+		if (!kg(&rng.vtable, &sk1, kp1, &pk1, kq1, 1024, 65537, nt)) {
+			fprintf(stderr, "RSA key pair generation failure\n");
+			exit(EXIT_FAILURE);
+		}
+		br_hmac_drbg_init(&rng, &br_sha256_vtable, "parallel", 8);
+		if (!kg(&rng.vtable, &sk2, kp2, &pk2, kq2, 1024, 65537, nt)) {
+			fprintf(stderr, "RSA key pair generation failure\n");
+			exit(EXIT_FAILURE);
+		}
+		if (memcmp(kp1, kp2, sizeof kp1) != 0
+			|| memcmp(kq1, kq2, sizeof kq1) != 0)
+		{
+			fprintf(stderr, "non-deterministic key pair"
+				" (%u threads)\n", nt);
+			exit(EXIT_FAILURE);
+		}
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
 static void
 test_RSA_i31(void)
 {
@@ -6974,12 +7032,1058 @@ test_RSA_i31(void)
 		&br_rsa_i31_compute_modulus, &br_rsa_i31_compute_pubexp,
 		&br_rsa_i31_compute_privexp, &br_rsa_i31_public,
 		&br_rsa_i31_pkcs1_sign, &br_rsa_i31_pkcs1_vrfy);
+	test_RSA_keygen("RSA i31 parallel keygen", &rsa_i31_keygen_parallel3,
+		&br_rsa_i31_compute_modulus, &br_rsa_i31_compute_pubexp,
+		&br_rsa_i31_compute_privexp, &br_rsa_i31_public,
+		&br_rsa_i31_pkcs1_sign, &br_rsa_i31_pkcs1_vrfy);
+	test_RSA_keygen_parallel("RSA i31 parallel keygen determinism",
+		&br_rsa_i31_keygen_parallel);
+}
+
+/*
+ * Deterministic DRBG used to exercise the caller-supplied PRNG variants
+ * of the protected engines.
+ */
+static br_hmac_drbg_context rsa_test_rng;
+
+static uint32_t
+rsa_i31_private_mod_rand_testrng(unsigned char *x,
+	const br_rsa_private_key *sk)
+{
+	return br_rsa_i31_private_mod_rand_rng(&rsa_test_rng.vtable, x, sk);
+}
+
+static uint32_t
+rsa_i31_private_mod_prerand_testrng(unsigned char *x,
+	const br_rsa_private_key *sk)
+{
+	return br_rsa_i31_private_mod_prerand_rng(&rsa_test_rng.vtable, x, sk);
+}
+
+static void
+test_RSA_protected_ctx_inner(const br_rsa_public_key *pk,
+	const br_rsa_private_key *sk, const br_prng_class **rng)
+{
+	br_rsa_i31_protected_context ctx;
+	unsigned char t1[512], t2[512];
+	size_t len, u;
+	int i;
+
+	if (!br_rsa_i31_protected_init(&ctx, rng, sk, 2)) {
+		fprintf(stderr, "protected context init failed\n");
+		exit(EXIT_FAILURE);
+	}
+	len = pk->nlen;
+	for (i = 0; i < 5; i ++) {
+		t1[0] = 0;
+		for (u = 1; u < len; u ++) {
+			t1[u] = (unsigned char)(u * 7 + i * 13 + 1);
+		}
+		memcpy(t2, t1, len);
+		if (!br_rsa_i31_public(t2, len, pk)) {
+			fprintf(stderr, "RSA public operation failed\n");
+			exit(EXIT_FAILURE);
+		}
+		if (!br_rsa_i31_private_mod_prerand_ctx(t2, &ctx)) {
+			fprintf(stderr, "RSA protected context operation"
+				" failed\n");
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA protected context", t1, t2, len);
+		printf(".");
+		fflush(stdout);
+	}
+
+	/*
+	 * Cached blinding pair: run past several regenerations (short
+	 * period), and with regeneration on every call (period 0).
+	 */
+	for (i = 0; i < 12; i ++) {
+		if (i == 0) {
+			br_rsa_i31_protected_set_blind_period(&ctx, 3);
+		} else if (i == 8) {
+			br_rsa_i31_protected_set_blind_period(&ctx, 0);
+		}
+		t1[0] = 0;
+		for (u = 1; u < len; u ++) {
+			t1[u] = (unsigned char)(u * 11 + i * 5 + 3);
+		}
+		memcpy(t2, t1, len);
+		br_rsa_i31_public(t2, len, pk);
+		if ((i & 1) == 0) {
+			if (!br_rsa_i31_private_protected_ctx(t2, &ctx)) {
+				fprintf(stderr, "RSA protected context"
+					" operation failed\n");
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			if (!br_rsa_i31_private_mod_prerand_ctx(t2, &ctx)) {
+				fprintf(stderr, "RSA protected context"
+					" operation failed\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		check_equals("RSA protected context (blinding pair)",
+			t1, t2, len);
+	}
+	printf(".");
+	fflush(stdout);
+}
+
+static void
+test_RSA_protected_ctx(void)
+{
+	printf("Test RSA i31 protected context: ");
+	fflush(stdout);
+	test_RSA_protected_ctx_inner(&RSA_PK, &RSA_SK, NULL);
+	test_RSA_protected_ctx_inner(&RSA2048_PK, &RSA2048_SK, NULL);
+	test_RSA_protected_ctx_inner(&RSA4096_PK, &RSA4096_SK, NULL);
+	test_RSA_protected_ctx_inner(&RSA2048_PK, &RSA2048_SK,
+		&rsa_test_rng.vtable);
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+typedef struct {
+	br_rsa_i31_protected_context *ctx;
+	unsigned calls;
+	uint64_t faults;
+} rsa_fault_watch;
+
+static void
+rsa_fault_notify(void *cb_ctx, const br_rsa_i31_protected_stats *stats)
+{
+	rsa_fault_watch *fw;
+
+	fw = cb_ctx;
+	fw->calls ++;
+	fw->faults = stats->faults;
+	br_rsa_i31_protected_refresh(fw->ctx);
+}
+
+static void
+check_rsa_stats(const char *banner, br_rsa_i31_protected_context *ctx,
+	uint64_t ops, uint64_t faults, uint64_t range_errors,
+	uint64_t refreshes)
+{
+	br_rsa_i31_protected_stats st;
+
+	br_rsa_i31_protected_get_stats(ctx, &st);
+	if (st.operations != ops || st.faults != faults
+		|| st.range_errors != range_errors
+		|| st.refreshes != refreshes)
+	{
+		fprintf(stderr, "%s: wrong statistics: %lu/%lu/%lu/%lu"
+			" (expected: %lu/%lu/%lu/%lu)\n", banner,
+			(unsigned long)st.operations, (unsigned long)st.faults,
+			(unsigned long)st.range_errors,
+			(unsigned long)st.refreshes,
+			(unsigned long)ops, (unsigned long)faults,
+			(unsigned long)range_errors, (unsigned long)refreshes);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Context statistics: operations, range errors, refreshes and faults
+ * (injected by corrupting the word form of the masked p in the
+ * context), with the rate-limited callback.
+ */
+static void
+test_RSA_protected_stats(void)
+{
+	br_rsa_i31_protected_context ctx;
+	rsa_fault_watch fw;
+	unsigned char t1[256], t2[256], *xs[2];
+	size_t len, u;
+	int i;
+
+	printf("Test RSA i31 protected statistics: ");
+	fflush(stdout);
+
+	if (!br_rsa_i31_protected_init(&ctx, &rsa_test_rng.vtable,
+		&RSA2048_SK, 0))
+	{
+		fprintf(stderr, "protected context init failed\n");
+		exit(EXIT_FAILURE);
+	}
+	check_rsa_stats("init", &ctx, 0, 0, 0, 0);
+	len = RSA2048_PK.nlen;
+	for (u = 1; u < len; u ++) {
+		t1[u] = (unsigned char)(u * 3 + 1);
+	}
+	t1[0] = 0;
+	memcpy(t2, t1, len);
+	br_rsa_i31_public(t2, len, &RSA2048_PK);
+	if (!br_rsa_i31_private_protected_ctx(t2, &ctx)) {
+		fprintf(stderr, "RSA protected context operation failed\n");
+		exit(EXIT_FAILURE);
+	}
+	check_equals("RSA protected statistics", t1, t2, len);
+	check_rsa_stats("operation", &ctx, 1, 0, 0, 0);
+
+	/*
+	 * Inputs not lower than the modulus.
+	 */
+	memcpy(t2, RSA2048_PK.n, len);
+	if (br_rsa_i31_private_protected_ctx(t2, &ctx)) {
+		fprintf(stderr, "RSA protected context: input not rejected\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(t2, 0xFF, len);
+	br_rsa_i31_private_mod_prerand_ctx(t2, &ctx);
+	check_rsa_stats("range", &ctx, 3, 0, 2, 0);
+
+	br_rsa_i31_protected_refresh(&ctx);
+	xs[0] = t1;
+	xs[1] = t2;
+	memcpy(t2, t1, len);
+	br_rsa_i31_private_batch(xs, 2, &ctx, NULL);
+	check_rsa_stats("batch", &ctx, 5, 0, 2, 1);
+	printf(".");
+	fflush(stdout);
+
+	/*
+	 * Faults: the callback (which refreshes the masks) is called on
+	 * the first fault, then not before 3 more operations.
+	 */
+	fw.ctx = &ctx;
+	fw.calls = 0;
+	fw.faults = 0;
+	br_rsa_i31_protected_set_fault_callback(&ctx,
+		&rsa_fault_notify, &fw, 3);
+	for (i = 0; i < 5; i ++) {
+		uint32_t w;
+		unsigned calls;
+
+		/*
+		 * The callback refresh rebuilds the word form of the
+		 * key; otherwise, the fault is removed here.
+		 */
+		calls = fw.calls;
+		w = ctx.wk.p[2];
+		ctx.wk.p[2] ^= 0x100;
+		memcpy(t2, t1, len);
+		if (br_rsa_i31_private_protected_ctx(t2, &ctx)) {
+			fprintf(stderr, "RSA protected context: fault not"
+				" detected\n");
+			exit(EXIT_FAILURE);
+		}
+		for (u = 0; u < len; u ++) {
+			if (t2[u] != 0) {
+				fprintf(stderr, "RSA protected context:"
+					" faulty result not cleared\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (fw.calls == calls) {
+			ctx.wk.p[2] = w;
+		}
+	}
+	check_rsa_stats("faults", &ctx, 10, 5, 2, 3);
+	if (fw.calls != 2 || fw.faults != 4) {
+		fprintf(stderr, "wrong fault callback calls: %u (%lu)\n",
+			fw.calls, (unsigned long)fw.faults);
+		exit(EXIT_FAILURE);
+	}
+	printf(".");
+	fflush(stdout);
+
+	/*
+	 * A refresh that fails to convert the key (here, an even
+	 * modulus) is reported, and operations then fail without being
+	 * counted.
+	 */
+	br_rsa_i31_protected_set_fault_callback(&ctx, 0, NULL, 0);
+	ctx.n[len - 1] ^= 0x01;
+	if (br_rsa_i31_protected_refresh(&ctx)) {
+		fprintf(stderr, "RSA protected context: refresh failure"
+			" not reported\n");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(t2, t1, len);
+	if (br_rsa_i31_private_protected_ctx(t2, &ctx)
+		|| br_rsa_i31_private_mod_prerand_ctx(t2, &ctx))
+	{
+		fprintf(stderr, "RSA protected context: refresh failure"
+			" not latched\n");
+		exit(EXIT_FAILURE);
+	}
+	check_rsa_stats("refresh failure", &ctx, 10, 5, 2, 4);
+	printf(".");
+	fflush(stdout);
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+/*
+ * Masked key generation: the public key must match that of the plain
+ * key generation for the same seed, and the masked private key, once
+ * loaded into a protected context, must invert the public operation,
+ * also after mask refreshes.
+ */
+static void
+test_RSA_keygen_protected(const char *name, br_rsa_keygen kg,
+	br_rsa_keygen kg_plain)
+{
+	static const unsigned sizes[] = { 1024, 1025, 1535, 2048, 3072 };
+	static const uint32_t pubexps[] = { 3, 65537, 17, 0, 0xFFFFFFFF };
+	br_hmac_drbg_context rng;
+	size_t k;
+
+	printf("Test %s: ", name);
+	fflush(stdout);
+
+	for (k = 0; k < (sizeof sizes) / sizeof sizes[0]; k ++) {
+		br_rsa_i31_protected_context ctx;
+		br_rsa_private_key sk, sk2;
+		br_rsa_public_key pk, pk2;
+		unsigned char kbuf_prot[BR_RSA_KBUF_PROTECTED_SIZE(3072)];
+		unsigned char kbuf_priv[BR_RSA_KBUF_PRIV_SIZE(3072)];
+		unsigned char kbuf_pub[BR_RSA_KBUF_PUB_SIZE(3072)];
+		unsigned char kbuf_pub2[BR_RSA_KBUF_PUB_SIZE(3072)];
+		unsigned char t1[384], t2[384], hv[32], hv2[32];
+		size_t len, u;
+		int i;
+
+		br_hmac_drbg_init(&rng, &br_sha256_vtable, &k, sizeof k);
+		if (!kg(&rng.vtable, &sk, kbuf_prot, &pk, kbuf_pub,
+			sizes[k], pubexps[k]))
+		{
+			fprintf(stderr, "RSA key pair generation failure\n");
+			exit(EXIT_FAILURE);
+		}
+		br_hmac_drbg_init(&rng, &br_sha256_vtable, &k, sizeof k);
+		if (!kg_plain(&rng.vtable, &sk2, kbuf_priv, &pk2, kbuf_pub2,
+			sizes[k], pubexps[k]))
+		{
+			fprintf(stderr, "RSA key pair generation failure\n");
+			exit(EXIT_FAILURE);
+		}
+		len = pk.nlen;
+		check_equals("RSA masked keygen (modulus)", pk.n, pk2.n, len);
+		check_equals("RSA masked keygen (key modulus)", sk.n, pk.n, len);
+		if (pk.elen != pk2.elen || sk.elen != pk.elen) {
+			fprintf(stderr, "wrong public exponent length\n");
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA masked keygen (exponent)", sk.e, pk.e,
+			pk.elen);
+
+		/*
+		 * A mask longer than the context arrays (here, three
+		 * data words) must be rejected.
+		 */
+		for (u = 65; u <= 96; u += 31) {
+			br_rsa_private_key sk3;
+			uint32_t rx[4];
+
+			rx[0] = (uint32_t)u;
+			rx[1] = 1;
+			rx[2] = 1;
+			rx[3] = 1;
+			sk3 = sk;
+			sk3.r1 = rx;
+			if (br_rsa_i31_protected_init_masked(&ctx,
+				&rng.vtable, &sk3, 2))
+			{
+				fprintf(stderr, "long mask r1 accepted\n");
+				exit(EXIT_FAILURE);
+			}
+			sk3 = sk;
+			sk3.r2 = rx;
+			if (br_rsa_i31_protected_init_masked(&ctx,
+				&rng.vtable, &sk3, 2))
+			{
+				fprintf(stderr, "long mask r2 accepted\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		if (!br_rsa_i31_protected_init_masked(&ctx, &rng.vtable,
+			&sk, 2))
+		{
+			fprintf(stderr, "protected context init failed\n");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < 6; i ++) {
+			if (i == 3) {
+				br_rsa_i31_protected_refresh(&ctx);
+			}
+			rng.vtable->generate(&rng.vtable, t1, len);
+			t1[0] = 0;
+			memcpy(t2, t1, len);
+			if (!br_rsa_i31_public(t2, len, &pk)) {
+				fprintf(stderr, "RSA public operation"
+					" failed\n");
+				exit(EXIT_FAILURE);
+			}
+			if ((i & 1) == 0) {
+				if (!br_rsa_i31_private_protected_ctx(t2,
+					&ctx))
+				{
+					fprintf(stderr, "RSA protected context"
+						" operation failed\n");
+					exit(EXIT_FAILURE);
+				}
+			} else {
+				if (!br_rsa_i31_private_mod_prerand_ctx(t2,
+					&ctx))
+				{
+					fprintf(stderr, "RSA protected context"
+						" operation failed\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+			check_equals("RSA masked keygen (private)",
+				t1, t2, len);
+		}
+
+		for (u = 0; u < sizeof hv; u ++) {
+			hv[u] = (unsigned char)(u * 3 + k);
+		}
+		if (!br_rsa_i31_protected_pkcs1_sign(BR_HASH_OID_SHA256,
+			hv, sizeof hv, &ctx, t1))
+		{
+			fprintf(stderr, "RSA protected PKCS#1 sign failed\n");
+			exit(EXIT_FAILURE);
+		}
+		if (!br_rsa_i31_pkcs1_vrfy(t1, len, BR_HASH_OID_SHA256,
+			sizeof hv, &pk, hv2))
+		{
+			fprintf(stderr, "RSA masked keygen signature"
+				" not verified\n");
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA masked keygen (signature)", hv, hv2,
+			sizeof hv);
+
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_RSA_protected_pad_inner(const br_rsa_public_key *pk,
+	const br_rsa_private_key *sk)
+{
+	br_rsa_i31_protected_context ctx;
+	unsigned char hash[20], t1[512], t2[512];
+	size_t len, u;
+
+	if (!br_rsa_i31_protected_init(&ctx, &rsa_test_rng.vtable, sk, 2)) {
+		fprintf(stderr, "protected context init failed\n");
+		exit(EXIT_FAILURE);
+	}
+	len = pk->nlen;
+	for (u = 0; u < sizeof hash; u ++) {
+		hash[u] = (unsigned char)(u * 17 + len);
+	}
+
+	/*
+	 * PKCS#1 v1.5 signatures are deterministic: compare with the
+	 * unprotected engine.
+	 */
+	if (!br_rsa_i31_pkcs1_sign(BR_HASH_OID_SHA1, hash, sizeof hash,
+		sk, t1))
+	{
+		fprintf(stderr, "RSA PKCS#1 sign failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (!br_rsa_i31_protected_pkcs1_sign(BR_HASH_OID_SHA1,
+		hash, sizeof hash, &ctx, t2))
+	{
+		fprintf(stderr, "RSA protected PKCS#1 sign failed\n");
+		exit(EXIT_FAILURE);
+	}
+	check_equals("RSA protected PKCS#1 sign", t1, t2, len);
+	printf(".");
+	fflush(stdout);
+
+	/*
+	 * PSS signature, checked with the public key.
+	 */
+	if (!br_rsa_i31_protected_pss_sign(&rsa_test_rng.vtable,
+		&br_sha1_vtable, &br_sha1_vtable, hash, 20, &ctx, t1))
+	{
+		fprintf(stderr, "RSA protected PSS sign failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (!br_rsa_i31_pss_vrfy(t1, len, &br_sha1_vtable, &br_sha1_vtable,
+		hash, 20, pk))
+	{
+		fprintf(stderr, "RSA protected PSS signature not verified\n");
+		exit(EXIT_FAILURE);
+	}
+	printf(".");
+	fflush(stdout);
+
+	/*
+	 * OAEP round-trip.
+	 */
+	u = br_rsa_i31_oaep_encrypt(&rsa_test_rng.vtable, &br_sha1_vtable,
+		"label", 5, pk, t1, sizeof t1, hash, sizeof hash);
+	if (u != len) {
+		fprintf(stderr, "RSA OAEP encrypt failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (!br_rsa_i31_protected_oaep_decrypt(&br_sha1_vtable,
+		"label", 5, &ctx, t1, &u))
+	{
+		fprintf(stderr, "RSA protected OAEP decrypt failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (u != sizeof hash) {
+		fprintf(stderr, "RSA protected OAEP: wrong length\n");
+		exit(EXIT_FAILURE);
+	}
+	check_equals("RSA protected OAEP decrypt", t1, hash, u);
+	printf(".");
+	fflush(stdout);
+
+	/*
+	 * SSL pre-master secret: build the PKCS#1 type 2 padding by
+	 * hand, then decrypt; a bad padding must be reported.
+	 */
+	t2[0] = 0x00;
+	t2[1] = 0x02;
+	for (u = 2; u < len - 49; u ++) {
+		t2[u] = (unsigned char)(u | 1);
+	}
+	t2[len - 49] = 0x00;
+	for (u = len - 48; u < len; u ++) {
+		t2[u] = (unsigned char)(u * 3);
+	}
+	memcpy(t1, t2, len);
+	if (!br_rsa_i31_public(t1, len, pk)) {
+		fprintf(stderr, "RSA public operation failed\n");
+		exit(EXIT_FAILURE);
+	}
+	if (!br_rsa_i31_protected_ssl_decrypt(&ctx, t1, len)) {
+		fprintf(stderr, "RSA protected SSL decrypt failed\n");
+		exit(EXIT_FAILURE);
+	}
+	check_equals("RSA protected SSL decrypt", t1, t2 + len - 48, 48);
+	t2[1] = 0x01;
+	memcpy(t1, t2, len);
+	br_rsa_i31_public(t1, len, pk);
+	if (br_rsa_i31_protected_ssl_decrypt(&ctx, t1, len)) {
+		fprintf(stderr, "RSA protected SSL decrypt: bad padding"
+			" accepted\n");
+		exit(EXIT_FAILURE);
+	}
+	printf(".");
+	fflush(stdout);
+}
+
+static void
+test_RSA_protected_pad(void)
+{
+	printf("Test RSA i31 protected padding engines: ");
+	fflush(stdout);
+	test_RSA_protected_pad_inner(&RSA_PK, &RSA_SK);
+	test_RSA_protected_pad_inner(&RSA2048_PK, &RSA2048_SK);
+	test_RSA_protected_pad_inner(&RSA4096_PK, &RSA4096_SK);
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_RSA_protected_key_inner(const br_rsa_private_key *sk)
+{
+	br_rsa_i31_protected_key wk;
+	br_rsa_private_key sk2;
+	uint32_t t1[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t t2[BR_RSA_I31_PROTECTED_FWLEN];
+	unsigned char p[BR_MAX_RSA_FACTOR / 8];
+
+	if (!br_rsa_i31_protected_key_init(&wk, sk)) {
+		fprintf(stderr, "RSA word key conversion failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * iq is kept in Montgomery representation modulo p, so that a
+	 * Montgomery product with q mod p must yield 1.
+	 */
+	br_i31_zero(t1, wk.p[0]);
+	br_i31_reduce(t1, wk.q, wk.p);
+	br_i31_montymul(t2, t1, wk.iq, wk.p, wk.p0i);
+	br_i31_zero(t1, wk.p[0]);
+	t1[1] = 1;
+	check_equals("RSA word key iq", t1, t2,
+		((wk.p[0] + 63) >> 5) * sizeof(uint32_t));
+
+	/*
+	 * R^2 mod q: a Montgomery product with 1 yields R mod q.
+	 */
+	br_i31_montymul(t2, t1, wk.q_r2, wk.q, wk.q0i);
+	t1[0] = wk.q[0];
+	br_i31_to_monty(t1, wk.q);
+	check_equals("RSA word key R^2", t1, t2,
+		((wk.q[0] + 63) >> 5) * sizeof(uint32_t));
+
+	/*
+	 * An even factor is rejected.
+	 */
+	sk2 = *sk;
+	memcpy(p, sk->p, sk->plen);
+	p[sk->plen - 1] &= 0xFE;
+	sk2.p = p;
+	if (br_rsa_i31_protected_key_init(&wk, &sk2)) {
+		fprintf(stderr, "RSA word key accepted even factor\n");
+		exit(EXIT_FAILURE);
+	}
+	printf(".");
+	fflush(stdout);
+}
+
+static void
+test_RSA_protected_key(void)
+{
+	printf("Test RSA i31 word key: ");
+	fflush(stdout);
+	test_RSA_protected_key_inner(&RSA_SK);
+	test_RSA_protected_key_inner(&RSA2048_SK);
+	test_RSA_protected_key_inner(&RSA4096_SK);
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+typedef uint32_t (*rsa_batch_fun)(unsigned char *const *xs, size_t count,
+	br_rsa_i31_protected_context *ctx, uint32_t *status);
+
+static void
+test_RSA_protected_batch_inner(rsa_batch_fun fbatch,
+	const br_rsa_public_key *pk, const br_rsa_private_key *sk)
+{
+	br_rsa_i31_protected_context ctx;
+	unsigned char t1[11][512], t2[11][512];
+	unsigned char *xs[11];
+	uint32_t status[11];
+	size_t len, u;
+	int i;
+
+	if (!br_rsa_i31_protected_init(&ctx, &rsa_test_rng.vtable, sk, 3)) {
+		fprintf(stderr, "protected context init failed\n");
+		exit(EXIT_FAILURE);
+	}
+	br_rsa_i31_protected_set_blind_period(&ctx, 2);
+	len = pk->nlen;
+	for (i = 0; i < 11; i ++) {
+		t1[i][0] = 0;
+		for (u = 1; u < len; u ++) {
+			t1[i][u] = (unsigned char)(u * 3 + i * 29 + 5);
+		}
+		memcpy(t2[i], t1[i], len);
+		br_rsa_i31_public(t2[i], len, pk);
+		xs[i] = t2[i];
+	}
+
+	/*
+	 * Item 4 is out of range (not lower than the modulus) and must
+	 * be reported as failed without affecting the other items. The
+	 * batch is longer than the refresh period, so the masked key is
+	 * replaced in the middle of it; it is also longer than one
+	 * shared inversion group.
+	 */
+	memset(t2[4], 0xFF, len);
+	if (fbatch(xs, 11, &ctx, status)) {
+		fprintf(stderr, "RSA batch did not report failure\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < 11; i ++) {
+		if (i == 4) {
+			if (status[i] != 0) {
+				fprintf(stderr, "RSA batch accepted"
+					" out-of-range item\n");
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		if (status[i] != 1) {
+			fprintf(stderr, "RSA batch item %d failed\n", i);
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA protected batch", t1[i], t2[i], len);
+	}
+	printf(".");
+	fflush(stdout);
+
+	/*
+	 * Without a status array; an empty batch succeeds.
+	 */
+	for (i = 0; i < 3; i ++) {
+		memcpy(t2[i], t1[i], len);
+		br_rsa_i31_public(t2[i], len, pk);
+	}
+	if (!fbatch(xs, 3, &ctx, NULL) || !fbatch(xs, 0, &ctx, NULL))
+	{
+		fprintf(stderr, "RSA batch failed\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < 3; i ++) {
+		check_equals("RSA protected batch", t1[i], t2[i], len);
+	}
+	printf(".");
+	fflush(stdout);
+}
+
+static void
+test_RSA_protected_batch(void)
+{
+	printf("Test RSA i31 protected batch: ");
+	fflush(stdout);
+	test_RSA_protected_batch_inner(&br_rsa_i31_private_batch,
+		&RSA_PK, &RSA_SK);
+	test_RSA_protected_batch_inner(&br_rsa_i31_private_batch,
+		&RSA2048_PK, &RSA2048_SK);
+	test_RSA_protected_batch_inner(&br_rsa_i31_private_batch,
+		&RSA4096_PK, &RSA4096_SK);
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_RSA_protection_levels(void)
+{
+	unsigned level;
+	br_hmac_drbg_context rng;
+	br_rsa_private_key gsk;
+	br_rsa_public_key gpk;
+	unsigned char kbuf_priv[BR_RSA_KBUF_PRIV_SIZE(1024)];
+	unsigned char kbuf_pub[BR_RSA_KBUF_PUB_SIZE(1024)];
+	br_skey_decoder_context dc;
+	const br_rsa_private_key *dk;
+	unsigned char der[1024], d[128];
+	size_t der_len, dlen;
+
+	printf("Test RSA protection levels: ");
+	fflush(stdout);
+
+	/*
+	 * A key obtained from br_skey_decoder has no modulus and no
+	 * public exponent; the engines must recompute them. This needs
+	 * factors equal to 3 modulo 4, as produced by the key generator.
+	 */
+	br_hmac_drbg_init(&rng, &br_sha256_vtable, "seed levels", 11);
+	if (!br_rsa_i31_keygen(&rng.vtable, &gsk, kbuf_priv,
+		&gpk, kbuf_pub, 1024, 0))
+	{
+		fprintf(stderr, "RSA key generation failed\n");
+		exit(EXIT_FAILURE);
+	}
+	gsk.n = gpk.n;
+	dlen = br_rsa_i31_compute_privexp(d, &gsk,
+		br_rsa_i31_compute_pubexp(&gsk));
+	der_len = br_encode_rsa_raw_der(NULL, &gsk, &gpk, d, dlen);
+	if (dlen == 0 || der_len == 0 || der_len > sizeof der) {
+		fprintf(stderr, "RSA key encoding failed\n");
+		exit(EXIT_FAILURE);
+	}
+	br_encode_rsa_raw_der(der, &gsk, &gpk, d, dlen);
+	br_skey_decoder_init(&dc);
+	br_skey_decoder_push(&dc, der, der_len);
+	dk = br_skey_decoder_get_rsa(&dc);
+	if (dk == NULL || dk->n != NULL || dk->e != NULL) {
+		fprintf(stderr, "RSA key decoding failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (level = BR_RSA_PROTECT_NONE; level <= BR_RSA_PROTECT_FULL;
+		level ++)
+	{
+		br_rsa_private priv;
+		br_rsa_pkcs1_sign sign;
+		unsigned char hash[20], t1[256], t2[256];
+		size_t len, u;
+
+		priv = br_rsa_private_get_protected(level);
+		sign = br_rsa_pkcs1_sign_get_protected(level);
+		if (priv == 0 || sign == 0) {
+			fprintf(stderr, "no engine for level %u\n", level);
+			exit(EXIT_FAILURE);
+		}
+		len = RSA2048_PK.nlen;
+		for (u = 0; u < sizeof hash; u ++) {
+			hash[u] = (unsigned char)(u + level);
+		}
+		br_rsa_i31_pkcs1_sign(BR_HASH_OID_SHA1, hash, sizeof hash,
+			&RSA2048_SK, t1);
+		if (!sign(BR_HASH_OID_SHA1, hash, sizeof hash,
+			&RSA2048_SK, t2))
+		{
+			fprintf(stderr, "sign failed (level %u)\n", level);
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA protection level sign", t1, t2, len);
+		t1[0] = 0;
+		for (u = 1; u < len; u ++) {
+			t1[u] = (unsigned char)(u * 5 + level);
+		}
+		memcpy(t2, t1, len);
+		br_rsa_i31_public(t2, len, &RSA2048_PK);
+		if (!priv(t2, &RSA2048_SK)) {
+			fprintf(stderr, "private operation failed"
+				" (level %u)\n", level);
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA protection level private", t1, t2, len);
+
+		len = gpk.nlen;
+		memcpy(t2, t1, len);
+		br_rsa_i31_public(t2, len, &gpk);
+		if (!priv(t2, dk)) {
+			fprintf(stderr, "private operation failed with"
+				" decoded key (level %u)\n", level);
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA protection level private (decoded)",
+			t1, t2, len);
+		br_rsa_i31_pkcs1_sign(BR_HASH_OID_SHA1, hash, sizeof hash,
+			&gsk, t1);
+		if (!sign(BR_HASH_OID_SHA1, hash, sizeof hash, dk, t2)) {
+			fprintf(stderr, "sign failed with decoded key"
+				" (level %u)\n", level);
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA protection level sign (decoded)",
+			t1, t2, len);
+		printf(".");
+		fflush(stdout);
+	}
+	if (br_rsa_private_get_protected(BR_RSA_PROTECT_FULL + 1) != 0
+		|| br_rsa_pkcs1_sign_get_protected(BR_RSA_PROTECT_FULL + 1) != 0)
+	{
+		fprintf(stderr, "engine returned for unknown level\n");
+		exit(EXIT_FAILURE);
+	}
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_RSA_mb_i52_inner(br_rsa_private_mb fmb,
+	const br_rsa_public_key *pk, const br_rsa_private_key *sk)
+{
+	unsigned char t1[11][512], t2[11][512];
+	unsigned char *xs[11];
+	uint32_t status[11];
+	size_t len, u;
+	int i;
+
+	len = pk->nlen;
+	for (i = 0; i < 11; i ++) {
+		t1[i][0] = 0;
+		for (u = 1; u < len; u ++) {
+			t1[i][u] = (unsigned char)(u * 5 + i * 31 + 7);
+		}
+		memcpy(t2[i], t1[i], len);
+		br_rsa_i31_public(t2[i], len, pk);
+		xs[i] = t2[i];
+	}
+
+	/*
+	 * Item 6 is out of range; the batch spans three groups, the
+	 * last one partial.
+	 */
+	memset(t2[6], 0xFF, len);
+	if (fmb(xs, 11, sk, status)) {
+		fprintf(stderr, "RSA multi-buffer did not report failure\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < 11; i ++) {
+		if (i == 6) {
+			if (status[i] != 0) {
+				fprintf(stderr, "RSA multi-buffer accepted"
+					" out-of-range item\n");
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		if (status[i] != 1) {
+			fprintf(stderr, "RSA multi-buffer item %d failed\n", i);
+			exit(EXIT_FAILURE);
+		}
+		check_equals("RSA multi-buffer", t1[i], t2[i], len);
+	}
+	printf(".");
+	fflush(stdout);
+
+	for (i = 0; i < 3; i ++) {
+		memcpy(t2[i], t1[i], len);
+		br_rsa_i31_public(t2[i], len, pk);
+	}
+	if (!fmb(xs, 3, sk, NULL) || !fmb(xs, 0, sk, NULL)) {
+		fprintf(stderr, "RSA multi-buffer failed\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < 3; i ++) {
+		check_equals("RSA multi-buffer", t1[i], t2[i], len);
+	}
+	printf(".");
+	fflush(stdout);
+}
+
+static void
+test_RSA_mb_i52(void)
+{
+	br_rsa_private_mb fmb;
+
+	fmb = br_rsa_i52_private_mb_get();
+	if (fmb == 0) {
+		printf("Test RSA i52 multi-buffer: UNAVAILABLE\n");
+		return;
+	}
+	printf("Test RSA i52 multi-buffer: ");
+	fflush(stdout);
+	test_RSA_mb_i52_inner(fmb, &RSA_PK, &RSA_SK);
+	test_RSA_mb_i52_inner(fmb, &RSA2048_PK, &RSA2048_SK);
+	test_RSA_mb_i52_inner(fmb, &RSA4096_PK, &RSA4096_SK);
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+/*
+ * The FI engine must detect a faulty CRT half through its public
+ * exponent check, and then output zero.
+ */
+static void
+test_RSA_FI_check_inner(const br_rsa_public_key *pk,
+	const br_rsa_private_key *sk)
+{
+	br_rsa_private_key sk2;
+	unsigned char dp[256], t1[512], t2[512];
+	size_t len, u;
+
+	len = pk->nlen;
+	for (u = 1; u < len; u ++) {
+		t1[u] = (unsigned char)(u * 5 + 7);
+	}
+	t1[0] = 0;
+	memcpy(t2, t1, len);
+	br_rsa_i31_public(t2, len, pk);
+	if (!br_rsa_i31_private_FI(t2, sk)) {
+		fprintf(stderr, "RSA FI operation failed\n");
+		exit(EXIT_FAILURE);
+	}
+	check_equals("RSA FI (correct key)", t1, t2, len);
+
+	sk2 = *sk;
+	memcpy(dp, sk->dp, sk->dplen);
+	dp[sk->dplen >> 1] ^= 0x10;
+	sk2.dp = dp;
+	memcpy(t2, t1, len);
+	br_rsa_i31_public(t2, len, pk);
+	br_rsa_i31_private_FI(t2, &sk2);
+	memset(t1, 0, len);
+	check_equals("RSA FI (faulty dp)", t1, t2, len);
+	printf(".");
+	fflush(stdout);
+}
+
+static void
+test_RSA_FI_check(void)
+{
+	printf("Test RSA i31 FI check: ");
+	fflush(stdout);
+	test_RSA_FI_check_inner(&RSA_PK, &RSA_SK);
+	test_RSA_FI_check_inner(&RSA2048_PK, &RSA2048_SK);
+	test_RSA_FI_check_inner(&RSA4096_PK, &RSA4096_SK);
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+/*
+ * The i15 protected engine must detect a fault in a CRT half and then
+ * output zero. The fault is a corrupted factor: the exponentiation
+ * modulo a composite value no longer satisfies the co-exponent check.
+ */
+static void
+test_RSA_i15_fault_inner(const br_rsa_public_key *pk,
+	const br_rsa_private_key *sk)
+{
+	br_rsa_private_key sk2;
+	unsigned char p[256], t1[512], t2[512];
+	size_t len, u;
+
+	len = pk->nlen;
+	for (u = 1; u < len; u ++) {
+		t1[u] = (unsigned char)(u * 5 + 7);
+	}
+	t1[0] = 0;
+	sk2 = *sk;
+	memcpy(p, sk->p, sk->plen);
+	p[sk->plen >> 1] ^= 0x10;
+	sk2.p = p;
+	memcpy(t2, t1, len);
+	br_rsa_i15_public(t2, len, pk);
+	if (br_rsa_i15_private_protected(t2, &sk2)) {
+		fprintf(stderr, "RSA i15 protected: fault not detected\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(t1, 0, len);
+	check_equals("RSA i15 protected (faulty p)", t1, t2, len);
+	printf(".");
+	fflush(stdout);
+}
+
+static void
+test_RSA_i15_fault(void)
+{
+	printf("Test RSA i15 protected fault check: ");
+	fflush(stdout);
+	test_RSA_i15_fault_inner(&RSA_PK, &RSA_SK);
+	test_RSA_i15_fault_inner(&RSA2048_PK, &RSA2048_SK);
+	printf(" done.\n");
+	fflush(stdout);
 }
 
 static void
 test_RSA_safe(void)
 {
+	br_rsa_private priv62, priv52;
+
 	test_RSA_core("RSA i31 safe", &br_rsa_i31_public, &br_rsa_i31_private_mod_rand);
+	test_RSA_core("RSA i31 prerand", &br_rsa_i31_public,
+		&br_rsa_i31_private_mod_prerand);
+	test_RSA_core("RSA i31 FI", &br_rsa_i31_public,
+		&br_rsa_i31_private_FI);
+	test_RSA_FI_check();
+	test_RSA_core("RSA i31 protected", &br_rsa_i31_public,
+		&br_rsa_i31_private_protected);
+	test_RSA_core("RSA i15 protected", &br_rsa_i15_public,
+		&br_rsa_i15_private_protected);
+	test_RSA_i15_fault();
+	priv62 = br_rsa_i62_private_protected_get();
+	if (priv62) {
+		test_RSA_core("RSA i62 protected", &br_rsa_i31_public, priv62);
+	} else {
+		printf("Test RSA i62 protected: UNAVAILABLE\n");
+	}
+	priv52 = br_rsa_i52_private_protected_get();
+	if (priv52) {
+		test_RSA_core("RSA i52 protected", &br_rsa_i31_public, priv52);
+	} else {
+		printf("Test RSA i52 protected: UNAVAILABLE\n");
+	}
+	br_hmac_drbg_init(&rsa_test_rng, &br_sha256_vtable, "rsa-rng", 7);
+	test_RSA_core("RSA i31 safe (caller PRNG)", &br_rsa_i31_public,
+		&rsa_i31_private_mod_rand_testrng);
+	test_RSA_core("RSA i31 prerand (caller PRNG)", &br_rsa_i31_public,
+		&rsa_i31_private_mod_prerand_testrng);
+	test_RSA_protected_ctx();
+	test_RSA_protected_stats();
+	test_RSA_keygen_protected("RSA i31 masked keygen",
+		&br_rsa_i31_keygen_protected, &br_rsa_i31_keygen);
+	test_RSA_protected_pad();
+	test_RSA_protected_key();
+	test_RSA_protected_batch();
+	test_RSA_protection_levels();
 }
 
 static void
@@ -7006,6 +8110,8 @@ test_RSA_i62(void)
 	br_rsa_oaep_encrypt menc;
 	br_rsa_oaep_decrypt mdec;
 	br_rsa_keygen kgen;
+	br_rsa_keygen_parallel kpar;
+	br_rsa_keygen kprot;
 
 	pub = br_rsa_i62_public_get();
 	priv = br_rsa_i62_private_get();
@@ -7016,9 +8122,11 @@ test_RSA_i62(void)
 	menc = br_rsa_i62_oaep_encrypt_get();
 	mdec = br_rsa_i62_oaep_decrypt_get();
 	kgen = br_rsa_i62_keygen_get();
+	kpar = br_rsa_i62_keygen_parallel_get();
+	kprot = br_rsa_i62_keygen_protected_get();
 	if (pub) {
 		if (!priv || !sign || !vrfy || !pss_sign || !pss_vrfy
-			|| !menc || !mdec || !kgen)
+			|| !menc || !mdec || !kgen || !kpar || !kprot)
 		{
 			fprintf(stderr, "Inconsistent i62 availability\n");
 			exit(EXIT_FAILURE);
@@ -7031,9 +8139,13 @@ test_RSA_i62(void)
 			&br_rsa_i31_compute_modulus, &br_rsa_i31_compute_pubexp,
 			&br_rsa_i31_compute_privexp, pub,
 			sign, vrfy);
+		test_RSA_keygen_parallel("RSA i62 parallel keygen determinism",
+			kpar);
+		test_RSA_keygen_protected("RSA i62 masked keygen",
+			kprot, kgen);
 	} else {
 		if (priv || sign || vrfy || pss_sign || pss_vrfy
-			|| menc || mdec || kgen)
+			|| menc || mdec || kgen || kpar || kprot)
 		{
 			fprintf(stderr, "Inconsistent i62 availability\n");
 			exit(EXIT_FAILURE);
@@ -9295,6 +10407,413 @@ test_modpow_i31(void)
 	fflush(stdout);
 }
 
+static void
+test_modpow_rand_inner(const char *name, br_i31_modpow_opt_rand_type mp,
+	br_i31_double_modpow_opt_rand_type dmp)
+{
+	br_hmac_drbg_context hc, rc;
+	int k;
+
+	printf("Test %s: ", name);
+
+	br_hmac_drbg_init(&hc, &br_sha256_vtable, "seed modpow", 11);
+	br_hmac_drbg_init(&rc, &br_sha256_vtable, "rand modpow", 11);
+	for (k = 10; k <= 500; k += 7) {
+		size_t blen, elen2;
+		unsigned char bm[128], bx[128], bx1[128], bx2[128], bx3[128];
+		unsigned char be1[128], be2[128];
+		unsigned mask;
+		uint32_t x1[40], x2[40], x3[40], m1[40], r2[40];
+		uint64_t tmp2[500];
+		uint32_t *tmp1;
+
+		tmp1 = (uint32_t *)tmp2;
+		blen = (k + 7) >> 3;
+		elen2 = (blen >> 1) + 1;
+		br_hmac_drbg_generate(&hc, bm, blen);
+		br_hmac_drbg_generate(&hc, bx, blen);
+		br_hmac_drbg_generate(&hc, be1, blen);
+		br_hmac_drbg_generate(&hc, be2, elen2);
+		bm[blen - 1] |= 0x01;
+		mask = 0xFF >> ((int)(blen << 3) - k);
+		bm[0] &= mask;
+		bm[0] |= (mask - (mask >> 1));
+		bx[0] &= (mask >> 1);
+
+		br_i31_decode(m1, bm, blen);
+
+		br_i31_decode_mod(x1, bx, blen, m1);
+		br_i31_modpow_opt(x1, be1, blen, m1, br_i31_ninv31(m1[1]),
+			tmp1, (sizeof tmp2) / (sizeof tmp1[0]));
+		br_i31_encode(bx1, blen, x1);
+		br_i31_decode_mod(x1, bx, blen, m1);
+		br_i31_modpow_opt(x1, be2, elen2, m1, br_i31_ninv31(m1[1]),
+			tmp1, (sizeof tmp2) / (sizeof tmp1[0]));
+		br_i31_encode(bx3, blen, x1);
+
+		br_i31_decode_mod(x2, bx, blen, m1);
+		mp(&rc.vtable, x2, be1, blen,
+			m1, br_i31_ninv31(m1[1]),
+			tmp1, (sizeof tmp2) / (sizeof tmp1[0]));
+		br_i31_encode(bx2, blen, x2);
+		check_equals("ModPow i31 rand", bx1, bx2, blen);
+
+		br_i31_decode_mod(x2, bx, blen, m1);
+		dmp(&rc.vtable, x2, x3,
+			be1, blen, be2, elen2, m1, br_i31_ninv31(m1[1]), NULL,
+			tmp1, (sizeof tmp2) / (sizeof tmp1[0]));
+		br_i31_encode(bx2, blen, x2);
+		check_equals("ModPow i31 double rand (1)", bx1, bx2, blen);
+		br_i31_encode(bx2, blen, x3);
+		check_equals("ModPow i31 double rand (2)", bx3, bx2, blen);
+
+		/*
+		 * Same with a cached R^2 mod m.
+		 */
+		br_i31_zero(r2, m1[0]);
+		r2[1] = 1;
+		br_i31_to_monty(r2, m1);
+		br_i31_to_monty(r2, m1);
+		br_i31_decode_mod(x2, bx, blen, m1);
+		dmp(&rc.vtable, x2, x3,
+			be1, blen, be2, elen2, m1, br_i31_ninv31(m1[1]), r2,
+			tmp1, (sizeof tmp2) / (sizeof tmp1[0]));
+		br_i31_encode(bx2, blen, x2);
+		check_equals("ModPow i31 double rand R^2 (1)", bx1, bx2, blen);
+		br_i31_encode(bx2, blen, x3);
+		check_equals("ModPow i31 double rand R^2 (2)", bx3, bx2, blen);
+
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_modpow_rand_i15(void)
+{
+	br_hmac_drbg_context hc, rc;
+	int k;
+
+	printf("Test ModPow/i15 randomized: ");
+
+	br_hmac_drbg_init(&hc, &br_sha256_vtable, "seed modpow", 11);
+	br_hmac_drbg_init(&rc, &br_sha256_vtable, "rand modpow", 11);
+	for (k = 10; k <= 500; k += 7) {
+		size_t blen, elen2;
+		unsigned char bm[128], bx[128], bx1[128], bx2[128], bx3[128];
+		unsigned char be1[128], be2[128];
+		unsigned mask;
+		uint16_t x1[70], x2[70], x3[70], m1[70];
+		uint16_t tmp1[2000];
+
+		blen = (k + 7) >> 3;
+		elen2 = (blen >> 1) + 1;
+		br_hmac_drbg_generate(&hc, bm, blen);
+		br_hmac_drbg_generate(&hc, bx, blen);
+		br_hmac_drbg_generate(&hc, be1, blen);
+		br_hmac_drbg_generate(&hc, be2, elen2);
+		bm[blen - 1] |= 0x01;
+		mask = 0xFF >> ((int)(blen << 3) - k);
+		bm[0] &= mask;
+		bm[0] |= (mask - (mask >> 1));
+		bx[0] &= (mask >> 1);
+
+		br_i15_decode(m1, bm, blen);
+
+		br_i15_decode_mod(x1, bx, blen, m1);
+		br_i15_modpow_opt(x1, be1, blen, m1, br_i15_ninv15(m1[1]),
+			tmp1, (sizeof tmp1) / (sizeof tmp1[0]));
+		br_i15_encode(bx1, blen, x1);
+		br_i15_decode_mod(x1, bx, blen, m1);
+		br_i15_modpow_opt(x1, be2, elen2, m1, br_i15_ninv15(m1[1]),
+			tmp1, (sizeof tmp1) / (sizeof tmp1[0]));
+		br_i15_encode(bx3, blen, x1);
+
+		br_i15_decode_mod(x2, bx, blen, m1);
+		br_i15_modpow_opt_rand(&rc.vtable, x2, be1, blen,
+			m1, br_i15_ninv15(m1[1]),
+			tmp1, (sizeof tmp1) / (sizeof tmp1[0]));
+		br_i15_encode(bx2, blen, x2);
+		check_equals("ModPow i15 rand", bx1, bx2, blen);
+
+		br_i15_decode_mod(x2, bx, blen, m1);
+		br_i15_double_modpow_opt_rand(&rc.vtable, x2, x3,
+			be1, blen, be2, elen2, m1, br_i15_ninv15(m1[1]),
+			tmp1, (sizeof tmp1) / (sizeof tmp1[0]));
+		br_i15_encode(bx2, blen, x2);
+		check_equals("ModPow i15 double rand (1)", bx1, bx2, blen);
+		br_i15_encode(bx2, blen, x3);
+		check_equals("ModPow i15 double rand (2)", bx3, bx2, blen);
+
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_wtab_i31(void)
+{
+	br_hmac_drbg_context hc;
+	int k;
+
+	printf("Test i31 window tables: ");
+	fflush(stdout);
+
+	br_hmac_drbg_init(&hc, &br_sha256_vtable, "seed wtab", 9);
+	for (k = 2; k <= BR_I31_MAX_WINDOW; k ++) {
+		unsigned char bm[64], bx[64];
+		uint32_t m[20], x[20], t[20], d[20], tab[127 * 20];
+		uint32_t tmp[40];
+		uint32_t m0i, bits;
+		size_t mwlen;
+
+		br_hmac_drbg_generate(&hc, bm, sizeof bm);
+		br_hmac_drbg_generate(&hc, bx, sizeof bx);
+		bm[0] |= 0x80;
+		bm[sizeof bm - 1] |= 0x01;
+		br_i31_decode(m, bm, sizeof bm);
+		br_i31_decode_mod(x, bx, sizeof bx, m);
+		m0i = br_i31_ninv31(m[1]);
+		mwlen = (m[0] + 63) >> 5;
+		br_i31_wtab_build(tab, k, x, m, m0i, mwlen, tmp);
+
+		/*
+		 * Entry u must be x^u (Montgomery products of x); the
+		 * zero entry is all-zero.
+		 */
+		memcpy(t, x, mwlen * sizeof *x);
+		for (bits = 1; bits < ((uint32_t)1 << k); bits ++) {
+			br_i31_wtab_get(d, tab, k, bits, mwlen, m[0]);
+			check_equals("wtab entry", d, t,
+				((m[0] + 63) >> 5) * sizeof *d);
+			br_i31_montymul(d, t, x, m, m0i);
+			memcpy(t, d, mwlen * sizeof *d);
+		}
+		br_i31_wtab_get(d, tab, k, 0, mwlen, m[0]);
+		if (!br_i31_iszero(d)) {
+			fprintf(stderr, "wtab zero entry\n");
+			exit(EXIT_FAILURE);
+		}
+		printf(".");
+		fflush(stdout);
+	}
+
+	/*
+	 * Window size grows with the exponent, within the scratch.
+	 */
+	if (br_i31_window_len(2048, 70, 2 * 70) != 1
+		|| br_i31_window_len(2048, 70, 200 * 70) < 5
+		|| br_i31_window_len(16, 70, 200 * 70) > 3)
+	{
+		fprintf(stderr, "window size selection\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_montysqr_i31(void)
+{
+	br_hmac_drbg_context hc;
+	size_t len;
+
+	printf("Test i31 Montgomery squaring: ");
+	fflush(stdout);
+
+	br_hmac_drbg_init(&hc, &br_sha256_vtable, "seed montysqr", 13);
+	for (len = 1; len <= 600; len += 1 + (len >> 2)) {
+		unsigned char bm[600], bx[600];
+		uint32_t m[160], x[160], d1[160], d2[160];
+		uint32_t m0i;
+		int u;
+
+		br_hmac_drbg_generate(&hc, bm, len);
+		bm[0] |= 0x80;
+		bm[len - 1] |= 0x01;
+		br_i31_decode(m, bm, len);
+		m0i = br_i31_ninv31(m[1]);
+		for (u = 0; u < 10; u ++) {
+			size_t wlen;
+
+			wlen = (m[0] + 63) >> 5;
+			switch (u) {
+			case 0:
+				br_i31_zero(x, m[0]);
+				break;
+			case 1:
+				memcpy(x, m, wlen * sizeof *m);
+				x[1] --;
+				break;
+			default:
+				br_hmac_drbg_generate(&hc, bx, len);
+				br_i31_decode_mod(x, bx, len, m);
+				break;
+			}
+			br_i31_montymul(d1, x, x, m, m0i);
+			br_i31_montysqr(d2, x, m, m0i);
+			check_equals("montysqr", d1, d2, wlen * sizeof *d1);
+		}
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+typedef uint32_t (*modinv_fun)(uint32_t *x, const uint32_t *y,
+	const uint32_t *m, uint32_t *t);
+
+static void
+test_modinv_inner(const char *name, modinv_fun fmi)
+{
+	br_hmac_drbg_context hc;
+	size_t len;
+
+	printf("Test %s: ", name);
+	fflush(stdout);
+
+	br_hmac_drbg_init(&hc, &br_sha256_vtable, "seed modinv", 11);
+	for (len = 1; len <= 540; len += 1 + (len >> 2)) {
+		unsigned char bm[540], bx[540], by[540];
+		uint32_t m[150], x[150], y[150], x2[150];
+		uint64_t t[7 * 75];
+		uint32_t m0i;
+		int u;
+
+		br_hmac_drbg_generate(&hc, bm, len);
+		bm[0] |= 0x80;
+		bm[len - 1] |= 0x01;
+		br_i31_decode(m, bm, len);
+		m0i = br_i31_ninv31(m[1]);
+		for (u = 0; u < 12; u ++) {
+			size_t wlen, tlen, k;
+			uint32_t r1, r2;
+
+			wlen = (m[0] + 63) >> 5;
+			br_hmac_drbg_generate(&hc, bx, len);
+			br_i31_decode_mod(x, bx, len, m);
+			switch (u) {
+			case 0:
+				br_i31_zero(y, m[0]);
+				break;
+			case 1:
+				br_i31_zero(y, m[0]);
+				y[1] = 1;
+				break;
+			case 2:
+				memcpy(y, m, wlen * sizeof *m);
+				y[1] --;
+				break;
+			case 3:
+				br_i31_zero(x, m[0]);
+				x[1] = 1;
+				/* fall through */
+			default:
+				br_hmac_drbg_generate(&hc, by, len);
+				br_i31_decode_mod(y, by, len, m);
+				break;
+			}
+			memcpy(x2, x, wlen * sizeof *x);
+
+			/*
+			 * Both implementations must stay within five
+			 * integers of the size of m, plus ten words.
+			 */
+			tlen = 5 * wlen + 10;
+			memset((uint32_t *)t + tlen, 0xA5,
+				sizeof t - tlen * sizeof(uint32_t));
+			r1 = fmi(x, y, m, (uint32_t *)t);
+			for (k = tlen; k < 2 * (sizeof t / sizeof *t); k ++) {
+				if (((uint32_t *)t)[k] != 0xA5A5A5A5) {
+					fprintf(stderr, "%s: temporary"
+						" overflow\n", name);
+					exit(EXIT_FAILURE);
+				}
+			}
+			r2 = br_i31_moddiv(x2, y, m, m0i, (uint32_t *)t);
+			if (r1 != r2) {
+				fprintf(stderr, "%s: wrong status (%u, %u)\n",
+					name, (unsigned)r1, (unsigned)r2);
+				exit(EXIT_FAILURE);
+			}
+			if (r1) {
+				check_equals(name, x, x2, wlen * sizeof *x);
+			}
+		}
+
+		/*
+		 * Non-invertible value: m = a*b and y = a.
+		 */
+		if (len >= 4) {
+			uint32_t a[80], b[80];
+			size_t hlen;
+
+			hlen = len >> 1;
+			br_hmac_drbg_generate(&hc, bm, hlen);
+			bm[0] |= 0x80;
+			bm[hlen - 1] |= 0x01;
+			br_i31_decode(a, bm, hlen);
+			br_hmac_drbg_generate(&hc, bm, hlen);
+			bm[0] |= 0x80;
+			bm[hlen - 1] |= 0x01;
+			bm[hlen - 1] |= 0x02;
+			br_i31_decode(b, bm, hlen);
+			br_i31_zero(m, a[0]);
+			br_i31_mulacc(m, a, b);
+			br_i31_encode(by, hlen, a);
+			br_i31_decode_mod(y, by, hlen, m);
+			br_i31_zero(x, m[0]);
+			x[1] = 1;
+			if (fmi(x, y, m, (uint32_t *)t)) {
+				fprintf(stderr, "%s: non-invertible value"
+					" accepted\n", name);
+				exit(EXIT_FAILURE);
+			}
+		}
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_modinv_i31(void)
+{
+	test_modinv_inner("ModInv/i31", &br_i31_modinv);
+}
+
+static void
+test_modinv_i62(void)
+{
+	test_modinv_inner("ModInv/i62", &br_i62_modinv);
+}
+
+static void
+test_modpow_rand_i31(void)
+{
+	test_modpow_rand_inner("ModPow/i31 randomized",
+		&br_i31_modpow_opt_rand, &br_i31_double_modpow_opt_rand);
+}
+
+static void
+test_modpow_rand_i62(void)
+{
+	test_modpow_rand_inner("ModPow/i62 randomized",
+		&br_i62_modpow_opt_rand_as_i31,
+		&br_i62_double_modpow_opt_rand_as_i31);
+}
+
 static void
 test_modpow_i62(void)
 {
@@ -9346,6 +10865,188 @@ test_modpow_i62(void)
 	fflush(stdout);
 }
 
+static void
+test_modpow_i52(void)
+{
+	br_hmac_drbg_context hc;
+	br_i31_modpow_opt_type mp;
+	int k;
+
+	mp = br_i52_modpow_opt_get();
+	if (mp == 0) {
+		printf("Test ModPow/i52: UNAVAILABLE\n");
+		return;
+	}
+
+	printf("Test ModPow/i52: ");
+
+	br_hmac_drbg_init(&hc, &br_sha256_vtable, "seed modpow", 11);
+	for (k = 10; k <= 1100; k += 3) {
+		size_t blen;
+		unsigned char bm[140], bx[140], bx1[140], bx2[140];
+		unsigned char be[140];
+		unsigned mask;
+		uint32_t x1[40], m1[40], x2[40];
+		uint64_t tmp1[500];
+		uint32_t tmp2[1000];
+
+		blen = (k + 7) >> 3;
+		br_hmac_drbg_generate(&hc, bm, blen);
+		br_hmac_drbg_generate(&hc, bx, blen);
+		br_hmac_drbg_generate(&hc, be, blen);
+		bm[blen - 1] |= 0x01;
+		mask = 0xFF >> ((int)(blen << 3) - k);
+		bm[0] &= mask;
+		bm[0] |= (mask - (mask >> 1));
+		bx[0] &= (mask >> 1);
+
+		br_i31_decode(m1, bm, blen);
+		br_i31_decode_mod(x1, bx, blen, m1);
+		mp(x1, be, blen, m1, br_i31_ninv31(m1[1]),
+			(uint32_t *)tmp1, 2 * (sizeof tmp1) / (sizeof tmp1[0]));
+		br_i31_encode(bx1, blen, x1);
+
+		br_i31_decode_mod(x2, bx, blen, m1);
+		br_i31_modpow_opt(x2, be, blen, m1, br_i31_ninv31(m1[1]),
+			tmp2, (sizeof tmp2) / (sizeof tmp2[0]));
+		br_i31_encode(bx2, blen, x2);
+
+		check_equals("ModPow i52/i31", bx1, bx2, blen);
+
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_modpow_mb_i52(void)
+{
+	br_hmac_drbg_context hc;
+	br_i52_modpow_mb_type mp;
+	int k;
+
+	mp = br_i52_modpow_mb_get();
+	if (mp == 0) {
+		printf("Test ModPow/i52 multi-buffer: UNAVAILABLE\n");
+		return;
+	}
+
+	printf("Test ModPow/i52 multi-buffer: ");
+
+	/*
+	 * Lanes get moduli of different sizes (down to k-50 bits), and
+	 * the batch size cycles through 1 to 8.
+	 */
+	br_hmac_drbg_init(&hc, &br_sha256_vtable, "seed modpow mb", 14);
+	for (k = 60; k <= 1100; k += 13) {
+		unsigned char bm[8][140], bx[8][140], be[8][140];
+		unsigned char bx1[140], bx2[140];
+		uint32_t m1[8][40], x1[8][40], x2[40];
+		uint32_t *xv[8];
+		const uint32_t *mv[8];
+		const unsigned char *ev[8];
+		uint32_t tmp2[1000];
+		size_t blen[8], elen, count;
+		static uint64_t tmp1[8 * 20 * 22];
+		int j;
+
+		count = 1 + (size_t)(k % 8);
+		elen = (k + 7) >> 3;
+		for (j = 0; j < (int)count; j ++) {
+			unsigned mask;
+			int kj;
+
+			kj = k - (j * 7) % 50;
+			blen[j] = (kj + 7) >> 3;
+			br_hmac_drbg_generate(&hc, bm[j], blen[j]);
+			br_hmac_drbg_generate(&hc, bx[j], blen[j]);
+			br_hmac_drbg_generate(&hc, be[j], elen);
+			bm[j][blen[j] - 1] |= 0x01;
+			mask = 0xFF >> ((int)(blen[j] << 3) - kj);
+			bm[j][0] &= mask;
+			bm[j][0] |= (mask - (mask >> 1));
+			bx[j][0] &= (mask >> 1);
+			br_i31_decode(m1[j], bm[j], blen[j]);
+			br_i31_decode_mod(x1[j], bx[j], blen[j], m1[j]);
+			xv[j] = x1[j];
+			mv[j] = m1[j];
+			ev[j] = be[j];
+		}
+		if (!mp(xv, ev, elen, mv, count, tmp1, (k & 1)
+			? (sizeof tmp1) / (sizeof tmp1[0])
+			: (size_t)(48 * ((k + 51) / 52))))
+		{
+			fprintf(stderr, "ModPow i52 multi-buffer failed\n");
+			exit(EXIT_FAILURE);
+		}
+		for (j = 0; j < (int)count; j ++) {
+			br_i31_encode(bx1, blen[j], x1[j]);
+			br_i31_decode_mod(x2, bx[j], blen[j], m1[j]);
+			br_i31_modpow_opt(x2, be[j], elen, m1[j],
+				br_i31_ninv31(m1[j][1]),
+				tmp2, (sizeof tmp2) / (sizeof tmp2[0]));
+			br_i31_encode(bx2, blen[j], x2);
+			check_equals("ModPow i52 multi-buffer/i31",
+				bx1, bx2, blen[j]);
+		}
+
+		printf(".");
+		fflush(stdout);
+	}
+
+	/*
+	 * More than eight lanes, or too small temporaries: error.
+	 */
+	{
+		uint32_t m1[2], x1[2];
+		uint32_t *xv[9];
+		const uint32_t *mv[9];
+		const unsigned char *ev[9];
+		unsigned char e1 = 3;
+		uint64_t tmp1[48];
+		int j;
+
+		m1[0] = 0x08;
+		m1[1] = 0x81;
+		x1[0] = 0x08;
+		x1[1] = 0x05;
+		for (j = 0; j < 9; j ++) {
+			xv[j] = x1;
+			mv[j] = m1;
+			ev[j] = &e1;
+		}
+		if (mp(xv, ev, 1, mv, 9, tmp1, 48)
+			|| mp(xv, ev, 1, mv, 8, tmp1, 47)
+			|| !mp(xv, ev, 1, mv, 8, tmp1, 48)
+			|| x1[1] != (5 * 5 * 5) % 0x81)
+		{
+			fprintf(stderr, "ModPow i52 multi-buffer limits\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf(" done.\n");
+	fflush(stdout);
+}
+
+static void
+test_modpow_rand_i52(void)
+{
+	br_i31_modpow_opt_rand_type mp;
+	br_i31_double_modpow_opt_rand_type dmp;
+
+	mp = br_i52_modpow_opt_rand_get();
+	dmp = br_i52_double_modpow_opt_rand_get();
+	if (mp == 0 || dmp == 0) {
+		printf("Test ModPow/i52 randomized: UNAVAILABLE\n");
+		return;
+	}
+	test_modpow_rand_inner("ModPow/i52 randomized", mp, dmp);
+}
+
 static int
 eq_name(const char *s1, const char *s2)
 {
@@ -9430,6 +11131,7 @@ static const struct {
 	STU(RSA_i32),
 	STU(RSA_i62),
 	STU(RSA_safe),
+	STU(RSA_mb_i52),
 	STU(GHASH_ctmul),
 	STU(GHASH_ctmul32),
 	STU(GHASH_ctmul64),
@@ -9453,7 +11155,17 @@ static const struct {
 	STU(ECDSA_i15),
 	STU(ECDSA_i31),
 	STU(modpow_i31),
+	STU(wtab_i31),
+	STU(montysqr_i31),
+	STU(modinv_i31),
+	STU(modinv_i62),
+	STU(modpow_rand_i31),
+	STU(modpow_rand_i15),
 	STU(modpow_i62),
+	STU(modpow_i52),
+	STU(modpow_mb_i52),
+	STU(modpow_rand_i62),
+	STU(modpow_rand_i52),
 	{ 0, 0 }
 };
 
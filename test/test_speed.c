@@ -28,6 +28,11 @@
 #include <time.h>
 #include "inner.h"
 
+#if (BR_i386 || BR_amd64) && (BR_GCC || BR_CLANG)
+#include <x86intrin.h>
+#define HAVE_RDTSC   1
+#endif
+
 #define HASH_SIZE(cname)   br_ ## cname ## _SIZE
 
 #define SPEED_HASH(Name, cname) \
@@ -749,13 +754,14 @@ static const br_rsa_public_key RSA_PK = {
 };
 
 static const br_rsa_private_key RSA_SK = {
-	2048,
+	(void *)RSA_N, 2048,
 	(void *)RSA_P, sizeof RSA_P,
 	(void *)RSA_Q, sizeof RSA_Q,
 	(void *)RSA_DP, sizeof RSA_DP,
 	(void *)RSA_DQ, sizeof RSA_DQ,
 	(void *)RSA_IQ, sizeof RSA_IQ,
-	(void *)RSA_E, sizeof RSA_E
+	(void *)RSA_E, sizeof RSA_E,
+	NULL, NULL, NULL, NULL
 };
 
 static void
@@ -938,6 +944,476 @@ test_speed_rsa_i62(void)
 	}
 }
 
+static void
+test_speed_rsa_mb(void)
+{
+	br_rsa_private_mb fmb;
+	unsigned char tmp[8][sizeof RSA_N];
+	unsigned char *xs[8];
+	int i;
+	long num;
+
+	fmb = br_rsa_i52_private_mb_get();
+	if (fmb == 0) {
+		printf("%-30s UNAVAILABLE\n", "RSA i52 multi-buffer");
+		return;
+	}
+	for (i = 0; i < 8; i ++) {
+		memset(tmp[i], 'R' + i, sizeof tmp[i]);
+		tmp[i][0] = 0;
+		xs[i] = tmp[i];
+	}
+	for (i = 0; i < 10; i ++) {
+		if (!fmb(xs, 8, &RSA_SK, NULL)) {
+			abort();
+		}
+	}
+	num = 10;
+	for (;;) {
+		clock_t begin, end;
+		double tt;
+		long k;
+
+		begin = clock();
+		for (k = num; k > 0; k --) {
+			fmb(xs, 8, &RSA_SK, NULL);
+		}
+		end = clock();
+		tt = (double)(end - begin) / CLOCKS_PER_SEC;
+		if (tt >= 2.0) {
+			printf("%-30s %8.2f priv/s\n", "RSA i52 multi-buffer",
+				(double)(8 * num) / tt);
+			fflush(stdout);
+			break;
+		}
+		num <<= 1;
+	}
+}
+
+/*
+ * Protected RSA engines ("rsa_protected"): every countermeasure
+ * variant, at 1024, 2048, 3072 and 4096 bits. For each variant we
+ * report throughput, median and 99th percentile latency, and cycles per
+ * operation (x86 only); for the full protected engine, the average time
+ * per operation is also split between key re-randomization, DRBG,
+ * modular exponentiations and the final fault check. The DRBG and
+ * exponentiation times are measured within the engine; the other two
+ * are estimates from separate loops.
+ *
+ * All engines are called through their "_rng" variants, with a PRNG
+ * wrapper that accounts for the time spent in the DRBG.
+ */
+
+#define PROT_MAX_SAMPLES   2048
+#define PROT_MIN_SAMPLES   20
+#define PROT_MIN_TIME      1.0
+
+typedef struct {
+	const br_prng_class *vtable;
+	br_hmac_drbg_context drbg;
+	double time;
+} timed_prng_context;
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t
+now_cycles(void)
+{
+#if HAVE_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void
+timed_prng_init(const br_prng_class **ctx, const void *params,
+	const void *seed, size_t seed_len)
+{
+	timed_prng_context *tc;
+
+	(void)params;
+	tc = (timed_prng_context *)(void *)ctx;
+	br_hmac_drbg_init(&tc->drbg, &br_sha256_vtable, seed, seed_len);
+	tc->time = 0.0;
+}
+
+static void
+timed_prng_generate(const br_prng_class **ctx, void *out, size_t len)
+{
+	timed_prng_context *tc;
+	double begin;
+
+	tc = (timed_prng_context *)(void *)ctx;
+	begin = now_sec();
+	br_hmac_drbg_generate(&tc->drbg, out, len);
+	tc->time += now_sec() - begin;
+}
+
+static void
+timed_prng_update(const br_prng_class **ctx,
+	const void *seed, size_t seed_len)
+{
+	timed_prng_context *tc;
+
+	tc = (timed_prng_context *)(void *)ctx;
+	br_hmac_drbg_update(&tc->drbg, seed, seed_len);
+}
+
+static const br_prng_class timed_prng_vtable = {
+	sizeof(timed_prng_context),
+	&timed_prng_init,
+	&timed_prng_generate,
+	&timed_prng_update
+};
+
+typedef uint32_t (*prot_engine)(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk);
+
+static timed_prng_context prot_rng;
+static double prot_modpow_time;
+static volatile uint32_t prot_sink;
+
+/*
+ * Exponentiation hook for the full protected engine: time spent in
+ * the double exponentiation, not counting the DRBG calls made for the
+ * modulus masks.
+ */
+static uint32_t
+timed_double_modpow(const br_prng_class **rng,
+	uint32_t *x1, uint32_t *x2,
+	const unsigned char *e1, size_t elen1,
+	const unsigned char *e2, size_t elen2,
+	const uint32_t *m, uint32_t m0i, const uint32_t *r2,
+	uint32_t *tmp, size_t twlen)
+{
+	double begin, drbg;
+	uint32_t r;
+
+	drbg = prot_rng.time;
+	begin = now_sec();
+	r = br_i31_double_modpow_opt_rand(rng, x1, x2,
+		e1, elen1, e2, elen2, m, m0i, r2, tmp, twlen);
+	prot_modpow_time += (now_sec() - begin) - (prot_rng.time - drbg);
+	return r;
+}
+
+static uint32_t
+prot_i31_protected_timed(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
+{
+	return br_rsa_i31_private_protected_inner(rng, x, sk,
+		&timed_double_modpow);
+}
+
+static uint32_t
+prot_i31_plain(const br_prng_class **rng,
+	unsigned char *x, const br_rsa_private_key *sk)
+{
+	(void)rng;
+	return br_rsa_i31_private(x, sk);
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x, y;
+
+	x = *(const double *)a;
+	y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Run an engine until both PROT_MIN_TIME seconds and PROT_MIN_SAMPLES
+ * operations are reached; return the average time per operation.
+ */
+static double
+prot_run(const char *name, prot_engine fn, const br_rsa_private_key *sk)
+{
+	static double lat[PROT_MAX_SAMPLES];
+	unsigned char x[BR_MAX_RSA_SIZE >> 3];
+	size_t xlen, u, n;
+	double total;
+	uint64_t cycles;
+	int i;
+
+	xlen = (sk->n_bitlen + 7) >> 3;
+	x[0] = 0;
+	for (u = 1; u < xlen; u ++) {
+		x[u] = (unsigned char)(u * 29 + 3);
+	}
+	for (i = 0; i < 3; i ++) {
+		if (!fn(&prot_rng.vtable, x, sk)) {
+			abort();
+		}
+	}
+	n = 0;
+	total = 0.0;
+	cycles = 0;
+	while (n < PROT_MAX_SAMPLES
+		&& (total < PROT_MIN_TIME || n < PROT_MIN_SAMPLES))
+	{
+		double begin;
+		uint64_t c0;
+
+		c0 = now_cycles();
+		begin = now_sec();
+		fn(&prot_rng.vtable, x, sk);
+		lat[n] = now_sec() - begin;
+		cycles += now_cycles() - c0;
+		total += lat[n];
+		n ++;
+	}
+	qsort(lat, n, sizeof lat[0], &cmp_double);
+	printf("%-30s %8.2f priv/s  p50 %9.1f us  p99 %9.1f us",
+		name, (double)n / total,
+		lat[n / 2] * 1e6, lat[(n * 99) / 100] * 1e6);
+	if (cycles != 0) {
+		printf("  %12.0f cyc/op\n", (double)cycles / (double)n);
+	} else {
+		printf("  cyc/op n/a\n");
+	}
+	fflush(stdout);
+	return total / (double)n;
+}
+
+/*
+ * Masked copy of the benchmark key, as built by the full protected
+ * engine on each call.
+ */
+static struct {
+	br_rsa_private_key sk;
+	uint32_t r1[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t r2[(BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t phi_p[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
+	uint32_t phi_q[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 63) >> 5];
+	unsigned char n[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char p[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+	unsigned char q[(BR_MAX_RSA_SIZE + BR_RSA_RAND_FACTOR + 15) >> 3];
+	unsigned char dp[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char dq[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char iq[(BR_MAX_RSA_SIZE + 15) >> 3];
+	unsigned char e[(BR_MAX_RSA_SIZE + 15) >> 3];
+} prot_mk;
+
+/*
+ * Set the buffers of prot_mk and return the slot length (in words)
+ * used by br_rsa_i31_private_protected() for that key.
+ */
+static size_t
+prot_mk_setup(const br_rsa_private_key *sk)
+{
+	size_t fwlen, plen;
+	long z;
+
+	prot_mk.sk.r1 = prot_mk.r1;
+	prot_mk.sk.r2 = prot_mk.r2;
+	prot_mk.sk.n = prot_mk.n;
+	prot_mk.sk.p = prot_mk.p;
+	prot_mk.sk.q = prot_mk.q;
+	prot_mk.sk.dp = prot_mk.dp;
+	prot_mk.sk.dq = prot_mk.dq;
+	prot_mk.sk.iq = prot_mk.iq;
+	prot_mk.sk.phi_p = prot_mk.phi_p;
+	prot_mk.sk.phi_q = prot_mk.phi_q;
+	prot_mk.sk.e = prot_mk.e;
+	plen = sk->plen > sk->qlen ? sk->plen : sk->qlen;
+	z = (long)plen << 3;
+	fwlen = 1 + 10;
+	while (z > 0) {
+		z -= 31;
+		fwlen ++;
+	}
+	fwlen += (fwlen & 1);
+	return fwlen;
+}
+
+/*
+ * Estimated cost of the fault check at the end of the full protected
+ * engine. This is not measured inside the engine: the same operations
+ * (CRT recombination of the complementary exponentiations modulo the
+ * masked factors, reduction modulo n, comparison with 1) are repeated
+ * on a masked key in word form, with arbitrary operands.
+ */
+static double
+prot_fault_check_time(const br_rsa_private_key *sk, long num)
+{
+	static br_rsa_i31_protected_key wk;
+	uint64_t tmp64[(2 + 36 * (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))) >> 1];
+	uint32_t co1[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t co2[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t s1[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t t2[BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t t1[2 * BR_RSA_I31_PROTECTED_FWLEN];
+	uint32_t t3[2 * BR_RSA_I31_PROTECTED_FWLEN];
+	size_t fwlen, u;
+	uint32_t acc;
+	double begin;
+	long k;
+
+	fwlen = prot_mk_setup(sk);
+	init_key(&prot_rng.vtable, sk, &prot_mk.sk, (uint32_t *)tmp64, fwlen);
+	update_key(&prot_rng.vtable, &prot_mk.sk, (uint32_t *)tmp64, fwlen);
+	if (!br_rsa_i31_protected_key_decode(&wk, &prot_mk.sk, 0)) {
+		abort();
+	}
+	br_i31_decode_reduce(co1, sk->dp, sk->dplen, wk.p);
+	br_i31_decode_reduce(co2, sk->dq, sk->dqlen, wk.q);
+	acc = 0;
+	begin = now_sec();
+	for (k = num; k > 0; k --) {
+		memcpy(s1, co1, ((wk.p[0] + 63) >> 5) * sizeof(uint32_t));
+		memcpy(t3, co2, ((wk.q[0] + 63) >> 5) * sizeof(uint32_t));
+		br_i31_reduce(t2, t3, wk.p);
+		br_i31_add(s1, wk.p, br_i31_sub(s1, t2, 1));
+		br_i31_montymul(t2, s1, wk.iq, wk.p, wk.p0i);
+		br_i31_mulacc(t3, wk.q, t2);
+		br_i31_reduce(t1, t3, wk.n);
+		acc |= t1[1] ^ 1;
+		for (u = 2; u <= ((size_t)(wk.n[0] + 31) >> 5); u ++) {
+			acc |= t1[u];
+		}
+	}
+	begin = now_sec() - begin;
+	prot_sink ^= acc;
+	return begin / (double)num;
+}
+
+/*
+ * Estimated cost of building a freshly masked key (init_key() then
+ * update_key()), as done by the full protected engine on each call,
+ * DRBG excluded. This is measured on separate calls, not inside the
+ * engine.
+ */
+static double
+prot_key_rand_time(const br_rsa_private_key *sk, long num)
+{
+	uint64_t tmp64[(2 + 36 * (2 + ((BR_MAX_RSA_FACTOR + 30) / 31))) >> 1];
+	uint32_t *tmp;
+	size_t fwlen;
+	double begin, drbg;
+	long k;
+
+	tmp = (uint32_t *)tmp64;
+	fwlen = prot_mk_setup(sk);
+	drbg = prot_rng.time;
+	begin = now_sec();
+	for (k = num; k > 0; k --) {
+		init_key(&prot_rng.vtable, sk, &prot_mk.sk, tmp, fwlen);
+		update_key(&prot_rng.vtable, &prot_mk.sk, tmp, fwlen);
+	}
+	return ((now_sec() - begin) - (prot_rng.time - drbg)) / (double)num;
+}
+
+static void
+test_speed_rsa_protected(void)
+{
+	static const struct {
+		const char *name;
+		prot_engine fn;
+	} engines[] = {
+		{ "i31 plain",          &prot_i31_plain },
+		{ "i31 msg_blind",      &br_rsa_i31_private_msg_blind_rng },
+		{ "i31 mod_rand",       &br_rsa_i31_private_mod_rand_rng },
+		{ "i31 mod_prerand",    &br_rsa_i31_private_mod_prerand_rng },
+		{ "i31 FI",             &br_rsa_i31_private_FI_rng },
+		{ "i31 protected",      &br_rsa_i31_private_protected_rng },
+		{ "i15 protected",      &br_rsa_i15_private_protected_rng },
+#if BR_INT128 || BR_UMUL128
+		{ "i62 protected",      &br_rsa_i62_private_protected_rng },
+#endif
+#if BR_AVX512IFMA
+		{ "i52 protected",      &br_rsa_i52_private_protected_rng },
+#endif
+		{ 0, 0 }
+	};
+	static const uint32_t sizes[] = { 1024, 2048, 3072, 4096, 0 };
+	static unsigned char kbuf[BR_RSA_KBUF_PRIV_SIZE(4096)];
+	static unsigned char kbuf_pub[BR_RSA_KBUF_PUB_SIZE(4096)];
+	br_hmac_drbg_context krng;
+	int i, j;
+
+	timed_prng_init(&prot_rng.vtable, NULL, "RSA protected bench", 19);
+	prot_rng.vtable = &timed_prng_vtable;
+	br_hmac_drbg_init(&krng, &br_sha256_vtable, "RSA protected keys", 18);
+	for (i = 0; sizes[i] != 0; i ++) {
+		br_rsa_private_key sk;
+		br_rsa_public_key pk;
+		char name[40];
+		double total, drbg, modpow, keyrand, fault;
+		long num;
+
+		if (!br_rsa_i31_keygen(&krng.vtable, &sk, kbuf,
+			&pk, kbuf_pub, sizes[i], 65537))
+		{
+			abort();
+		}
+		sk.n = pk.n;
+		for (j = 0; engines[j].name != 0; j ++) {
+#if BR_AVX512IFMA
+			if (engines[j].fn == &br_rsa_i52_private_protected_rng
+				&& br_rsa_i52_private_protected_get() == 0)
+			{
+				continue;
+			}
+#endif
+			sprintf(name, "RSA %s [%u]",
+				engines[j].name, (unsigned)sizes[i]);
+			prot_run(name, engines[j].fn, &sk);
+		}
+
+		/*
+		 * Breakdown for the full protected engine.
+		 */
+		prot_rng.time = 0.0;
+		prot_modpow_time = 0.0;
+		sprintf(name, "RSA i31 protected* [%u]", (unsigned)sizes[i]);
+		drbg = prot_rng.time;
+		num = 0;
+		{
+			double begin;
+
+			begin = now_sec();
+			while (num < PROT_MIN_SAMPLES
+				|| now_sec() - begin < PROT_MIN_TIME)
+			{
+				unsigned char x[BR_MAX_RSA_SIZE >> 3];
+
+				memset(x, 0x55, sizeof x);
+				x[0] = 0;
+				prot_i31_protected_timed(&prot_rng.vtable,
+					x, &sk);
+				num ++;
+			}
+			total = (now_sec() - begin) / (double)num;
+		}
+		drbg = (prot_rng.time - drbg) / (double)num;
+		modpow = prot_modpow_time / (double)num;
+		keyrand = prot_key_rand_time(&sk, 20);
+		fault = prot_fault_check_time(&sk, 200);
+		/*
+		 * DRBG and modpow are measured inside the engine; key
+		 * rand and fault check are estimates from separate
+		 * loops, and "other" is what remains of the total.
+		 */
+		printf("%-30s total %9.1f us: key rand (est.) %9.1f,"
+			" DRBG %9.1f, modpow %9.1f, fault check (est.) %7.1f,"
+			" other (rest) %9.1f\n",
+			name, total * 1e6, keyrand * 1e6, drbg * 1e6,
+			modpow * 1e6, fault * 1e6,
+			(total - keyrand - drbg - modpow - fault) * 1e6);
+		fflush(stdout);
+	}
+}
+
 static void
 test_speed_ec_inner_1(const char *name,
 	const br_ec_impl *impl, const br_ec_curve_def *cd)
@@ -1689,7 +2165,9 @@ static const struct {
 	STU(rsa_i31),
 	STU(rsa_i32),
 	STU(rsa_i62),
+	STU(rsa_mb),
 	STU(rsa_msg),
+	STU(rsa_protected),
 	STU(ec_prime_i15),
 	STU(ec_prime_i31),
 	STU(ec_p256_m15),
@@ -72,6 +72,18 @@ decode_key(const unsigned char *buf, size_t len)
 		sk->key.rsa.dqlen = rk->dqlen;
 		sk->key.rsa.iq = xblobdup(rk->iq, rk->iqlen);
 		sk->key.rsa.iqlen = rk->iqlen;
+
+		/*
+		 * The decoded key has no modulus, public exponent or
+		 * masks; the protected engines recompute n and e.
+		 */
+		sk->key.rsa.n = NULL;
+		sk->key.rsa.e = NULL;
+		sk->key.rsa.elen = 0;
+		sk->key.rsa.r1 = NULL;
+		sk->key.rsa.r2 = NULL;
+		sk->key.rsa.phi_p = NULL;
+		sk->key.rsa.phi_q = NULL;
 		break;
 
 	case BR_KEYTYPE_EC: